@@ -40,8 +40,15 @@ namespace Config {
   constexpr unsigned long SERIAL_BAUD_RATE = 115200;
   
   // OTA Configuration
-  constexpr bool AUTO_CHECK_OTA = false;  // Automatically check for updates on wake (disabled by default)
-  // Note: Target OTA version is now stored in ConfigManager (use 'otaver' command to set)
+  constexpr bool AUTO_CHECK_OTA = true;  // Check the signed release manifest (conditional GET) after publishing
+  constexpr unsigned long OTA_CHECK_INTERVAL_MS = 3600000;  // Between manifest checks while always on; deep sleep checks once per wake
+  // Note: 'otaver' pins a target version in ConfigManager, overriding the manifest
+  constexpr bool OTA_TRY_DELTA = true;  // Try a binary diff against the running image before the full .bin
+  constexpr bool OTA_TRY_COMPRESSED = true;  // Then try the heatshrink-compressed image (<name>.bin.hs)
+  constexpr unsigned long OTA_STREAM_TIMEOUT_MS = 15000;  // Abort a streamed update after this long without data
+  constexpr uint8_t OTA_MAX_TRIAL_BOOTS = 3;  // Roll back new firmware after this many boots that reached the broker or crashed without publishing
+  constexpr unsigned long OTA_POLL_INTERVAL_MS = 250;  // CPU sleeps this long between ArduinoOTA invitation checks
+  // Note: the ArduinoOTA upload window length is 'ota_window' in ConfigManager (default 60 s)
   
   // Deep Sleep Configuration
   constexpr bool ENABLE_DEEP_SLEEP = true;  // Enable power-saving deep sleep
@@ -54,6 +61,21 @@ namespace Config {
   // #define WIFI_PASSWORD "your-wifi-password"
   constexpr unsigned long WIFI_TIMEOUT_MS = 10000;  // 10 seconds to connect
   
+  // Several networks (wifi_ssid plus wifi2..wifi4) for installs that move.
+  // The last joined network is tried first on its cached channel/BSSID.
+  constexpr int MAX_WIFI_NETWORKS = 4;
+  constexpr unsigned long WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;
+  constexpr uint32_t WIFI_SCAN_MS_PER_CHANNEL = 120;
+  constexpr uint8_t WIFI_ABSENT_AFTER_MISSES = 3;  // Scans without a network before it is tried last
+  constexpr uint8_t WIFI_MAX_SCAN_BACKOFF = 8;     // Most wakes skipped between scans when none is in range
+  
+  // TX power policy, learned per AP: after WIFI_TX_POWER_STEP_AFTER joins
+  // (wakes, with deep sleep) with a good link, try the next lower power
+  // level. RSSI below the floor or a failed join/publish steps back up.
+  constexpr uint8_t WIFI_TX_POWER_STEP_AFTER = 3;
+  constexpr int8_t WIFI_TX_POWER_MIN_RSSI = -67;
+  constexpr uint8_t WIFI_TX_FAIL_EXPIRE_AFTER = 24;  // Good joins before a failed level may be tried again
+  
   // Static IP Configuration (set to false to use DHCP)
   constexpr bool USE_STATIC_IP = false;
   constexpr char STATIC_IP[] = "192.168.1.100";
@@ -70,6 +92,49 @@ namespace Config {
   // #define MQTT_CLIENT_ID "esp32-battery-monitor"
   constexpr char MQTT_TOPIC_BASE[] = "battery/monitor";  // Base topic for MQTT messages
   constexpr unsigned long MQTT_TIMEOUT_MS = 15000;  // 15 seconds to connect and publish
+  constexpr uint16_t MQTT_BUFFER_SIZE = 1024;  // Largest MQTT packet sent or received (discovery)
+  constexpr uint16_t MQTT_KEEPALIVE_S = 15;
+  constexpr unsigned long MQTT_ACK_TIMEOUT_MS = 5000;  // Wait for CONNACK/SUBACK
+  constexpr size_t MQTT_BATCH_BYTES = 1400;  // Batched publishes are sent in chunks of about one TCP segment
+  
+  // Broker failover: mqtt_server plus the mqtt_fallback list, ranked by
+  // measured connect time. A broker that failed is tried last for a while.
+  constexpr int MAX_BROKERS = 4;
+  constexpr uint32_t MQTT_ATTEMPT_TIMEOUT_S = 5;  // TCP connect and TLS handshake, per broker
+  constexpr uint32_t BROKER_FAILED_HOLDOFF_S = 3600;
+  
+  // Persistent connection mode (deep sleep disabled): reconnect backoff after a loss
+  constexpr unsigned long RECONNECT_BACKOFF_MIN_MS = 2000;
+  constexpr unsigned long RECONNECT_BACKOFF_MAX_MS = 300000;  // 5 minutes
+  
+  // Home Assistant marks sensors unavailable when no state arrives within
+  // EXPIRE_AFTER_INTERVALS reading intervals plus the grace period
+  constexpr uint32_t EXPIRE_AFTER_INTERVALS = 2;
+  constexpr uint32_t EXPIRE_AFTER_GRACE_S = 60;
+  
+  // ESP-NOW uplink (uplink espnow): sensor units send each reading as one
+  // frame to the gateway MAC and sleep again without joining WiFi. Retries
+  // and the channel sweep are in SensorUplinkConfig.
+  constexpr unsigned long ESPNOW_ACK_TIMEOUT_MS = 30;  // Per frame, for the gateway's radio ack
+  
+  // BLE beacon uplink (uplink ble, esp32dev_ble build): each reading is
+  // advertised for BLE_BEACON_DURATION_MS, then the device sleeps
+  constexpr unsigned long BLE_BEACON_DURATION_MS = 300;
+  constexpr uint16_t BLE_BEACON_INTERVAL_UNITS = 32;  // 20 ms, in 0.625 ms units
+  
+  // Gateway build (pio run -e gateway): batching is in SensorUplinkConfig
+  constexpr int ESPNOW_MAX_ENCRYPTED_PEERS = 6;    // ESP-IDF default limit for encrypted peers
+  constexpr int ESPNOW_RX_QUEUE_LEN = 32;          // Frames waiting for loop()
+  constexpr unsigned long GATEWAY_STATS_INTERVAL_MS = 600000;  // Log receive statistics every 10 minutes
+  
+  // Reading log (lib/FlashLog) in the "readings" partition of partitions.csv.
+  // Readings are logged once the clock has been set by NTP.
+  constexpr char READING_LOG_PARTITION[] = "readings";
+  constexpr uint32_t CLOCK_VALID_AFTER = 1704067200;  // 2024-01-01; earlier = not set yet
+  
+  // Broker address cached in RTC memory across deep sleep (lwIP does not
+  // expose the record TTL, so this is the maximum age of a cached lookup)
+  constexpr uint32_t DNS_CACHE_TTL_S = 6 * 3600;
   
   // Battery Type Specific Thresholds
   #if BATTERY_TYPE == BATTERY_TYPE_LEAD_ACID
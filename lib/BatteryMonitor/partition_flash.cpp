@@ -0,0 +1,30 @@
+/*
+ * Partition Flash Implementation
+ */
+
+#include "partition_flash.h"
+
+bool PartitionFlash::begin(const char* label) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    return partition != nullptr;
+}
+
+uint32_t PartitionFlash::size() const {
+    if (partition == nullptr) {
+        return 0;
+    }
+    return partition->size - partition->size % FlashLogConfig::SECTOR_SIZE;
+}
+
+bool PartitionFlash::read(uint32_t offset, void* buf, size_t len) {
+    return partition != nullptr && esp_partition_read(partition, offset, buf, len) == ESP_OK;
+}
+
+bool PartitionFlash::write(uint32_t offset, const void* data, size_t len) {
+    return partition != nullptr && esp_partition_write(partition, offset, data, len) == ESP_OK;
+}
+
+bool PartitionFlash::eraseSector(uint32_t offset) {
+    return partition != nullptr &&
+           esp_partition_erase_range(partition, offset, FlashLogConfig::SECTOR_SIZE) == ESP_OK;
+}
@@ -0,0 +1,31 @@
+/*
+ * Partition Flash
+ *
+ * FlashRegion over a data partition of the flash layout (partitions.csv),
+ * found by its label. Holds the reading log.
+ */
+
+#ifndef PARTITION_FLASH_H
+#define PARTITION_FLASH_H
+
+#include <esp_partition.h>
+#include "flash_region.h"
+
+class PartitionFlash : public FlashLog::FlashRegion {
+public:
+    PartitionFlash() : partition(nullptr) {}
+
+    // False if the flashed partition table has no such partition (tables
+    // only change over USB, not with an OTA update)
+    bool begin(const char* label);
+
+    uint32_t size() const override;
+    bool read(uint32_t offset, void* buf, size_t len) override;
+    bool write(uint32_t offset, const void* data, size_t len) override;
+    bool eraseSector(uint32_t offset) override;
+
+private:
+    const esp_partition_t* partition;
+};
+
+#endif // PARTITION_FLASH_H
@@ -0,0 +1,138 @@
+/*
+ * Voltage History Implementation
+ */
+
+#include "voltage_history.h"
+#include <string.h>
+
+uint8_t VoltageHistory::quantize(float voltage) {
+  float steps = (voltage - HistoryConfig::QUANT_BASE) / HistoryConfig::QUANT_STEP + 0.5f;
+  if (steps <= 0.0f) return 0;
+  if (steps >= 255.0f) return 255;
+  return (uint8_t)steps;
+}
+
+float VoltageHistory::dequantize(uint8_t sample) {
+  return HistoryConfig::QUANT_BASE + sample * HistoryConfig::QUANT_STEP;
+}
+
+uint8_t VoltageHistory::heightFor(uint8_t sample) const {
+  if (plotHigh <= plotLow || sample <= plotLow) return 0;
+  if (sample >= plotHigh) return HistoryConfig::PLOT_HEIGHT;
+  return (uint8_t)(((sample - plotLow) * HistoryConfig::PLOT_HEIGHT +
+                    (plotHigh - plotLow) / 2) / (plotHigh - plotLow));
+}
+
+void VoltageHistory::setPlotRange(float low, float high) {
+  uint8_t newLow = quantize(low);
+  uint8_t newHigh = quantize(high);
+  if (newLow == plotLow && newHigh == plotHigh) return;
+
+  plotLow = newLow;
+  plotHigh = newHigh;
+  for (uint8_t i = 0; i < HistoryConfig::SAMPLES; i++) {
+    heights[i] = heightFor(samples[i]);
+  }
+}
+
+void VoltageHistory::add(float voltage) {
+  if (head >= HistoryConfig::SAMPLES) head = 0;  // Corrupt RTC data
+
+  uint8_t sample = quantize(voltage);
+  samples[head] = sample;
+  heights[head] = heightFor(sample);
+  head = (head + 1) % HistoryConfig::SAMPLES;
+  if (count < HistoryConfig::SAMPLES) count++;
+  added++;
+}
+
+uint8_t VoltageHistory::sampleAt(uint8_t i) const {
+  uint8_t start = (head + HistoryConfig::SAMPLES - count) % HistoryConfig::SAMPLES;
+  return samples[(start + i) % HistoryConfig::SAMPLES];
+}
+
+uint8_t VoltageHistory::heightAt(uint8_t i) const {
+  uint8_t start = (head + HistoryConfig::SAMPLES - count) % HistoryConfig::SAMPLES;
+  return heights[(start + i) % HistoryConfig::SAMPLES];
+}
+
+float VoltageHistory::minVoltage() const {
+  if (count == 0) return 0.0f;
+  uint8_t lowest = 255;
+  for (uint8_t i = 0; i < count; i++) {
+    if (sampleAt(i) < lowest) lowest = sampleAt(i);
+  }
+  return dequantize(lowest);
+}
+
+float VoltageHistory::maxVoltage() const {
+  if (count == 0) return 0.0f;
+  uint8_t highest = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (sampleAt(i) > highest) highest = sampleAt(i);
+  }
+  return dequantize(highest);
+}
+
+float VoltageHistory::averageVoltage() const {
+  if (count == 0) return 0.0f;
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    sum += sampleAt(i);
+  }
+  return dequantize(0) + (float)sum / count * HistoryConfig::QUANT_STEP;
+}
+
+HistoryPlot::Change HistoryPlot::update(const VoltageHistory& history) {
+  bool sameSeries = valid && plotLow == history.plotLow && plotHigh == history.plotHigh &&
+                    count <= HistoryConfig::SAMPLES;
+  if (sameSeries && history.added == added) {
+    return UNCHANGED;
+  }
+
+  Change change = REDRAWN;
+  if (sameSeries && history.added == added + 1 && history.count > 0) {
+    uint8_t newest = history.heightAt(history.count - 1);
+    if (history.count == count + 1) {
+      // Still filling up: append a column
+      setColumn(history.count - 1, newest);
+      change = APPENDED;
+    } else if (history.count == HistoryConfig::SAMPLES && count == HistoryConfig::SAMPLES) {
+      // Full: scroll left by one column, newest on the right
+      for (uint8_t p = 0; p < HistoryConfig::PLOT_PAGES; p++) {
+        memmove(pages[p], pages[p] + 1, HistoryConfig::SAMPLES - 1);
+      }
+      setColumn(HistoryConfig::SAMPLES - 1, newest);
+      change = SCROLLED;
+    }
+  }
+
+  if (change == REDRAWN) {
+    memset(pages, 0, sizeof(pages));
+    for (uint8_t i = 0; i < history.count; i++) {
+      setColumn(i, history.heightAt(i));
+    }
+  }
+
+  valid = true;
+  added = history.added;
+  count = history.count;
+  plotLow = history.plotLow;
+  plotHigh = history.plotHigh;
+  return change;
+}
+
+void HistoryPlot::setColumn(uint8_t x, uint8_t height) {
+  // Filled from the bottom; bit n of a page byte is row n of that page
+  uint8_t top = HistoryConfig::PLOT_HEIGHT - height;
+  for (uint8_t p = 0; p < HistoryConfig::PLOT_PAGES; p++) {
+    uint8_t pageTop = p * 8;
+    if (top <= pageTop) {
+      pages[p][x] = 0xFF;
+    } else if (top >= pageTop + 8) {
+      pages[p][x] = 0x00;
+    } else {
+      pages[p][x] = (uint8_t)(0xFF << (top - pageTop));
+    }
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * Voltage History
+ *
+ * Compact ring buffer of the last readings for the display's history
+ * screen. Samples are quantized to one byte (20 mV steps from 10.0 V) and
+ * each one's plot column height is computed once, when it is added, so
+ * drawing the sparkline is a table lookup per column.
+ *
+ * HistoryPlot holds the sparkline pixels drawn from it and is updated one
+ * column per new sample.
+ *
+ * Plain data with no constructor: an all-zero instance is an empty history
+ * (or a plot not drawn yet), which lets both live in RTC memory across deep
+ * sleep.
+ */
+
+#ifndef VOLTAGE_HISTORY_H
+#define VOLTAGE_HISTORY_H
+
+#include <stdint.h>
+
+namespace HistoryConfig {
+  constexpr uint8_t SAMPLES = 120;        // One plot column per sample
+  constexpr uint8_t PLOT_HEIGHT = 32;     // Pixels
+  constexpr uint8_t PLOT_PAGES = PLOT_HEIGHT / 8;  // Display pages of 8 rows
+  constexpr float QUANT_BASE = 10.0f;     // Voltage of sample value 0
+  constexpr float QUANT_STEP = 0.02f;     // Volts per step (10.00 - 15.10 V)
+}
+
+struct VoltageHistory {
+  uint8_t samples[HistoryConfig::SAMPLES];  // Quantized voltages
+  uint8_t heights[HistoryConfig::SAMPLES];  // Column heights, 0..PLOT_HEIGHT
+  uint8_t head;        // Next slot to write
+  uint8_t count;       // Valid samples
+  uint8_t plotLow;     // Quantized plot range the heights were computed for
+  uint8_t plotHigh;
+  uint32_t added;      // Samples ever added, to detect a one-sample change
+
+  // Append a reading, evicting the oldest when full
+  void add(float voltage);
+
+  // Set the voltage range mapped onto the plot; recomputes the stored
+  // heights only if the range changed (e.g. new battery chemistry)
+  void setPlotRange(float low, float high);
+
+  // Oldest first, 0 <= i < count
+  uint8_t sampleAt(uint8_t i) const;
+  uint8_t heightAt(uint8_t i) const;
+
+  float minVoltage() const;
+  float maxVoltage() const;
+  float averageVoltage() const;
+
+  static uint8_t quantize(float voltage);
+  static float dequantize(uint8_t sample);
+
+private:
+  uint8_t heightFor(uint8_t sample) const;
+};
+
+// Sparkline pixels in display buffer layout (one byte = 8 rows of a column,
+// bit 0 at the top), for the VoltageHistory it was last updated from
+struct HistoryPlot {
+  enum Change : uint8_t { UNCHANGED, APPENDED, SCROLLED, REDRAWN };
+
+  uint8_t pages[HistoryConfig::PLOT_PAGES][HistoryConfig::SAMPLES];
+  bool valid;
+  uint32_t added;      // VoltageHistory::added the pixels were drawn for
+  uint8_t count;
+  uint8_t plotLow;
+  uint8_t plotHigh;
+
+  // Exactly one new sample appends a column, or scrolls left by one once
+  // full; anything else (first draw, skipped samples, new range) redraws
+  Change update(const VoltageHistory& history);
+
+private:
+  void setColumn(uint8_t x, uint8_t height);
+};
+
+#endif // VOLTAGE_HISTORY_H
@@ -0,0 +1,131 @@
+#include "bthome_payload.h"
+#include <string.h>
+
+namespace BleBeacon {
+
+namespace {
+    const uint8_t AD_FLAGS = 0x01;
+    const uint8_t AD_COMPLETE_NAME = 0x09;
+    const uint8_t AD_SERVICE_DATA_16 = 0x16;
+    const uint8_t FLAGS_GENERAL_NO_BREDR = 0x06;
+    
+    const uint8_t INFO_ENCRYPTED = 0x01;
+    const uint8_t INFO_IRREGULAR = 0x04;
+    const uint8_t INFO_VERSION_SHIFT = 5;
+    
+    // Value size of the objects a battery beacon may carry (0 = unknown)
+    size_t objectSize(uint8_t id) {
+        switch (id) {
+            case 0x00: return 1;   // packet id
+            case 0x01: return 1;   // battery
+            case 0x02: return 2;   // temperature
+            case 0x03: return 2;   // humidity
+            case 0x0C: return 2;   // voltage
+            case 0x0F: return 1;   // generic boolean
+            case 0x10: return 1;   // power
+            case 0x15: return 1;   // battery low
+            case 0x16: return 1;   // battery charging
+            case 0x4A: return 2;   // voltage, 0.1 V
+            default: return 0;
+        }
+    }
+}
+
+size_t encodeServiceData(const BeaconReading& reading, uint8_t* buf, size_t cap) {
+    const size_t len = 1 + 2 + 2 + 3 + 2;
+    if (cap < len) {
+        return 0;
+    }
+    size_t pos = 0;
+    buf[pos++] = (BleBeaconConfig::BTHOME_VERSION << INFO_VERSION_SHIFT) | INFO_IRREGULAR;
+    buf[pos++] = PACKET_ID;
+    buf[pos++] = reading.packetId;
+    buf[pos++] = BATTERY;
+    buf[pos++] = reading.percentage > 100 ? 100 : reading.percentage;
+    buf[pos++] = VOLTAGE;
+    buf[pos++] = reading.millivolts & 0xFF;
+    buf[pos++] = reading.millivolts >> 8;
+    buf[pos++] = BATTERY_LOW;
+    buf[pos++] = reading.batteryLow ? 1 : 0;
+    return pos;
+}
+
+size_t encodeAdvertisement(const BeaconReading& reading, const char* name, uint8_t* buf, size_t cap) {
+    uint8_t serviceData[BleBeaconConfig::SERVICE_DATA_MAX];
+    size_t serviceLen = encodeServiceData(reading, serviceData, sizeof(serviceData));
+    size_t needed = 3 + 4 + serviceLen;
+    if (cap < needed) {
+        return 0;
+    }
+    
+    size_t pos = 0;
+    buf[pos++] = 2;
+    buf[pos++] = AD_FLAGS;
+    buf[pos++] = FLAGS_GENERAL_NO_BREDR;
+    
+    buf[pos++] = 3 + serviceLen;
+    buf[pos++] = AD_SERVICE_DATA_16;
+    buf[pos++] = BleBeaconConfig::BTHOME_UUID & 0xFF;
+    buf[pos++] = BleBeaconConfig::BTHOME_UUID >> 8;
+    memcpy(buf + pos, serviceData, serviceLen);
+    pos += serviceLen;
+    
+    size_t nameLen = name ? strlen(name) : 0;
+    size_t limit = cap < BleBeaconConfig::ADV_MAX ? cap : BleBeaconConfig::ADV_MAX;
+    if (nameLen > 0 && pos + 2 + nameLen <= limit) {
+        buf[pos++] = 1 + nameLen;
+        buf[pos++] = AD_COMPLETE_NAME;
+        memcpy(buf + pos, name, nameLen);
+        pos += nameLen;
+    }
+    return pos;
+}
+
+bool decodeServiceData(const uint8_t* data, size_t len, BeaconReading& out) {
+    if (len < 1 || (data[0] >> INFO_VERSION_SHIFT) != BleBeaconConfig::BTHOME_VERSION || (data[0] & INFO_ENCRYPTED)) {
+        return false;
+    }
+    
+    memset(&out, 0, sizeof(out));
+    bool hasVoltage = false;
+    bool hasBattery = false;
+    size_t pos = 1;
+    while (pos < len) {
+        uint8_t id = data[pos++];
+        size_t size = objectSize(id);
+        if (size == 0 || pos + size > len) {
+            return false;  // Unknown objects cannot be skipped: BTHome has no length field
+        }
+        const uint8_t* value = data + pos;
+        switch (id) {
+            case PACKET_ID: out.packetId = value[0]; break;
+            case BATTERY: out.percentage = value[0]; hasBattery = true; break;
+            case VOLTAGE: out.millivolts = value[0] | (value[1] << 8); hasVoltage = true; break;
+            case BATTERY_LOW: out.batteryLow = value[0] != 0; break;
+            default: break;
+        }
+        pos += size;
+    }
+    return hasVoltage && hasBattery;
+}
+
+bool findServiceData(const uint8_t* adv, size_t len, const uint8_t*& data, size_t& dataLen) {
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t fieldLen = adv[pos];
+        if (fieldLen == 0 || pos + 1 + fieldLen > len) {
+            return false;
+        }
+        const uint8_t* field = adv + pos + 1;
+        if (field[0] == AD_SERVICE_DATA_16 && fieldLen >= 3 &&
+            (field[1] | (field[2] << 8)) == BleBeaconConfig::BTHOME_UUID) {
+            data = field + 3;
+            dataLen = fieldLen - 3;
+            return true;
+        }
+        pos += 1 + fieldLen;
+    }
+    return false;
+}
+
+} // namespace BleBeacon
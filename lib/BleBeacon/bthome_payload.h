@@ -0,0 +1,68 @@
+/*
+ * BTHome Beacon Payload
+ *
+ * Encodes a battery reading as a BTHome v2 advertisement (service data
+ * for UUID 0xFCD2), which Home Assistant decodes natively, including
+ * through ESPHome Bluetooth proxies. The decoder lets a gateway read the
+ * same beacons. Pure C++ with no Arduino dependency, so it also runs in
+ * the native test build.
+ *
+ * Service data layout (after the UUID):
+ *   [0]     device info: version 2 in bits 5-7, bit 2 = irregular updates
+ *           (the device sleeps between readings), bit 0 = encrypted (not used)
+ *   then objects in ascending id order, values little-endian:
+ *   0x00    packet id, uint8 (low byte of the reading sequence; receivers
+ *           drop repeats of the same id)
+ *   0x01    battery, uint8 %
+ *   0x0C    voltage, uint16 in mV
+ *   0x15    battery low, uint8 0/1 (status LOW, CRITICAL or DEAD)
+ *
+ * The full advertisement is the flags AD, the service data AD and, if it
+ * fits, the complete local name: at most 31 bytes.
+ */
+
+#ifndef BTHOME_PAYLOAD_H
+#define BTHOME_PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace BleBeaconConfig {
+    constexpr uint16_t BTHOME_UUID = 0xFCD2;
+    constexpr uint8_t BTHOME_VERSION = 2;
+    constexpr size_t ADV_MAX = 31;          // Legacy advertising payload
+    constexpr size_t SERVICE_DATA_MAX = 12;
+}
+
+namespace BleBeacon {
+
+enum Object : uint8_t {
+    PACKET_ID = 0x00,
+    BATTERY = 0x01,
+    VOLTAGE = 0x0C,
+    BATTERY_LOW = 0x15
+};
+
+struct BeaconReading {
+    uint8_t packetId;
+    uint8_t percentage;
+    uint16_t millivolts;
+    bool batteryLow;
+};
+
+// Service data after the UUID; returns its length, or 0 if cap is too small
+size_t encodeServiceData(const BeaconReading& reading, uint8_t* buf, size_t cap);
+
+// Whole advertisement; the name is left out if it does not fit (nullptr = none)
+size_t encodeAdvertisement(const BeaconReading& reading, const char* name, uint8_t* buf, size_t cap);
+
+// False for another BTHome version, encrypted data, an object this decoder
+// does not know the size of, or a missing voltage/battery
+bool decodeServiceData(const uint8_t* data, size_t len, BeaconReading& out);
+
+// Finds the BTHome service data in an advertisement (data points past the UUID)
+bool findServiceData(const uint8_t* adv, size_t len, const uint8_t*& data, size_t& dataLen);
+
+} // namespace BleBeacon
+
+#endif // BTHOME_PAYLOAD_H
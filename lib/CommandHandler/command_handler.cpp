@@ -1,7 +1,12 @@
 #include "command_handler.h"
+#include "battery_config.h"
 
 CommandHandler::CommandHandler(ConfigManager& cfg) : config(cfg) {}
 
+void CommandHandler::setTlsBenchmarkCallback(std::function<void(int)> callback) {
+    tlsBenchmarkCallback = callback;
+}
+
 void CommandHandler::checkCommands() {
     if (Serial.available() > 0) {
         String command = Serial.readStringUntil('\n');
@@ -46,6 +51,9 @@ void CommandHandler::checkCommands() {
         else if (cmd == "clearota" || cmd == "otaclear") {
             handleClearOTA();
         }
+        else if (cmd == "tlsbench") {
+            handleTlsBenchmark(arg);
+        }
         else if (cmd == "help") {
             showHelp();
         }
@@ -87,6 +95,10 @@ void CommandHandler::handleSet(const String& arg) {
             config.wifiPassword = value;
             Serial.println("✓ WiFi password set (hidden)");
         }
+        else if (key.length() > 6 && key.startsWith("wifi") && key.charAt(5) == '_' &&
+                 key.charAt(4) >= '2' && key.charAt(4) < '2' + Config::MAX_WIFI_NETWORKS - 1) {
+            handleExtraWifiSet(key.charAt(4) - '2', key.substring(6), value, validKey);
+        }
         else if (key == "mqtt_server" || key == "server") {
             config.mqttServer = value;
             Serial.print("✓ MQTT server set to: ");
@@ -111,14 +123,134 @@ void CommandHandler::handleSet(const String& arg) {
             Serial.print("✓ MQTT client ID set to: ");
             Serial.println(value);
         }
+        else if (key == "mqtt_fallback" || key == "fallback") {
+            String lower = value;
+            lower.toLowerCase();
+            if (lower == "off" || lower == "none") {
+                config.mqttFallbacks = "";
+                Serial.println("✓ MQTT fallback brokers cleared");
+            } else {
+                config.mqttFallbacks = value;
+                String hosts[Config::MAX_BROKERS];
+                uint16_t ports[Config::MAX_BROKERS];
+                int count = config.getBrokers(hosts, ports, Config::MAX_BROKERS);
+                Serial.print("✓ MQTT brokers:");
+                for (int i = 0; i < count; i++) {
+                    Serial.printf(" %s%s:%u", i > 0 ? "> " : "", hosts[i].c_str(), ports[i]);
+                }
+                Serial.println();
+                Serial.printf("  (at most %d are used, ranked by connect time)\n", Config::MAX_BROKERS);
+            }
+        }
+        else if (key == "mqtt_psk_id" || key == "psk_id") {
+            config.mqttPskIdentity = value;
+            Serial.print("✓ MQTT PSK identity set to: ");
+            Serial.println(value);
+        }
+        else if (key == "mqtt_psk" || key == "psk") {
+            String lower = value;
+            lower.toLowerCase();
+            if (lower == "off" || lower == "none") {
+                config.mqttPsk = "";
+                Serial.println("✓ MQTT PSK cleared, using CA certificate");
+            } else if (isHexKey(value)) {
+                config.mqttPsk = value;
+                Serial.print("✓ MQTT PSK set (");
+                Serial.print(value.length() / 2);
+                Serial.println(" bytes, hidden)");
+            } else {
+                validKey = false;
+                Serial.println("✗ PSK must be 1-32 bytes as hex (e.g. 2f6a...), or 'off'");
+            }
+        }
+        else if (key == "mqtt_version" || key == "mqtt_ver") {
+            if (value == "3" || value == "3.1.1") {
+                config.mqttVersion = 3;
+                Serial.println("✓ MQTT version set to: 3.1.1");
+            } else if (value == "5") {
+                config.mqttVersion = 5;
+                Serial.println("✓ MQTT version set to: 5");
+            } else {
+                validKey = false;
+                Serial.println("✗ MQTT version must be 3 or 5");
+            }
+        }
+        else if (key == "uplink") {
+            String lower = value;
+            lower.toLowerCase();
+            if (lower == "mqtt" || lower == "espnow" || lower == "ble") {
+                config.uplinkMode = lower;
+                Serial.print("✓ Uplink set to: ");
+                Serial.println(lower);
+                if (lower == "espnow" && config.espnowGateway.length() == 0) {
+                    Serial.println("  Set espnow_gateway too, until then readings go over MQTT");
+                }
+            } else {
+                validKey = false;
+                Serial.println("✗ Uplink must be mqtt, espnow or ble");
+            }
+        }
+        else if (key == "espnow_gateway" || key == "gateway") {
+            uint8_t mac[6];
+            String previous = config.espnowGateway;
+            config.espnowGateway = value;
+            if (config.getEspNowGateway(mac)) {
+                Serial.print("✓ ESP-NOW gateway set to: ");
+                Serial.println(value);
+            } else {
+                config.espnowGateway = previous;
+                validKey = false;
+                Serial.println("✗ Gateway must be a MAC address (e.g. 24:6f:28:aa:bb:cc)");
+            }
+        }
+        else if (key == "espnow_key") {
+            String lower = value;
+            lower.toLowerCase();
+            if (lower == "off" || lower == "none") {
+                config.espnowKey = "";
+                Serial.println("✓ ESP-NOW key cleared, frames are sent unencrypted");
+            } else if (isHexKey(value) && value.length() == 32) {
+                config.espnowKey = value;
+                Serial.println("✓ ESP-NOW key set (16 bytes, hidden)");
+            } else {
+                validKey = false;
+                Serial.println("✗ ESP-NOW key must be 16 bytes as hex (32 digits), or 'off'");
+            }
+        }
+        else if (key == "espnow_peers" || key == "peers") {
+            String lower = value;
+            lower.toLowerCase();
+            if (lower == "off" || lower == "none") {
+                config.espnowPeers = "";
+                Serial.println("✓ ESP-NOW peers cleared, only unencrypted units are received");
+            } else {
+                config.espnowPeers = value;
+                uint8_t macs[Config::ESPNOW_MAX_ENCRYPTED_PEERS][6];
+                int count = config.getEspNowPeers(macs, Config::ESPNOW_MAX_ENCRYPTED_PEERS);
+                Serial.printf("✓ ESP-NOW peers: %d encrypted units (at most %d)\n", count, Config::ESPNOW_MAX_ENCRYPTED_PEERS);
+            }
+        }
         else if (key == "deep_sleep") {
             handleDeepSleepSet(value, validKey);
         }
         else if (key == "ota_version" || key == "ota_target" || key == "otaver") {
             config.otaTargetVersion = value;
+            allowRolledBackVersion();
             Serial.print("✓ OTA target version set to: ");
             Serial.println(value);
         }
+        else if (key == "ota_window") {
+            long seconds = value.toInt();
+            if (seconds >= 10 && seconds <= 600) {
+                config.otaWindowSec = seconds;
+                Serial.print("✓ OTA upload window set to: ");
+                Serial.print(seconds);
+                Serial.println(" s");
+            } else {
+                validKey = false;
+                Serial.println("✗ OTA window must be 10-600 seconds");
+            }
+        }
         else {
             validKey = false;
             Serial.print("✗ Unknown key: ");
@@ -135,6 +267,25 @@ void CommandHandler::handleSet(const String& arg) {
     }
 }
 
+void CommandHandler::handleExtraWifiSet(int index, const String& field, const String& value, bool& validKey) {
+    String lower = value;
+    lower.toLowerCase();
+    if (field == "ssid" && (lower == "off" || lower == "none")) {
+        config.extraWifiSSID[index] = "";
+        config.extraWifiPassword[index] = "";
+        Serial.printf("✓ WiFi network %d removed\n", index + 2);
+    } else if (field == "ssid") {
+        config.extraWifiSSID[index] = value;
+        Serial.printf("✓ WiFi %d SSID set to: %s\n", index + 2, value.c_str());
+    } else if (field == "password" || field == "pass") {
+        config.extraWifiPassword[index] = value;
+        Serial.printf("✓ WiFi %d password set (hidden)\n", index + 2);
+    } else {
+        validKey = false;
+        Serial.printf("✗ Use wifi%d_ssid or wifi%d_password\n", index + 2, index + 2);
+    }
+}
+
 void CommandHandler::handleDeepSleepSet(String value, bool& validKey) {
     value.toLowerCase();
     if (value == "true" || value == "1" || value == "on" || value == "enable") {
@@ -175,6 +326,7 @@ void CommandHandler::handleOTAVersion(const String& version) {
     if (version.length() > 0) {
         config.otaTargetVersion = version;
         config.saveConfig();
+        allowRolledBackVersion();
         Serial.print("✓ OTA target version set to: ");
         Serial.println(version);
         Serial.println("✓ Configuration saved");
@@ -202,6 +354,41 @@ void CommandHandler::handleClearOTA() {
     Serial.println("Device will no longer attempt OTA on next boot");
 }
 
+// Pinning a version is an explicit retry: lift the block OTAManager keeps
+// on firmware that was rolled back
+void CommandHandler::allowRolledBackVersion() {
+    Preferences preferences;
+    preferences.begin("ota", false);
+    preferences.remove("rb_version");
+    preferences.end();
+}
+
+bool CommandHandler::isHexKey(const String& value) {
+    // mbedTLS accepts keys up to MBEDTLS_PSK_MAX_LEN (32) bytes
+    if (value.length() < 2 || value.length() > 64 || value.length() % 2 != 0) {
+        return false;
+    }
+    for (unsigned int i = 0; i < value.length(); i++) {
+        if (!isxdigit(value[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CommandHandler::handleTlsBenchmark(const String& arg) {
+    int rounds = arg.length() > 0 ? arg.toInt() : 5;
+    if (rounds < 1 || rounds > 20) {
+        Serial.println("✗ Usage: tlsbench [rounds 1-20]");
+        return;
+    }
+    if (!tlsBenchmarkCallback) {
+        Serial.println("✗ TLS benchmark not available");
+        return;
+    }
+    tlsBenchmarkCallback(rounds);
+}
+
 void CommandHandler::showHelp() {
     Serial.println("\n╔═══════════════════════════════════════════════════════╗");
     Serial.println("║   Battery Monitor - Serial Commands                   ║");
@@ -214,18 +401,29 @@ void CommandHandler::showHelp() {
     Serial.println("\nConfiguration Keys:");
     Serial.println("  wifi_ssid         - WiFi network name");
     Serial.println("  wifi_password     - WiFi password");
+    Serial.println("  wifi2_ssid ...    - More networks: wifi2..wifi4 _ssid/_password ('off' removes)");
     Serial.println("  mqtt_server       - MQTT broker address");
     Serial.println("  mqtt_port         - MQTT broker port");
     Serial.println("  mqtt_user         - MQTT username");
     Serial.println("  mqtt_password     - MQTT password");
     Serial.println("  mqtt_client_id    - MQTT client identifier");
+    Serial.println("  mqtt_fallback     - Fallback brokers host[:port],... or 'off'");
+    Serial.println("  mqtt_psk_id       - TLS-PSK identity (PSK mode when key is set too)");
+    Serial.println("  mqtt_psk          - TLS-PSK key as hex, or 'off' for CA certificate");
+    Serial.println("  mqtt_version      - MQTT protocol: 3 (3.1.1) or 5");
+    Serial.println("  uplink            - Send readings over mqtt, espnow (to a gateway) or ble");
+    Serial.println("  espnow_gateway    - Gateway MAC address for the espnow uplink");
+    Serial.println("  espnow_key        - ESP-NOW key as 16 bytes hex, or 'off'");
+    Serial.println("  espnow_peers      - Gateway: encrypted unit MACs mac,mac,... or 'off'");
     Serial.println("  deep_sleep        - Enable/disable deep sleep (true/false)");
     Serial.println("  ota_version       - Target OTA version (e.g., 1.0.1)");
+    Serial.println("  ota_window        - ArduinoOTA upload window in seconds (10-600)");
     Serial.println("\nSystem Commands:");
     Serial.println("  nosleep           - Disable deep sleep (stay awake)");
     Serial.println("  sleep             - Enable deep sleep");
     Serial.println("  otaver <version>  - Set target OTA version (shortcut)");
     Serial.println("  clearota          - Clear pending OTA trigger");
+    Serial.println("  tlsbench [n]      - Time n broker TLS handshakes (default 5)");
     Serial.println("  reboot            - Restart the device");
     Serial.println("  help              - Show this help message");
     Serial.println("\nExamples:");
@@ -3,24 +3,31 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <functional>
 #include "config_manager.h"
 
 class CommandHandler {
 private:
     ConfigManager& config;
+    std::function<void(int)> tlsBenchmarkCallback;
     
     void handleReset();
     void handleSet(const String& arg);
+    void handleExtraWifiSet(int index, const String& field, const String& value, bool& validKey);
     void handleDeepSleepSet(String value, bool& validKey);
     void handleNoSleep();
     void handleSleep();
     void handleReboot();
     void handleOTAVersion(const String& version);
     void handleClearOTA();
+    void allowRolledBackVersion();
+    void handleTlsBenchmark(const String& arg);
+    static bool isHexKey(const String& value);
     void showHelp();
     
 public:
     CommandHandler(ConfigManager& cfg);
+    void setTlsBenchmarkCallback(std::function<void(int)> callback);
     void checkCommands();
 };
 
@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include "battery_config.h"
 
 class ConfigManager {
 private:
@@ -13,6 +14,11 @@ public:
     String wifiSSID;
     String wifiPassword;
     
+    // Further networks for installs that move (slots 2..MAX_WIFI_NETWORKS,
+    // empty SSID = unused)
+    String extraWifiSSID[Config::MAX_WIFI_NETWORKS - 1];
+    String extraWifiPassword[Config::MAX_WIFI_NETWORKS - 1];
+    
     // MQTT settings
     String mqttServer;
     uint16_t mqttPort;
@@ -20,6 +26,23 @@ public:
     String mqttPassword;
     String mqttClientID;
     
+    // Fallback brokers tried after mqttServer: "host[:port],host[:port]"
+    String mqttFallbacks;
+    
+    // TLS-PSK for the MQTT connection (both set = PSK instead of CA certificate)
+    String mqttPskIdentity;
+    String mqttPsk;  // Hex encoded key
+    
+    // MQTT protocol version (3 = 3.1.1, 5 = MQTT 5)
+    uint8_t mqttVersion;
+    
+    // Reading uplink: "mqtt", "espnow" to send frames to a gateway, or
+    // "ble" to broadcast a BTHome beacon; the last two skip WiFi
+    String uplinkMode;
+    String espnowGateway;  // Gateway MAC, "aa:bb:cc:dd:ee:ff"
+    String espnowKey;      // 16-byte local master key as hex ("" = unencrypted)
+    String espnowPeers;    // Gateway only: encrypted sensor units, "mac,mac,..."
+    
     // Deep sleep setting
     bool deepSleepEnabled;
     
@@ -29,7 +52,106 @@ public:
     // OTA target version
     String otaTargetVersion;
     
-    ConfigManager() : mqttPort(1883), deepSleepEnabled(true), batteryType("leadacid"), otaTargetVersion("") {}
+    // How long ArduinoOTA mode waits for an upload (seconds)
+    uint16_t otaWindowSec;
+    
+    // Old per-entity Home Assistant discovery configs have been removed
+    bool discoveryMigrated;
+    
+    ConfigManager() : mqttPort(1883), mqttVersion(3), uplinkMode("mqtt"), deepSleepEnabled(true), batteryType("leadacid"), otaTargetVersion(""),
+                      otaWindowSec(60), discoveryMigrated(false) {}
+    
+    // Slot 0 is wifi_ssid/wifi_password, slot n the network set as wifi<n+1>_*
+    const String& getWifiSSID(int slot) const { return slot == 0 ? wifiSSID : extraWifiSSID[slot - 1]; }
+    const String& getWifiPassword(int slot) const { return slot == 0 ? wifiPassword : extraWifiPassword[slot - 1]; }
+    
+    bool usePsk() const { return mqttPskIdentity.length() > 0 && mqttPsk.length() > 0; }
+    
+    bool useEspNow() const { return uplinkMode == "espnow"; }
+    bool useBleBeacon() const { return uplinkMode == "ble"; }
+    
+    // Parses espnowGateway; false if it is not a MAC address
+    bool getEspNowGateway(uint8_t mac[6]) const {
+        unsigned int bytes[6];
+        if (sscanf(espnowGateway.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x",
+                   &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+            return false;
+        }
+        for (int i = 0; i < 6; i++) {
+            mac[i] = bytes[i];
+        }
+        return true;
+    }
+    
+    // Parses espnowPeers; entries that are not a MAC address are skipped.
+    // Returns how many were written.
+    int getEspNowPeers(uint8_t macs[][6], int max) const {
+        int count = 0;
+        int start = 0;
+        while (count < max && start < (int)espnowPeers.length()) {
+            int end = espnowPeers.indexOf(',', start);
+            if (end < 0) {
+                end = espnowPeers.length();
+            }
+            String entry = espnowPeers.substring(start, end);
+            entry.trim();
+            start = end + 1;
+            unsigned int bytes[6];
+            if (sscanf(entry.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x",
+                       &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+                continue;
+            }
+            for (int i = 0; i < 6; i++) {
+                macs[count][i] = bytes[i];
+            }
+            count++;
+        }
+        return count;
+    }
+    
+    // Parses espnowKey; false if it is not 16 bytes of hex
+    bool getEspNowKey(uint8_t key[16]) const {
+        if (espnowKey.length() != 32) {
+            return false;
+        }
+        for (int i = 0; i < 16; i++) {
+            unsigned int byte;
+            if (sscanf(espnowKey.c_str() + 2 * i, "%2x", &byte) != 1) {
+                return false;
+            }
+            key[i] = byte;
+        }
+        return true;
+    }
+    
+    // mqttServer followed by the fallbacks (port defaults to mqttPort);
+    // returns how many were written
+    int getBrokers(String hosts[], uint16_t ports[], int max) const {
+        int count = 0;
+        hosts[count] = mqttServer;
+        ports[count] = mqttPort;
+        count++;
+        
+        int start = 0;
+        while (count < max && start < (int)mqttFallbacks.length()) {
+            int end = mqttFallbacks.indexOf(',', start);
+            if (end < 0) {
+                end = mqttFallbacks.length();
+            }
+            String entry = mqttFallbacks.substring(start, end);
+            entry.trim();
+            start = end + 1;
+            if (entry.length() == 0) {
+                continue;
+            }
+            int colon = entry.lastIndexOf(':');
+            long port = colon > 0 ? entry.substring(colon + 1).toInt() : 0;
+            hosts[count] = colon > 0 ? entry.substring(0, colon) : entry;
+            ports[count] = (port > 0 && port <= 65535) ? port : mqttPort;
+            count++;
+        }
+        return count;
+    }
     
     void begin(const char* wifiSsidDefault, const char* wifiPassDefault,
                const char* mqttServerDefault, uint16_t mqttPortDefault,
@@ -62,14 +184,31 @@ public:
         // Load credentials from NVS
         wifiSSID = preferences.getString("wifi_ssid", wifiSsidDefault);
         wifiPassword = preferences.getString("wifi_pass", wifiPassDefault);
+        for (int i = 0; i < Config::MAX_WIFI_NETWORKS - 1; i++) {
+            char key[16];
+            snprintf(key, sizeof(key), "wifi%d_ssid", i + 2);
+            extraWifiSSID[i] = preferences.getString(key, "");
+            snprintf(key, sizeof(key), "wifi%d_pass", i + 2);
+            extraWifiPassword[i] = preferences.getString(key, "");
+        }
         mqttServer = preferences.getString("mqtt_srv", mqttServerDefault);
         mqttPort = preferences.getUShort("mqtt_port", mqttPortDefault);
         mqttUser = preferences.getString("mqtt_user", mqttUserDefault);
         mqttPassword = preferences.getString("mqtt_pass", mqttPassDefault);
         mqttClientID = preferences.getString("mqtt_id", mqttClientIDDefault);
+        mqttPskIdentity = preferences.getString("psk_id", "");
+        mqttPsk = preferences.getString("psk_key", "");
+        mqttFallbacks = preferences.getString("mqtt_fallback", "");
+        mqttVersion = preferences.getUChar("mqtt_ver", 3);
+        uplinkMode = preferences.getString("uplink", "mqtt");
+        espnowGateway = preferences.getString("espnow_gw", "");
+        espnowKey = preferences.getString("espnow_key", "");
+        espnowPeers = preferences.getString("espnow_peers", "");
         deepSleepEnabled = preferences.getBool("deep_sleep", true);
         batteryType = preferences.getString("battery_type", "leadacid");
         otaTargetVersion = preferences.getString("ota_target", "");
+        otaWindowSec = preferences.getUShort("ota_window", 60);
+        discoveryMigrated = preferences.getBool("disc_migrated", false);
         
         Serial.println("\n╔═══════════════════════════════════════╗");
         Serial.println("║   Configuration Loaded from NVS       ║");
@@ -82,6 +221,8 @@ public:
         Serial.println(mqttPort);
         Serial.print("MQTT Client ID: ");
         Serial.println(mqttClientID);
+        Serial.print("MQTT TLS: ");
+        Serial.println(usePsk() ? "PSK" : "CA certificate");
         Serial.print("Battery Type (NVS): ");
         Serial.println(batteryType);
         Serial.println();
@@ -90,18 +231,40 @@ public:
     void saveConfig() {
         preferences.putString("wifi_ssid", wifiSSID);
         preferences.putString("wifi_pass", wifiPassword);
+        for (int i = 0; i < Config::MAX_WIFI_NETWORKS - 1; i++) {
+            char key[16];
+            snprintf(key, sizeof(key), "wifi%d_ssid", i + 2);
+            preferences.putString(key, extraWifiSSID[i]);
+            snprintf(key, sizeof(key), "wifi%d_pass", i + 2);
+            preferences.putString(key, extraWifiPassword[i]);
+        }
         preferences.putString("mqtt_srv", mqttServer);
         preferences.putUShort("mqtt_port", mqttPort);
         preferences.putString("mqtt_user", mqttUser);
         preferences.putString("mqtt_pass", mqttPassword);
         preferences.putString("mqtt_id", mqttClientID);
+        preferences.putString("psk_id", mqttPskIdentity);
+        preferences.putString("psk_key", mqttPsk);
+        preferences.putString("mqtt_fallback", mqttFallbacks);
+        preferences.putUChar("mqtt_ver", mqttVersion);
+        preferences.putString("uplink", uplinkMode);
+        preferences.putString("espnow_gw", espnowGateway);
+        preferences.putString("espnow_key", espnowKey);
+        preferences.putString("espnow_peers", espnowPeers);
         preferences.putBool("deep_sleep", deepSleepEnabled);
         preferences.putString("battery_type", batteryType);
         preferences.putString("ota_target", otaTargetVersion);
+        preferences.putUShort("ota_window", otaWindowSec);
         
         Serial.println("Configuration saved to NVS");
     }
     
+    // Written on its own: it is device state, not a setting changed over serial
+    void setDiscoveryMigrated() {
+        discoveryMigrated = true;
+        preferences.putBool("disc_migrated", true);
+    }
+    
     void resetToDefaults(const char* wifiSsidDefault, const char* wifiPassDefault,
                         const char* mqttServerDefault, uint16_t mqttPortDefault,
                         const char* mqttUserDefault, const char* mqttPassDefault,
@@ -139,6 +302,11 @@ public:
         Serial.println(wifiSSID);
         Serial.print("WiFi Password: ");
         Serial.println(wifiPassword);
+        for (int i = 0; i < Config::MAX_WIFI_NETWORKS - 1; i++) {
+            if (extraWifiSSID[i].length() > 0) {
+                Serial.printf("WiFi %d: %s\n", i + 2, extraWifiSSID[i].c_str());
+            }
+        }
         Serial.print("MQTT Server: ");
         Serial.println(mqttServer);
         Serial.print("MQTT Port: ");
@@ -149,10 +317,41 @@ public:
         Serial.println(mqttPassword);
         Serial.print("MQTT Client ID: ");
         Serial.println(mqttClientID);
+        Serial.print("MQTT Fallbacks: ");
+        Serial.println(mqttFallbacks.length() > 0 ? mqttFallbacks : "(none)");
+        Serial.print("MQTT TLS: ");
+        if (usePsk()) {
+            Serial.print("PSK, identity ");
+            Serial.print(mqttPskIdentity);
+            Serial.print(", ");
+            Serial.print(mqttPsk.length() / 2);
+            Serial.println("-byte key");
+        } else {
+            Serial.println("CA certificate");
+        }
+        Serial.print("MQTT Version: ");
+        Serial.println(mqttVersion == 5 ? "5" : "3.1.1");
+        Serial.print("Uplink: ");
+        if (useEspNow()) {
+            Serial.print("ESP-NOW to ");
+            Serial.print(espnowGateway.length() > 0 ? espnowGateway : "(no gateway)");
+            Serial.println(espnowKey.length() > 0 ? ", encrypted" : ", unencrypted");
+        } else if (useBleBeacon()) {
+            Serial.println("BLE beacon (BTHome)");
+        } else {
+            Serial.println("MQTT");
+        }
+        if (espnowPeers.length() > 0) {
+            Serial.print("ESP-NOW Peers (gateway): ");
+            Serial.println(espnowPeers);
+        }
         Serial.print("Deep Sleep: ");
         Serial.println(deepSleepEnabled ? "Enabled" : "Disabled");
         Serial.print("OTA Target Version: ");
         Serial.println(otaTargetVersion.length() > 0 ? otaTargetVersion : "(not set)");
+        Serial.print("OTA Upload Window: ");
+        Serial.print(otaWindowSec);
+        Serial.println(" s");
         Serial.println();
     }
     
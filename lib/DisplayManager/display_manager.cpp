@@ -4,17 +4,79 @@
 
 #include "display_manager.h"
 
+#ifdef DISPLAY_HEADLESS
+
+// Headless build: no U8g2, no I2C, no render task
+DisplayManager::DisplayManager() : initialized(false), stats() {}
+void DisplayManager::begin(uint8_t, uint8_t) {
+    Serial.println("Display: headless build");
+}
+void DisplayManager::update(const BatteryReading&, bool, int8_t) {}
+void DisplayManager::showBootScreen(int) {}
+void DisplayManager::showOTAScreen(const char*) {}
+void DisplayManager::showOTAProgress(unsigned int, unsigned int) {}
+void DisplayManager::showOTAComplete() {}
+void DisplayManager::showOTAError(const char*) {}
+void DisplayManager::showSleepScreen(time_t, const BatteryReading&) {}
+void DisplayManager::showHistory(const VoltageHistory&) {}
+void DisplayManager::clear() {}
+bool DisplayManager::waitIdle(unsigned long) { return true; }
+
+#else
+
+#include <esp_sleep.h>
+
+// Result of the last presence probe, kept across deep sleep so timer wakes
+// on installs without a panel skip I2C entirely
+enum class DisplayPresence : uint8_t { UNKNOWN, PRESENT, ABSENT };
+RTC_DATA_ATTR static DisplayPresence displayPresence = DisplayPresence::UNKNOWN;
+
+// Sparkline pixels, kept next to voltageHistory across deep sleep so each
+// timer wake only appends or scrolls one column
+RTC_DATA_ATTR static HistoryPlot historyPlot;
+
 DisplayManager::DisplayManager() 
-    : display(U8G2_R0, /* reset=*/ U8X8_PIN_NONE)
-    , initialized(false)
-    , lastUpdate(0) {
+    : initialized(false)
+    , stats()
+    , display(U8G2_R0, /* reset=*/ U8X8_PIN_NONE)
+    , lastUpdate(0)
+    , mailboxLock(nullptr)
+    , renderTask(nullptr)
+    , mailbox()
+    , pending(false)
+    , busy(false)
+    , otaPercentShown(-1)
+    , otaBarShown(0)
+    , shadowValid(false)
+    , chromeReady(false)
+    , fullFrameMicros(0) {
 }
 
 void DisplayManager::begin(uint8_t sda, uint8_t scl) {
+    // A panel can only be plugged in while the device is off or reset, so
+    // a cached "absent" holds for timer wakes
+    if (displayPresence == DisplayPresence::ABSENT &&
+        esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+        Serial.println("No display (cached), skipping I2C init");
+        return;
+    }
+    
     // Initialize I2C with custom pins
     Wire.begin(sda, scl);
+    Wire.setTimeOut(DisplayConfig::PROBE_TIMEOUT_MS);
+    
+    // U8g2's begin() doesn't check for an ACK, so probe the address first
+    if (!probe(DisplayConfig::I2C_ADDRESS)) {
+        Serial.println("No SH1106 display found, continuing without display");
+        displayPresence = DisplayPresence::ABSENT;
+        Wire.end();
+        initialized = false;
+        return;
+    }
+    displayPresence = DisplayPresence::PRESENT;
     
     // Initialize display
+    display.setI2CAddress(DisplayConfig::I2C_ADDRESS << 1);
     if (!display.begin()) {
         Serial.println("Failed to initialize SH1106 display!");
         initialized = false;
@@ -23,25 +85,202 @@ void DisplayManager::begin(uint8_t sda, uint8_t scl) {
     
     display.setFont(u8g2_font_6x10_tr);
     display.clear();
+    
+    mailboxLock = xSemaphoreCreateMutex();
+    if (!mailboxLock ||
+        xTaskCreate(renderTaskEntry, "display", DisplayConfig::TASK_STACK, this,
+                    DisplayConfig::TASK_PRIORITY, &renderTask) != pdPASS) {
+        Serial.println("Failed to start display task!");
+        initialized = false;
+        return;
+    }
     initialized = true;
     
     Serial.println("SH1106 Display initialized");
 }
 
+bool DisplayManager::probe(uint8_t address) {
+    Wire.beginTransmission(address);
+    return Wire.endTransmission() == 0;
+}
+
 void DisplayManager::update(const BatteryReading& reading, bool wifiConnected, int8_t rssi) {
     if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::MAIN;
+    request.reading = reading;
+    request.wifiConnected = wifiConnected;
+    request.rssi = rssi;
+    post(request);
+}
+
+void DisplayManager::showBootScreen(int bootCount) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::BOOT;
+    request.bootCount = bootCount;
+    post(request);
+}
+
+void DisplayManager::showOTAScreen(const char* message) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::OTA_MESSAGE;
+    strlcpy(request.message, message, sizeof(request.message));
+    post(request);
+}
+
+void DisplayManager::showOTAProgress(unsigned int progress, unsigned int total) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::OTA_PROGRESS;
+    request.progress = progress;
+    request.total = total;
+    post(request);
+}
+
+void DisplayManager::showOTAComplete() {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::OTA_COMPLETE;
+    post(request);
+}
+
+void DisplayManager::showOTAError(const char* error) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::OTA_ERROR;
+    strlcpy(request.message, error, sizeof(request.message));
+    post(request);
+}
+
+void DisplayManager::showSleepScreen(time_t wakeupTime, const BatteryReading& reading) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::SLEEP;
+    request.wakeupTime = wakeupTime;
+    request.reading = reading;
+    post(request);
+}
+
+void DisplayManager::showHistory(const VoltageHistory& history) {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::HISTORY;
+    request.history = history;
+    post(request);
+}
+
+void DisplayManager::clear() {
+    if (!initialized) return;
+    DisplayRequest request = {};
+    request.screen = DisplayScreen::CLEAR;
+    post(request);
+}
+
+bool DisplayManager::waitIdle(unsigned long timeoutMs) {
+    if (!initialized) return true;
+    
+    unsigned long start = millis();
+    for (;;) {
+        xSemaphoreTake(mailboxLock, portMAX_DELAY);
+        bool idle = !pending && !busy;
+        xSemaphoreGive(mailboxLock);
+        
+        if (idle) return true;
+        if (millis() - start >= timeoutMs) return false;
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
+
+void DisplayManager::post(const DisplayRequest& request) {
+    xSemaphoreTake(mailboxLock, portMAX_DELAY);
+    mailbox = request;  // Replaces a request the task hasn't drawn yet
+    pending = true;
+    xSemaphoreGive(mailboxLock);
+    xTaskNotifyGive(renderTask);
+}
+
+bool DisplayManager::takeRequest(DisplayRequest& request) {
+    xSemaphoreTake(mailboxLock, portMAX_DELAY);
+    bool found = pending;
+    if (found) {
+        request = mailbox;
+        pending = false;
+    }
+    busy = found;
+    xSemaphoreGive(mailboxLock);
+    return found;
+}
+
+void DisplayManager::renderTaskEntry(void* param) {
+    static_cast<DisplayManager*>(param)->renderLoop();
+}
+
+void DisplayManager::renderLoop() {
+    DisplayRequest request;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        while (takeRequest(request)) {
+            // Main screen refreshes are throttled; a newer request posted
+            // while we wait replaces this one
+            if (request.screen == DisplayScreen::MAIN) {
+                unsigned long since = millis() - lastUpdate;
+                if (since < DisplayConfig::UPDATE_INTERVAL &&
+                    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DisplayConfig::UPDATE_INTERVAL - since)) > 0) {
+                    xSemaphoreTake(mailboxLock, portMAX_DELAY);
+                    bool replaced = pending;
+                    xSemaphoreGive(mailboxLock);
+                    if (replaced) continue;
+                }
+            }
+            render(request);
+        }
+    }
+}
+
+void DisplayManager::render(const DisplayRequest& request) {
+    switch (request.screen) {
+        case DisplayScreen::CLEAR:
+            renderClear();
+            break;
+        case DisplayScreen::MAIN:
+            renderMain(request.reading, request.wifiConnected, request.rssi);
+            break;
+        case DisplayScreen::BOOT:
+            renderBootScreen(request.bootCount);
+            break;
+        case DisplayScreen::OTA_MESSAGE:
+            renderOTAScreen(request.message);
+            break;
+        case DisplayScreen::OTA_PROGRESS:
+            renderOTAProgress(request.progress, request.total);
+            break;
+        case DisplayScreen::OTA_COMPLETE:
+            renderOTAComplete();
+            break;
+        case DisplayScreen::OTA_ERROR:
+            renderOTAError(request.message);
+            break;
+        case DisplayScreen::SLEEP:
+            renderSleepScreen(request.wakeupTime, request.reading);
+            break;
+        case DisplayScreen::HISTORY:
+            renderHistory(request.history);
+            break;
+    }
+}
+
+void DisplayManager::renderMain(const BatteryReading& reading, bool wifiConnected, int8_t rssi) {
+    lastUpdate = millis();
     
-    // Throttle updates
-    unsigned long now = millis();
-    if (now - lastUpdate < DisplayConfig::UPDATE_INTERVAL) return;
-    lastUpdate = now;
-    
-    display.clearBuffer();
-    
-    // Title bar
-    display.setFont(u8g2_font_5x7_tr);
-    display.drawStr(0, 7, "Battery Monitor");
-    display.drawHLine(0, 9, 128);
+    // Start from the retained static chrome and draw only the live values
+    if (!chromeReady) {
+        buildChrome();
+    }
+    memcpy(display.getBufferPtr(), chrome, DisplayConfig::FRAME_BYTES);
+    otaPercentShown = -1;
     
     // Battery section
     display.setFont(u8g2_font_9x15_tr);
@@ -64,14 +303,12 @@ void DisplayManager::update(const BatteryReading& reading, bool wifiConnected, i
     display.drawStr(45, 42, BatteryMonitor::statusToString(reading.status));
     
     // Progress bar for percentage
-    display.drawFrame(5, 46, 118, 8);
     int barWidth = (int)((reading.percentage / 100.0) * 114);
     if (barWidth > 0) {
         display.drawBox(7, 48, barWidth, 4);
     }
     
     // WiFi section
-    display.drawHLine(0, 56, 128);
     display.setFont(u8g2_font_5x7_tr);
     
     if (wifiConnected) {
@@ -83,12 +320,68 @@ void DisplayManager::update(const BatteryReading& reading, bool wifiConnected, i
         display.drawStr(5, 63, "WiFi: Disconnected");
     }
     
-    display.sendBuffer();
+    sendChangedTiles();
 }
 
-void DisplayManager::showBootScreen(int bootCount) {
-    if (!initialized) return;
+void DisplayManager::buildChrome() {
+    display.clearBuffer();
+    
+    // Title bar
+    display.setFont(u8g2_font_5x7_tr);
+    display.drawStr(0, 7, "Battery Monitor");
+    display.drawHLine(0, 9, 128);
     
+    // Percentage bar frame and WiFi separator
+    display.drawFrame(5, 46, 118, 8);
+    display.drawHLine(0, 56, 128);
+    
+    memcpy(chrome, display.getBufferPtr(), DisplayConfig::FRAME_BYTES);
+    chromeReady = true;
+}
+
+void DisplayManager::sendChangedTiles() {
+    if (!shadowValid) {
+        sendFrame();
+        return;
+    }
+    
+    // The buffer is 8 pages of 128 columns; tile (tx, ty) is the 8 bytes
+    // at ty * 128 + tx * 8. Runs of changed tiles in a row go out together.
+    const uint8_t* buf = display.getBufferPtr();
+    unsigned long start = micros();
+    uint32_t sent = 0;
+    
+    for (uint8_t ty = 0; ty < DisplayConfig::TILE_ROWS; ty++) {
+        uint8_t tx = 0;
+        while (tx < DisplayConfig::TILE_COLS) {
+            uint16_t offset = ty * 128 + tx * 8;
+            if (memcmp(buf + offset, shadow + offset, 8) == 0) {
+                tx++;
+                continue;
+            }
+            uint8_t runStart = tx;
+            while (tx < DisplayConfig::TILE_COLS &&
+                   memcmp(buf + ty * 128 + tx * 8, shadow + ty * 128 + tx * 8, 8) != 0) {
+                tx++;
+            }
+            sendTiles(runStart, ty, tx - runStart, 1);
+            sent += (tx - runStart) * 8;
+        }
+    }
+    
+    uint32_t elapsed = micros() - start;
+    uint32_t saved = fullFrameMicros > elapsed ? fullFrameMicros - elapsed : 0;
+    stats.bytesSkipped += DisplayConfig::FRAME_BYTES - sent;
+    stats.savedMicros += saved;
+    
+    if (DisplayConfig::LOG_RENDER_STATS) {
+        Serial.printf("Display: sent %u/%u bytes, saved %u bytes / ~%u.%u ms\n",
+                      sent, DisplayConfig::FRAME_BYTES, DisplayConfig::FRAME_BYTES - sent,
+                      saved / 1000, (saved / 100) % 10);
+    }
+}
+
+void DisplayManager::renderBootScreen(int bootCount) {
     display.clearBuffer();
     
     display.setFont(u8g2_font_9x15_tr);
@@ -100,12 +393,10 @@ void DisplayManager::showBootScreen(int bootCount) {
     snprintf(buffer, sizeof(buffer), "Boot: %d", bootCount);
     display.drawStr(10, 55, buffer);
     
-    display.sendBuffer();
+    sendFrame();
 }
 
-void DisplayManager::showOTAScreen(const char* message) {
-    if (!initialized) return;
-    
+void DisplayManager::renderOTAScreen(const char* message) {
     display.clearBuffer();
     
     display.setFont(u8g2_font_9x15_tr);
@@ -114,46 +405,76 @@ void DisplayManager::showOTAScreen(const char* message) {
     display.setFont(u8g2_font_6x10_tr);
     display.drawStr(5, 40, message);
     
-    display.sendBuffer();
+    sendFrame();
 }
 
-void DisplayManager::showOTAProgress(unsigned int progress, unsigned int total) {
-    if (!initialized) return;
-    
-    display.clearBuffer();
-    
-    // Title
-    display.setFont(u8g2_font_9x15_tr);
-    display.drawStr(15, 15, "OTA Update");
+void DisplayManager::renderOTAProgress(unsigned int progress, unsigned int total) {
+    if (total == 0) return;
     
     // Calculate percentage
-    uint8_t percentage = (progress * 100) / total;
+    uint8_t percentage = (uint8_t)(((uint64_t)progress * 100) / total);
+    if (percentage > 100) percentage = 100;
+    
+    // Called for every received chunk; nothing to do until the number changes
+    if (percentage == otaPercentShown) return;
+    
+    bool fullFrame = otaPercentShown < 0;
+    
+    if (fullFrame) {
+        display.clearBuffer();
+        
+        // Title
+        display.setFont(u8g2_font_9x15_tr);
+        display.drawStr(15, 15, "OTA Update");
+        
+        // Progress bar frame
+        display.drawFrame(10, 42, 108, 12);
+        
+        // Status text
+        display.setFont(u8g2_font_6x10_tr);
+        display.drawStr(5, 63, "Downloading...");
+        otaBarShown = 0;
+    }
     
-    // Show percentage
+    // Percentage text, centered in tile rows 3-4 (y 24-39)
+    display.setDrawColor(0);
+    display.drawBox(0, 24, 128, 16);
+    display.setDrawColor(1);
     display.setFont(u8g2_font_9x15_tr);
     char percentStr[8];
     snprintf(percentStr, sizeof(percentStr), "%d%%", percentage);
-    // Center the percentage text
     int textWidth = strlen(percentStr) * 9;
     display.drawStr((128 - textWidth) / 2, 35, percentStr);
     
-    // Progress bar
-    display.drawFrame(10, 42, 108, 12);
-    int barWidth = (percentage * 104) / 100;
+    // Progress bar fill, tile rows 5-6 (y 40-55)
+    uint8_t barWidth = (percentage * 104) / 100;
+    display.setDrawColor(0);
+    display.drawBox(12, 44, 104, 8);
+    display.setDrawColor(1);
     if (barWidth > 0) {
         display.drawBox(12, 44, barWidth, 8);
     }
     
-    // Status text
-    display.setFont(u8g2_font_6x10_tr);
-    display.drawStr(5, 63, "Downloading...");
+    if (fullFrame) {
+        sendFrame();
+    } else {
+        // Text: the widest string ("100%") spans x 46-81, tiles 5-10
+        sendTiles(5, 3, 6, 2);
+        // Bar: only the tile columns between the old and new fill end
+        uint8_t from = 12 + (barWidth < otaBarShown ? barWidth : otaBarShown);
+        uint8_t to = 12 + (barWidth > otaBarShown ? barWidth : otaBarShown);
+        if (to > from) {
+            uint8_t firstTile = from / 8;
+            uint8_t lastTile = (to - 1) / 8;
+            sendTiles(firstTile, 5, lastTile - firstTile + 1, 2);
+        }
+    }
     
-    display.sendBuffer();
+    otaPercentShown = percentage;
+    otaBarShown = barWidth;
 }
 
-void DisplayManager::showOTAComplete() {
-    if (!initialized) return;
-    
+void DisplayManager::renderOTAComplete() {
     display.clearBuffer();
     
     display.setFont(u8g2_font_9x15_tr);
@@ -163,12 +484,10 @@ void DisplayManager::showOTAComplete() {
     display.setFont(u8g2_font_6x10_tr);
     display.drawStr(20, 55, "Rebooting...");
     
-    display.sendBuffer();
+    sendFrame();
 }
 
-void DisplayManager::showOTAError(const char* error) {
-    if (!initialized) return;
-    
+void DisplayManager::renderOTAError(const char* error) {
     display.clearBuffer();
     
     display.setFont(u8g2_font_9x15_tr);
@@ -178,12 +497,10 @@ void DisplayManager::showOTAError(const char* error) {
     // Wrap error message if too long
     display.drawStr(5, 35, error);
     
-    display.sendBuffer();
+    sendFrame();
 }
 
-void DisplayManager::showSleepScreen(time_t wakeupTime, const BatteryReading& reading) {
-    if (!initialized) return;
-    
+void DisplayManager::renderSleepScreen(time_t wakeupTime, const BatteryReading& reading) {
     display.clearBuffer();
  
     // Last battery reading info
@@ -231,12 +548,83 @@ void DisplayManager::showSleepScreen(time_t wakeupTime, const BatteryReading& re
     snprintf(nextReadingStr, sizeof(nextReadingStr), "Next reading at %s", timeStr);
     display.drawStr(5, 63, nextReadingStr);
     
-    display.sendBuffer();
+    sendFrame();
 }
 
-void DisplayManager::clear() {
-    if (!initialized) return;
+void DisplayManager::renderHistory(const VoltageHistory& history) {
+    historyPlot.update(history);
+    
+    display.clearBuffer();
+    otaPercentShown = -1;
+    
+    // Title bar
+    display.setFont(u8g2_font_5x7_tr);
+    display.drawStr(0, 7, "Voltage history");
+    char countStr[8];
+    snprintf(countStr, sizeof(countStr), "%u", history.count);
+    display.drawStr(128 - display.getStrWidth(countStr), 7, countStr);
+    display.drawHLine(0, 9, 128);
+    
+    if (history.count == 0) {
+        display.drawStr(5, 35, "No readings yet");
+        sendChangedTiles();
+        return;
+    }
+    
+    // Sparkline straight from the retained plot pages
+    uint8_t* buf = display.getBufferPtr();
+    for (uint8_t p = 0; p < DisplayConfig::HISTORY_PLOT_PAGES; p++) {
+        memcpy(buf + (DisplayConfig::HISTORY_PLOT_PAGE + p) * 128 + DisplayConfig::HISTORY_PLOT_X,
+               historyPlot.pages[p], HistoryConfig::SAMPLES);
+    }
+    uint8_t baseline = (DisplayConfig::HISTORY_PLOT_PAGE + DisplayConfig::HISTORY_PLOT_PAGES) * 8;
+    display.drawHLine(DisplayConfig::HISTORY_PLOT_X, baseline, HistoryConfig::SAMPLES);
+    
+    // Statistics
+    char line[32];
+    snprintf(line, sizeof(line), "min %.2f  max %.2f",
+             history.minVoltage(), history.maxVoltage());
+    display.drawStr(5, 55, line);
+    snprintf(line, sizeof(line), "avg %.2f  now %.2f", history.averageVoltage(),
+             VoltageHistory::dequantize(history.sampleAt(history.count - 1)));
+    display.drawStr(5, 63, line);
+    
+    sendChangedTiles();
+}
+
+void DisplayManager::renderClear() {
     display.clear();
+    otaPercentShown = -1;
+    shadowValid = false;
+}
+
+void DisplayManager::sendFrame() {
+    unsigned long start = micros();
+    display.sendBuffer();
+    fullFrameMicros = micros() - start;
+    stats.frames++;
+    stats.bytesSent += DisplayConfig::FRAME_BYTES;
+    stats.busyMicros += fullFrameMicros;
+    
+    memcpy(shadow, display.getBufferPtr(), DisplayConfig::FRAME_BYTES);
+    shadowValid = true;
+    
+    // Any full frame replaces the OTA progress screen
+    otaPercentShown = -1;
+}
+
+void DisplayManager::sendTiles(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+    unsigned long start = micros();
+    display.updateDisplayArea(tx, ty, tw, th);
+    stats.frames++;
+    stats.bytesSent += (uint32_t)tw * th * 8;
+    stats.busyMicros += micros() - start;
+    
+    // Keep the shadow in step with what the panel shows
+    const uint8_t* buf = display.getBufferPtr();
+    for (uint8_t row = ty; row < ty + th; row++) {
+        memcpy(shadow + row * 128 + tx * 8, buf + row * 128 + tx * 8, tw * 8);
+    }
 }
 
 void DisplayManager::drawBatteryIcon(uint8_t x, uint8_t y, float percentage) {
@@ -274,3 +662,5 @@ int8_t DisplayManager::getWiFiSignalBars(int8_t rssi) {
     if (rssi >= -80) return 1;      // Weak
     return 0;                        // Very weak
 }
+
+#endif // DISPLAY_HEADLESS
@@ -3,15 +3,24 @@
  * 
  * Manages SH1106 OLED display for battery monitoring
  * Displays battery info and WiFi signal strength
+ *
+ * Build with -D DISPLAY_HEADLESS to leave out U8g2 and the render task
+ * entirely; every call is then a no-op and isReady() is always false.
  */
 
 #ifndef DISPLAY_MANAGER_H
 #define DISPLAY_MANAGER_H
 
 #include <Arduino.h>
+#ifndef DISPLAY_HEADLESS
 #include <U8g2lib.h>
 #include <Wire.h>
+#endif
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "battery_monitor.h"
+#include "voltage_history.h"
 
 // Display configuration
 namespace DisplayConfig {
@@ -19,8 +28,59 @@ namespace DisplayConfig {
     const uint8_t I2C_SCL = 22;      // Default SCL pin
     const uint8_t I2C_ADDRESS = 0x3C; // Default SH1106 I2C address
     const unsigned long UPDATE_INTERVAL = 1000; // Update display every 1 second
+    const uint16_t FRAME_BYTES = 1024;          // Full 128x64 frame buffer
+    const uint8_t TILE_COLS = 16;               // 8x8 tiles per row
+    const uint8_t TILE_ROWS = 8;
+    const bool LOG_RENDER_STATS = true;         // Print bytes/time saved per update()
+    const uint32_t TASK_STACK = 4096;           // Render task stack (bytes)
+    const UBaseType_t TASK_PRIORITY = 1;        // Same as loop(), below WiFi/lwIP
+    const unsigned long FINAL_FRAME_TIMEOUT_MS = 500; // Max wait for the last frame before sleep/reboot
+    const uint16_t PROBE_TIMEOUT_MS = 10;       // I2C presence probe timeout
+    const uint8_t HISTORY_PLOT_X = 4;           // Left edge of the sparkline
+    const uint8_t HISTORY_PLOT_PAGE = 2;        // First 8-pixel page of the sparkline (y 16)
+    const uint8_t HISTORY_PLOT_PAGES = HistoryConfig::PLOT_PAGES;
 }
 
+// I2C traffic counters, used to measure what rendering costs during OTA
+struct DisplayStats {
+    uint32_t frames;      // sendBuffer / updateDisplayArea calls
+    uint32_t bytesSent;   // Frame buffer bytes pushed over I2C
+    uint32_t busyMicros;  // Time spent transmitting
+    uint32_t bytesSkipped;  // Unchanged tiles not sent by update()
+    uint32_t savedMicros;   // Estimated transfer time saved by skipping them
+};
+
+// Screens the render task can draw
+enum class DisplayScreen : uint8_t {
+    CLEAR,
+    MAIN,
+    BOOT,
+    OTA_MESSAGE,
+    OTA_PROGRESS,
+    OTA_COMPLETE,
+    OTA_ERROR,
+    SLEEP,
+    HISTORY
+};
+
+// Everything needed to draw one screen; only the latest one is kept
+struct DisplayRequest {
+    DisplayScreen screen;
+    BatteryReading reading;
+    bool wifiConnected;
+    int8_t rssi;
+    int bootCount;
+    time_t wakeupTime;
+    unsigned int progress;
+    unsigned int total;
+    char message[32];
+    VoltageHistory history;  // Snapshot, so the task never reads RTC data being written
+};
+
+// Rendering runs in its own low-priority task. The show*/update calls only
+// post the requested screen to a single-slot mailbox (a newer post replaces
+// one not drawn yet) and return immediately; waitIdle() blocks until the
+// latest screen is on the panel.
 class DisplayManager {
 public:
     DisplayManager();
@@ -29,7 +89,7 @@ public:
     void begin(uint8_t sda = DisplayConfig::I2C_SDA, 
                uint8_t scl = DisplayConfig::I2C_SCL);
     
-    // Update display with battery and network info
+    // Update display with battery and network info (at most once per UPDATE_INTERVAL)
     void update(const BatteryReading& reading, bool wifiConnected, int8_t rssi);
     
     // Display individual screens
@@ -39,22 +99,80 @@ public:
     void showOTAComplete();
     void showOTAError(const char* error);
     void showSleepScreen(time_t wakeupTime, const BatteryReading& reading);
+    void showHistory(const VoltageHistory& history);
     
     // Clear display
     void clear();
     
+    // Wait until the last posted screen has been sent; false on timeout
+    bool waitIdle(unsigned long timeoutMs);
+    
     // Check if display is ready
     bool isReady() const { return initialized; }
     
+    // Rendering cost counters
+    const DisplayStats& getStats() const { return stats; }
+    void resetStats() { stats = DisplayStats(); }
+    
 private:
-    U8G2_SH1106_128X64_NONAME_F_HW_I2C display;
     bool initialized;
-    unsigned long lastUpdate;
+    DisplayStats stats;
+    
+#ifndef DISPLAY_HEADLESS
+    U8G2_SH1106_128X64_NONAME_F_HW_I2C display;
+    unsigned long lastUpdate;  // Last main screen render
+    
+    // Single address-only transaction; true if the panel ACKs
+    static bool probe(uint8_t address);
+    
+    // Single-slot mailbox between the posting code and the render task
+    SemaphoreHandle_t mailboxLock;
+    TaskHandle_t renderTask;
+    DisplayRequest mailbox;
+    bool pending;  // mailbox holds a request not taken yet
+    bool busy;     // render task is drawing or has more to draw
+    
+    void post(const DisplayRequest& request);
+    bool takeRequest(DisplayRequest& request);
+    static void renderTaskEntry(void* param);
+    void renderLoop();
+    void render(const DisplayRequest& request);
+    
+    // Drawing, only called from the render task
+    void renderMain(const BatteryReading& reading, bool wifiConnected, int8_t rssi);
+    void renderBootScreen(int bootCount);
+    void renderOTAScreen(const char* message);
+    void renderOTAProgress(unsigned int progress, unsigned int total);
+    void renderOTAComplete();
+    void renderOTAError(const char* error);
+    void renderSleepScreen(time_t wakeupTime, const BatteryReading& reading);
+    void renderHistory(const VoltageHistory& history);
+    void renderClear();
+    
+    // Percentage currently on the OTA progress screen (-1 = not shown)
+    int16_t otaPercentShown;
+    uint8_t otaBarShown;
+    
+    // What the panel currently shows, and the static chrome of the main
+    // screen (title, separators, frames), so update() only sends changed tiles
+    uint8_t shadow[DisplayConfig::FRAME_BYTES];
+    uint8_t chrome[DisplayConfig::FRAME_BYTES];
+    bool shadowValid;
+    bool chromeReady;
+    uint32_t fullFrameMicros;  // Last measured sendBuffer() time
+    
+    void buildChrome();
+    void sendChangedTiles();
+    
+    // Transmit the whole frame / only the given tile rectangle
+    void sendFrame();
+    void sendTiles(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
     
     // Helper functions
     void drawBatteryIcon(uint8_t x, uint8_t y, float percentage);
     void drawWiFiIcon(uint8_t x, uint8_t y, int8_t rssi);
     int8_t getWiFiSignalBars(int8_t rssi);
+#endif // DISPLAY_HEADLESS
 };
 
 #endif // DISPLAY_MANAGER_H
@@ -0,0 +1,98 @@
+#include "flash_region.h"
+#include <string.h>
+
+namespace FlashLog {
+
+using FlashLogConfig::SECTOR_SIZE;
+
+bool FileFlash::open(const char* path, uint32_t size) {
+    close();
+    if (size == 0 || size % SECTOR_SIZE != 0) {
+        return false;
+    }
+
+    file = fopen(path, "r+b");
+    long existing = -1;
+    if (file != nullptr && fseek(file, 0, SEEK_END) == 0) {
+        existing = ftell(file);
+    }
+    if (existing != static_cast<long>(size)) {
+        if (file != nullptr) {
+            fclose(file);
+        }
+        file = fopen(path, "w+b");
+        if (file == nullptr) {
+            return false;
+        }
+        uint8_t blank[SECTOR_SIZE];
+        memset(blank, 0xFF, sizeof(blank));
+        for (uint32_t offset = 0; offset < size; offset += SECTOR_SIZE) {
+            if (fwrite(blank, 1, sizeof(blank), file) != sizeof(blank)) {
+                close();
+                return false;
+            }
+        }
+    }
+
+    bytes = size;
+    erases.assign(size / SECTOR_SIZE, 0);
+    return true;
+}
+
+void FileFlash::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+    bytes = 0;
+}
+
+bool FileFlash::read(uint32_t offset, void* buf, size_t len) {
+    reads++;
+    if (file == nullptr || offset > bytes || len > bytes - offset) {
+        return false;
+    }
+    return fseek(file, offset, SEEK_SET) == 0 && fread(buf, 1, len, file) == len;
+}
+
+bool FileFlash::write(uint32_t offset, const void* data, size_t len) {
+    if (file == nullptr || offset > bytes || len > bytes - offset || budget == 0) {
+        return false;
+    }
+
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        if (budget == 0) {
+            return false;  // Power cut part-way through
+        }
+        uint8_t current;
+        if (fseek(file, offset + i, SEEK_SET) != 0 || fread(&current, 1, 1, file) != 1) {
+            return false;
+        }
+        uint8_t programmed = current & in[i];  // NOR flash only clears bits
+        if (fseek(file, offset + i, SEEK_SET) != 0 || fwrite(&programmed, 1, 1, file) != 1) {
+            return false;
+        }
+        if (budget > 0) {
+            budget--;
+        }
+    }
+    fflush(file);
+    return true;
+}
+
+bool FileFlash::eraseSector(uint32_t offset) {
+    if (file == nullptr || offset % SECTOR_SIZE != 0 || offset >= bytes || budget == 0) {
+        return false;
+    }
+    uint8_t blank[SECTOR_SIZE];
+    memset(blank, 0xFF, sizeof(blank));
+    if (fseek(file, offset, SEEK_SET) != 0 || fwrite(blank, 1, sizeof(blank), file) != sizeof(blank)) {
+        return false;
+    }
+    fflush(file);
+    erases[offset / SECTOR_SIZE]++;
+    return true;
+}
+
+} // namespace FlashLog
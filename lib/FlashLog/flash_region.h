@@ -0,0 +1,67 @@
+/*
+ * Flash Region
+ *
+ * The storage under the reading log: a byte-addressed area with NOR flash
+ * rules. Erasing a sector sets all its bytes to 0xFF, and a write can only
+ * clear bits, so each byte is written once between erases.
+ *
+ * FileFlash emulates a region in a file for host tests. It keeps those
+ * rules, counts erases per sector and can cut the power after a number of
+ * programmed bytes, so interrupted writes can be replayed on the host.
+ */
+
+#ifndef FLASH_REGION_H
+#define FLASH_REGION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+
+namespace FlashLogConfig {
+    constexpr uint32_t SECTOR_SIZE = 4096;   // ESP32 flash erase unit
+}
+
+namespace FlashLog {
+
+class FlashRegion {
+public:
+    virtual ~FlashRegion() {}
+    virtual uint32_t size() const = 0;       // Bytes, a multiple of SECTOR_SIZE
+    virtual bool read(uint32_t offset, void* buf, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void* data, size_t len) = 0;
+    virtual bool eraseSector(uint32_t offset) = 0;  // offset is sector aligned
+};
+
+class FileFlash : public FlashRegion {
+public:
+    FileFlash() : reads(0), file(nullptr), bytes(0), budget(-1) {}
+    ~FileFlash() override { close(); }
+
+    // Opens the region in path; a missing file or one of another size is
+    // replaced by an erased region of size bytes
+    bool open(const char* path, uint32_t size);
+    void close();
+
+    // Power fails after this many more programmed bytes (-1 = never): the
+    // write in progress stops part-way and later writes and erases fail
+    void cutPowerAfter(int32_t programmedBytes) { budget = programmedBytes; }
+
+    uint32_t size() const override { return bytes; }
+    bool read(uint32_t offset, void* buf, size_t len) override;
+    bool write(uint32_t offset, const void* data, size_t len) override;
+    bool eraseSector(uint32_t offset) override;
+
+    uint32_t erasesOf(uint32_t sector) const { return sector < erases.size() ? erases[sector] : 0; }
+    uint32_t reads;          // read() calls, to check what a query touches
+
+private:
+    FILE* file;
+    uint32_t bytes;
+    int32_t budget;
+    std::vector<uint32_t> erases;  // Since open()
+};
+
+} // namespace FlashLog
+
+#endif // FLASH_REGION_H
@@ -0,0 +1,142 @@
+#include "history_query.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+namespace FlashLog {
+
+using FlashLogConfig::HISTORY_MAX_READINGS;
+using FlashLogConfig::HISTORY_MAX_PACKED;
+using FlashLogConfig::HISTORY_REQUEST_MAX;
+
+namespace {
+    // Unsigned decimal; advances p past it
+    bool parseNumber(const char*& p, uint32_t& value) {
+        if (!isdigit(static_cast<unsigned char>(*p))) {
+            return false;
+        }
+        char* end;
+        unsigned long long v = strtoull(p, &end, 10);
+        if (v > 0xFFFFFFFEull) {
+            return false;
+        }
+        value = static_cast<uint32_t>(v);
+        p = end;
+        return true;
+    }
+
+    void skipSpaces(const char*& p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        }
+    }
+
+    size_t writeJson(ReadingLog& log, const HistoryRequest& request, PayloadWriter& write) {
+        size_t length = 0;
+        char text[64];
+        auto emit = [&](int n) {
+            write(reinterpret_cast<const uint8_t*>(text), n);
+            length += n;
+        };
+
+        emit(snprintf(text, sizeof(text), "{\"from\":%lu,\"to\":%lu,\"readings\":[",
+                      (unsigned long)request.from, (unsigned long)request.to));
+
+        size_t count = 0;
+        uint32_t next = 0;
+        log.query(request.from, request.to, [&](const LogRecord& record) {
+            if (count == HISTORY_MAX_READINGS) {
+                next = record.time;
+                return false;
+            }
+            emit(snprintf(text, sizeof(text), "%s[%lu,%u,%u,%u]", count > 0 ? "," : "",
+                          (unsigned long)record.time, record.millivolts, record.percentage, record.status));
+            count++;
+            return true;
+        });
+
+        if (next != 0) {
+            emit(snprintf(text, sizeof(text), "],\"count\":%u,\"next\":%lu}", (unsigned)count, (unsigned long)next));
+        } else {
+            emit(snprintf(text, sizeof(text), "],\"count\":%u}", (unsigned)count));
+        }
+        return length;
+    }
+
+    size_t writePacked(ReadingLog& log, const HistoryRequest& request, PayloadWriter& write) {
+        size_t length = 0;
+        uint8_t data[SeriesCodecConfig::MAX_SAMPLE_BYTES];
+        auto emit = [&](size_t n) {
+            write(data, n);
+            length += n;
+        };
+
+        data[0] = FlashLogConfig::HISTORY_PACKED_VERSION;
+        emit(1);
+
+        SeriesCodec::Encoder encoder;
+        uint32_t count = 0;
+        uint32_t next = 0;
+        log.query(request.from, request.to, [&](const LogRecord& record) {
+            if (count == HISTORY_MAX_PACKED) {
+                next = record.time;
+                return false;
+            }
+            emit(encoder.encode(record, data));
+            count++;
+            return true;
+        });
+
+        data[0] = SeriesCodecConfig::END;
+        size_t n = 1;
+        n += SeriesCodec::putVarint(data + n, count);
+        n += SeriesCodec::putVarint(data + n, next);
+        emit(n);
+        return length;
+    }
+}
+
+bool parseHistoryRequest(const char* text, size_t len, uint32_t now, HistoryRequest& out) {
+    char buf[HISTORY_REQUEST_MAX + 1];
+    if (len > HISTORY_REQUEST_MAX) {
+        return false;
+    }
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+
+    const char* p = buf;
+    skipSpaces(p);
+    if (*p == '-') {
+        p++;
+        uint32_t seconds;
+        if (!parseNumber(p, seconds)) {
+            return false;
+        }
+        out.from = seconds < now ? now - seconds : 0;
+        out.to = now;
+        skipSpaces(p);
+    } else {
+        if (!parseNumber(p, out.from)) {
+            return false;
+        }
+        skipSpaces(p);
+        out.to = now;
+        if (isdigit(static_cast<unsigned char>(*p)) && !parseNumber(p, out.to)) {
+            return false;
+        }
+        skipSpaces(p);
+    }
+    out.packed = strncmp(p, "packed", 6) == 0;
+    if (out.packed) {
+        p += 6;
+        skipSpaces(p);
+    }
+    return *p == '\0' && out.from <= out.to;
+}
+
+size_t writeHistoryResponse(ReadingLog& log, const HistoryRequest& request, PayloadWriter write) {
+    return request.packed ? writePacked(log, request, write) : writeJson(log, request, write);
+}
+
+} // namespace FlashLog
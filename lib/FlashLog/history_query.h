@@ -0,0 +1,58 @@
+/*
+ * History Query
+ *
+ * Request and response of the MQTT history command.
+ *
+ * A request is "<from> [<to>]" in Unix seconds, where to defaults to now.
+ * "-<seconds>" asks for the last seconds up to now. Either may be followed
+ * by "packed" for the compact binary response.
+ *
+ * The response is one JSON payload, readings oldest first:
+ *   {"from":F,"to":T,"readings":[[time,millivolts,percentage,status],...],
+ *    "count":N,"next":X}
+ * status is the BatteryStatus number (0 = FULL ... 4 = DEAD). At most
+ * HISTORY_MAX_READINGS readings go in one response. When more match,
+ * "next" is the from of the request that fetches the rest; otherwise it
+ * is left out.
+ *
+ * The packed response holds up to HISTORY_MAX_PACKED readings in a
+ * fraction of the bytes:
+ *   0x01 (version), the readings as one SeriesCodec stream, 0xFF,
+ *   count (varint), next (varint, 0 = nothing more)
+ */
+
+#ifndef HISTORY_QUERY_H
+#define HISTORY_QUERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "reading_log.h"
+
+namespace FlashLogConfig {
+    constexpr size_t HISTORY_MAX_READINGS = 300;  // About 7 KB of JSON
+    constexpr size_t HISTORY_MAX_PACKED = 2000;   // About 4 KB for a steady battery
+    constexpr uint8_t HISTORY_PACKED_VERSION = 1;
+    constexpr size_t HISTORY_REQUEST_MAX = 48;
+}
+
+namespace FlashLog {
+
+struct HistoryRequest {
+    uint32_t from;
+    uint32_t to;
+    bool packed;
+};
+
+bool parseHistoryRequest(const char* text, size_t len, uint32_t now, HistoryRequest& out);
+
+using PayloadWriter = std::function<void(const uint8_t* data, size_t len)>;
+
+// Writes the response through write and returns its length. Run it once
+// with a writer that discards the data to size a streamed publish, then
+// again to send it.
+size_t writeHistoryResponse(ReadingLog& log, const HistoryRequest& request, PayloadWriter write);
+
+} // namespace FlashLog
+
+#endif // HISTORY_QUERY_H
@@ -0,0 +1,266 @@
+#include "reading_log.h"
+#include <string.h>
+
+namespace FlashLog {
+
+using namespace FlashLogConfig;
+using SeriesCodec::Decoder;
+using SeriesCodecConfig::MAX_SAMPLE_BYTES;
+
+namespace {
+    const uint32_t UNUSED = 0xFFFFFFFF;  // Erased flash
+
+    // Header fields
+    const size_t SEQUENCE = 4;
+    const size_t FIRST_TIME = 8;
+    const size_t ERASES = 12;
+    const size_t RECORDS = 16;
+
+    void put32(uint8_t* p, uint32_t v) {
+        p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    }
+
+    uint32_t get32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+}
+
+bool ReadingLog::readStream(uint32_t sector, size_t len) {
+    return flash.read(sector * SECTOR_SIZE + HEADER_SIZE, stream, len);
+}
+
+uint32_t ReadingLog::countRecords(uint32_t sector) {
+    uint32_t count = 0;
+    if (readStream(sector, STREAM_SIZE)) {
+        Decoder decoder(stream, STREAM_SIZE);
+        LogRecord record;
+        while (decoder.next(record)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool ReadingLog::mount() {
+    isMounted = false;
+    sectorCount = flash.size() / SECTOR_SIZE;
+    if (sectorCount > MAX_SECTORS) {
+        sectorCount = MAX_SECTORS;
+    }
+    if (sectorCount < 2) {
+        return false;  // Reusing the oldest sector needs another one to keep
+    }
+
+    head = -1;
+    headUsed = 0;
+    headRecords = 0;
+    sequence = 0;
+    newest = 0;
+    encoder.reset();
+    bool headClosed = false;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        uint8_t header[HEADER_SIZE];
+        firstTimes[s] = UNUSED;
+        if (!flash.read(s * SECTOR_SIZE, header, sizeof(header)) || get32(header) != MAGIC) {
+            continue;
+        }
+        uint32_t seq = get32(header + SEQUENCE);
+        firstTimes[s] = get32(header + FIRST_TIME);
+        if (head < 0 || seq > sequence) {
+            head = s;
+            sequence = seq;
+            headClosed = get32(header + RECORDS) != UNUSED;
+        }
+    }
+
+    if (head >= 0) {
+        // Decode the head sector to continue its stream
+        newest = firstTimes[head];
+        if (readStream(head, STREAM_SIZE)) {
+            Decoder decoder(stream, STREAM_SIZE);
+            LogRecord record;
+            while (decoder.next(record)) {
+                headRecords++;
+                newest = record.time;
+            }
+            headUsed = decoder.position();
+            encoder.resume(decoder.getState());
+            if (decoder.malformed() && !headClosed) {
+                closeHead();  // Cut short by a reset: nothing more goes here
+            }
+            if (decoder.malformed() || headClosed) {
+                headUsed = STREAM_SIZE;
+            }
+        } else {
+            headUsed = STREAM_SIZE;
+        }
+    }
+
+    isMounted = true;
+    return true;
+}
+
+void ReadingLog::closeHead() {
+    uint8_t count[4];
+    put32(count, headRecords);
+    flash.write(head * SECTOR_SIZE + RECORDS, count, sizeof(count));
+}
+
+bool ReadingLog::openSector(uint32_t sector, uint32_t firstTime) {
+    uint32_t offset = sector * SECTOR_SIZE;
+    uint8_t header[HEADER_SIZE];
+    uint32_t erases = 1;
+    if (flash.read(offset, header, sizeof(header)) && get32(header) == MAGIC && get32(header + ERASES) != UNUSED) {
+        erases = get32(header + ERASES) + 1;
+    }
+
+    firstTimes[sector] = UNUSED;
+    if (!flash.eraseSector(offset)) {
+        return false;
+    }
+
+    // The magic goes in last: a header cut short by a reset does not count.
+    // The record count stays erased until the sector is closed.
+    put32(header, MAGIC);
+    put32(header + SEQUENCE, sequence + 1);
+    put32(header + FIRST_TIME, firstTime);
+    put32(header + ERASES, erases);
+    if (!flash.write(offset + SEQUENCE, header + SEQUENCE, RECORDS - SEQUENCE) || !flash.write(offset, header, 4)) {
+        return false;
+    }
+
+    sequence++;
+    head = sector;
+    headUsed = 0;
+    headRecords = 0;
+    firstTimes[sector] = firstTime;
+    encoder.reset();
+    return true;
+}
+
+bool ReadingLog::append(const LogRecord& record) {
+    if (!isMounted || record.time == 0 || record.time == UNUSED || record.status > 0x7F) {
+        return false;
+    }
+
+    uint8_t raw[MAX_SAMPLE_BYTES];
+    size_t n = 0;
+    if (head >= 0 && headUsed < STREAM_SIZE) {
+        SeriesCodec::SeriesState before = encoder.getState();
+        n = encoder.encode(record, raw);
+        if (headUsed + n > STREAM_SIZE) {
+            encoder.resume(before);
+            n = 0;
+        }
+    }
+    if (n == 0) {
+        if (head >= 0) {
+            closeHead();
+        }
+        uint32_t next = head < 0 ? 0 : (head + 1) % sectorCount;
+        if (!openSector(next, record.time)) {
+            return false;
+        }
+        n = encoder.encode(record, raw);
+    }
+
+    bool ok = flash.write(head * SECTOR_SIZE + HEADER_SIZE + headUsed, raw, n);
+    if (!ok) {
+        headUsed = STREAM_SIZE;  // The stream may end in a partial reading; start a new sector
+        return false;
+    }
+    headUsed += n;
+    headRecords++;
+    newest = record.time;
+    return true;
+}
+
+size_t ReadingLog::query(uint32_t from, uint32_t to, Visitor visit) {
+    size_t visited = 0;
+    if (!isMounted || head < 0 || from > to) {
+        return 0;
+    }
+
+    // Oldest first: the sector after the head, around the ring to the head
+    for (uint32_t i = 1; i <= sectorCount; i++) {
+        uint32_t s = (head + i) % sectorCount;
+        if (firstTimes[s] == UNUSED) {
+            continue;
+        }
+        if (firstTimes[s] > to) {
+            break;
+        }
+        if (static_cast<int32_t>(s) != head) {
+            // All records here are older than the next sector's first one
+            uint32_t next = (s + 1) % sectorCount;
+            while (firstTimes[next] == UNUSED && static_cast<int32_t>(next) != head) {
+                next = (next + 1) % sectorCount;
+            }
+            if (firstTimes[next] != UNUSED && firstTimes[next] < from) {
+                continue;
+            }
+        }
+
+        size_t len = static_cast<int32_t>(s) == head ? headUsed : STREAM_SIZE;
+        if (!readStream(s, len)) {
+            return visited;
+        }
+        Decoder decoder(stream, len);
+        LogRecord record;
+        while (decoder.next(record)) {
+            if (record.time < from) {
+                continue;
+            }
+            if (record.time > to) {
+                return visited;
+            }
+            visited++;
+            if (!visit(record)) {
+                return visited;
+            }
+        }
+    }
+    return visited;
+}
+
+LogStats ReadingLog::stats() {
+    LogStats out;
+    memset(&out, 0, sizeof(out));
+    out.sectors = sectorCount;
+    if (!isMounted || head < 0) {
+        return out;
+    }
+
+    for (uint32_t i = 1; i <= sectorCount; i++) {
+        uint32_t s = (head + i) % sectorCount;
+        if (firstTimes[s] == UNUSED) {
+            continue;
+        }
+        uint8_t header[HEADER_SIZE];
+        if (!flash.read(s * SECTOR_SIZE, header, sizeof(header))) {
+            continue;
+        }
+        uint32_t erases = get32(header + ERASES);
+        if (out.usedSectors == 0) {
+            out.oldest = firstTimes[s];
+            out.minErases = erases;
+        }
+        out.usedSectors++;
+        if (static_cast<int32_t>(s) == head) {
+            out.records += headRecords;
+        } else {
+            uint32_t records = get32(header + RECORDS);
+            out.records += records != UNUSED ? records : countRecords(s);
+        }
+        if (erases < out.minErases) {
+            out.minErases = erases;
+        }
+        if (erases > out.maxErases) {
+            out.maxErases = erases;
+        }
+    }
+    out.newest = newest;
+    return out;
+}
+
+} // namespace FlashLog
@@ -0,0 +1,100 @@
+/*
+ * Reading Log
+ *
+ * Append-only log of readings in a flash region, so readings taken while
+ * the broker is unreachable can still be fetched later. The region is a
+ * ring of sectors filled in order. Once it is full the oldest sector is
+ * erased and reused, so every sector is erased once per lap and none
+ * wears out ahead of the others.
+ *
+ * Sector layout (little-endian):
+ *   header   magic, sequence (counts up per sector opened), time of the
+ *            first reading, times this sector was erased, and the number
+ *            of readings, written when the sector is closed    20 bytes
+ *   stream   the readings, compressed with SeriesCodec (one or two bytes
+ *            each for a steady battery); ends at the first erased byte
+ * Each sector starts its stream afresh, so it decodes on its own after
+ * older sectors were reused.
+ *
+ * The first-reading times are the time index: mount() reads only the
+ * sector headers and keeps those times in RAM, and a range query reads
+ * only the sectors that can hold matching readings. Readings are expected
+ * in time order (the caller skips readings taken before the clock was
+ * set). A reading cut short by a reset decodes as malformed, so the
+ * stream ends before it and the sector is closed.
+ */
+
+#ifndef READING_LOG_H
+#define READING_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "flash_region.h"
+#include "series_codec.h"
+
+namespace FlashLogConfig {
+    constexpr uint32_t MAGIC = 0x32474F4C;   // "LOG2" (LOG1 sectors held 9-byte records)
+    constexpr size_t HEADER_SIZE = 20;
+    constexpr size_t STREAM_SIZE = SECTOR_SIZE - HEADER_SIZE;
+    constexpr uint32_t MAX_SECTORS = 512;    // Time index entries (a 2 MB region)
+}
+
+namespace FlashLog {
+
+using LogRecord = SeriesCodec::Sample;
+
+struct LogStats {
+    uint32_t sectors;
+    uint32_t usedSectors;
+    uint32_t records;
+    uint32_t oldest;         // Time of the first record (0 = empty)
+    uint32_t newest;
+    uint32_t minErases;      // Over the used sectors
+    uint32_t maxErases;
+};
+
+class ReadingLog {
+public:
+    using Visitor = std::function<bool(const LogRecord& record)>;  // false = stop
+
+    explicit ReadingLog(FlashRegion& flash) : flash(flash), sectorCount(0), head(-1), headUsed(0),
+                                              headRecords(0), sequence(0), newest(0), isMounted(false) {}
+
+    // Reads the sector headers and the head sector's stream to find where
+    // to append; false if the region is too small for a log
+    bool mount();
+    bool mounted() const { return isMounted; }
+
+    // time must be set (not 0 or 0xFFFFFFFF), status below 128
+    bool append(const LogRecord& record);
+
+    // Visits the records with from <= time <= to, oldest first; returns
+    // how many were visited
+    size_t query(uint32_t from, uint32_t to, Visitor visit);
+
+    LogStats stats();
+
+private:
+    FlashRegion& flash;
+    uint32_t firstTimes[FlashLogConfig::MAX_SECTORS];  // Per sector, UNUSED if it holds no records
+    uint32_t sectorCount;
+    int32_t head;            // Sector being filled (-1 = empty log)
+    uint32_t headUsed;       // Stream bytes used in the head sector
+    uint32_t headRecords;
+    uint32_t sequence;       // Of the head sector
+    uint32_t newest;
+    bool isMounted;
+    SeriesCodec::Encoder encoder;  // Continues the head sector's stream
+    uint8_t stream[FlashLogConfig::STREAM_SIZE];  // One sector's stream while decoding it
+
+    bool openSector(uint32_t sector, uint32_t firstTime);
+    void closeHead();
+    // Reads len bytes of a sector's stream into stream[]; false on a read error
+    bool readStream(uint32_t sector, size_t len);
+    uint32_t countRecords(uint32_t sector);  // For a sector that was never closed
+};
+
+} // namespace FlashLog
+
+#endif // READING_LOG_H
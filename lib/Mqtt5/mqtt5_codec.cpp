@@ -0,0 +1,521 @@
+/*
+ * MQTT 5 Packet Codec Implementation
+ */
+
+#include "mqtt5_codec.h"
+#include <string.h>
+
+namespace Mqtt5 {
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+namespace {
+
+// Bounded big-endian writer; any overflow makes the packet invalid
+class Writer {
+public:
+    Writer(uint8_t* buf, size_t cap) : buf(buf), cap(cap), len(0), overflow(false) {}
+
+    void u8(uint8_t v) {
+        if (len < cap) buf[len++] = v;
+        else overflow = true;
+    }
+    void u16(uint16_t v) { u8(v >> 8); u8(v & 0xFF); }
+    void u32(uint32_t v) { u16(v >> 16); u16(v & 0xFFFF); }
+    void varint(uint32_t v) {
+        do {
+            uint8_t b = v & 0x7F;
+            v >>= 7;
+            u8(v > 0 ? (b | 0x80) : b);
+        } while (v > 0);
+    }
+    void bytes(const void* data, size_t n) {
+        if (n == 0) return;
+        if (len > cap || n > cap - len) { overflow = true; return; }
+        memcpy(buf + len, data, n);
+        len += n;
+    }
+    void str(const char* s) {
+        size_t n = s ? strlen(s) : 0;
+        u16((uint16_t)n);
+        bytes(s, n);
+    }
+    void bin(const void* data, size_t n) {
+        u16((uint16_t)n);
+        bytes(data, n);
+    }
+
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+};
+
+size_t varintSize(uint32_t v) {
+    return v < 128 ? 1 : v < 16384 ? 2 : v < 2097152 ? 3 : 4;
+}
+
+// Packets are built as [fixed header][body]. The body is written first at
+// a 5-byte offset (the largest header), then the header is placed in front.
+const size_t HEADER_RESERVE = 5;
+
+// streamedLen counts bytes the caller sends after the packet (a streamed payload)
+size_t finish(uint8_t* buf, size_t cap, uint8_t firstByte, const Writer& body, size_t streamedLen = 0) {
+    if (body.overflow) {
+        return 0;
+    }
+    size_t bodyLen = body.len - HEADER_RESERVE;
+    size_t headerLen = 1 + varintSize(bodyLen + streamedLen);
+    size_t start = HEADER_RESERVE - headerLen;
+    Writer header(buf + start, cap - start);
+    header.u8(firstByte);
+    header.varint(bodyLen + streamedLen);
+    memmove(buf, buf + start, headerLen + bodyLen);
+    return headerLen + bodyLen;
+}
+
+bool hasText(const char* s) {
+    return s != nullptr && s[0] != '\0';
+}
+
+} // namespace
+
+size_t encodeConnect(uint8_t* buf, size_t cap, const ConnectOptions& options) {
+    if (cap < HEADER_RESERVE) return 0;
+    Writer w(buf, cap);
+    w.len = HEADER_RESERVE;
+
+    // Variable header
+    w.str("MQTT");
+    w.u8(5);  // Protocol version
+    uint8_t flags = 0;
+    if (options.cleanStart) flags |= 0x02;
+    if (hasText(options.willTopic)) {
+        flags |= 0x04 | ((options.willQos & 0x03) << 3);
+        if (options.willRetain) flags |= 0x20;
+    }
+    if (hasText(options.password)) flags |= 0x40;
+    if (hasText(options.username)) flags |= 0x80;
+    w.u8(flags);
+    w.u16(options.keepAliveSec);
+
+    // Properties
+    size_t propLen = 0;
+    if (options.sessionExpirySec > 0) propLen += 5;
+    if (options.maxPacketSize > 0) propLen += 5;
+    w.varint(propLen);
+    if (options.sessionExpirySec > 0) {
+        w.u8(SESSION_EXPIRY_INTERVAL);
+        w.u32(options.sessionExpirySec);
+    }
+    if (options.maxPacketSize > 0) {
+        w.u8(MAXIMUM_PACKET_SIZE);
+        w.u32(options.maxPacketSize);
+    }
+
+    // Payload
+    w.str(options.clientId);
+    if (hasText(options.willTopic)) {
+        w.varint(0);  // No will properties
+        w.str(options.willTopic);
+        w.bin(options.willPayload, options.willPayload ? strlen(options.willPayload) : 0);
+    }
+    if (hasText(options.username)) w.str(options.username);
+    if (hasText(options.password)) w.bin(options.password, strlen(options.password));
+
+    return finish(buf, cap, CONNECT << 4, w);
+}
+
+size_t encodePublish(uint8_t* buf, size_t cap, const char* topic, uint16_t topicAlias,
+                     const uint8_t* payload, size_t payloadLen, bool retain,
+                     uint8_t qos, uint16_t packetId) {
+    if (cap < HEADER_RESERVE) return 0;
+    Writer w(buf, cap);
+    w.len = HEADER_RESERVE;
+
+    w.str(topic);  // Empty when an established alias replaces it
+    if (qos > 0) w.u16(packetId);
+    if (topicAlias > 0) {
+        w.varint(3);
+        w.u8(TOPIC_ALIAS);
+        w.u16(topicAlias);
+    } else {
+        w.varint(0);
+    }
+    w.bytes(payload, payloadLen);
+
+    uint8_t first = (PUBLISH << 4) | ((qos & 0x03) << 1) | (retain ? 0x01 : 0x00);
+    return finish(buf, cap, first, w);
+}
+
+size_t encodePublishHeader(uint8_t* buf, size_t cap, const char* topic, size_t payloadLen, bool retain) {
+    if (cap < HEADER_RESERVE) return 0;
+    Writer w(buf, cap);
+    w.len = HEADER_RESERVE;
+
+    w.str(topic);
+    w.varint(0);  // No properties
+
+    uint8_t first = (PUBLISH << 4) | (retain ? 0x01 : 0x00);
+    return finish(buf, cap, first, w, payloadLen);
+}
+
+size_t encodeSubscribe(uint8_t* buf, size_t cap, uint16_t packetId, const char* topicFilter, uint8_t qos) {
+    if (cap < HEADER_RESERVE) return 0;
+    Writer w(buf, cap);
+    w.len = HEADER_RESERVE;
+
+    w.u16(packetId);
+    w.varint(0);  // No properties
+    w.str(topicFilter);
+    w.u8(qos & 0x03);  // No Local = 0, Retain As Published = 0, Retain Handling = 0
+
+    return finish(buf, cap, (SUBSCRIBE << 4) | 0x02, w);
+}
+
+size_t encodePuback(uint8_t* buf, size_t cap, uint16_t packetId, uint8_t reason) {
+    if (cap < HEADER_RESERVE) return 0;
+    Writer w(buf, cap);
+    w.len = HEADER_RESERVE;
+
+    w.u16(packetId);
+    if (reason != SUCCESS) {
+        w.u8(reason);  // Reason and properties may be omitted on success
+    }
+    return finish(buf, cap, PUBACK << 4, w);
+}
+
+size_t encodePingreq(uint8_t* buf, size_t cap) {
+    if (cap < 2) return 0;
+    buf[0] = PINGREQ << 4;
+    buf[1] = 0;
+    return 2;
+}
+
+size_t encodeDisconnect(uint8_t* buf, size_t cap, uint8_t reason) {
+    if (reason == SUCCESS) {
+        if (cap < 2) return 0;
+        buf[0] = DISCONNECT << 4;
+        buf[1] = 0;
+        return 2;
+    }
+    if (cap < 4) return 0;
+    buf[0] = DISCONNECT << 4;
+    buf[1] = 2;
+    buf[2] = reason;
+    buf[3] = 0;  // No properties
+    return 4;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+int decodeVarint(const uint8_t* buf, size_t len, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= len) return 0;
+        value |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+        if ((buf[i] & 0x80) == 0) return (int)i + 1;
+    }
+    return -1;
+}
+
+int decodeFixedHeader(const uint8_t* buf, size_t len, uint8_t& type, uint8_t& flags, uint32_t& remaining) {
+    if (len < 2) return 0;
+    type = buf[0] >> 4;
+    flags = buf[0] & 0x0F;
+    int n = decodeVarint(buf + 1, len - 1, remaining);
+    return n <= 0 ? n : n + 1;
+}
+
+namespace {
+
+// Bounded big-endian reader; running past the end sets failed
+class Reader {
+public:
+    Reader(const uint8_t* buf, size_t len) : buf(buf), len(len), pos(0), failed(false) {}
+
+    bool need(size_t n) {
+        if (failed || n > len - pos) { failed = true; return false; }
+        return true;
+    }
+    uint8_t u8() { return need(1) ? buf[pos++] : 0; }
+    uint16_t u16() {
+        if (!need(2)) return 0;
+        uint16_t v = (uint16_t)(buf[pos] << 8) | buf[pos + 1];
+        pos += 2;
+        return v;
+    }
+    uint32_t u32() {
+        uint32_t hi = u16();
+        return (hi << 16) | u16();
+    }
+    uint32_t varint() {
+        uint32_t v = 0;
+        int n = failed ? -1 : decodeVarint(buf + pos, len - pos, v);
+        if (n <= 0) { failed = true; return 0; }
+        pos += n;
+        return v;
+    }
+    // Length-prefixed string or binary; returns a pointer into the buffer
+    const uint8_t* lengthPrefixed(uint16_t& n) {
+        n = u16();
+        if (!need(n)) return nullptr;
+        const uint8_t* p = buf + pos;
+        pos += n;
+        return p;
+    }
+    void skip(size_t n) { if (need(n)) pos += n; }
+    size_t remaining() const { return failed ? 0 : len - pos; }
+
+    const uint8_t* buf;
+    size_t len;
+    size_t pos;
+    bool failed;
+};
+
+void copyString(char* dest, size_t destLen, const uint8_t* src, uint16_t n) {
+    size_t count = n < destLen - 1 ? n : destLen - 1;
+    if (src != nullptr) memcpy(dest, src, count);
+    dest[src != nullptr ? count : 0] = '\0';
+}
+
+enum PropertyKind { KIND_BYTE, KIND_U16, KIND_U32, KIND_VARINT, KIND_STRING, KIND_BINARY, KIND_PAIR, KIND_UNKNOWN };
+
+PropertyKind propertyKind(uint8_t id) {
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            return KIND_BYTE;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return KIND_U16;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return KIND_U32;
+        case 0x0B:
+            return KIND_VARINT;
+        case 0x03: case 0x08: case 0x12: case 0x15: case 0x1A: case 0x1C: case 0x1F:
+            return KIND_STRING;
+        case 0x09: case 0x16:
+            return KIND_BINARY;
+        case 0x26:
+            return KIND_PAIR;
+        default:
+            return KIND_UNKNOWN;
+    }
+}
+
+// Walks a property block, calling onProperty(id, reader) for each entry the
+// callback wants to read itself (it returns true) and skipping the others.
+template <typename Fn>
+bool readProperties(Reader& r, Fn onProperty) {
+    uint32_t total = r.varint();
+    if (r.failed || total > r.remaining()) return false;
+    size_t end = r.pos + total;
+    while (r.pos < end && !r.failed) {
+        uint8_t id = r.u8();
+        if (onProperty(id, r)) continue;
+        uint16_t n;
+        switch (propertyKind(id)) {
+            case KIND_BYTE: r.skip(1); break;
+            case KIND_U16: r.skip(2); break;
+            case KIND_U32: r.skip(4); break;
+            case KIND_VARINT: r.varint(); break;
+            case KIND_STRING:
+            case KIND_BINARY: r.lengthPrefixed(n); break;
+            case KIND_PAIR: r.lengthPrefixed(n); r.lengthPrefixed(n); break;
+            default: return false;  // Cannot know its size
+        }
+    }
+    return !r.failed && r.pos == end;
+}
+
+bool readReasonString(uint8_t id, Reader& r, char* dest, size_t destLen) {
+    if (id != REASON_STRING) return false;
+    uint16_t n;
+    const uint8_t* s = r.lengthPrefixed(n);
+    copyString(dest, destLen, s, n);
+    return true;
+}
+
+} // namespace
+
+bool decodeConnack(const uint8_t* body, size_t len, Connack& out) {
+    memset(&out, 0, sizeof(out));
+    out.receiveMax = 65535;
+    out.maxQos = 2;
+    out.retainAvailable = true;
+
+    Reader r(body, len);
+    out.sessionPresent = (r.u8() & 0x01) != 0;
+    out.reason = r.u8();
+    if (r.failed) return false;
+    if (r.remaining() == 0) return true;  // Properties may be absent on errors
+
+    return readProperties(r, [&out](uint8_t id, Reader& pr) {
+        switch (id) {
+            case SESSION_EXPIRY_INTERVAL:
+                out.hasSessionExpiry = true;
+                out.sessionExpirySec = pr.u32();
+                return true;
+            case SERVER_KEEP_ALIVE:
+                out.hasServerKeepAlive = true;
+                out.serverKeepAliveSec = pr.u16();
+                return true;
+            case RECEIVE_MAXIMUM:
+                out.receiveMax = pr.u16();
+                return true;
+            case TOPIC_ALIAS_MAXIMUM:
+                out.topicAliasMax = pr.u16();
+                return true;
+            case MAXIMUM_QOS:
+                out.maxQos = pr.u8();
+                return true;
+            case RETAIN_AVAILABLE:
+                out.retainAvailable = pr.u8() != 0;
+                return true;
+            case MAXIMUM_PACKET_SIZE:
+                out.maxPacketSize = pr.u32();
+                return true;
+            default:
+                return readReasonString(id, pr, out.reasonString, sizeof(out.reasonString));
+        }
+    });
+}
+
+bool decodeSuback(const uint8_t* body, size_t len, Suback& out) {
+    memset(&out, 0, sizeof(out));
+    Reader r(body, len);
+    out.packetId = r.u16();
+    bool ok = readProperties(r, [&out](uint8_t id, Reader& pr) {
+        return readReasonString(id, pr, out.reasonString, sizeof(out.reasonString));
+    });
+    if (!ok) return false;
+    while (r.remaining() > 0 && out.count < sizeof(out.reasons)) {
+        out.reasons[out.count++] = r.u8();
+    }
+    return out.count > 0;
+}
+
+bool decodeDisconnect(const uint8_t* body, size_t len, Disconnect& out) {
+    memset(&out, 0, sizeof(out));
+    if (len == 0) return true;  // Reason 0x00, no properties
+    Reader r(body, len);
+    out.reason = r.u8();
+    if (r.remaining() == 0) return !r.failed;
+    return readProperties(r, [&out](uint8_t id, Reader& pr) {
+        return readReasonString(id, pr, out.reasonString, sizeof(out.reasonString));
+    });
+}
+
+bool decodePublish(uint8_t flags, const uint8_t* body, size_t len, Publish& out) {
+    memset(&out, 0, sizeof(out));
+    out.qos = (flags >> 1) & 0x03;
+    out.retain = (flags & 0x01) != 0;
+    if (out.qos > 2) return false;
+
+    Reader r(body, len);
+    out.topic = (const char*)r.lengthPrefixed(out.topicLen);
+    if (out.qos > 0) out.packetId = r.u16();
+    bool ok = readProperties(r, [&out](uint8_t id, Reader& pr) {
+        if (id != TOPIC_ALIAS) return false;
+        out.topicAlias = pr.u16();
+        return true;
+    });
+    if (!ok) return false;
+    out.payload = body + r.pos;
+    out.payloadLen = r.remaining();
+    return true;
+}
+
+// ============================================================================
+// Topic aliases, keep-alive and reason codes
+// ============================================================================
+
+void TopicAliases::reset(uint16_t max) {
+    count = 0;
+    limit = max < Mqtt5Config::MAX_ALIASES ? max : Mqtt5Config::MAX_ALIASES;
+}
+
+uint16_t TopicAliases::lookup(const char* topic, bool& isNew) {
+    isNew = false;
+    for (uint16_t i = 0; i < count; i++) {
+        if (strcmp(topics[i], topic) == 0) {
+            return i + 1;
+        }
+    }
+    if (count >= limit || strlen(topic) >= Mqtt5Config::MAX_TOPIC_LEN) {
+        return 0;  // Table full: publish with the full topic name
+    }
+    strcpy(topics[count], topic);
+    isNew = true;
+    return ++count;
+}
+
+void KeepAlive::reset(uint16_t keepAliveSec, unsigned long now) {
+    periodMs = keepAliveSec * 1000UL;
+    lastOutbound = now;
+    lastInbound = now;
+    pingSentAt = now;
+    pingOutstanding = false;
+}
+
+void KeepAlive::pingSent(unsigned long now) {
+    lastOutbound = now;
+    pingSentAt = now;
+    pingOutstanding = true;
+}
+
+KeepAlive::Action KeepAlive::poll(unsigned long now) const {
+    if (periodMs == 0) {
+        return NONE;
+    }
+    if (pingOutstanding) {
+        // Timed from the PINGREQ, not from the last packet received
+        return now - pingSentAt >= periodMs ? TIMED_OUT : NONE;
+    }
+    if (now - lastOutbound >= periodMs || now - lastInbound >= periodMs) {
+        return SEND_PING;
+    }
+    return NONE;
+}
+
+const char* reasonName(uint8_t code) {
+    switch (code) {
+        case 0x00: return "Success";
+        case 0x01: return "Granted QoS 1";
+        case 0x02: return "Granted QoS 2";
+        case 0x04: return "Disconnect with will";
+        case 0x10: return "No matching subscribers";
+        case 0x80: return "Unspecified error";
+        case 0x81: return "Malformed packet";
+        case 0x82: return "Protocol error";
+        case 0x83: return "Implementation specific error";
+        case 0x84: return "Unsupported protocol version";
+        case 0x85: return "Client identifier not valid";
+        case 0x86: return "Bad user name or password";
+        case 0x87: return "Not authorized";
+        case 0x88: return "Server unavailable";
+        case 0x89: return "Server busy";
+        case 0x8A: return "Banned";
+        case 0x8B: return "Server shutting down";
+        case 0x8D: return "Keep alive timeout";
+        case 0x8E: return "Session taken over";
+        case 0x8F: return "Topic filter invalid";
+        case 0x90: return "Topic name invalid";
+        case 0x93: return "Receive maximum exceeded";
+        case 0x94: return "Topic alias invalid";
+        case 0x95: return "Packet too large";
+        case 0x97: return "Quota exceeded";
+        case 0x99: return "Payload format invalid";
+        case 0x9A: return "Retain not supported";
+        case 0x9B: return "QoS not supported";
+        case 0x9C: return "Use another server";
+        case 0x9D: return "Server moved";
+        case 0x9F: return "Connection rate exceeded";
+        default: return code < 0x80 ? "Success" : "Error";
+    }
+}
+
+} // namespace Mqtt5
@@ -0,0 +1,208 @@
+/*
+ * MQTT 5 Packet Codec
+ *
+ * Encodes the packets the battery monitor sends (CONNECT, PUBLISH,
+ * SUBSCRIBE, PUBACK, PINGREQ, DISCONNECT) and decodes the ones it receives
+ * (CONNACK, PUBLISH, SUBACK, DISCONNECT). Pure C++ with no Arduino
+ * dependency, so it also runs in the native test build.
+ *
+ * Only the MQTT 5 features the device uses are covered:
+ *   - Session Expiry Interval, so a broker forgets a device that stopped
+ *     waking instead of keeping its session forever
+ *   - Topic aliases for repeated publishes on one connection
+ *   - Reason codes and reason strings for every failure the broker reports
+ */
+
+#ifndef MQTT5_CODEC_H
+#define MQTT5_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Mqtt5Config {
+    constexpr size_t MAX_ALIASES = 16;        // Outgoing topic aliases tracked per connection
+    constexpr size_t MAX_TOPIC_LEN = 96;      // Longest topic that gets an alias
+    constexpr size_t REASON_STRING_LEN = 64;
+}
+
+namespace Mqtt5 {
+
+enum PacketType : uint8_t {
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14
+};
+
+enum Property : uint8_t {
+    SESSION_EXPIRY_INTERVAL = 0x11,
+    ASSIGNED_CLIENT_ID = 0x12,
+    SERVER_KEEP_ALIVE = 0x13,
+    REASON_STRING = 0x1F,
+    RECEIVE_MAXIMUM = 0x21,
+    TOPIC_ALIAS_MAXIMUM = 0x22,
+    TOPIC_ALIAS = 0x23,
+    MAXIMUM_QOS = 0x24,
+    RETAIN_AVAILABLE = 0x25,
+    MAXIMUM_PACKET_SIZE = 0x27
+};
+
+// Reason codes the device acts on (all codes >= 0x80 are failures)
+enum Reason : uint8_t {
+    SUCCESS = 0x00,
+    GRANTED_QOS_1 = 0x01,
+    DISCONNECT_WITH_WILL = 0x04,
+    UNSPECIFIED_ERROR = 0x80,
+    MALFORMED_PACKET = 0x81,
+    PROTOCOL_ERROR = 0x82,
+    UNSUPPORTED_PROTOCOL_VERSION = 0x84,
+    BAD_USERNAME_OR_PASSWORD = 0x86,
+    NOT_AUTHORIZED = 0x87,
+    SERVER_UNAVAILABLE = 0x88,
+    KEEP_ALIVE_TIMEOUT = 0x8D,
+    SESSION_TAKEN_OVER = 0x8E,
+    TOPIC_ALIAS_INVALID = 0x94,
+    PACKET_TOO_LARGE = 0x95
+};
+
+// Human-readable name of a reason code ("Not authorized", ...)
+const char* reasonName(uint8_t code);
+
+struct ConnectOptions {
+    const char* clientId;
+    const char* username;        // nullptr or "" = none
+    const char* password;
+    const char* willTopic;       // nullptr = no will
+    const char* willPayload;
+    uint8_t willQos;
+    bool willRetain;
+    bool cleanStart;
+    uint16_t keepAliveSec;
+    uint32_t sessionExpirySec;   // 0 = session ends with the connection
+    uint32_t maxPacketSize;      // Largest packet we accept (0 = no limit)
+};
+
+struct Connack {
+    bool sessionPresent;
+    uint8_t reason;
+    uint16_t topicAliasMax;      // 0 = broker accepts no topic aliases
+    uint16_t receiveMax;
+    uint8_t maxQos;
+    bool retainAvailable;
+    uint32_t maxPacketSize;      // 0 = no limit
+    bool hasSessionExpiry;       // Broker overrode our Session Expiry Interval
+    uint32_t sessionExpirySec;
+    bool hasServerKeepAlive;
+    uint16_t serverKeepAliveSec;
+    char reasonString[Mqtt5Config::REASON_STRING_LEN];
+};
+
+struct Suback {
+    uint16_t packetId;
+    uint8_t reasons[8];          // One per topic filter, in SUBSCRIBE order
+    uint8_t count;
+    char reasonString[Mqtt5Config::REASON_STRING_LEN];
+};
+
+struct Disconnect {
+    uint8_t reason;
+    char reasonString[Mqtt5Config::REASON_STRING_LEN];
+};
+
+// Incoming PUBLISH; topic and payload point into the decoded packet
+struct Publish {
+    const char* topic;           // Not NUL-terminated
+    uint16_t topicLen;
+    uint8_t qos;
+    bool retain;
+    uint16_t packetId;           // QoS 1/2 only
+    uint16_t topicAlias;         // 0 = none
+    const uint8_t* payload;
+    size_t payloadLen;
+};
+
+// Encoders write one complete packet into buf and return its length,
+// or 0 if it does not fit in cap.
+size_t encodeConnect(uint8_t* buf, size_t cap, const ConnectOptions& options);
+size_t encodePublish(uint8_t* buf, size_t cap, const char* topic, uint16_t topicAlias,
+                     const uint8_t* payload, size_t payloadLen, bool retain,
+                     uint8_t qos = 0, uint16_t packetId = 0);
+// QoS 0 PUBLISH without its payload, for payloads streamed separately;
+// the remaining length already counts payloadLen
+size_t encodePublishHeader(uint8_t* buf, size_t cap, const char* topic, size_t payloadLen, bool retain);
+size_t encodeSubscribe(uint8_t* buf, size_t cap, uint16_t packetId, const char* topicFilter, uint8_t qos);
+size_t encodePuback(uint8_t* buf, size_t cap, uint16_t packetId, uint8_t reason = SUCCESS);
+size_t encodePingreq(uint8_t* buf, size_t cap);
+size_t encodeDisconnect(uint8_t* buf, size_t cap, uint8_t reason = SUCCESS);
+
+// Fixed header: returns its length (2-5 bytes), 0 if more bytes are needed,
+// or -1 if the remaining-length field is malformed.
+int decodeFixedHeader(const uint8_t* buf, size_t len, uint8_t& type, uint8_t& flags, uint32_t& remaining);
+
+// Variable byte integer (1-4 bytes): returns bytes used, 0 if incomplete, -1 if malformed
+int decodeVarint(const uint8_t* buf, size_t len, uint32_t& value);
+
+// Body decoders take the packet without its fixed header
+bool decodeConnack(const uint8_t* body, size_t len, Connack& out);
+bool decodeSuback(const uint8_t* body, size_t len, Suback& out);
+bool decodeDisconnect(const uint8_t* body, size_t len, Disconnect& out);
+bool decodePublish(uint8_t flags, const uint8_t* body, size_t len, Publish& out);
+
+// Outgoing topic alias table for one connection. The first publish on a
+// topic sends the topic with a new alias; later ones send only the alias.
+class TopicAliases {
+public:
+    TopicAliases() { reset(0); }
+
+    // Start a new connection; max is the broker's Topic Alias Maximum
+    void reset(uint16_t max);
+
+    // Alias for topic (0 = send without alias); isNew is true when the
+    // topic name still has to be sent along with it
+    uint16_t lookup(const char* topic, bool& isNew);
+
+    uint16_t assigned() const { return count; }
+
+private:
+    char topics[Mqtt5Config::MAX_ALIASES][Mqtt5Config::MAX_TOPIC_LEN];
+    uint16_t count;
+    uint16_t limit;
+};
+
+// Keep-alive timing for one connection; times are milliseconds from any
+// clock (millis() on the device). A PINGREQ goes out once either direction
+// has been idle for the keep-alive period, and the connection has failed
+// when its PINGRESP has not arrived within another period.
+class KeepAlive {
+public:
+    enum Action { NONE, SEND_PING, TIMED_OUT };
+    
+    KeepAlive() { reset(0, 0); }
+    
+    // Start a new connection (keepAliveSec 0 = no keep-alive)
+    void reset(uint16_t keepAliveSec, unsigned long now);
+    
+    void sent(unsigned long now) { lastOutbound = now; }
+    void received(unsigned long now) { lastInbound = now; }
+    void pingSent(unsigned long now);
+    void pingAnswered() { pingOutstanding = false; }
+    
+    // What to do now; call after reading the packets already received
+    Action poll(unsigned long now) const;
+    
+private:
+    unsigned long periodMs;
+    unsigned long lastOutbound;
+    unsigned long lastInbound;
+    unsigned long pingSentAt;
+    bool pingOutstanding;
+};
+
+} // namespace Mqtt5
+
+#endif // MQTT5_CODEC_H
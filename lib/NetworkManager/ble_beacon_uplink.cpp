@@ -0,0 +1,57 @@
+#include "ble_beacon_uplink.h"
+#include "bthome_payload.h"
+
+#ifdef ENABLE_BLE_BEACON
+#include <BLEDevice.h>
+
+// BTHome receivers drop repeats of a packet id, so it must change per reading
+RTC_DATA_ATTR static uint8_t beaconPacketId = 0;
+
+bool BleBeaconUplink::available() {
+    return true;
+}
+
+bool BleBeaconUplink::publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) {
+    BleBeacon::BeaconReading beacon = {};
+    beacon.packetId = ++beaconPacketId;
+    float percentage = reading.percentage + 0.5f;
+    beacon.percentage = percentage < 0 ? 0 : percentage > 100 ? 100 : (uint8_t)percentage;
+    float millivolts = reading.voltage * 1000.0f + 0.5f;
+    beacon.millivolts = millivolts < 0 ? 0 : millivolts > 65535 ? 65535 : (uint16_t)millivolts;
+    beacon.batteryLow = reading.status == BatteryStatus::LOW_BATTERY || reading.status == BatteryStatus::CRITICAL ||
+                        reading.status == BatteryStatus::DEAD;
+    
+    uint8_t adv[BleBeaconConfig::ADV_MAX];
+    size_t len = BleBeacon::encodeAdvertisement(beacon, name.c_str(), adv, sizeof(adv));
+    
+    unsigned long start = millis();
+    BLEDevice::init("");
+    BLEAdvertising* advertising = BLEDevice::getAdvertising();
+    BLEAdvertisementData data;
+    data.addData(std::string(reinterpret_cast<const char*>(adv), len));
+    advertising->setAdvertisementData(data);
+    advertising->setAdvertisementType(ADV_TYPE_NONCONN_IND);
+    advertising->setMinInterval(Config::BLE_BEACON_INTERVAL_UNITS);
+    advertising->setMaxInterval(Config::BLE_BEACON_INTERVAL_UNITS);
+    advertising->start();
+    delay(Config::BLE_BEACON_DURATION_MS);
+    advertising->stop();
+    BLEDevice::deinit(false);
+    
+    Serial.printf("✓ BLE beacon: packet %u, %.2f V, %u%% broadcast for %lu ms\n",
+                  beacon.packetId, reading.voltage, beacon.percentage, millis() - start);
+    return true;
+}
+
+#else
+
+bool BleBeaconUplink::available() {
+    return false;
+}
+
+bool BleBeaconUplink::publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) {
+    Serial.println("❌ BLE beacon not in this build (use the esp32dev_ble environment)");
+    return false;
+}
+
+#endif // ENABLE_BLE_BEACON
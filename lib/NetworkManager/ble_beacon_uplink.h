@@ -0,0 +1,29 @@
+#ifndef BLE_BEACON_UPLINK_H
+#define BLE_BEACON_UPLINK_H
+
+#include <Arduino.h>
+#include "reading_uplink.h"
+
+// Broadcasts each reading as a BTHome advertisement for BLE_BEACON_DURATION_MS
+// (non-connectable, so nothing can connect or pair). Home Assistant picks it
+// up through a Bluetooth adapter or proxy in range. No acknowledgement: the
+// publish counts as done once the beacon went out.
+//
+// The BLE stack needs the larger app partitions of the esp32dev_ble
+// environment, which defines ENABLE_BLE_BEACON; other builds report the
+// mode as unavailable.
+class BleBeaconUplink : public ReadingUplink {
+public:
+    // name = local name in the advertisement (left out when too long)
+    explicit BleBeaconUplink(const String& name) : name(name) {}
+    
+    static bool available();
+    
+    const char* uplinkName() const override { return "BLE beacon"; }
+    bool publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) override;
+    
+private:
+    const String& name;
+};
+
+#endif // BLE_BEACON_UPLINK_H
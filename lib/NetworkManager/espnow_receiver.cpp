@@ -0,0 +1,79 @@
+#include "espnow_receiver.h"
+
+QueueHandle_t EspNowReceiver::queue = nullptr;
+volatile uint32_t EspNowReceiver::droppedFrames = 0;
+volatile uint32_t EspNowReceiver::rejectedFrames = 0;
+uint8_t EspNowReceiver::peerMacs[Config::ESPNOW_MAX_ENCRYPTED_PEERS][6];
+int EspNowReceiver::peerMacCount = 0;
+bool EspNowReceiver::peersOnly = false;
+
+bool EspNowReceiver::begin(const uint8_t* key, const uint8_t (*peers)[6], int peerCount) {
+    if (queue == nullptr) {
+        queue = xQueueCreate(Config::ESPNOW_RX_QUEUE_LEN, sizeof(Frame));
+        if (queue == nullptr) {
+            Serial.println("❌ ESP-NOW receive queue not allocated");
+            return false;
+        }
+    }
+    if (esp_now_init() != ESP_OK) {
+        Serial.println("❌ ESP-NOW init failed");
+        return false;
+    }
+    
+    // The peer list is complete before the callback is registered
+    peersOnly = key != nullptr;
+    peerMacCount = 0;
+    
+    int added = 0;
+    for (int i = 0; i < peerCount && i < Config::ESPNOW_MAX_ENCRYPTED_PEERS && key != nullptr; i++) {
+        esp_now_peer_info_t peer = {};
+        memcpy(peer.peer_addr, peers[i], 6);
+        peer.channel = 0;
+        peer.ifidx = WIFI_IF_STA;
+        peer.encrypt = true;
+        memcpy(peer.lmk, key, ESP_NOW_KEY_LEN);
+        esp_err_t err = esp_now_add_peer(&peer);
+        if (err == ESP_OK) {
+            memcpy(peerMacs[peerMacCount++], peers[i], 6);
+            added++;
+        } else {
+            Serial.printf("❌ ESP-NOW peer %02x:%02x:%02x:%02x:%02x:%02x not added (error %d)\n",
+                          peers[i][0], peers[i][1], peers[i][2], peers[i][3], peers[i][4], peers[i][5], err);
+        }
+    }
+    esp_now_register_recv_cb(onReceive);
+    Serial.printf("✓ ESP-NOW gateway listening (%d encrypted units)\n", added);
+    return true;
+}
+
+bool EspNowReceiver::take(Frame& frame) {
+    return queue != nullptr && xQueueReceive(queue, &frame, 0) == pdTRUE;
+}
+
+void EspNowReceiver::onReceive(const uint8_t* mac, const uint8_t* data, int len) {
+    // Anything but a frame is not from a sensor unit; size is checked here
+    // so the queue holds fixed-size entries
+    if (len <= 0 || len > (int)SensorUplinkConfig::FRAME_SIZE) {
+        droppedFrames++;
+        return;
+    }
+    if (peersOnly) {
+        // Plaintext frames from unknown addresses still reach this callback;
+        // drop them before they take a queue entry or an aggregator slot
+        bool listed = false;
+        for (int i = 0; i < peerMacCount && !listed; i++) {
+            listed = memcmp(peerMacs[i], mac, 6) == 0;
+        }
+        if (!listed) {
+            rejectedFrames++;
+            return;
+        }
+    }
+    Frame frame;
+    memcpy(frame.mac, mac, sizeof(frame.mac));
+    frame.len = len;
+    memcpy(frame.data, data, len);
+    if (xQueueSend(queue, &frame, 0) != pdTRUE) {
+        droppedFrames++;
+    }
+}
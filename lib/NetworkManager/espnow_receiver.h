@@ -0,0 +1,43 @@
+#ifndef ESPNOW_RECEIVER_H
+#define ESPNOW_RECEIVER_H
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "battery_config.h"
+#include "sensor_frame.h"
+
+// Receives sensor unit frames on the gateway. The ESP-NOW callback runs in
+// the WiFi task, so frames are queued there and taken from loop().
+class EspNowReceiver {
+public:
+    struct Frame {
+        uint8_t mac[6];
+        uint8_t len;
+        uint8_t data[SensorUplinkConfig::FRAME_SIZE];
+    };
+    
+    // Start after WiFi is up: ESP-NOW listens on the access point's channel.
+    // Encrypted units must be listed in peers (key = their 16-byte LMK), at
+    // most ESPNOW_MAX_ENCRYPTED_PEERS of them; with a key set, frames from
+    // any other address are dropped. Without a key any address is accepted.
+    bool begin(const uint8_t* key, const uint8_t (*peers)[6], int peerCount);
+    
+    bool take(Frame& frame);  // Next queued frame, false if none
+    uint32_t dropped() const { return droppedFrames; }  // Queue full or wrong size
+    uint32_t rejected() const { return rejectedFrames; }  // Not from a listed peer
+    
+private:
+    static void onReceive(const uint8_t* mac, const uint8_t* data, int len);
+    static QueueHandle_t queue;
+    static volatile uint32_t droppedFrames;
+    static volatile uint32_t rejectedFrames;
+    
+    // Registered peers, read by onReceive() in the WiFi task
+    static uint8_t peerMacs[Config::ESPNOW_MAX_ENCRYPTED_PEERS][6];
+    static int peerMacCount;
+    static bool peersOnly;
+};
+
+#endif // ESPNOW_RECEIVER_H
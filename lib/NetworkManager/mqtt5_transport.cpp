@@ -0,0 +1,365 @@
+#include "mqtt5_transport.h"
+
+Mqtt5Transport::Mqtt5Transport(Client& client)
+    : client(client), host(nullptr), port(0), connack(), isConnected(false),
+      nextPacketId(0), streamRemaining(0), awaitedSubackId(0), subackReceived(false), suback(),
+      failedStep(nullptr), failedReason(0) {
+    failedReasonString[0] = '\0';
+}
+
+void Mqtt5Transport::setServer(const char* host, uint16_t port) {
+    this->host = host;
+    this->port = port;
+}
+
+bool Mqtt5Transport::connect(const MqttConnectOptions& options) {
+    failedStep = nullptr;
+    failedReason = 0;
+    failedReasonString[0] = '\0';
+    isConnected = false;
+    
+    if (!client.connect(host, port)) {
+        fail("TCP/TLS connect");
+        return false;
+    }
+    
+    Mqtt5::ConnectOptions connect = {};
+    connect.clientId = options.clientId;
+    connect.username = options.user;
+    connect.password = options.password;
+    connect.willTopic = options.willTopic;
+    connect.willPayload = options.willPayload;
+    connect.willQos = 1;
+    connect.willRetain = true;
+    connect.cleanStart = false;
+    connect.keepAliveSec = Config::MQTT_KEEPALIVE_S;
+    connect.sessionExpirySec = options.sessionExpirySec;
+    connect.maxPacketSize = sizeof(buffer);
+    
+    size_t len = Mqtt5::encodeConnect(buffer, sizeof(buffer), connect);
+    if (len == 0 || !send(buffer, len)) {
+        fail("CONNECT");
+        drop();
+        return false;
+    }
+    
+    if (!waitFor(Mqtt5::CONNACK, len, Config::MQTT_ACK_TIMEOUT_MS) ||
+        !Mqtt5::decodeConnack(buffer, len, connack)) {
+        fail("CONNACK");
+        drop();
+        return false;
+    }
+    if (connack.reason >= Mqtt5::UNSPECIFIED_ERROR) {
+        fail("CONNACK", connack.reason, connack.reasonString);
+        drop();
+        return false;
+    }
+    
+    keepAlive.reset(connack.hasServerKeepAlive ? connack.serverKeepAliveSec : Config::MQTT_KEEPALIVE_S, millis());
+    aliases.reset(options.topicAliases ? connack.topicAliasMax : 0);
+    isConnected = true;
+    return true;
+}
+
+bool Mqtt5Transport::connected() {
+    if (isConnected && !client.connected()) {
+        fail("connection lost");
+        isConnected = false;
+    }
+    return isConnected;
+}
+
+bool Mqtt5Transport::publish(const char* topic, const char* payload, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+    
+    bool isNew;
+    uint16_t alias = aliases.lookup(topic, isNew);
+    const char* topicName = (alias == 0 || isNew) ? topic : "";
+    bool retain = retained && connack.retainAvailable;
+    
+    size_t len = Mqtt5::encodePublish(buffer, sizeof(buffer), topicName, alias,
+                                      (const uint8_t*)payload, strlen(payload), retain);
+    if (len == 0 || (connack.maxPacketSize > 0 && len > connack.maxPacketSize)) {
+        fail("PUBLISH", Mqtt5::PACKET_TOO_LARGE);
+        return false;
+    }
+    return send(buffer, len);
+}
+
+bool Mqtt5Transport::beginPublish(const char* topic, size_t length, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+    
+    // Streamed payloads are one-off (discovery), so they go without an alias
+    bool retain = retained && connack.retainAvailable;
+    size_t len = Mqtt5::encodePublishHeader(buffer, sizeof(buffer), topic, length, retain);
+    if (len == 0 || (connack.maxPacketSize > 0 && len + length > connack.maxPacketSize)) {
+        fail("PUBLISH", Mqtt5::PACKET_TOO_LARGE);
+        return false;
+    }
+    streamRemaining = length;
+    return send(buffer, len);
+}
+
+size_t Mqtt5Transport::write(const uint8_t* data, size_t len) {
+    if (len > streamRemaining || !send(data, len)) {
+        return 0;
+    }
+    streamRemaining -= len;
+    return len;
+}
+
+bool Mqtt5Transport::endPublish() {
+    if (streamRemaining != 0) {
+        // A short payload leaves the broker waiting for bytes that never come
+        fail("PUBLISH", Mqtt5::MALFORMED_PACKET);
+        streamRemaining = 0;
+        drop();
+        return false;
+    }
+    return true;
+}
+
+bool Mqtt5Transport::subscribe(const char* topic, uint8_t qos) {
+    if (!connected()) {
+        return false;
+    }
+    
+    uint16_t id = packetId();
+    size_t len = Mqtt5::encodeSubscribe(buffer, sizeof(buffer), id, topic, qos);
+    if (len == 0 || !send(buffer, len)) {
+        fail("SUBSCRIBE");
+        return false;
+    }
+    
+    // Wait for the SUBACK so a refused subscription shows its reason code.
+    // Retained messages on the new subscription may come first; their
+    // callback can run loop() and read the SUBACK, which is recorded then.
+    awaitedSubackId = id;
+    subackReceived = false;
+    unsigned long start = millis();
+    while (!subackReceived) {
+        if (!isConnected) {
+            awaitedSubackId = 0;
+            return false;  // Disconnected by the broker, reason already recorded
+        }
+        unsigned long elapsed = millis() - start;
+        uint8_t type, flags;
+        int n = -1;
+        if (elapsed < Config::MQTT_ACK_TIMEOUT_MS) {
+            n = readPacket(type, flags, Config::MQTT_ACK_TIMEOUT_MS - elapsed);
+        }
+        if (n < 0) {
+            awaitedSubackId = 0;
+            fail("SUBACK");
+            return false;
+        }
+        handlePacket(type, flags, n);
+    }
+    awaitedSubackId = 0;
+    if (suback.reasons[0] >= Mqtt5::UNSPECIFIED_ERROR) {
+        fail("SUBSCRIBE", suback.reasons[0], suback.reasonString);
+        return false;
+    }
+    return true;
+}
+
+bool Mqtt5Transport::loop() {
+    if (!connected()) {
+        return false;
+    }
+    
+    // Read first, so a PINGRESP that has arrived is seen before the timeout check
+    while (isConnected && client.available()) {
+        uint8_t type, flags;
+        int len = readPacket(type, flags, Config::MQTT_ACK_TIMEOUT_MS);
+        if (len < 0) {
+            drop();
+            return false;
+        }
+        handlePacket(type, flags, len);
+    }
+    if (!isConnected) {
+        return false;
+    }
+    
+    switch (keepAlive.poll(millis())) {
+        case Mqtt5::KeepAlive::SEND_PING: {
+            uint8_t ping[2];
+            if (send(ping, Mqtt5::encodePingreq(ping, sizeof(ping)))) {
+                keepAlive.pingSent(millis());
+            }
+            break;
+        }
+        case Mqtt5::KeepAlive::TIMED_OUT:
+            fail("keep alive", Mqtt5::KEEP_ALIVE_TIMEOUT);
+            drop();
+            return false;
+        default:
+            break;
+    }
+    return isConnected;
+}
+
+void Mqtt5Transport::disconnect() {
+    if (isConnected) {
+        // Normal disconnect: the broker keeps the session for its expiry interval
+        uint8_t packet[4];
+        send(packet, Mqtt5::encodeDisconnect(packet, sizeof(packet)));
+    }
+    drop();
+}
+
+String Mqtt5Transport::lastError() {
+    if (failedStep == nullptr) {
+        return "none";
+    }
+    String error = failedStep;
+    if (failedReason != 0) {
+        char code[8];
+        snprintf(code, sizeof(code), "0x%02X", failedReason);
+        error += String(": ") + Mqtt5::reasonName(failedReason) + " (" + code + ")";
+    }
+    if (failedReasonString[0] != '\0') {
+        error += String(" - ") + failedReasonString;
+    }
+    return error;
+}
+
+bool Mqtt5Transport::send(const uint8_t* data, size_t len) {
+    if (len == 0 || client.write(data, len) != len) {
+        fail("write");
+        return false;
+    }
+    keepAlive.sent(millis());
+    return true;
+}
+
+bool Mqtt5Transport::readByte(uint8_t& b, unsigned long deadline) {
+    while (!client.available()) {
+        if (!client.connected() || (long)(millis() - deadline) >= 0) {
+            return false;
+        }
+        delay(1);
+    }
+    b = client.read();
+    return true;
+}
+
+// Reads one packet into buffer (without its fixed header); returns the body length or -1
+int Mqtt5Transport::readPacket(uint8_t& type, uint8_t& flags, unsigned long timeoutMs) {
+    unsigned long deadline = millis() + timeoutMs;
+    uint8_t header[5];
+    size_t have = 0;
+    uint32_t remaining = 0;
+    int headerLen = 0;
+    while (headerLen == 0) {
+        if (have == sizeof(header) || !readByte(header[have++], deadline)) {
+            fail("read");
+            return -1;
+        }
+        headerLen = Mqtt5::decodeFixedHeader(header, have, type, flags, remaining);
+    }
+    if (headerLen < 0 || remaining > sizeof(buffer)) {
+        fail("read", Mqtt5::MALFORMED_PACKET);
+        return -1;
+    }
+    for (size_t i = 0; i < remaining; i++) {
+        if (!readByte(buffer[i], deadline)) {
+            fail("read");
+            return -1;
+        }
+    }
+    keepAlive.received(millis());
+    return (int)remaining;
+}
+
+// Reads packets until one of the given type arrives, handling others meanwhile
+bool Mqtt5Transport::waitFor(uint8_t wanted, size_t& len, unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs) {
+        uint8_t type, flags;
+        int n = readPacket(type, flags, timeoutMs - (millis() - start));
+        if (n < 0) {
+            return false;
+        }
+        if (type == wanted) {
+            len = n;
+            return true;
+        }
+        handlePacket(type, flags, n);
+        if (type == Mqtt5::DISCONNECT) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void Mqtt5Transport::handlePacket(uint8_t type, uint8_t flags, size_t len) {
+    switch (type) {
+        case Mqtt5::PUBLISH: {
+            Mqtt5::Publish publish;
+            if (!Mqtt5::decodePublish(flags, buffer, len, publish)) {
+                fail("PUBLISH received", Mqtt5::MALFORMED_PACKET);
+                return;
+            }
+            if (publish.qos == 1) {
+                // Acknowledge first: the callback may reuse the buffer
+                uint8_t ack[8];
+                send(ack, Mqtt5::encodePuback(ack, sizeof(ack), publish.packetId));
+            }
+            char topic[128];
+            size_t topicLen = publish.topicLen < sizeof(topic) - 1 ? publish.topicLen : sizeof(topic) - 1;
+            memcpy(topic, publish.topic, topicLen);
+            topic[topicLen] = '\0';
+            if (callback) {
+                callback(topic, const_cast<uint8_t*>(publish.payload), publish.payloadLen);
+            }
+            break;
+        }
+        case Mqtt5::PINGRESP:
+            keepAlive.pingAnswered();
+            break;
+        case Mqtt5::SUBACK: {
+            // Kept only for the SUBSCRIBE being waited for; a late one is stale
+            Mqtt5::Suback received;
+            if (awaitedSubackId != 0 && Mqtt5::decodeSuback(buffer, len, received) &&
+                received.packetId == awaitedSubackId) {
+                suback = received;
+                subackReceived = true;
+            }
+            break;
+        }
+        case Mqtt5::DISCONNECT: {
+            Mqtt5::Disconnect disconnect;
+            Mqtt5::decodeDisconnect(buffer, len, disconnect);
+            fail("disconnected by broker", disconnect.reason, disconnect.reasonString);
+            Serial.printf("MQTT 5: %s\n", lastError().c_str());
+            drop();
+            break;
+        }
+        default:
+            break;  // PUBACK: nothing to do for QoS 0 publishes
+    }
+}
+
+void Mqtt5Transport::fail(const char* step, uint8_t reason, const char* reasonString) {
+    failedStep = step;
+    failedReason = reason;
+    strlcpy(failedReasonString, reasonString ? reasonString : "", sizeof(failedReasonString));
+}
+
+void Mqtt5Transport::drop() {
+    isConnected = false;
+    client.stop();
+}
+
+uint16_t Mqtt5Transport::packetId() {
+    if (++nextPacketId == 0) {
+        nextPacketId = 1;  // 0 is not a valid packet identifier
+    }
+    return nextPacketId;
+}
@@ -0,0 +1,71 @@
+#ifndef MQTT5_TRANSPORT_H
+#define MQTT5_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "mqtt_transport.h"
+#include "mqtt5_codec.h"
+#include "battery_config.h"
+
+// MQTT 5 over any Arduino Client. Compared with the 3.1.1 transport it
+// sets a Session Expiry Interval, uses topic aliases for repeated publishes
+// and reports the broker's reason codes and reason strings on failure.
+// QoS 0 publishes, QoS 0/1 subscriptions.
+class Mqtt5Transport : public MqttTransport {
+public:
+    explicit Mqtt5Transport(Client& client);
+    
+    const char* protocolName() const override { return "MQTT 5"; }
+    void setServer(const char* host, uint16_t port) override;
+    void setCallback(MessageCallback callback) override { this->callback = callback; }
+    bool connect(const MqttConnectOptions& options) override;
+    bool connected() override;
+    bool sessionPresent() const override { return connack.sessionPresent; }
+    bool publish(const char* topic, const char* payload, bool retained) override;
+    bool beginPublish(const char* topic, size_t length, bool retained) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    bool endPublish() override;
+    bool subscribe(const char* topic, uint8_t qos) override;
+    bool loop() override;
+    void disconnect() override;
+    String lastError() override;
+    
+    const Mqtt5::Connack& getConnack() const { return connack; }
+    uint16_t aliasesAssigned() const { return aliases.assigned(); }
+    
+private:
+    Client& client;
+    const char* host;
+    uint16_t port;
+    MessageCallback callback;
+    
+    uint8_t buffer[Config::MQTT_BUFFER_SIZE];
+    Mqtt5::Connack connack;
+    Mqtt5::TopicAliases aliases;
+    bool isConnected;
+    Mqtt5::KeepAlive keepAlive;
+    uint16_t nextPacketId;
+    size_t streamRemaining;  // Payload bytes still expected by a streamed publish
+    
+    // SUBACK for the SUBSCRIBE in flight, recorded by handlePacket() so one
+    // read by a nested loop() (from the message callback) is not lost
+    uint16_t awaitedSubackId;  // 0 = none
+    bool subackReceived;
+    Mqtt5::Suback suback;
+    
+    // Last failure, for lastError()
+    const char* failedStep;
+    uint8_t failedReason;
+    char failedReasonString[Mqtt5Config::REASON_STRING_LEN];
+    
+    bool send(const uint8_t* data, size_t len);
+    bool readByte(uint8_t& b, unsigned long deadline);
+    int readPacket(uint8_t& type, uint8_t& flags, unsigned long timeoutMs);
+    bool waitFor(uint8_t type, size_t& len, unsigned long timeoutMs);
+    void handlePacket(uint8_t type, uint8_t flags, size_t len);
+    void fail(const char* step, uint8_t reason = 0, const char* reasonString = nullptr);
+    void drop();
+    uint16_t packetId();
+};
+
+#endif // MQTT5_TRANSPORT_H
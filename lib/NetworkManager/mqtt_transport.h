@@ -0,0 +1,43 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <functional>
+
+struct MqttConnectOptions {
+    const char* clientId;
+    const char* user;
+    const char* password;
+    const char* willTopic;      // nullptr = no LWT
+    const char* willPayload;
+    uint32_t sessionExpirySec;  // MQTT 5 only; 3.1.1 sessions never expire
+    bool topicAliases;          // MQTT 5 only; pays off when topics repeat on one connection
+};
+
+// MQTT protocol client used by NetworkManager. Sessions are always resumed
+// (clean_session / clean start = false) so subscriptions survive deep sleep.
+class MqttTransport {
+public:
+    using MessageCallback = std::function<void(char* topic, uint8_t* payload, unsigned int length)>;
+    
+    virtual ~MqttTransport() {}
+    
+    virtual const char* protocolName() const = 0;
+    virtual void setServer(const char* host, uint16_t port) = 0;
+    virtual void setCallback(MessageCallback callback) = 0;
+    virtual bool connect(const MqttConnectOptions& options) = 0;
+    virtual bool connected() = 0;
+    virtual bool sessionPresent() const = 0;  // Broker kept our session (valid after connect)
+    virtual bool publish(const char* topic, const char* payload, bool retained) = 0;
+    // Streamed publish for payloads larger than the packet buffer:
+    // beginPublish(), write() exactly length bytes, endPublish()
+    virtual bool beginPublish(const char* topic, size_t length, bool retained) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+    virtual bool endPublish() = 0;
+    virtual bool subscribe(const char* topic, uint8_t qos) = 0;
+    virtual bool loop() = 0;
+    virtual void disconnect() = 0;
+    virtual String lastError() = 0;     // Why the last operation failed, for logs
+};
+
+#endif // MQTT_TRANSPORT_H
@@ -1,13 +1,123 @@
 #include "network_manager.h"
 #include <time.h>
 #include "../../include/mqtt_credentials.h"
+#include "history_query.h"
 
-NetworkManager::NetworkManager(WiFiClientSecure& wifi, PubSubClient& mqtt, ConfigManager& cfg)
-    : wifiClient(wifi), mqttClient(mqtt), config(cfg), 
-      wifiConnected(false), mqttConnected(false) {
-    mqttClient.setCallback([this](char* topic, byte* payload, unsigned int length) {
-        this->mqttCallback(topic, payload, length);
+// Command topics (below MQTT_TOPIC_BASE), all subscribed with QoS 1
+static const char* const COMMAND_TOPICS[] = {
+    "/ota",
+    "/reset",
+    "/config/battery_type",
+    "/history"
+};
+
+// Version of the topic set the broker session was subscribed to (0 = none).
+// Survives deep sleep so a resumed session skips SUBSCRIBE.
+RTC_DATA_ATTR static uint32_t subscribedTopicsVersion = 0;
+
+// Home Assistant sensors, published as components of one device discovery
+// config. State topics are <hostname>_<key>/state.
+struct DiscoveryComponent {
+    const char* key;
+    const char* name;
+    const char* options;  // Extra JSON members, each followed by a comma
+    bool local;           // This device's own radio/firmware; sensor units behind a gateway have none
+};
+static const DiscoveryComponent DISCOVERY_COMPONENTS[] = {
+    {"voltage", "Battery Voltage", "\"unit_of_measurement\":\"V\",\"device_class\":\"voltage\",\"state_class\":\"measurement\",", false},
+    {"percentage", "Battery Level", "\"unit_of_measurement\":\"%\",\"device_class\":\"battery\",\"state_class\":\"measurement\",", false},
+    {"status", "Battery Status", "\"icon\":\"mdi:battery-check\",", false},
+    {"rssi", "WiFi Signal", "\"unit_of_measurement\":\"dBm\",\"device_class\":\"signal_strength\",\"state_class\":\"measurement\",", true},
+    {"boot", "Boot Count", "\"icon\":\"mdi:restart\",\"state_class\":\"total_increasing\",", false},
+    {"last_updated", "Last Updated", "\"device_class\":\"timestamp\",\"icon\":\"mdi:clock-check\",", false},
+    {"firmware", "Firmware Version", "\"icon\":\"mdi:chip\",\"entity_category\":\"diagnostic\",", true},
+    {"battery_type", "Battery Type", "\"icon\":\"mdi:battery\",", false},
+    {"tx_power", "WiFi TX Power", "\"unit_of_measurement\":\"dBm\",\"icon\":\"mdi:antenna\",\"entity_category\":\"diagnostic\",", true}
+};
+// Components that had per-entity configs before device discovery (the first ones)
+static const size_t LEGACY_DISCOVERY_COMPONENTS = 8;
+
+// Fingerprint of the last discovery payload published (0 = none), so
+// wakes with an unchanged config skip the publish
+RTC_DATA_ATTR static uint32_t discoveryFingerprint = 0;
+
+static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+static uint32_t fnv1a(uint32_t hash, const char* text) {
+    for (; *text; text++) {
+        hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619u;
+    }
+    return hash;
+}
+
+// What was learned about each configured WiFi network (by NVS slot)
+struct WifiNetworkStats {
+    uint32_t id;          // Hash of the SSID; a changed slot starts over
+    uint32_t lastJoined;  // wifiJoinCount when last joined (0 = never)
+    int8_t rssi;
+    uint8_t channel;      // 0 = not known / not seen in the last scan
+    uint8_t bssid[6];
+    uint8_t misses;       // Consecutive scans the network was not found in
+    uint8_t txStep;       // Index into TX_POWER_STEPS used for this AP
+    uint8_t txFailStep;   // Lowest power step that failed on this AP (0 = none)
+    uint8_t txFailAge;    // Good joins since txFailStep was set
+    uint8_t txGoodLinks;  // Reliable joins at txStep since the last change
+};
+RTC_DATA_ATTR static WifiNetworkStats wifiStats[Config::MAX_WIFI_NETWORKS] = {};
+RTC_DATA_ATTR static uint32_t wifiJoinCount = 0;
+RTC_DATA_ATTR static uint8_t wifiScanBackoff = 0;   // Wakes to skip between scans when nothing is in range
+RTC_DATA_ATTR static uint8_t wifiScansSkipped = 0;
+
+// TX power levels, strongest first. The policy steps down one level after a
+// few reliable wakes and back up after a failure.
+static const wifi_power_t TX_POWER_STEPS[] = {
+    WIFI_POWER_19_5dBm, WIFI_POWER_17dBm, WIFI_POWER_15dBm, WIFI_POWER_13dBm,
+    WIFI_POWER_11dBm, WIFI_POWER_8_5dBm, WIFI_POWER_7dBm
+};
+static const uint8_t TX_POWER_STEP_COUNT = sizeof(TX_POWER_STEPS) / sizeof(TX_POWER_STEPS[0]);
+
+// Connect statistics per broker list entry, used to rank the brokers
+struct BrokerStats {
+    uint32_t id;         // Hash of host:port; an edited entry starts over
+    uint32_t connectMs;  // Smoothed time to a connected session (0 = not measured)
+    time_t failedAt;
+    uint8_t failures;    // Consecutive failed attempts
+};
+RTC_DATA_ATTR static BrokerStats brokerStats[Config::MAX_BROKERS] = {};
+
+// Last resolved address of each broker list entry, so timer wakes can skip
+// the DNS lookup (also after failing over to a fallback broker)
+struct BrokerAddressCache {
+    char host[64];
+    uint32_t address;
+    time_t resolvedAt;
+    uint32_t lookupMs;  // What the lookup took
+};
+RTC_DATA_ATTR static BrokerAddressCache brokerAddresses[Config::MAX_BROKERS] = {};
+
+static bool brokerAddressValid(const BrokerAddressCache& cache, const char* host) {
+    // time() keeps counting through deep sleep; a backwards jump expires the entry
+    time_t now = time(nullptr);
+    return cache.address != 0 &&
+           strcmp(cache.host, host) == 0 &&
+           now >= cache.resolvedAt &&
+           now - cache.resolvedAt < (time_t)Config::DNS_CACHE_TTL_S;
+}
+
+NetworkManager::NetworkManager(WiFiClientSecure& wifi, SessionClient& session, PubSubClient& mqtt, ConfigManager& cfg)
+    : wifiClient(wifi), sessionClient(session), mqtt311(mqtt, session), mqtt5(session),
+      mqtt(&mqtt311), config(cfg), 
+      lastReconnectAttempt(0), reconnectBackoffMs(0),
+      persistentSession(false), reportIntervalSec(Config::DEEP_SLEEP_INTERVAL_US / 1000000),
+      timings(), brokerCount(0), connectedSlot(-1), txPowerRated(false), listenMode(false), uplink(nullptr), readingLog(nullptr), wifiConnected(false), mqttConnected(false) {
+    sessionClient.setConnector([this](const char* host, uint16_t port) {
+        return this->connectBroker(host, port);
     });
+    auto callback = [this](char* topic, byte* payload, unsigned int length) {
+        this->mqttCallback(topic, payload, length);
+    };
+    mqtt311.setCallback(callback);
+    mqtt5.setCallback(callback);
 }
 
 void NetworkManager::setOTACallback(std::function<void(const String&)> callback) {
@@ -18,10 +128,21 @@ void NetworkManager::setResetCallback(std::function<void()> callback) {
     resetCallback = callback;
 }
 
+void NetworkManager::setAvailabilityMode(bool persistent, uint32_t intervalSec) {
+    persistentSession = persistent;
+    reportIntervalSec = intervalSec;
+}
+
+uint32_t NetworkManager::expireAfterSec(uint32_t intervalSec) const {
+    return intervalSec * Config::EXPIRE_AFTER_INTERVALS + Config::EXPIRE_AFTER_GRACE_S;
+}
+
+DeviceIdentity NetworkManager::selfIdentity() const {
+    DeviceIdentity self = {WiFi.getHostname(), BatteryMonitor::getBatteryTypeName(), nullptr, reportIntervalSec};
+    return self;
+}
+
 bool NetworkManager::connectWiFi() {
-    Serial.print("Connecting to WiFi: ");
-    Serial.println(config.wifiSSID);
-    
     // Set hostname before connecting
     WiFi.setHostname(config.mqttClientID.c_str());
     
@@ -40,16 +161,14 @@ bool NetworkManager::connectWiFi() {
         Serial.println("Using static IP configuration");
     }
     
-    WiFi.begin(config.wifiSSID.c_str(), config.wifiPassword.c_str());
-    
     unsigned long startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startTime < Config::WIFI_TIMEOUT_MS) {
-        delay(500);
-        Serial.print(".");
-    }
+    timings.wifiFast = false;
+    joinWiFi();
     
     if (WiFi.status() == WL_CONNECTED) {
-        Serial.println(" Connected!");
+        timings.wifiMs = millis() - startTime;
+        Serial.printf(" Connected to %s (%d dBm, channel %d)%s\n", WiFi.SSID().c_str(), WiFi.RSSI(),
+                      (int)WiFi.channel(), timings.wifiFast ? " via fast connect" : "");
         Serial.print("IP Address: ");
         Serial.println(WiFi.localIP());
         
@@ -78,83 +197,572 @@ bool NetworkManager::connectWiFi() {
     }
 }
 
-bool NetworkManager::connectMQTT() {
+// Nothing known in range: wait 1, 2, 4... wakes before the next scan
+static void backOffScans() {
+    wifiScanBackoff = min<uint8_t>(wifiScanBackoff == 0 ? 1 : wifiScanBackoff * 2, Config::WIFI_MAX_SCAN_BACKOFF);
+}
+
+bool NetworkManager::joinWiFi() {
+    int slots[Config::MAX_WIFI_NETWORKS];
+    int count = loadWifiNetworks(slots);
+    if (count == 0) {
+        Serial.println("No WiFi network configured");
+        return false;
+    }
+    WiFi.mode(WIFI_STA);
+    
+    // Most likely network first: the one joined last, on its cached
+    // channel and BSSID, which skips the scan inside WiFi.begin()
+    int likely = slots[0];
+    WifiNetworkStats& last = wifiStats[likely];
+    if (last.lastJoined > 0 && last.channel > 0 && last.misses < Config::WIFI_ABSENT_AFTER_MISSES) {
+        Serial.printf("Connecting to WiFi: %s (fast, channel %u)", config.getWifiSSID(likely).c_str(), last.channel);
+        if (tryWiFi(likely, last.channel, last.bssid, Config::WIFI_FAST_CONNECT_TIMEOUT_MS, 0)) {
+            timings.wifiFast = true;
+            return true;
+        }
+        Serial.println(" not found");
+        last.channel = 0;  // The AP moved or went away; rediscover it
+    }
+    
+    // Out of range of every known network for a while (a van on the road):
+    // only scan every few wakes instead of paying for it on each one
+    if (wifiScansSkipped < wifiScanBackoff) {
+        wifiScansSkipped++;
+        Serial.printf("No known WiFi network nearby, next scan in %u wake(s)\n", wifiScanBackoff - wifiScansSkipped + 1);
+        return false;
+    }
+    wifiScansSkipped = 0;
+    
+    // A single network needs no separate scan: WiFi.begin() looks for it
+    // anyway, and tryWiFi() counts the miss when it is not found
+    if (count == 1) {
+        Serial.printf("Connecting to WiFi: %s", config.getWifiSSID(likely).c_str());
+        uint8_t misses = last.misses;
+        if (tryWiFi(likely, 0, nullptr, Config::WIFI_TIMEOUT_MS, 0)) {
+            wifiScanBackoff = 0;
+            return true;
+        }
+        if (last.misses > misses) {
+            Serial.println(" not in range");
+            backOffScans();
+        }
+        return false;
+    }
+    
+    Serial.print("Scanning for known WiFi networks...");
+    int16_t found = WiFi.scanNetworks(false, false, false, Config::WIFI_SCAN_MS_PER_CHANNEL);
+    int present = 0;
+    for (int i = 0; i < count; i++) {
+        WifiNetworkStats& stats = wifiStats[slots[i]];
+        int best = -1;
+        for (int16_t n = 0; n < found; n++) {
+            if (WiFi.SSID(n) == config.getWifiSSID(slots[i]) && (best < 0 || WiFi.RSSI(n) > WiFi.RSSI(best))) {
+                best = n;
+            }
+        }
+        if (best >= 0) {
+            stats.rssi = WiFi.RSSI(best);
+            stats.channel = WiFi.channel(best);
+            memcpy(stats.bssid, WiFi.BSSID(best), sizeof(stats.bssid));
+            stats.misses = 0;
+            present++;
+        } else {
+            stats.channel = 0;
+            stats.misses = stats.misses < 255 ? stats.misses + 1 : 255;
+        }
+    }
+    WiFi.scanDelete();
+    Serial.printf(" %d of %d in range\n", present, count);
+    
+    if (present == 0) {
+        backOffScans();
+        return false;
+    }
+    wifiScanBackoff = 0;
+    
+    // Strongest network in range first
+    std::stable_sort(slots, slots + count, [](int a, int b) {
+        bool inRangeA = wifiStats[a].channel > 0, inRangeB = wifiStats[b].channel > 0;
+        return inRangeA != inRangeB ? inRangeA : wifiStats[a].rssi > wifiStats[b].rssi;
+    });
+    for (int i = 0; i < present; i++) {
+        WifiNetworkStats& stats = wifiStats[slots[i]];
+        Serial.printf("Connecting to WiFi: %s (%d dBm)", config.getWifiSSID(slots[i]).c_str(), stats.rssi);
+        if (tryWiFi(slots[i], stats.channel, stats.bssid, Config::WIFI_TIMEOUT_MS, stats.rssi)) {
+            return true;
+        }
+        Serial.println(" failed");
+    }
+    return false;
+}
+
+bool NetworkManager::tryWiFi(int slot, uint8_t channel, const uint8_t* bssid, unsigned long timeoutMs, int8_t seenRssi) {
+    // Full power saving off while connecting and publishing: DTIM wake-ups
+    // would only stretch the handshakes
+    WiFi.setSleep(WIFI_PS_NONE);
+    WiFi.setTxPower(TX_POWER_STEPS[wifiStats[slot].txStep]);
+    if (channel > 0) {
+        WiFi.begin(config.getWifiSSID(slot).c_str(), config.getWifiPassword(slot).c_str(), channel, bssid);
+    } else {
+        WiFi.begin(config.getWifiSSID(slot).c_str(), config.getWifiPassword(slot).c_str());
+    }
+    
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+        delay(100);
+        if ((millis() - start) % 500 < 100) {
+            Serial.print(".");
+        }
+    }
+    if (WiFi.status() != WL_CONNECTED) {
+        if (channel == 0 && WiFi.status() == WL_NO_SSID_AVAIL) {
+            // The scan inside WiFi.begin() did not find the network
+            WifiNetworkStats& stats = wifiStats[slot];
+            stats.misses = stats.misses < 255 ? stats.misses + 1 : 255;
+        }
+        WiFi.disconnect();
+        // Only a join that failed although the AP was heard well points at
+        // our TX power; an AP that is away or was not scanned says nothing
+        if (seenRssi != 0 && seenRssi >= Config::WIFI_TX_POWER_MIN_RSSI) {
+            updateTxPower(slot, false);
+        }
+        return false;
+    }
+    
+    WifiNetworkStats& stats = wifiStats[slot];
+    if (memcmp(stats.bssid, WiFi.BSSID(), sizeof(stats.bssid)) != 0) {
+        // Another access point: what was learned about the old one does not apply
+        stats.txStep = 0;
+        stats.txFailStep = 0;
+        stats.txFailAge = 0;
+        stats.txGoodLinks = 0;
+    }
+    connectedSlot = slot;
+    txPowerRated = false;
+    stats.lastJoined = ++wifiJoinCount;
+    stats.rssi = WiFi.RSSI();
+    stats.channel = WiFi.channel();
+    memcpy(stats.bssid, WiFi.BSSID(), sizeof(stats.bssid));
+    stats.misses = 0;
+    return true;
+}
+
+void NetworkManager::updateTxPower(int slot, bool linkOk) {
+    WifiNetworkStats& stats = wifiStats[slot];
+    if (!linkOk) {
+        // Back up one step and do not try the failing level again on this AP
+        if (stats.txStep > 0) {
+            stats.txFailStep = stats.txStep;
+            stats.txFailAge = 0;
+            stats.txStep--;
+        }
+        stats.txGoodLinks = 0;
+        return;
+    }
+    if (WiFi.RSSI() < Config::WIFI_TX_POWER_MIN_RSSI) {
+        // Weak link: the AP is likely near the edge of our range too
+        if (stats.txStep > 0) {
+            stats.txStep--;
+        }
+        stats.txGoodLinks = 0;
+        return;
+    }
+    if (stats.txFailStep > 0 && ++stats.txFailAge >= Config::WIFI_TX_FAIL_EXPIRE_AFTER) {
+        // The failure may have been a passing one (interference, a busy AP): try that level again
+        stats.txFailStep = 0;
+        stats.txFailAge = 0;
+    }
+    uint8_t next = stats.txStep + 1;
+    bool lowerAllowed = next < TX_POWER_STEP_COUNT && (stats.txFailStep == 0 || next < stats.txFailStep);
+    if (++stats.txGoodLinks >= Config::WIFI_TX_POWER_STEP_AFTER && lowerAllowed) {
+        stats.txStep = next;
+        stats.txGoodLinks = 0;
+    }
+}
+
+void NetworkManager::setListenMode(bool listening) {
+    listenMode = listening;
+    if (WiFi.status() == WL_CONNECTED) {
+        // Between commands the radio only wakes for DTIM beacons
+        WiFi.setSleep(listening ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE);
+    }
+}
+
+float NetworkManager::getTxPowerDbm() const {
+    return connectedSlot < 0 ? 0 : WiFi.getTxPower() / 4.0f;
+}
+
+void NetworkManager::printRadioPolicy() const {
+    if (connectedSlot < 0) {
+        return;
+    }
+    const WifiNetworkStats& stats = wifiStats[connectedSlot];
+    Serial.printf("Radio: TX power %.1f dBm (step %u/%u", getTxPowerDbm(), stats.txStep, (unsigned)(TX_POWER_STEP_COUNT - 1));
+    if (stats.txFailStep > 0) {
+        Serial.printf(", %.1f dBm failed", TX_POWER_STEPS[stats.txFailStep] / 4.0f);
+    }
+    Serial.printf(") | RSSI %d dBm | modem sleep %s\n", WiFi.RSSI(), listenMode ? "max (DTIM)" : "off");
+    if (WiFi.getTxPower() != TX_POWER_STEPS[stats.txStep]) {
+        Serial.printf("✗ TX power policy wants %.1f dBm, radio is at %.1f dBm\n",
+                      TX_POWER_STEPS[stats.txStep] / 4.0f, getTxPowerDbm());
+    }
+}
+
+int NetworkManager::loadWifiNetworks(int slots[]) {
+    int count = 0;
+    for (int slot = 0; slot < Config::MAX_WIFI_NETWORKS; slot++) {
+        const String& ssid = config.getWifiSSID(slot);
+        if (ssid.length() == 0) {
+            continue;
+        }
+        uint32_t id = fnv1a(FNV_OFFSET_BASIS, ssid.c_str());
+        if (wifiStats[slot].id != id) {
+            wifiStats[slot] = {};  // New or changed network in this slot
+            wifiStats[slot].id = id;
+        }
+        slots[count++] = slot;
+    }
+    
+    // Most recently joined first; networks absent from recent scans last
+    std::stable_sort(slots, slots + count, [](int a, int b) {
+        bool absentA = wifiStats[a].misses >= Config::WIFI_ABSENT_AFTER_MISSES;
+        bool absentB = wifiStats[b].misses >= Config::WIFI_ABSENT_AFTER_MISSES;
+        return absentA != absentB ? absentB : wifiStats[a].lastJoined > wifiStats[b].lastJoined;
+    });
+    return count;
+}
+
+bool NetworkManager::connectMQTT(unsigned long timeoutMs) {
+    int order[Config::MAX_BROKERS];
+    loadBrokers(order);
     Serial.print("Connecting to MQTT broker: ");
-    Serial.println(config.mqttServer);
+    Serial.println(brokerHosts[order[0]]);
     
     // Configure SSL/TLS for secure MQTT connection
-    wifiClient.setCACert(MQTT_CA_CERT);
-    Serial.println("SSL/TLS enabled with certificate validation");
+    if (config.usePsk()) {
+        Serial.printf("SSL/TLS enabled with pre-shared key (identity %s)\n", config.mqttPskIdentity.c_str());
+    } else {
+        wifiClient.setCACert(MQTT_CA_CERT);
+        Serial.println("SSL/TLS enabled with certificate validation");
+    }
+    // Give up on an unreachable broker quickly so the next one gets a chance
+    wifiClient.setTimeout(Config::MQTT_ATTEMPT_TIMEOUT_S);
+    wifiClient.setHandshakeTimeout(Config::MQTT_ATTEMPT_TIMEOUT_S);
     
-    mqttClient.setServer(config.mqttServer.c_str(), config.mqttPort);
+    mqtt = config.mqttVersion == 5 ? static_cast<MqttTransport*>(&mqtt5) : &mqtt311;
+    Serial.printf("Protocol: %s, buffer %u bytes\n", mqtt->protocolName(), (unsigned)Config::MQTT_BUFFER_SIZE);
     
-    // Increase buffer size for discovery messages (default 256 may be too small)
-    mqttClient.setBufferSize(1024);
-    Serial.printf("MQTT buffer size: %d bytes\n", mqttClient.getBufferSize());
+    // Availability topic, only used while the connection is kept open
+    char stateTopic[100];
+    snprintf(stateTopic, sizeof(stateTopic), "%s_availability/state", WiFi.getHostname());
+    
+    // Sessions are resumed to persist subscriptions across deep sleep.
+    // A persistent session registers an LWT ("offline") for a lost
+    // connection; a sleeping device has none and is covered by expire_after.
+    // MQTT 5 lets the broker drop the session once it is as stale as the
+    // sensors, and topic aliases only pay off on a connection kept open.
+    MqttConnectOptions options = {};
+    options.clientId = config.mqttClientID.c_str();
+    options.user = config.mqttUser.c_str();
+    options.password = config.mqttPassword.c_str();
+    options.willTopic = persistentSession ? stateTopic : nullptr;
+    options.willPayload = "offline";
+    options.sessionExpirySec = expireAfterSec(reportIntervalSec);
+    options.topicAliases = persistentSession;
     
     unsigned long startTime = millis();
-    while (!mqttClient.connected() && millis() - startTime < Config::MQTT_TIMEOUT_MS) {
-        // Prepare Last Will and Testament (LWT) for availability topic
-        char stateTopic[100];
-        snprintf(stateTopic, sizeof(stateTopic), "%s_availability/state", WiFi.getHostname());
-        
-        // Use clean_session=false to persist subscriptions across deep sleep
-        // LWT: publish "offline" to availability topic when connection is lost
-        if (mqttClient.connect(config.mqttClientID.c_str(), config.mqttUser.c_str(), config.mqttPassword.c_str(), 
-                               stateTopic, 1, true, "offline", false)) {
-            Serial.println(" Connected!");
-            
-            // Subscribe to OTA trigger topic with QoS 1 for guaranteed delivery
-            char otaTopic[100];
-            snprintf(otaTopic, sizeof(otaTopic), "%s/ota", Config::MQTT_TOPIC_BASE);
-            mqttClient.subscribe(otaTopic, 1);  // QoS 1
-            Serial.print("Subscribed to OTA topic (QoS 1): ");
-            Serial.println(otaTopic);
-            
-            // Subscribe to reset topic
-            char resetTopic[100];
-            snprintf(resetTopic, sizeof(resetTopic), "%s/reset", Config::MQTT_TOPIC_BASE);
-            mqttClient.subscribe(resetTopic, 1);  // QoS 1
-            Serial.print("Subscribed to reset topic (QoS 1): ");
-            Serial.println(resetTopic);
+    do {
+        // One attempt per broker, fastest healthy one first
+        for (int i = 0; i < brokerCount; i++) {
+            int slot = order[i];
+            mqtt->setServer(brokerHosts[slot].c_str(), brokerPorts[slot]);
             
-            // Subscribe to config change topic: battery type
-            char cfgBatteryTypeTopic[128];
-            snprintf(cfgBatteryTypeTopic, sizeof(cfgBatteryTypeTopic), "%s/config/battery_type", Config::MQTT_TOPIC_BASE);
-            mqttClient.subscribe(cfgBatteryTypeTopic, 1);
-            Serial.print("Subscribed to config topic (battery_type): ");
-            Serial.println(cfgBatteryTypeTopic);
-            
-            // Publish availability state as "online"
-            char stateTopic[100];
-            snprintf(stateTopic, sizeof(stateTopic), "%s_availability/state", WiFi.getHostname());
-            mqttClient.publish(stateTopic, "online", true);
-            Serial.print("Published availability state: online to ");
-            Serial.println(stateTopic);
-            
-            // Publish Home Assistant discovery messages
-            publishHomeAssistantDiscovery();
-            
-            mqttConnected = true;
-            return true;
+            unsigned long attemptStart = millis();
+            if (mqtt->connect(options)) {
+                unsigned long setupStart = millis();
+                timings.mqttMs = setupStart - attemptStart - timings.dnsMs - timings.tlsMs;
+                recordBrokerResult(slot, true, setupStart - attemptStart);
+                Serial.printf(" Connected to %s:%u!\n", brokerHosts[slot].c_str(), brokerPorts[slot]);
+                
+                // With clean_session=false the broker keeps our subscriptions;
+                // only send SUBSCRIBE when it lost the session or the topics changed
+                uint32_t topicsVersion = commandTopicsVersion();
+                if (mqtt->sessionPresent() && subscribedTopicsVersion == topicsVersion) {
+                    Serial.println("Session resumed, subscriptions kept by broker");
+                } else {
+                    Serial.println(mqtt->sessionPresent()
+                        ? "Session resumed, command topics changed"
+                        : "New session, subscribing to command topics");
+                    subscribedTopicsVersion = subscribeCommandTopics() ? topicsVersion : 0;
+                }
+                
+                if (persistentSession) {
+                    mqtt->publish(stateTopic, "online", true);
+                    Serial.print("Published availability state: online to ");
+                    Serial.println(stateTopic);
+                }
+                
+                // Publish Home Assistant discovery messages
+                publishHomeAssistantDiscovery(selfIdentity(), discoveryFingerprint);
+                timings.setupMs = millis() - setupStart;
+                printTimings();
+                
+                mqttConnected = true;
+                return true;
+            }
+            recordBrokerResult(slot, false, millis() - attemptStart);
+            Serial.printf(" %s:%u failed after %lu ms (%s)\n", brokerHosts[slot].c_str(), brokerPorts[slot],
+                          millis() - attemptStart, mqtt->lastError().c_str());
+            if (timeoutMs > 0 && millis() - startTime >= timeoutMs) {
+                break;  // A single pass (timeoutMs = 0) still tries every broker
+            }
+        }
+        if (millis() - startTime >= timeoutMs) {
+            break;
         }
         delay(500);
         Serial.print(".");
-    }
+    } while (true);
     
     Serial.println(" Failed!");
     mqttConnected = false;
     return false;
 }
 
-void NetworkManager::publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) {
-    if (!mqttClient.connected()) {
-        Serial.println("MQTT not connected, skipping publish");
+void NetworkManager::loadBrokers(int order[]) {
+    brokerCount = config.getBrokers(brokerHosts, brokerPorts, Config::MAX_BROKERS);
+    time_t now = time(nullptr);
+    
+    for (int i = 0; i < brokerCount; i++) {
+        char port[8];
+        snprintf(port, sizeof(port), ":%u", brokerPorts[i]);
+        uint32_t id = fnv1a(fnv1a(FNV_OFFSET_BASIS, brokerHosts[i].c_str()), port);
+        if (brokerStats[i].id != id) {
+            brokerStats[i] = {id, 0, 0, 0};  // New or edited list entry
+        }
+        order[i] = i;
+    }
+    
+    // Measured brokers by smoothed connect time, then unmeasured ones in list
+    // order, then those that failed within the hold-off, least failures first
+    auto rank = [&](int slot) -> uint64_t {
+        const BrokerStats& stats = brokerStats[slot];
+        bool holdoff = stats.failures > 0 && now >= stats.failedAt &&
+                       now - stats.failedAt < (time_t)Config::BROKER_FAILED_HOLDOFF_S;
+        if (holdoff) {
+            return (2ULL << 32) | ((uint64_t)stats.failures << 8) | slot;
+        }
+        return stats.connectMs > 0 ? stats.connectMs : (1ULL << 32) | slot;
+    };
+    std::stable_sort(order, order + brokerCount, [&](int a, int b) { return rank(a) < rank(b); });
+    
+    if (brokerCount > 1) {
+        Serial.print("Broker order:");
+        for (int i = 0; i < brokerCount; i++) {
+            const BrokerStats& stats = brokerStats[order[i]];
+            Serial.printf(" %s%s:%u", i > 0 ? "> " : "", brokerHosts[order[i]].c_str(), brokerPorts[order[i]]);
+            if (stats.failures > 0) {
+                Serial.printf(" (failed %ux)", stats.failures);
+            } else if (stats.connectMs > 0) {
+                Serial.printf(" (%lu ms)", (unsigned long)stats.connectMs);
+            }
+        }
+        Serial.println();
+    }
+}
+
+void NetworkManager::recordBrokerResult(int slot, bool connected, uint32_t elapsedMs) {
+    BrokerStats& stats = brokerStats[slot];
+    if (connected) {
+        // Smoothed over wakes so one slow handshake does not reorder the list
+        stats.connectMs = stats.connectMs == 0 ? elapsedMs : (stats.connectMs * 3 + elapsedMs) / 4;
+        if (stats.connectMs == 0) {
+            stats.connectMs = 1;
+        }
+        stats.failures = 0;
+    } else {
+        stats.failures = stats.failures < 255 ? stats.failures + 1 : 255;
+        stats.failedAt = time(nullptr);
+    }
+}
+
+int NetworkManager::connectBroker(const char* host, uint16_t port) {
+    IPAddress address;
+    timings.dnsMs = 0;
+    timings.dnsSavedMs = 0;
+    timings.tlsMs = 0;
+    timings.dnsCached = false;
+    
+    // Cache entry of the broker list slot being tried (none for a host not in the list)
+    BrokerAddressCache* cache = nullptr;
+    for (int i = 0; i < brokerCount; i++) {
+        if (brokerHosts[i] == host && brokerPorts[i] == port) {
+            cache = &brokerAddresses[i];
+            break;
+        }
+    }
+    
+    if (address.fromString(host)) {
+        // IP address configured, nothing to resolve
+    } else if (cache && brokerAddressValid(*cache, host)) {
+        address = IPAddress(cache->address);
+        timings.dnsCached = true;
+        timings.dnsSavedMs = cache->lookupMs;
+        Serial.printf("Using cached broker address %s\n", address.toString().c_str());
+    } else if (!resolveBroker(host, address, cache)) {
+        return 0;
+    }
+    
+    unsigned long start = millis();
+    int ok = openTls(address, port, host);
+    
+    if (!ok && timings.dnsCached) {
+        // The broker may have moved: look it up again before giving up
+        Serial.println("Cached broker address failed, resolving again");
+        cache->address = 0;
+        timings.dnsCached = false;
+        timings.dnsSavedMs = 0;
+        IPAddress fresh;
+        if (resolveBroker(host, fresh, cache) && uint32_t(fresh) != uint32_t(address)) {
+            start = millis();
+            ok = openTls(fresh, port, host);
+        }
+    }
+    timings.tlsMs = millis() - start;
+    return ok;
+}
+
+int NetworkManager::openTls(const IPAddress& address, uint16_t port, const char* host) {
+    timings.tlsPsk = config.usePsk();
+    if (timings.tlsPsk) {
+        // Symmetric key exchange: no certificate chain to verify
+        return wifiClient.connect(address, port, config.mqttPskIdentity.c_str(), config.mqttPsk.c_str());
+    }
+    // Connect by address but verify the certificate against the host name
+    return wifiClient.connect(address, port, host, MQTT_CA_CERT, nullptr, nullptr);
+}
+
+bool NetworkManager::resolveBroker(const char* host, IPAddress& address, BrokerAddressCache* cache) {
+    unsigned long start = millis();
+    if (!WiFi.hostByName(host, address)) {
+        Serial.printf("❌ DNS lookup failed for %s\n", host);
+        return false;
+    }
+    timings.dnsMs = millis() - start;
+    Serial.printf("Resolved %s to %s (%lu ms)\n", host, address.toString().c_str(), (unsigned long)timings.dnsMs);
+    
+    if (cache) {
+        strlcpy(cache->host, host, sizeof(cache->host));
+        cache->address = uint32_t(address);
+        cache->resolvedAt = time(nullptr);
+        cache->lookupMs = timings.dnsMs;
+    }
+    return true;
+}
+
+void NetworkManager::printTimings() const {
+    Serial.printf("Connect phases: WiFi %lu ms%s | DNS %lu ms", 
+                  (unsigned long)timings.wifiMs, timings.wifiFast ? " (fast)" : "", (unsigned long)timings.dnsMs);
+    if (timings.dnsCached) {
+        Serial.printf(" (cached, saved ~%lu ms)", (unsigned long)timings.dnsSavedMs);
+    }
+    Serial.printf(" | TCP+TLS (%s) %lu ms | MQTT %lu ms | setup %lu ms\n",
+                  timings.tlsPsk ? "PSK" : "cert", (unsigned long)timings.tlsMs, (unsigned long)timings.mqttMs, (unsigned long)timings.setupMs);
+}
+
+void NetworkManager::benchmarkHandshake(int rounds) {
+    Serial.println("\n╔═══════════════════════════════╗");
+    Serial.println("║   TLS Handshake Benchmark     ║");
+    Serial.println("╚═══════════════════════════════╝");
+    Serial.printf("Mode: %s, broker %s:%u, %d rounds\n",
+                  config.usePsk() ? "PSK" : "CA certificate",
+                  config.mqttServer.c_str(), config.mqttPort, rounds);
+    
+    if (WiFi.status() != WL_CONNECTED && !connectWiFi()) {
+        Serial.println("✗ WiFi not connected");
         return;
     }
+    if (mqtt->connected()) {
+        // The benchmark needs the TLS socket; a kept-open session reconnects afterwards
+        mqtt->disconnect();
+        mqttConnected = false;
+    }
+    
+    uint32_t total = 0, best = UINT32_MAX, worst = 0;
+    int done = 0;
+    for (int i = 0; i < rounds; i++) {
+        bool ok = connectBroker(config.mqttServer.c_str(), config.mqttPort) != 0;
+        wifiClient.stop();
+        if (!ok) {
+            Serial.printf("  #%d failed after %lu ms\n", i + 1, (unsigned long)timings.tlsMs);
+            continue;
+        }
+        Serial.printf("  #%d %lu ms\n", i + 1, (unsigned long)timings.tlsMs);
+        total += timings.tlsMs;
+        best = min(best, timings.tlsMs);
+        worst = max(worst, timings.tlsMs);
+        done++;
+    }
+    
+    if (done > 0) {
+        Serial.printf("TCP+TLS handshake: avg %lu ms, min %lu ms, max %lu ms (%d/%d ok)\n",
+                      (unsigned long)(total / done), (unsigned long)best, (unsigned long)worst, done, rounds);
+    } else {
+        Serial.println("✗ No handshake succeeded");
+    }
+}
+
+bool NetworkManager::subscribeCommandTopics() {
+    bool ok = true;
+    char topic[128];
+    for (const char* suffix : COMMAND_TOPICS) {
+        snprintf(topic, sizeof(topic), "%s%s", Config::MQTT_TOPIC_BASE, suffix);
+        if (mqtt->subscribe(topic, 1)) {  // QoS 1
+            Serial.print("Subscribed (QoS 1): ");
+            Serial.println(topic);
+        } else {
+            Serial.print("❌ Failed to subscribe: ");
+            Serial.println(topic);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+uint32_t NetworkManager::commandTopicsVersion() {
+    // FNV-1a over the full topic names, so renaming the base topic counts too
+    uint32_t hash = FNV_OFFSET_BASIS;
+    auto mix = [&hash](const char* text) {
+        hash = fnv1a(hash, text);
+        hash = (hash ^ '\n') * 16777619u;
+    };
+    for (const char* suffix : COMMAND_TOPICS) {
+        mix(Config::MQTT_TOPIC_BASE);
+        mix(suffix);
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+bool NetworkManager::publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) {
+    if (uplink) {
+        return uplink->publishReading(reading, bootCount, nextReadingTime);
+    }
+    return publishReading(selfIdentity(), reading, bootCount, nextReadingTime);
+}
+
+bool NetworkManager::publishReading(const DeviceIdentity& device, const BatteryReading& reading, int bootCount,
+                                    time_t nextReadingTime) {
+    if (!mqtt->connected()) {
+        Serial.println("MQTT not connected, skipping publish");
+        return false;
+    }
+    
+    bool allPublished = true;
+    bool self = device.viaDevice == nullptr;
     
     char topic[150];
-    const char* hostname = WiFi.getHostname();
+    const char* hostname = device.id;
     
     // Status as text
     const char* statusStr = "";
@@ -171,49 +779,56 @@ void NetworkManager::publishReading(const BatteryReading& reading, int bootCount
     
     // Battery type
     snprintf(topic, sizeof(topic), "%s_battery_type/state", hostname);
-    const char* typeName = BatteryMonitor::getBatteryTypeName();
-    if (!mqttClient.publish(topic, typeName, true)) {
-        Serial.printf("❌ Failed to publish battery type - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (!mqtt->publish(topic, device.batteryType, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish battery type - %s\n", mqtt->lastError().c_str());
     }
     
     // Voltage
     snprintf(topic, sizeof(topic), "%s_voltage/state", hostname);
     snprintf(value, sizeof(value), "%.2f", reading.voltage);
-    if (!mqttClient.publish(topic, value, true)) {
-        Serial.printf("❌ Failed to publish voltage - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (!mqtt->publish(topic, value, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish voltage - %s\n", mqtt->lastError().c_str());
     } 
     
     // Percentage
     snprintf(topic, sizeof(topic), "%s_percentage/state", hostname);
     snprintf(value, sizeof(value), "%.1f", reading.percentage);
-    if (!mqttClient.publish(topic, value, true)) {
-        Serial.printf("❌ Failed to publish percentage - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (!mqtt->publish(topic, value, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish percentage - %s\n", mqtt->lastError().c_str());
     }
     
     // Status
     snprintf(topic, sizeof(topic), "%s_status/state", hostname);
-    if (!mqttClient.publish(topic, statusStr, true)) {
-        Serial.printf("❌ Failed to publish status - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (!mqtt->publish(topic, statusStr, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish status - %s\n", mqtt->lastError().c_str());
     } 
     
     // RSSI
     snprintf(topic, sizeof(topic), "%s_rssi/state", hostname);
     snprintf(value, sizeof(value), "%d", WiFi.RSSI());
-    if (!mqttClient.publish(topic, value, true)) {
-        Serial.printf("❌ Failed to publish RSSI - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (self && !mqtt->publish(topic, value, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish RSSI - %s\n", mqtt->lastError().c_str());
     } 
     
+    // TX power chosen by the radio policy
+    snprintf(topic, sizeof(topic), "%s_tx_power/state", hostname);
+    snprintf(value, sizeof(value), "%.1f", getTxPowerDbm());
+    if (self && !mqtt->publish(topic, value, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish TX power - %s\n", mqtt->lastError().c_str());
+    }
+    
     // Boot count
     snprintf(topic, sizeof(topic), "%s_boot/state", hostname);
     snprintf(value, sizeof(value), "%d", bootCount);
-    if (!mqttClient.publish(topic, value, true)) {
-        Serial.printf("❌ Failed to publish boot count - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (!mqtt->publish(topic, value, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish boot count - %s\n", mqtt->lastError().c_str());
     }
     
     // Last updated (ISO 8601 timestamp)
@@ -224,16 +839,16 @@ void NetworkManager::publishReading(const BatteryReading& reading, int bootCount
     if (getLocalTime(&timeinfo)) {
         char timestamp[30];
         strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &timeinfo);
-        if (!mqttClient.publish(topic, timestamp, true)) {
-            Serial.printf("❌ Failed to publish last updated time - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+        if (!mqtt->publish(topic, timestamp, true)) {
+            allPublished = false;
+            Serial.printf("❌ Failed to publish last updated time - %s\n", mqtt->lastError().c_str());
         }
     } else {
         // Fallback if NTP not synced yet
         snprintf(value, sizeof(value), "%lu", millis() / 1000);
-        if (!mqttClient.publish(topic, value, true)) {
-            Serial.printf("❌ Failed to publish last updated time (no NTP) - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+        if (!mqtt->publish(topic, value, true)) {
+            allPublished = false;
+            Serial.printf("❌ Failed to publish last updated time (no NTP) - %s\n", mqtt->lastError().c_str());
         }
     }
     
@@ -244,9 +859,9 @@ void NetworkManager::publishReading(const BatteryReading& reading, int bootCount
         localtime_r(&nextReadingTime, &nextTimeinfo);
         char nextTimestamp[30];
         strftime(nextTimestamp, sizeof(nextTimestamp), "%Y-%m-%d %H:%M:%S", &nextTimeinfo);
-        if (!mqttClient.publish(topic, nextTimestamp, true)) {
-            Serial.printf("❌ Failed to publish next reading time - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+        if (!mqtt->publish(topic, nextTimestamp, true)) {
+            allPublished = false;
+            Serial.printf("❌ Failed to publish next reading time - %s\n", mqtt->lastError().c_str());
         }
     }
     
@@ -259,135 +874,207 @@ void NetworkManager::publishReading(const BatteryReading& reading, int bootCount
         "dev"
         #endif
     ;
-    if (!mqttClient.publish(topic, fwVersion, true)) {
-        Serial.printf("❌ Failed to publish firmware version - State: %d, Buffer: %d bytes\n", 
-                      mqttClient.state(), mqttClient.getBufferSize());
+    if (self && !mqtt->publish(topic, fwVersion, true)) {
+        allPublished = false;
+        Serial.printf("❌ Failed to publish firmware version - %s\n", mqtt->lastError().c_str());
     }
     
     Serial.printf("Published sensor states for device: %s\n", hostname);
+    if (self && connectedSlot >= 0) {
+        // A good link counts once per association (one per wake with deep
+        // sleep); with the link kept up, publishes every few seconds would
+        // otherwise walk the power down within minutes. Failures always count.
+        uint8_t step = wifiStats[connectedSlot].txStep;
+        if (!allPublished || !txPowerRated) {
+            updateTxPower(connectedSlot, allPublished);
+            txPowerRated = true;
+        }
+        if (wifiStats[connectedSlot].txStep != step) {
+            // Applied right away, so the radio (and the ESP-NOW acks of a
+            // gateway) use the level that is reported and evaluated
+            WiFi.setTxPower(TX_POWER_STEPS[wifiStats[connectedSlot].txStep]);
+        }
+        printRadioPolicy();
+    }
+    return allPublished;
 }
 
-void NetworkManager::publishHomeAssistantDiscovery() {
-    Serial.println("Publishing Home Assistant MQTT Discovery...");
-    
+void NetworkManager::publishOTAStatus(const char* status) {
+    if (!mqtt->connected()) {
+        return;
+    }
+    char topic[100];
+    snprintf(topic, sizeof(topic), "%s_ota_status/state", WiFi.getHostname());
+    if (mqtt->publish(topic, status, true)) {
+        Serial.print("Published OTA status: ");
+        Serial.println(status);
+    }
+}
+
+void NetworkManager::publishHomeAssistantDiscovery(const DeviceIdentity& device, uint32_t& fingerprintStore) {
+    const char* hostname = device.id;
+    // Only this device ever had per-entity configs to migrate
+    bool migrate = device.viaDevice == nullptr && !config.discoveryMigrated;
     char topic[150];
-    char payload[600];
-    const char* hostname = WiFi.getHostname();
-    
-    // Device information (shared across all sensors)
-    char deviceInfo[250];
-    snprintf(deviceInfo, sizeof(deviceInfo),
-        "\"device\":{\"identifiers\":[\"%s\"],\"name\":\"%s\",\"model\":\"Battery Monitor\",\"manufacturer\":\"ESP32\",\"sw_version\":\"%s\"}",
-        hostname, hostname,
-        #ifdef FIRMWARE_VERSION
-        FIRMWARE_VERSION
-        #else
-        "dev"
-        #endif
-    );
-    
-    // Voltage sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_voltage/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Battery Voltage\",\"state_topic\":\"%s_voltage/state\",\"unit_of_measurement\":\"V\",\"device_class\":\"voltage\",\"state_class\":\"measurement\",\"unique_id\":\"%s_voltage\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish voltage sensor config");
-    } 
+    snprintf(topic, sizeof(topic), "homeassistant/device/%s/config", hostname);
+    
+    // The payload is emitted twice: once to size and fingerprint it, and
+    // only if it changed since the last publish, once more into the stream
+    DiscoverySink measure = {nullptr, 0, FNV_OFFSET_BASIS, true};
+    writeDiscoveryPayload(device, measure);
+    uint32_t fingerprint = measure.hash == 0 ? 1 : measure.hash;
     
-    // Battery percentage sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_percentage/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Battery Level\",\"state_topic\":\"%s_percentage/state\",\"unit_of_measurement\":\"%%\",\"device_class\":\"battery\",\"state_class\":\"measurement\",\"unique_id\":\"%s_percentage\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish percentage sensor config");
+    // Retained configs survive on the broker; a lost session hints at a
+    // broker restart that may have dropped them too
+    if (fingerprint == fingerprintStore && mqtt->sessionPresent() && !migrate) {
+        Serial.printf("Home Assistant discovery for %s unchanged, not republished\n", hostname);
+        return;
     }
     
-    // Status sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_status/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Battery Status\",\"state_topic\":\"%s_status/state\",\"icon\":\"mdi:battery-check\",\"unique_id\":\"%s_status\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish status sensor config");
+    Serial.printf("Publishing Home Assistant MQTT Discovery for %s...\n", hostname);
+    char legacyTopic[150];
+    if (migrate) {
+        // Hand the old per-entity configs over to the device config so
+        // Home Assistant keeps the entities and their history
+        for (size_t i = 0; i < LEGACY_DISCOVERY_COMPONENTS; i++) {
+            snprintf(legacyTopic, sizeof(legacyTopic), "homeassistant/sensor/%s_%s/config", hostname, DISCOVERY_COMPONENTS[i].key);
+            mqtt->publish(legacyTopic, "{\"migrate_discovery\":true}", true);
+        }
     }
     
-    // RSSI sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_rssi/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"WiFi Signal\",\"state_topic\":\"%s_rssi/state\",\"unit_of_measurement\":\"dBm\",\"device_class\":\"signal_strength\",\"state_class\":\"measurement\",\"unique_id\":\"%s_rssi\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish RSSI sensor config");
+    DiscoverySink stream = {mqtt, 0, FNV_OFFSET_BASIS, true};
+    if (!mqtt->beginPublish(topic, measure.length, true)) {
+        Serial.printf("❌ Failed to publish device discovery - %s\n", mqtt->lastError().c_str());
+        return;
+    }
+    writeDiscoveryPayload(device, stream);
+    if (!mqtt->endPublish() || !stream.ok) {
+        Serial.printf("❌ Failed to publish device discovery - %s\n", mqtt->lastError().c_str());
+        fingerprintStore = 0;
+        return;
     }
+    fingerprintStore = fingerprint;
     
-    // Boot count sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_boot/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Boot Count\",\"state_topic\":\"%s_boot/state\",\"icon\":\"mdi:restart\",\"state_class\":\"total_increasing\",\"unique_id\":\"%s_boot\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish boot count sensor config");
+    if (migrate) {
+        bool cleared = true;
+        for (size_t i = 0; i < LEGACY_DISCOVERY_COMPONENTS; i++) {
+            snprintf(legacyTopic, sizeof(legacyTopic), "homeassistant/sensor/%s_%s/config", hostname, DISCOVERY_COMPONENTS[i].key);
+            cleared &= mqtt->publish(legacyTopic, "", true);
+        }
+        if (cleared) {
+            config.setDiscoveryMigrated();
+            Serial.println("Removed per-entity discovery configs (migrated to device discovery)");
+        }
     }
+    
+    Serial.printf("Sensors expire after %lu s without a reading\n", (unsigned long)expireAfterSec(device.reportIntervalSec));
+    Serial.printf("Home Assistant discovery published (%u bytes)\n", (unsigned)measure.length);
+}
 
-    // Last updated sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_last_updated/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Last Updated\",\"state_topic\":\"%s_last_updated/state\",\"device_class\":\"timestamp\",\"icon\":\"mdi:clock-check\",\"unique_id\":\"%s_last_updated\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish last updated sensor config");
-    }
+void NetworkManager::writeDiscoveryPayload(const DeviceIdentity& device, DiscoverySink& sink) {
+    const char* hostname = device.id;
+    const char* version =
+        #ifdef FIRMWARE_VERSION
+        FIRMWARE_VERSION;
+        #else
+        "dev";
+        #endif
+    // Each piece holds at most one free-form string (hostname up to 32
+    // characters, a nightly version, a component's options), so none of
+    // them can outgrow the buffer the way one header chunk could
+    char chunk[200];
     
-    // Firmware version sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_firmware/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Firmware Version\",\"state_topic\":\"%s_firmware/state\",\"icon\":\"mdi:chip\",\"entity_category\":\"diagnostic\",\"unique_id\":\"%s_firmware\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish firmware version sensor config");
+    // Device, origin and the availability shared by all components:
+    // expire_after covers sleeping between readings; a kept-open
+    // connection also reports through its LWT. Sensor units behind a
+    // gateway are linked to it and rely on expire_after alone.
+    snprintf(chunk, sizeof(chunk), "{\"device\":{\"identifiers\":[\"%s\"],", hostname);
+    sink.write(chunk);
+    snprintf(chunk, sizeof(chunk), "\"name\":\"%s\",\"model\":\"%s\",\"manufacturer\":\"ESP32\",",
+        hostname, device.viaDevice ? "Battery Monitor (ESP-NOW)" : "Battery Monitor");
+    sink.write(chunk);
+    if (device.viaDevice) {
+        snprintf(chunk, sizeof(chunk), "\"via_device\":\"%s\"},", device.viaDevice);
+    } else {
+        snprintf(chunk, sizeof(chunk), "\"sw_version\":\"%s\"},", version);
+    }
+    sink.write(chunk);
+    snprintf(chunk, sizeof(chunk), "\"origin\":{\"name\":\"batterymonitor\",\"sw_version\":\"%s\"},", version);
+    sink.write(chunk);
+    if (persistentSession && !device.viaDevice) {
+        snprintf(chunk, sizeof(chunk), "\"availability_topic\":\"%s_availability/state\",", hostname);
+        sink.write(chunk);
+        sink.write("\"payload_available\":\"online\",\"payload_not_available\":\"offline\",");
     }
     
-    // Battery type sensor
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_battery_type/config", hostname);
-    snprintf(payload, sizeof(payload),
-        "{\"name\":\"Battery Type\",\"state_topic\":\"%s_battery_type/state\",\"icon\":\"mdi:battery\",\"unique_id\":\"%s_battery_type\",%s}",
-        hostname, hostname, deviceInfo);
-    if (!mqttClient.publish(topic, payload, true)) {
-        Serial.println("Failed to publish battery type sensor config");
+    sink.write("\"components\":{");
+    unsigned long expireAfter = expireAfterSec(device.reportIntervalSec);
+    bool first = true;
+    for (const DiscoveryComponent& component : DISCOVERY_COMPONENTS) {
+        if (component.local && device.viaDevice) {
+            continue;
+        }
+        snprintf(chunk, sizeof(chunk),
+            "%s\"%s_%s\":{\"platform\":\"sensor\",\"name\":\"%s\",\"state_topic\":\"%s_%s/state\",",
+            first ? "" : ",", hostname, component.key, component.name, hostname, component.key);
+        sink.write(chunk);
+        sink.write(component.options);
+        snprintf(chunk, sizeof(chunk), "\"expire_after\":%lu,\"unique_id\":\"%s_%s\"}",
+            expireAfter, hostname, component.key);
+        sink.write(chunk);
+        first = false;
+    }
+    sink.write("}}");
+}
+
+void NetworkManager::DiscoverySink::write(const char* text) {
+    size_t n = strlen(text);
+    length += n;
+    hash = fnv1a(hash, text);
+    if (mqtt != nullptr && mqtt->write(reinterpret_cast<const uint8_t*>(text), n) != n) {
+        ok = false;
+    }
+}
+
+bool NetworkManager::maintainConnection() {
+    if (WiFi.status() == WL_CONNECTED && mqtt->connected()) {
+        mqtt->loop();
+        return true;
     }
     
-    // Configure availability for all sensors (shared state topic)
-    char availabilityConfig[250];
-    snprintf(availabilityConfig, sizeof(availabilityConfig),
-        ",\"availability_topic\":\"%s_availability/state\",\"payload_available\":\"online\",\"payload_not_available\":\"offline\"",
-        hostname);
+    // Connection lost (or never made): retry, backing off while it keeps failing
+    if (reconnectBackoffMs > 0 && millis() - lastReconnectAttempt < reconnectBackoffMs) {
+        return false;
+    }
+    lastReconnectAttempt = millis();
     
-    // Update all sensor configs with availability (done in next connection)
-    Serial.println("Note: Availability topic configured for all sensors");
-    Serial.printf("Availability Topic: %s_availability/state\n", hostname);
+    bool ok = (WiFi.status() == WL_CONNECTED || connectWiFi()) && connectMQTT(0);
+    if (ok) {
+        reconnectBackoffMs = 0;
+        setListenMode(listenMode);  // Joining turned modem sleep off
+        return true;
+    }
     
-    Serial.println("Home Assistant discovery published");
+    reconnectBackoffMs = reconnectBackoffMs == 0
+        ? Config::RECONNECT_BACKOFF_MIN_MS
+        : min(reconnectBackoffMs * 2, Config::RECONNECT_BACKOFF_MAX_MS);
+    Serial.printf("Reconnect failed, next attempt in %lu s\n", reconnectBackoffMs / 1000);
+    return false;
 }
 
 void NetworkManager::loop() {
-    mqttClient.loop();
+    mqtt->loop();
 }
 
 void NetworkManager::disconnect() {
-    // Publish offline state before disconnecting
-    if (mqttClient.connected()) {
-        char stateTopic[100];
-        snprintf(stateTopic, sizeof(stateTopic), "%s_availability/state", WiFi.getHostname());
-        mqttClient.publish(stateTopic, "offline", true);
-        mqttClient.loop();  // Process the publish
-        delay(100);  // Give time for message to send
-    }
-    
-    mqttClient.disconnect();
+    // Clean DISCONNECT: the broker keeps the session and does not fire the LWT.
+    // Sleeping devices publish no availability state; expire_after covers them.
+    mqtt->disconnect();
     WiFi.disconnect(true);
     WiFi.mode(WIFI_OFF);
+    timings.wifiMs = 0;
+    connectedSlot = -1;
+    listenMode = false;
     wifiConnected = false;
     mqttConnected = false;
 }
@@ -423,12 +1110,12 @@ void NetworkManager::mqttCallback(char* topic, byte* payload, unsigned int lengt
         snprintf(otaTopic, sizeof(otaTopic), "%s/ota", Config::MQTT_TOPIC_BASE);
         
         Serial.println("Clearing retained OTA message from broker...");
-        mqttClient.publish(otaTopic, "", true);  // Clear retained message
+        mqtt->publish(otaTopic, "", true);  // Clear retained message
         
         // Process outgoing publish and wait for it to complete
         // Need longer delay to ensure broker receives and processes the clear
         for (int i = 0; i < 20; i++) {
-            mqttClient.loop();
+            mqtt->loop();
             delay(50);
         }
         Serial.println("Retained OTA command cleared");
@@ -487,8 +1174,51 @@ void NetworkManager::mqttCallback(char* topic, byte* payload, unsigned int lengt
         // Acknowledge by publishing current type to a state topic
         char typeStateTopic[100];
         snprintf(typeStateTopic, sizeof(typeStateTopic), "%s_battery_type/state", WiFi.getHostname());
-        mqttClient.publish(typeStateTopic, config.batteryType.c_str(), true);
+        mqtt->publish(typeStateTopic, config.batteryType.c_str(), true);
         Serial.print("Published battery_type state: ");
         Serial.println(typeStateTopic);
     }
+
+    // Readings from the flash log for a time range
+    if (topicStr.endsWith("/history")) {
+        publishHistory(message);
+    }
+}
+
+void NetworkManager::publishHistory(const String& request) {
+    if (readingLog == nullptr || !readingLog->mounted()) {
+        Serial.println("No reading log, history request ignored");
+        return;
+    }
+    FlashLog::HistoryRequest query;
+    if (!FlashLog::parseHistoryRequest(request.c_str(), request.length(), time(nullptr), query)) {
+        Serial.println("Invalid history request. Use '<from> [<to>] [packed]' in Unix seconds or '-<seconds> [packed]'.");
+        return;
+    }
+    
+    // Measure first: the response is streamed as one publish of known length
+    size_t length = FlashLog::writeHistoryResponse(*readingLog, query, [](const uint8_t*, size_t) {});
+    
+    char topic[100];
+    snprintf(topic, sizeof(topic), "%s_history/%s", WiFi.getHostname(), query.packed ? "packed" : "response");
+    bool ok = true;
+    sessionClient.beginBatch();  // Many small writes, few TLS records
+    if (mqtt->beginPublish(topic, length, false)) {
+        FlashLog::writeHistoryResponse(*readingLog, query, [this, &ok](const uint8_t* data, size_t len) {
+            if (mqtt->write(data, len) != len) {
+                ok = false;
+            }
+        });
+        ok = mqtt->endPublish() && ok;
+    } else {
+        ok = false;
+    }
+    ok = sessionClient.endBatch() && ok;
+    
+    if (ok) {
+        Serial.printf("✓ History %lu-%lu sent to %s (%u bytes)\n", (unsigned long)query.from,
+                      (unsigned long)query.to, topic, (unsigned)length);
+    } else {
+        Serial.printf("❌ Failed to send history - %s\n", mqtt->lastError().c_str());
+    }
 }
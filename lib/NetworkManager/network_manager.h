@@ -9,31 +9,133 @@
 #include "battery_monitor.h"
 #include "battery_config.h"
 #include "config_manager.h"
+#include "session_client.h"
+#include "pubsub_transport.h"
+#include "mqtt5_transport.h"
+#include "reading_uplink.h"
+#include "reading_log.h"
+
+struct BrokerAddressCache;
+
+// Duration of each phase of the last connectWiFi()/connectMQTT()
+struct ConnectTimings {
+    uint32_t wifiMs;
+    bool wifiFast;        // Joined on the cached channel/BSSID without a scan
+    uint32_t dnsMs;       // Broker host name lookup (0 when the cached address was used)
+    uint32_t dnsSavedMs;  // What the skipped lookup took when it was cached
+    uint32_t tlsMs;       // TCP connect and TLS handshake
+    bool tlsPsk;          // Handshake used a pre-shared key instead of the CA certificate
+    uint32_t mqttMs;      // CONNECT/CONNACK
+    uint32_t setupMs;     // SUBSCRIBE, availability and discovery
+    bool dnsCached;
+};
+
+// Whose sensors a discovery config or reading is for: this device, or a
+// sensor unit reporting through it when running as a gateway
+struct DeviceIdentity {
+    const char* id;              // Topic and unique_id prefix (the hostname for this device)
+    const char* batteryType;     // Published as the battery type state
+    const char* viaDevice;       // Gateway id for sensor units, nullptr for this device
+    uint32_t reportIntervalSec;  // Sets expire_after
+};
 
 class NetworkManager {
 private:
     WiFiClientSecure& wifiClient;
-    PubSubClient& mqttClient;
+    SessionClient& sessionClient;
+    PubSubTransport mqtt311;
+    Mqtt5Transport mqtt5;
+    MqttTransport* mqtt;  // Picked by config.mqttVersion on connect
     ConfigManager& config;
     
     // Callback function pointers
     std::function<void(const String&)> otaCallback;
     std::function<void()> resetCallback;
     
+    // Persistent connection mode: reconnect backoff state
+    unsigned long lastReconnectAttempt;
+    unsigned long reconnectBackoffMs;
+    
+    // Availability: persistent sessions use LWT + "online", sleeping ones
+    // rely on expire_after in discovery
+    bool persistentSession;
+    uint32_t reportIntervalSec;
+    
+    ConnectTimings timings;
+    
+    // Broker list from config (mqttServer first); host strings must stay
+    // valid while the transport holds them
+    String brokerHosts[Config::MAX_BROKERS];
+    uint16_t brokerPorts[Config::MAX_BROKERS];
+    int brokerCount;
+    
+    int connectedSlot;  // WiFi network slot joined (-1 = none)
+    bool txPowerRated;  // This association's good link already counted by the TX power policy
+    bool listenMode;
+    
+    ReadingUplink* uplink;  // nullptr = readings go over MQTT
+    FlashLog::ReadingLog* readingLog;  // Answers history requests (nullptr = none)
+    
     void mqttCallback(char* topic, byte* payload, unsigned int length);
-    void publishHomeAssistantDiscovery();
+    // Counts, fingerprints and (with a transport) streams discovery JSON
+    struct DiscoverySink {
+        MqttTransport* mqtt;  // nullptr = measure only
+        size_t length;
+        uint32_t hash;
+        bool ok;
+        void write(const char* text);
+    };
+    
+    void writeDiscoveryPayload(const DeviceIdentity& device, DiscoverySink& sink);
+    bool subscribeCommandTopics();
+    void publishHistory(const String& request);
+    bool joinWiFi();
+    bool tryWiFi(int slot, uint8_t channel, const uint8_t* bssid, unsigned long timeoutMs, int8_t seenRssi);  // seenRssi: in this wake's scan (0 = not seen)
+    int loadWifiNetworks(int slots[]);  // Configured slots, most likely first
+    void updateTxPower(int slot, bool linkOk);
+    void loadBrokers(int order[]);  // Fills order with slots, best broker first
+    void recordBrokerResult(int slot, bool connected, uint32_t elapsedMs);
+    int connectBroker(const char* host, uint16_t port);
+    bool resolveBroker(const char* host, IPAddress& address, BrokerAddressCache* cache);  // Stores the result in cache if set
+    int openTls(const IPAddress& address, uint16_t port, const char* host);
+    uint32_t expireAfterSec(uint32_t intervalSec) const;  // Sensor expire_after and MQTT 5 session expiry
+    static uint32_t commandTopicsVersion();
     
 public:
     bool wifiConnected;
     bool mqttConnected;
     
-    NetworkManager(WiFiClientSecure& wifi, PubSubClient& mqtt, ConfigManager& cfg);
+    NetworkManager(WiFiClientSecure& wifi, SessionClient& session, PubSubClient& mqtt, ConfigManager& cfg);
     
     void setOTACallback(std::function<void(const String&)> callback);
     void setResetCallback(std::function<void()> callback);
+    void setAvailabilityMode(bool persistent, uint32_t intervalSec);  // Call before connectMQTT()
+    // Send readings through another uplink instead of MQTT (nullptr = MQTT)
+    void setUplink(ReadingUplink* readingUplink) { uplink = readingUplink; }
+    bool hasUplink() const { return uplink != nullptr; }
+    void setReadingLog(FlashLog::ReadingLog* log) { readingLog = log; }
     bool connectWiFi();
-    bool connectMQTT();
-    void publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime = 0);
+    bool connectMQTT(unsigned long timeoutMs = Config::MQTT_TIMEOUT_MS);  // 0 = one attempt per broker
+    bool maintainConnection();  // Keep WiFi/MQTT up, reconnecting with backoff; true if connected
+    const ConnectTimings& getTimings() const { return timings; }
+    void printTimings() const;
+    // Modem sleep while only waiting for commands; off while connecting/publishing
+    void setListenMode(bool listening);
+    float getTxPowerDbm() const;  // TX power the radio is using (0 = not connected)
+    void printRadioPolicy() const;
+    void benchmarkHandshake(int rounds);  // Time TLS handshakes with the broker in the configured mode
+    DeviceIdentity selfIdentity() const;
+    bool publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime = 0);
+    // Reading of another device; sensor units skip this device's radio and firmware states
+    bool publishReading(const DeviceIdentity& device, const BatteryReading& reading, int bootCount, time_t nextReadingTime);
+    // Skipped while the payload matches fingerprint (kept by the caller) and the session was resumed
+    void publishHomeAssistantDiscovery(const DeviceIdentity& device, uint32_t& fingerprint);
+    bool sessionPresent() const { return mqtt->sessionPresent(); }
+    // Coalesce the publishes in between into few TLS records; endBatch()
+    // is false if any of them could not be sent
+    void beginBatch() { sessionClient.beginBatch(); }
+    bool endBatch() { return sessionClient.endBatch(); }
+    void publishOTAStatus(const char* status);
     void loop();
     void disconnect();
 };
@@ -0,0 +1,50 @@
+#include "pubsub_transport.h"
+#include "battery_config.h"
+
+PubSubTransport::PubSubTransport(PubSubClient& client, SessionClient& session)
+    : client(client), session(session) {}
+
+void PubSubTransport::setServer(const char* host, uint16_t port) {
+    client.setServer(host, port);
+    // Discovery messages do not fit the default 256 bytes
+    client.setBufferSize(Config::MQTT_BUFFER_SIZE);
+    client.setKeepAlive(Config::MQTT_KEEPALIVE_S);
+    client.setSocketTimeout(Config::MQTT_ACK_TIMEOUT_MS / 1000);
+}
+
+void PubSubTransport::setCallback(MessageCallback callback) {
+    client.setCallback(callback);
+}
+
+bool PubSubTransport::connect(const MqttConnectOptions& options) {
+    if (options.willTopic != nullptr) {
+        return client.connect(options.clientId, options.user, options.password,
+                              options.willTopic, 1, true, options.willPayload, false);
+    }
+    return client.connect(options.clientId, options.user, options.password,
+                          nullptr, 0, false, nullptr, false);
+}
+
+bool PubSubTransport::publish(const char* topic, const char* payload, bool retained) {
+    return client.publish(topic, payload, retained);
+}
+
+String PubSubTransport::lastError() {
+    const char* name;
+    int state = client.state();
+    switch (state) {
+        case MQTT_CONNECTION_TIMEOUT: name = "connection timeout"; break;
+        case MQTT_CONNECTION_LOST: name = "connection lost"; break;
+        case MQTT_CONNECT_FAILED: name = "TCP/TLS connect failed"; break;
+        case MQTT_DISCONNECTED: name = "disconnected"; break;
+        case MQTT_CONNECTED: name = "connected"; break;
+        case MQTT_CONNECT_BAD_PROTOCOL: name = "bad protocol"; break;
+        case MQTT_CONNECT_BAD_CLIENT_ID: name = "bad client ID"; break;
+        case MQTT_CONNECT_UNAVAILABLE: name = "server unavailable"; break;
+        case MQTT_CONNECT_BAD_CREDENTIALS: name = "bad credentials"; break;
+        case MQTT_CONNECT_UNAUTHORIZED: name = "not authorized"; break;
+        default: name = "unknown"; break;
+    }
+    return String("state ") + state + " (" + name + "), buffer " +
+           client.getBufferSize() + " bytes";
+}
@@ -0,0 +1,35 @@
+#ifndef PUBSUB_TRANSPORT_H
+#define PUBSUB_TRANSPORT_H
+
+#include <PubSubClient.h>
+#include "mqtt_transport.h"
+#include "session_client.h"
+
+// MQTT 3.1.1 through PubSubClient
+class PubSubTransport : public MqttTransport {
+public:
+    PubSubTransport(PubSubClient& client, SessionClient& session);
+    
+    const char* protocolName() const override { return "MQTT 3.1.1"; }
+    void setServer(const char* host, uint16_t port) override;
+    void setCallback(MessageCallback callback) override;
+    bool connect(const MqttConnectOptions& options) override;
+    bool connected() override { return client.connected(); }
+    bool sessionPresent() const override { return session.sessionPresent(); }
+    bool publish(const char* topic, const char* payload, bool retained) override;
+    bool beginPublish(const char* topic, size_t length, bool retained) override {
+        return client.beginPublish(topic, length, retained);
+    }
+    size_t write(const uint8_t* data, size_t len) override { return client.write(data, len); }
+    bool endPublish() override { return client.endPublish() == 1; }
+    bool subscribe(const char* topic, uint8_t qos) override { return client.subscribe(topic, qos); }
+    bool loop() override { return client.loop(); }
+    void disconnect() override { client.disconnect(); }
+    String lastError() override;
+    
+private:
+    PubSubClient& client;
+    SessionClient& session;
+};
+
+#endif // PUBSUB_TRANSPORT_H
@@ -0,0 +1,116 @@
+#include "radio_uplink.h"
+#include <esp_wifi.h>
+#include <WiFi.h>
+#include "sensor_frame.h"
+
+// Survive deep sleep; cleared on power-on, which marks the next frame as a cold boot
+RTC_DATA_ATTR static uint16_t frameSequence = 0;
+RTC_DATA_ATTR static uint8_t gatewayChannel = 0;  // Channel the gateway last acknowledged on (0 = unknown)
+RTC_DATA_ATTR static bool frameSent = false;
+
+enum SendState { SEND_PENDING, SEND_FAILED, SEND_ACKED };
+
+volatile int EspNowLink::sendState = SEND_FAILED;
+
+void EspNowLink::onSent(const uint8_t* mac, esp_now_send_status_t status) {
+    sendState = status == ESP_NOW_SEND_SUCCESS ? SEND_ACKED : SEND_FAILED;
+}
+
+bool EspNowLink::begin(const uint8_t gatewayMac[6], const uint8_t* key) {
+    memcpy(gateway, gatewayMac, sizeof(gateway));
+    
+    // Station mode starts the radio without joining a network
+    WiFi.mode(WIFI_STA);
+    if (esp_now_init() != ESP_OK) {
+        Serial.println("❌ ESP-NOW init failed");
+        return false;
+    }
+    esp_now_register_send_cb(onSent);
+    
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, gateway, sizeof(gateway));
+    peer.channel = 0;  // Whatever channel the radio is on
+    peer.ifidx = WIFI_IF_STA;
+    peer.encrypt = key != nullptr;
+    if (key) {
+        memcpy(peer.lmk, key, ESP_NOW_KEY_LEN);
+    }
+    esp_err_t err = esp_now_add_peer(&peer);
+    if (err != ESP_OK) {
+        Serial.printf("❌ ESP-NOW gateway peer not added (error %d)\n", err);
+        esp_now_deinit();
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+void EspNowLink::end() {
+    if (started) {
+        esp_now_deinit();
+        started = false;
+    }
+}
+
+bool EspNowLink::setChannel(uint8_t channel) {
+    // The channel can only be changed while the station is not associated;
+    // promiscuous mode lets the driver accept it
+    esp_wifi_set_promiscuous(true);
+    esp_err_t err = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    esp_wifi_set_promiscuous(false);
+    return err == ESP_OK;
+}
+
+bool EspNowLink::send(const uint8_t* frame, size_t len) {
+    if (!started) {
+        return false;
+    }
+    sendState = SEND_PENDING;
+    if (esp_now_send(gateway, frame, len) != ESP_OK) {
+        return false;
+    }
+    unsigned long start = millis();
+    while (sendState == SEND_PENDING && millis() - start < Config::ESPNOW_ACK_TIMEOUT_MS) {
+        delay(1);
+    }
+    return sendState == SEND_ACKED;
+}
+
+bool RadioUplink::publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) {
+    SensorUplink::SensorReading frameReading = {};
+    frameReading.sequence = ++frameSequence;
+    float millivolts = reading.voltage * 1000.0f + 0.5f;
+    frameReading.millivolts = millivolts < 0 ? 0 : millivolts > 65535 ? 65535 : (uint16_t)millivolts;
+    frameReading.percentage = reading.percentage;
+    frameReading.status = static_cast<uint8_t>(reading.status);
+    frameReading.lifepo4 = BatteryMonitor::getChemistry() == BatteryChemistry::LIFEPO4;
+    frameReading.coldBoot = !frameSent;
+    frameReading.bootCount = bootCount;
+    
+    time_t now;
+    time(&now);
+    long untilNext = nextReadingTime > now ? (long)(nextReadingTime - now) : 0;
+    frameReading.nextReadingSec = untilNext > 65535 ? 65535 : untilNext;
+    
+    uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+    size_t len = SensorUplink::encodeFrame(frameReading, frame, sizeof(frame));
+    
+    unsigned long start = millis();
+    SensorUplink::FrameSender sender(link);
+    SensorUplink::SendResult result = sender.send(frame, len, gatewayChannel);
+    unsigned long elapsed = millis() - start;
+    
+    if (!result.delivered) {
+        Serial.printf("❌ %s: gateway did not acknowledge reading #%u (%u attempts, %lu ms)\n",
+                      name, frameReading.sequence, result.attempts, elapsed);
+        return false;
+    }
+    if (result.channel != gatewayChannel && gatewayChannel != 0) {
+        Serial.printf("%s: gateway moved from channel %u to %u\n", name, gatewayChannel, result.channel);
+    }
+    gatewayChannel = result.channel;
+    frameSent = true;
+    Serial.printf("✓ %s: reading #%u sent on channel %u (%u attempts, %lu ms)\n",
+                  name, frameReading.sequence, result.channel, result.attempts, elapsed);
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef RADIO_UPLINK_H
+#define RADIO_UPLINK_H
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include "reading_uplink.h"
+#include "frame_sender.h"
+
+// ESP-NOW link to one gateway: frames are encrypted with the peer's local
+// master key and acknowledged by the gateway's radio. No association, DHCP
+// or broker connection is needed.
+class EspNowLink : public SensorUplink::RadioLink {
+public:
+    EspNowLink() : started(false) {}
+    
+    // key = 16-byte local master key (nullptr = unencrypted)
+    bool begin(const uint8_t gatewayMac[6], const uint8_t* key);
+    void end();
+    
+    bool setChannel(uint8_t channel) override;
+    bool send(const uint8_t* frame, size_t len) override;
+    void wait(uint32_t ms) override { delay(ms); }
+    
+private:
+    static void onSent(const uint8_t* mac, esp_now_send_status_t status);
+    static volatile int sendState;
+    
+    uint8_t gateway[6];
+    bool started;
+};
+
+// Sends each reading as one SensorUplink frame over a RadioLink. The
+// sequence number and the channel the gateway answered on last are kept
+// in RTC memory across deep sleep.
+class RadioUplink : public ReadingUplink {
+public:
+    RadioUplink(SensorUplink::RadioLink& link, const char* name) : link(link), name(name) {}
+    
+    const char* uplinkName() const override { return name; }
+    bool publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) override;
+    
+private:
+    SensorUplink::RadioLink& link;
+    const char* name;
+};
+
+#endif // RADIO_UPLINK_H
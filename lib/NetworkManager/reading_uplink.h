@@ -0,0 +1,17 @@
+#ifndef READING_UPLINK_H
+#define READING_UPLINK_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "battery_monitor.h"
+
+// Delivers a reading somewhere other than the MQTT session: installed with
+// NetworkManager::setUplink(), publishReading() then goes through it
+class ReadingUplink {
+public:
+    virtual ~ReadingUplink() {}
+    virtual const char* uplinkName() const = 0;
+    virtual bool publishReading(const BatteryReading& reading, int bootCount, time_t nextReadingTime) = 0;
+};
+
+#endif // READING_UPLINK_H
@@ -0,0 +1,102 @@
+#include "session_client.h"
+
+namespace {
+    const uint8_t CONNACK_HEADER = 0x20;
+    const uint8_t CONNACK_LENGTH = 2;
+    const uint8_t SESSION_PRESENT = 0x01;
+}
+
+SessionClient::SessionClient(Client& client)
+    : inner(client), batch(nullptr), batchLen(0), batching(false), batchFailed(false) {
+    resetSession();
+}
+
+void SessionClient::resetSession() {
+    connackPos = 0;
+    connackSeen = false;
+    sessionFlag = false;
+}
+
+int SessionClient::connect(IPAddress ip, uint16_t port) {
+    resetSession();
+    return inner.connect(ip, port);
+}
+
+int SessionClient::connect(const char* host, uint16_t port) {
+    resetSession();
+    return connector ? connector(host, port) : inner.connect(host, port);
+}
+
+void SessionClient::stop() {
+    resetSession();
+    batchLen = 0;
+    inner.stop();
+}
+
+void SessionClient::beginBatch() {
+    if (batch == nullptr) {
+        batch = static_cast<uint8_t*>(malloc(Config::MQTT_BATCH_BYTES));
+    }
+    batching = batch != nullptr;  // Without memory, writes just go straight through
+    batchLen = 0;
+    batchFailed = false;
+}
+
+bool SessionClient::endBatch() {
+    sendBatch();
+    batching = false;
+    return !batchFailed;
+}
+
+void SessionClient::sendBatch() {
+    if (batchLen > 0 && inner.write(batch, batchLen) != batchLen) {
+        batchFailed = true;
+    }
+    batchLen = 0;
+}
+
+size_t SessionClient::write(const uint8_t* buf, size_t size) {
+    if (!batching) {
+        return inner.write(buf, size);
+    }
+    // Report everything as written; a failure shows up in endBatch()
+    size_t done = 0;
+    while (done < size) {
+        size_t n = min(size - done, Config::MQTT_BATCH_BYTES - batchLen);
+        memcpy(batch + batchLen, buf + done, n);
+        batchLen += n;
+        done += n;
+        if (batchLen == Config::MQTT_BATCH_BYTES) {
+            sendBatch();
+        }
+    }
+    return size;
+}
+
+int SessionClient::read() {
+    int b = inner.read();
+    if (b >= 0) {
+        inspect(static_cast<uint8_t>(b));
+    }
+    return b;
+}
+
+int SessionClient::read(uint8_t* buf, size_t size) {
+    int n = inner.read(buf, size);
+    for (int i = 0; i < n && connackPos < sizeof(connack); i++) {
+        inspect(buf[i]);
+    }
+    return n;
+}
+
+void SessionClient::inspect(uint8_t b) {
+    // Only the first four bytes of a connection are the CONNACK
+    if (connackPos >= sizeof(connack)) {
+        return;
+    }
+    connack[connackPos++] = b;
+    if (connackPos == sizeof(connack)) {
+        connackSeen = connack[0] == CONNACK_HEADER && connack[1] == CONNACK_LENGTH && connack[3] == 0;
+        sessionFlag = (connack[2] & SESSION_PRESENT) != 0;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef SESSION_CLIENT_H
+#define SESSION_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include "battery_config.h"
+
+// Pass-through Client that sits between PubSubClient and the TLS socket and
+// watches the first packet the broker sends after connect(). PubSubClient
+// does not expose the CONNACK "session present" flag, so this is the only
+// way to tell whether the broker kept our subscriptions.
+//
+// Between beginBatch() and endBatch() writes are collected and sent in
+// chunks of up to MQTT_BATCH_BYTES, so a burst of small publishes costs a
+// few TLS records instead of one each (the gateway publishes many units'
+// states at once).
+class SessionClient : public Client {
+public:
+    using Connector = std::function<int(const char* host, uint16_t port)>;
+    
+    explicit SessionClient(Client& client);
+    
+    // Optional replacement for connect(host, port), e.g. to reuse a cached
+    // broker address instead of resolving the host name again
+    void setConnector(Connector fn) { connector = fn; }
+    
+    // True once a successful CONNACK with session present = 1 was received
+    bool sessionPresent() const { return connackSeen && sessionFlag; }
+    
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    void beginBatch();
+    bool endBatch();  // Sends what is left; false if any batched write failed
+    
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override { return inner.available(); }
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override { return inner.peek(); }
+    void flush() override { inner.flush(); }
+    void stop() override;
+    uint8_t connected() override { return inner.connected(); }
+    operator bool() override { return static_cast<bool>(inner); }
+    
+private:
+    Client& inner;
+    Connector connector;
+    uint8_t connack[4];   // Fixed header, remaining length, flags, return code
+    uint8_t connackPos;
+    bool connackSeen;
+    bool sessionFlag;
+    uint8_t* batch;       // Allocated on first use, only gateways batch
+    size_t batchLen;
+    bool batching;
+    bool batchFailed;
+    
+    void resetSession();
+    void sendBatch();
+    void inspect(uint8_t b);
+};
+
+#endif // SESSION_CLIENT_H
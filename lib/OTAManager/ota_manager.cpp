@@ -1,14 +1,57 @@
 #include "ota_manager.h"
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
 #include "battery_config.h"
 #include "display_manager.h"
+#include "delta_patch.h"
+#include "compressed_image.h"
+#include "ota_manifest.h"
+#include <mbedtls/pk.h>
+#include <mbedtls/base64.h>
+#include <esp_wifi.h>
+#include <esp_pm.h>
+#include <esp_system.h>
+
+// Public key for release manifest signatures (optional, see ota_signing_key.h.example)
+#if __has_include("../../include/ota_signing_key.h")
+#include "../../include/ota_signing_key.h"
+#endif
+
+// Last verified release manifest, kept across deep sleep so a 304 answer
+// to the conditional GET still tells us the latest version
+struct ManifestCache {
+    char etag[64];
+    char version[OtaManifestConfig::VERSION_LEN];
+    char image[OtaManifestConfig::PATH_LEN];
+    uint8_t sha256[32];
+    bool hasSha256;
+    bool hasPatch;
+    bool valid;
+};
+RTC_DATA_ATTR static ManifestCache manifestCache;
 
 OTAManager::OTAManager(ConfigManager& cfg, DisplayManager* disp) 
-    : config(cfg), display(disp), otaRequested(false), otaFilename("") {}
+    : config(cfg), display(disp), otaRequested(false), otaFilename(""),
+      updateSize(0), updateWritten(0), updateStarted(false), downloadSize(0),
+      haveTrustedSha(false), skipDelta(false),
+      manifestChecked(false), lastManifestCheck(0),
+      lastProgressPercent(-1), progressBytes(0), progressStart(0),
+      arduinoOtaStarted(false), arduinoOtaFailed(false), savedPsMode(WIFI_PS_MIN_MODEM) {}
 
 void OTAManager::saveOTATrigger(const String& filename) {
     preferences.begin("ota", false);
     preferences.putBool("pending", true);
     preferences.putString("filename", filename);
+    // The manifest's hash and patch hint go with the trigger, so an update
+    // finished after a reboot is checked the same way
+    if (haveTrustedSha) {
+        preferences.putBytes("sha", trustedSha256, sizeof(trustedSha256));
+    } else {
+        preferences.remove("sha");
+    }
+    preferences.putBool("skip_delta", skipDelta);
     preferences.end();
     Serial.println("OTA trigger saved to persistent storage");
 }
@@ -17,6 +60,7 @@ void OTAManager::clearOTATrigger() {
     preferences.begin("ota", false);
     preferences.putBool("pending", false);
     preferences.putString("filename", "");
+    preferences.remove("sha");
     preferences.end();
     Serial.println("OTA trigger cleared from persistent storage");
 }
@@ -25,6 +69,10 @@ bool OTAManager::checkPendingOTA() {
     preferences.begin("ota", true);  // Read-only
     bool pending = preferences.getBool("pending", false);
     String filename = preferences.getString("filename", "");
+    if (pending) {
+        haveTrustedSha = preferences.getBytes("sha", trustedSha256, sizeof(trustedSha256)) == sizeof(trustedSha256);
+        skipDelta = preferences.getBool("skip_delta", false);
+    }
     preferences.end();
     
     if (pending) {
@@ -49,6 +97,8 @@ void OTAManager::setup() {
     // ArduinoOTA.setPassword("admin");
     
     ArduinoOTA.onStart([this]() {
+        arduinoOtaStarted = true;
+        startProgress();
         String type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
@@ -70,20 +120,23 @@ void OTAManager::setup() {
         Serial.println("║   OTA Update Complete         ║");
         Serial.println("╚═══════════════════════════════╝");
         
+        reportThroughput();
+        
+        // ArduinoOTA reboots right after this callback
+        beginTrialBoot();
+        
         if (display && display->isReady()) {
             display->showOTAComplete();
+            display->waitIdle(DisplayConfig::FINAL_FRAME_TIMEOUT_MS);
         }
     });
     
     ArduinoOTA.onProgress([this](unsigned int progress, unsigned int total) {
-        Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
-        
-        if (display && display->isReady()) {
-            display->showOTAProgress(progress, total);
-        }
+        reportProgress(progress, total);
     });
     
     ArduinoOTA.onError([this](ota_error_t error) {
+        arduinoOtaFailed = true;
         Serial.printf("\nError[%u]: ", error);
         const char* errorMsg = "Unknown";
         if (error == OTA_AUTH_ERROR) {
@@ -117,7 +170,171 @@ void OTAManager::setup() {
     Serial.println(WiFi.localIP());
 }
 
+// Keep the Arduino core from confirming a new image on its own; it is
+// confirmed in markBootHealthy() once a wake cycle has published
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+// Set once a boot has been counted in noteBrokerReached(). Survives the
+// panic/watchdog reset so that a crash after reaching the broker is not
+// counted twice.
+RTC_NOINIT_ATTR static bool trialBootCounted;
+
+static bool crashedLastBoot() {
+    switch (esp_reset_reason()) {
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void OTAManager::beginTrialBoot() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    
+    preferences.begin("ota", false);
+    preferences.putBool("trial", true);
+    preferences.putUChar("trial_boots", 0);
+    preferences.putString("prev_part", running ? running->label : "");
+    preferences.putString("prev_ver", FIRMWARE_VERSION);
+    preferences.end();
+    Serial.println("New firmware will run on trial until it publishes successfully");
+}
+
+void OTAManager::checkBootHealth() {
+    bool crashed = crashedLastBoot() && !trialBootCounted;
+    trialBootCounted = false;
+    
+    preferences.begin("ota", false);
+    if (!preferences.getBool("trial", false)) {
+        preferences.end();
+        return;
+    }
+    
+    // Wakes that never reached the broker (an outage, no WiFi) don't count
+    // against the new firmware; crashes do
+    uint8_t boots = preferences.getUChar("trial_boots", 0);
+    if (crashed) {
+        boots++;
+        preferences.putUChar("trial_boots", boots);
+    }
+    String prevPartition = preferences.getString("prev_part", "");
+    String prevVersion = preferences.getString("prev_ver", "");
+    
+    Serial.printf("Trial firmware: %u of %u failed boots%s\n",
+                  boots, Config::OTA_MAX_TRIAL_BOOTS, crashed ? " (last boot crashed)" : "");
+    
+    if (boots < Config::OTA_MAX_TRIAL_BOOTS) {
+        preferences.end();
+        return;
+    }
+    
+    const esp_partition_t* previous = esp_partition_find_first(
+        ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, prevPartition.c_str());
+    
+    char reason[128];
+    snprintf(reason, sizeof(reason), "%s failed %u boots without a publish, rolled back to %s",
+             FIRMWARE_VERSION, boots, prevVersion.c_str());
+    
+    preferences.putBool("trial", false);
+    if (!previous || esp_ota_set_boot_partition(previous) != ESP_OK) {
+        // Nothing to go back to; stop counting and keep running this image
+        Serial.println("❌ Rollback impossible, previous partition not found");
+        preferences.end();
+        return;
+    }
+    preferences.putString("rb_reason", reason);
+    preferences.putString("rb_version", FIRMWARE_VERSION);  // Not installed again automatically
+    preferences.end();
+    
+    Serial.println("\n╔═══════════════════════════════╗");
+    Serial.println("║   Rolling Back Firmware       ║");
+    Serial.println("╚═══════════════════════════════╝");
+    Serial.println(reason);
+    Serial.flush();
+    ESP.restart();
+}
+
+void OTAManager::noteBrokerReached() {
+    if (trialBootCounted) {
+        return;
+    }
+    trialBootCounted = true;
+    
+    preferences.begin("ota", true);  // Read-only
+    bool trial = preferences.getBool("trial", false);
+    preferences.end();
+    if (!trial) {
+        return;
+    }
+    
+    // Counted as failed until markBootHealthy() confirms the image
+    preferences.begin("ota", false);
+    preferences.putUChar("trial_boots", preferences.getUChar("trial_boots", 0) + 1);
+    preferences.end();
+}
+
+bool OTAManager::isRolledBack(const String& targetVersion) {
+    preferences.begin("ota", true);  // Read-only
+    String rolledBack = preferences.getString("rb_version", "");
+    preferences.end();
+    if (rolledBack.length() == 0) {
+        return false;
+    }
+    if (rolledBack == targetVersion) {
+        return true;
+    }
+    
+    // A different release replaced the bad one
+    if (config.otaTargetVersion.length() == 0) {
+        preferences.begin("ota", false);
+        preferences.remove("rb_version");
+        preferences.end();
+    }
+    return false;
+}
+
+void OTAManager::markBootHealthy() {
+    preferences.begin("ota", true);  // Read-only
+    bool trial = preferences.getBool("trial", false);
+    preferences.end();
+    if (!trial) {
+        return;
+    }
+    
+    preferences.begin("ota", false);
+    preferences.putBool("trial", false);
+    preferences.putUChar("trial_boots", 0);
+    preferences.end();
+    esp_ota_mark_app_valid_cancel_rollback();
+    Serial.println("✓ New firmware completed a wake cycle, marked valid");
+}
+
+String OTAManager::takeRollbackReason() {
+    preferences.begin("ota", true);  // Read-only
+    String reason = preferences.getString("rb_reason", "");
+    preferences.end();
+    
+    if (reason.length() > 0) {
+        preferences.begin("ota", false);
+        preferences.remove("rb_reason");
+        preferences.end();
+    }
+    return reason;
+}
+
 void OTAManager::requestUpdate(const String& filename) {
+    // Not from the manifest: its hash and patch hint are for another image
+    haveTrustedSha = false;
+    skipDelta = false;
+    queueUpdate(filename);
+}
+
+void OTAManager::queueUpdate(const String& filename) {
     otaRequested = true;
     otaFilename = filename;
     saveOTATrigger(filename);  // Persist for next boot
@@ -147,6 +364,7 @@ void OTAManager::handleUpdate() {
         
         if (performHTTPUpdate(otaFilename)) {
             Serial.println("HTTP update succeeded, device will reboot...");
+            beginTrialBoot();
             delay(1000);
             ESP.restart();
         } else {
@@ -166,26 +384,76 @@ void OTAManager::handleUpdate() {
     clearOTATrigger();
     Serial.println("Cleared OTA trigger before ArduinoOTA mode");
     
-    // Wait for OTA update with timeout
-    const unsigned long otaTimeout = 60000;  // 1 minute
-    unsigned long otaStartTime = millis();
+    waitForArduinoOTA((unsigned long)config.otaWindowSec * 1000);
+    otaRequested = false;
+    // No need to clear again - already cleared at start of ArduinoOTA mode
+}
+
+void OTAManager::waitForArduinoOTA(unsigned long windowMs) {
+    // ArduinoOTA only exposes a polled handle(), so the CPU sleeps between
+    // short checks for an invitation. Once an upload starts, handle() runs
+    // the whole transfer and reboots on success.
+    arduinoOtaStarted = false;
+    arduinoOtaFailed = false;
+    
+    setLowPowerWait(true);
     
-    while (millis() - otaStartTime < otaTimeout) {
+    unsigned long startTime = millis();
+    unsigned long lastReport = 0;
+    Serial.printf("Upload window: %lu seconds\n", windowMs / 1000);
+    
+    while (millis() - startTime < windowMs) {
         ArduinoOTA.handle();
-        delay(100);
         
-        // Print countdown every 10 seconds
-        if ((millis() - otaStartTime) % 10000 < 100) {
-            unsigned long remaining = (otaTimeout - (millis() - otaStartTime)) / 1000;
-            Serial.print("Time remaining: ");
-            Serial.print(remaining);
-            Serial.println(" seconds");
+        if (arduinoOtaFailed) {
+            Serial.println("\nOTA upload failed or was abandoned. Resuming normal operation.");
+            break;
+        }
+        
+        if (!arduinoOtaStarted) {
+            // Print countdown every 10 seconds
+            unsigned long elapsed = millis() - startTime;
+            if (elapsed - lastReport >= 10000) {
+                lastReport = elapsed - elapsed % 10000;
+                Serial.print("Time remaining: ");
+                Serial.print((windowMs - elapsed) / 1000);
+                Serial.println(" seconds");
+            }
         }
+        
+        // Idle task (and auto light sleep, if enabled) runs while we wait
+        vTaskDelay(pdMS_TO_TICKS(Config::OTA_POLL_INTERVAL_MS));
     }
     
-    Serial.println("\nOTA timeout reached. Resuming normal operation.");
-    otaRequested = false;
-    // No need to clear again - already cleared at start of ArduinoOTA mode
+    setLowPowerWait(false);
+    
+    if (!arduinoOtaFailed) {
+        Serial.println("\nOTA timeout reached. Resuming normal operation.");
+    }
+    Serial.printf("OTA window closed after %lu ms\n", millis() - startTime);
+}
+
+void OTAManager::setLowPowerWait(bool enable) {
+    // Modem sleep keeps the association but powers the radio down between
+    // beacons; packets for us are buffered by the AP until the next one.
+    // Afterwards the caller's mode (e.g. WIFI_PS_NONE while publishing) is restored.
+    if (enable) {
+        if (esp_wifi_get_ps(&savedPsMode) != ESP_OK) {
+            savedPsMode = WIFI_PS_MIN_MODEM;
+        }
+        esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    } else {
+        esp_wifi_set_ps(savedPsMode);
+    }
+    
+#if CONFIG_PM_ENABLE
+    // Let the idle task enter light sleep between polls (needs tickless idle)
+    esp_pm_config_esp32_t pm = {};
+    pm.max_freq_mhz = getCpuFrequencyMhz();
+    pm.min_freq_mhz = enable ? 40 : pm.max_freq_mhz;
+    pm.light_sleep_enable = enable;
+    esp_pm_configure(&pm);
+#endif
 }
 
 void OTAManager::loop() {
@@ -194,91 +462,329 @@ void OTAManager::loop() {
     }
 }
 
-bool OTAManager::performHTTPUpdate(const String& filename) {
-    // Construct full URL from base + filename
-    String fullUrl = String(OTA_BASE_URL) + filename;
+String OTAManager::deltaPatchPath(const String& filename) {
+    // "v1.0.3/firmware-prod.bin" -> "v1.0.3/firmware-prod-from-1.0.2.patch"
+    String current = String(FIRMWARE_VERSION);
+    if (!filename.endsWith(".bin") || !isReleaseVersion(current)) {
+        return "";
+    }
+    return filename.substring(0, filename.length() - 4) + "-from-" + current + ".patch";
+}
+
+bool OTAManager::isReleaseVersion(const String& version) {
+    int major, minor, patch, end = 0;
+    if (sscanf(version.c_str(), "%d.%d.%d%n", &major, &minor, &patch, &end) != 3) {
+        return false;
+    }
+    return end == (int)version.length();
+}
+
+bool OTAManager::verifyRunningImage(uint32_t size, const uint8_t expectedSha256[32]) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (!running || size > running->size) {
+        return false;
+    }
     
-    Serial.println("╔══════════════════════════════════╗");
-    Serial.println("║  HTTP OTA Update from GitHub     ║");
-    Serial.println("╚══════════════════════════════════╝");
-    Serial.print("Base URL: ");
-    Serial.println(OTA_BASE_URL);
-    Serial.print("Filename: ");
-    Serial.println(filename);
-    Serial.print("Full URL: ");
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    
+    uint8_t buf[1024];
+    for (uint32_t offset = 0; offset < size; offset += sizeof(buf)) {
+        size_t n = min((uint32_t)sizeof(buf), size - offset);
+        if (esp_partition_read(running, offset, buf, n) != ESP_OK) {
+            mbedtls_sha256_free(&ctx);
+            return false;
+        }
+        mbedtls_sha256_update(&ctx, buf, n);
+    }
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+    return memcmp(digest, expectedSha256, sizeof(digest)) == 0;
+}
+
+bool OTAManager::streamDownload(const String& path, const char* label, const StreamHandler& onData) {
+    String fullUrl = String(OTA_BASE_URL) + path;
+    Serial.printf("Trying %s: ", label);
     Serial.println(fullUrl);
-    Serial.println();
     
     WiFiClientSecure client;
-    client.setInsecure();  // Skip certificate verification (GitHub certs change frequently)
+    client.setInsecure();  // Authenticity comes from the signed manifest's hash
     
-    // Configure HTTPUpdate for GitHub redirects
-    httpUpdate.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
-    httpUpdate.setLedPin(LED_BUILTIN, LOW);
+    HTTPClient http;
+    http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
+    if (!http.begin(client, fullUrl)) {
+        return false;
+    }
     
-    // Add callbacks for update progress
-    httpUpdate.onStart([this]() {
-        Serial.println("HTTP Update Started...");
-        if (display && display->isReady()) {
-            display->showOTAScreen("Starting...");
-        }
-    });
+    int httpCode = http.GET();
+    if (httpCode != HTTP_CODE_OK) {
+        Serial.printf("No %s available (HTTP %d)\n", label, httpCode);
+        http.end();
+        return false;
+    }
     
-    httpUpdate.onEnd([this]() {
-        Serial.println("\nHTTP Update Complete!");
-        if (display && display->isReady()) {
-            display->showOTAComplete();
+    WiFiClient* stream = http.getStreamPtr();
+    int remaining = http.getSize();  // -1 when chunked
+    downloadSize = remaining > 0 ? remaining : 0;
+    Serial.printf("Downloading %d bytes\n", remaining);
+    
+    uint8_t buf[1024];
+    unsigned long lastData = millis();
+    bool ok = true;
+    
+    while (http.connected() && (remaining > 0 || remaining == -1)) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (millis() - lastData > Config::OTA_STREAM_TIMEOUT_MS) {
+                Serial.printf("\n%s download stalled\n", label);
+                ok = false;
+                break;
+            }
+            delay(1);
+            continue;
         }
-    });
-    
-    httpUpdate.onProgress([this](int current, int total) {
-        Serial.printf("Progress: %d%%\r", (current * 100) / total);
-        if (display && display->isReady()) {
-            display->showOTAProgress(current, total);
+        
+        int n = stream->readBytes(buf, min(available, sizeof(buf)));
+        if (n <= 0) continue;
+        lastData = millis();
+        if (remaining > 0) remaining -= n;
+        
+        if (!onData(buf, n)) {
+            ok = false;
+            break;
         }
-    });
+    }
+    if (remaining > 0) {
+        ok = false;
+    }
     
-    httpUpdate.onError([this](int error) {
-        Serial.printf("\nHTTP Update Error (%d): ", error);
-        const char* errorMsg = "Unknown";
-        switch(error) {
-            case HTTP_UPDATE_FAILED:
-                Serial.println("Update failed");
-                errorMsg = "Update failed";
-                break;
-            case HTTP_UPDATE_NO_UPDATES:
-                Serial.println("No updates available");
-                errorMsg = "No updates";
-                break;
-            case HTTP_UPDATE_OK:
-                Serial.println("Update OK (shouldn't see this as error)");
-                errorMsg = "Update OK";
-                break;
+    http.end();
+    return ok;
+}
+
+bool OTAManager::beginStreamedUpdate(uint32_t size) {
+    if (!Update.begin(size, U_FLASH)) {
+        Serial.printf("Update.begin failed: %s\n", Update.errorString());
+        return false;
+    }
+    Update.setLedPin(LED_BUILTIN, LOW);
+    mbedtls_sha256_init(&updateSha);
+    mbedtls_sha256_starts(&updateSha, 0);
+    updateSize = size;
+    updateWritten = 0;
+    updateStarted = true;
+    startProgress();
+    return true;
+}
+
+bool OTAManager::writeStreamedUpdate(const uint8_t* data, size_t len) {
+    if (!updateStarted || Update.write(const_cast<uint8_t*>(data), len) != len) {
+        return false;
+    }
+    mbedtls_sha256_update(&updateSha, data, len);
+    
+    updateWritten += len;
+    reportProgress(updateWritten, updateSize);
+    return true;
+}
+
+void OTAManager::startProgress() {
+    lastProgressPercent = -1;
+    progressBytes = 0;
+    progressStart = millis();
+    if (display && display->isReady()) {
+        display->resetStats();
+    }
+}
+
+void OTAManager::reportProgress(uint32_t done, uint32_t total) {
+    progressBytes = done;
+    if (total == 0) {
+        return;
+    }
+    
+    // Progress callbacks fire for every chunk; only print and draw when the
+    // percentage changes so rendering doesn't slow down the flash writes
+    int percent = (int)(((uint64_t)done * 100) / total);
+    if (percent == lastProgressPercent) {
+        return;
+    }
+    lastProgressPercent = percent;
+    
+    Serial.printf("Progress: %d%%\r", percent);
+    if (display && display->isReady()) {
+        display->showOTAProgress(done, total);
+    }
+}
+
+void OTAManager::reportThroughput() {
+    unsigned long elapsed = millis() - progressStart;
+    if (elapsed == 0) elapsed = 1;
+    
+    Serial.printf("Wrote %u bytes in %lu ms (%.1f KB/s)\n",
+                  progressBytes, elapsed, progressBytes / 1.024f / elapsed);
+    if (display && display->isReady()) {
+        const DisplayStats& stats = display->getStats();
+        Serial.printf("Display: %u updates, %u bytes, %u ms on I2C\n",
+                      stats.frames, stats.bytesSent, stats.busyMicros / 1000);
+    } else {
+        Serial.println("Display: not attached");
+    }
+}
+
+bool OTAManager::finishStreamedUpdate(bool ok, const uint8_t expectedSha256[32]) {
+    if (!updateStarted) {
+        return false;
+    }
+    updateStarted = false;
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&updateSha, digest);
+    mbedtls_sha256_free(&updateSha);
+    
+    if (ok && expectedSha256 && memcmp(digest, expectedSha256, sizeof(digest)) != 0) {
+        Serial.println("\nUpdate image SHA-256 mismatch");
+        ok = false;
+    }
+    if (ok && haveTrustedSha && memcmp(digest, trustedSha256, sizeof(digest)) != 0) {
+        Serial.println("\nUpdate image does not match the signed manifest");
+        ok = false;
+    }
+    if (!ok) {
+        Update.abort();
+        return false;
+    }
+    
+    if (!Update.end()) {
+        Serial.printf("Update.end failed: %s\n", Update.errorString());
+        return false;
+    }
+    
+    Serial.println("\nStreamed update complete");
+    reportThroughput();
+    if (display && display->isReady()) {
+        display->showOTAComplete();
+    }
+    return true;
+}
+
+bool OTAManager::performDeltaUpdate(const String& patchPath) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    
+    DeltaPatchApplier applier(
+        [running](uint32_t offset, uint8_t* buf, size_t len) {
+            return esp_partition_read(running, offset, buf, len) == ESP_OK;
+        },
+        [this](const uint8_t* data, size_t len) {
+            return writeStreamedUpdate(data, len);
+        });
+    
+    bool ok = streamDownload(patchPath, "delta patch", [this, &applier](const uint8_t* data, size_t len) {
+        bool wasReady = applier.headerReady();
+        if (!applier.feed(data, len)) {
+            return false;
+        }
+        if (wasReady || !applier.headerReady()) {
+            return true;
+        }
+        
+        // Header just arrived: make sure the patch was built against this image
+        const DeltaPatchHeader& hdr = applier.header();
+        Serial.printf("Patch: %u -> %u bytes\n", hdr.sourceSize, hdr.targetSize);
+        if (!verifyRunningImage(hdr.sourceSize, hdr.sourceSha256)) {
+            Serial.println("Running image does not match patch source, skipping delta");
+            return false;
         }
         if (display && display->isReady()) {
-            display->showOTAError(errorMsg);
-            delay(3000); // Show error for 3 seconds
+            display->showOTAScreen("Patching...");
         }
+        return beginStreamedUpdate(hdr.targetSize);
     });
     
-    // Perform the update
-    t_httpUpdate_return ret = httpUpdate.update(client, fullUrl);
+    if (ok) {
+        ok = applier.finish();
+    }
+    if (!ok && applier.error() != DeltaPatchError::NONE) {
+        Serial.printf("\nDelta patch failed: %s\n", DeltaPatchApplier::errorToString(applier.error()));
+    }
+    return finishStreamedUpdate(ok, applier.header().targetSha256);
+}
+
+bool OTAManager::performCompressedUpdate(const String& imagePath) {
+    CompressedImageDecoder decoder(
+        [this](const CompressedImageHeader& hdr) {
+            Serial.printf("Compressed image: %u bytes uncompressed\n", hdr.imageSize);
+            return beginStreamedUpdate(hdr.imageSize);
+        },
+        [this](const uint8_t* data, size_t len) {
+            return writeStreamedUpdate(data, len);
+        });
+    
+    bool ok = streamDownload(imagePath, "compressed image", [&decoder](const uint8_t* data, size_t len) {
+        return decoder.feed(data, len);
+    });
     
-    switch (ret) {
-        case HTTP_UPDATE_FAILED:
-            Serial.printf("Update failed: %s\n", httpUpdate.getLastErrorString().c_str());
-            Serial.printf("HTTP error code: %d\n", httpUpdate.getLastError());
-            return false;
-            
-        case HTTP_UPDATE_NO_UPDATES:
-            Serial.println("No updates available (same version already installed)");
-            return false;
-            
-        case HTTP_UPDATE_OK:
-            Serial.println("Update successful! Rebooting...");
+    if (ok) {
+        ok = decoder.finish();
+    }
+    return finishStreamedUpdate(ok, decoder.header().imageSha256);
+}
+
+bool OTAManager::performHTTPUpdate(const String& filename) {
+    // A small patch against the running image is much cheaper to download
+    if (Config::OTA_TRY_DELTA && !skipDelta) {
+        String patchPath = deltaPatchPath(filename);
+        if (patchPath.length() > 0 && performDeltaUpdate(patchPath)) {
+            return true;
+        }
+    }
+    
+    // Next best: the same image heatshrink-compressed
+    if (Config::OTA_TRY_COMPRESSED && filename.endsWith(".bin")) {
+        if (performCompressedUpdate(filename + ".hs")) {
             return true;
+        }
+        Serial.println("Falling back to uncompressed image download");
     }
     
+    // Last resort: the plain image, checked the same way as the others
+    return performFullUpdate(filename);
+}
+
+bool OTAManager::performFullUpdate(const String& imagePath) {
+    Serial.println("╔══════════════════════════════════╗");
+    Serial.println("║  HTTP OTA Update from GitHub     ║");
+    Serial.println("╚══════════════════════════════════╝");
+    if (display && display->isReady()) {
+        display->showOTAScreen("Starting...");
+    }
+    
+    bool ok = streamDownload(imagePath, "full image", [this](const uint8_t* data, size_t len) {
+        if (!updateStarted) {
+            if (downloadSize == 0) {
+                Serial.println("Server did not report the image size");
+                return false;
+            }
+            if (!beginStreamedUpdate(downloadSize)) {
+                return false;
+            }
+        }
+        return writeStreamedUpdate(data, len);
+    });
+    
+    if (ok && !haveTrustedSha) {
+        Serial.println("No signed manifest hash for this image, installing unverified");
+    }
+    if (finishStreamedUpdate(ok, nullptr)) {
+        return true;
+    }
+    if (display && display->isReady()) {
+        display->showOTAError("Update failed");
+        delay(3000); // Show error for 3 seconds
+    }
     return false;
 }
 
@@ -303,6 +809,119 @@ bool OTAManager::isNewerVersion(const String& latestVersion, const String& curre
     return false;
 }
 
+bool OTAManager::verifyManifestSignature(const char* text, const OtaManifest& manifest) {
+#ifdef OTA_MANIFEST_PUBKEY
+    uint8_t hash[32];
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, (const unsigned char*)text, manifest.signedLength);
+    mbedtls_sha256_finish(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    
+    unsigned char sig[80];
+    size_t sigLen = 0;
+    if (mbedtls_base64_decode(sig, sizeof(sig), &sigLen,
+                              (const unsigned char*)manifest.signature, strlen(manifest.signature)) != 0) {
+        return false;
+    }
+    
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    bool ok = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)OTA_MANIFEST_PUBKEY,
+                                          strlen(OTA_MANIFEST_PUBKEY) + 1) == 0 &&
+              mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, hash, sizeof(hash), sig, sigLen) == 0;
+    mbedtls_pk_free(&pk);
+    return ok;
+#else
+    (void)text;
+    (void)manifest;
+    return false;
+#endif
+}
+
+bool OTAManager::manifestCheckDue() {
+    // A deep sleep wake is a new boot, so it checks once per wake; always
+    // on, the check is repeated every OTA_CHECK_INTERVAL_MS instead of on
+    // every reading
+    if (manifestChecked && millis() - lastManifestCheck < Config::OTA_CHECK_INTERVAL_MS) {
+        return false;
+    }
+    manifestChecked = true;
+    lastManifestCheck = millis();
+    return true;
+}
+
+bool OTAManager::fetchManifest() {
+#ifndef OTA_MANIFEST_PUBKEY
+    Serial.println("No manifest signing key built in (include/ota_signing_key.h)");
+    return false;
+#endif
+    if (strlen(OTA_MANIFEST_URL) == 0) {
+        Serial.println("No OTA manifest URL configured");
+        return false;
+    }
+    
+    WiFiClientSecure client;
+    client.setInsecure();  // Authenticity comes from the manifest signature
+    
+    HTTPClient http;
+    http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
+    const char* headerKeys[] = { "ETag" };
+    http.collectHeaders(headerKeys, 1);
+    if (!http.begin(client, OTA_MANIFEST_URL)) {
+        return false;
+    }
+    
+    // Conditional GET: the usual answer is a bodyless 304
+    if (manifestCache.valid && manifestCache.etag[0] != '\0') {
+        http.addHeader("If-None-Match", manifestCache.etag);
+    }
+    
+    unsigned long start = millis();
+    int httpCode = http.GET();
+    
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        Serial.printf("Manifest unchanged (304, %lu ms)\n", millis() - start);
+        http.end();
+        return manifestCache.valid;
+    }
+    if (httpCode != HTTP_CODE_OK) {
+        Serial.printf("Manifest fetch failed (HTTP %d)\n", httpCode);
+        http.end();
+        return false;
+    }
+    if (http.getSize() > (int)OtaManifestConfig::MAX_SIZE) {
+        Serial.println("Manifest too large, ignoring");
+        http.end();
+        return false;
+    }
+    
+    String body = http.getString();
+    String etag = http.header("ETag");
+    http.end();
+    Serial.printf("Manifest downloaded (%u bytes, %lu ms)\n", body.length(), millis() - start);
+    
+    OtaManifest manifest;
+    if (!manifest.parse(body.c_str(), body.length(), config.batteryType.c_str())) {
+        Serial.println("Manifest is malformed");
+        return false;
+    }
+    if (!verifyManifestSignature(body.c_str(), manifest)) {
+        Serial.println("❌ Manifest signature invalid, ignoring");
+        return false;
+    }
+    
+    strlcpy(manifestCache.etag, etag.c_str(), sizeof(manifestCache.etag));
+    strlcpy(manifestCache.version, manifest.version, sizeof(manifestCache.version));
+    strlcpy(manifestCache.image, manifest.image, sizeof(manifestCache.image));
+    memcpy(manifestCache.sha256, manifest.sha256, sizeof(manifestCache.sha256));
+    manifestCache.hasSha256 = manifest.hasSha256;
+    manifestCache.hasPatch = manifest.hasPatchFrom(FIRMWARE_VERSION);
+    manifestCache.valid = true;
+    return true;
+}
+
 bool OTAManager::checkForUpdates() {
     Serial.println("\n╔═══════════════════════════════╗");
     Serial.println("║  Checking for OTA Updates     ║");
@@ -313,14 +932,39 @@ bool OTAManager::checkForUpdates() {
     Serial.println(currentVersion);
     
     String targetVersion = config.otaTargetVersion;
+    String firmwareFilename;
     
-    if (targetVersion.length() == 0) {
-        Serial.println("No target OTA version configured");
-        return false;
+    if (targetVersion.length() > 0) {
+        // A version pinned with 'otaver' overrides the release manifest
+        Serial.print("Target version (pinned): ");
+        Serial.println(targetVersion);
+        
+        firmwareFilename = "v" + targetVersion + "/firmware-" + config.batteryType + ".bin";
+    } else {
+        if (!isReleaseVersion(currentVersion)) {
+            // sscanf would read "dev" or "nightly-..." as 0.0.0 and any release would win
+            Serial.println("✗ Not a release build, skipping the manifest (pin a version with 'otaver')");
+            return false;
+        }
+        if (!manifestCheckDue()) {
+            return false;
+        }
+        if (!fetchManifest()) {
+            return false;
+        }
+        targetVersion = manifestCache.version;
+        Serial.print("Latest release: ");
+        Serial.println(targetVersion);
+        
+        firmwareFilename = manifestCache.image;
     }
     
-    Serial.print("Target version: ");
-    Serial.println(targetVersion);
+    if (isRolledBack(targetVersion)) {
+        Serial.print("✗ Skipping ");
+        Serial.print(targetVersion);
+        Serial.println(", it was rolled back (set it with 'otaver' to retry)");
+        return false;
+    }
     
     if (isNewerVersion(targetVersion, currentVersion)) {
         Serial.println("\n✓ New version available!");
@@ -329,25 +973,21 @@ bool OTAManager::checkForUpdates() {
         Serial.print("  Target:  ");
         Serial.println(targetVersion);
         
-        // Construct firmware filename based on battery type (version in URL path)
-        #if BATTERY_TYPE == BATTERY_TYPE_LEAD_ACID
-            String batteryType = "leadacid";
-        #elif BATTERY_TYPE == BATTERY_TYPE_LIFEPO4
-            String batteryType = "lifepo4";
-        #else
-            String batteryType = "unknown";
-        #endif
-        
-        String firmwareFilename = "v" + targetVersion + "/firmware-" + batteryType + ".bin";
-        
         Serial.print("Triggering update to: ");
         Serial.println(firmwareFilename);
         
-        requestUpdate(firmwareFilename);
+        if (config.otaTargetVersion.length() > 0) {
+            requestUpdate(firmwareFilename);
+        } else {
+            // The image must match the signed manifest
+            haveTrustedSha = manifestCache.hasSha256;
+            memcpy(trustedSha256, manifestCache.sha256, sizeof(trustedSha256));
+            skipDelta = !manifestCache.hasPatch;
+            queueUpdate(firmwareFilename);
+        }
         return true;
     } else {
         Serial.println("✓ Firmware is up to date");
         return false;
     }
 }
-
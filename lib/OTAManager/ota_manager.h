@@ -3,11 +3,13 @@
 
 #include <Arduino.h>
 #include <ArduinoOTA.h>
-#include <HTTPUpdate.h>
 #include <HTTPClient.h>
 #include <WiFi.h>
+#include <esp_wifi.h>
 #include <WiFiClientSecure.h>
 #include <Preferences.h>
+#include <functional>
+#include <mbedtls/sha256.h>
 #include "config_manager.h"
 
 // Forward declaration
@@ -21,6 +23,13 @@ class DisplayManager;
 #define FIRMWARE_VERSION "1.0.0"
 #endif
 
+// Signed release manifest checked by checkForUpdates() (empty = disabled)
+#ifndef OTA_MANIFEST_URL
+#define OTA_MANIFEST_URL ""
+#endif
+
+struct OtaManifest;
+
 class OTAManager {
 private:
     ConfigManager& config;
@@ -29,21 +38,77 @@ private:
     String otaFilename;
     Preferences preferences;
     
+    // Streamed (delta/compressed) update state
+    mbedtls_sha256_context updateSha;
+    uint32_t updateSize;
+    uint32_t updateWritten;
+    bool updateStarted;
+    uint32_t downloadSize;  // Content-Length of the current download (0 = not sent)
+    
+    // Set from the signed manifest for the update it triggered
+    bool haveTrustedSha;
+    uint8_t trustedSha256[32];
+    bool skipDelta;
+    
+    bool manifestChecked;  // This boot
+    unsigned long lastManifestCheck;
+    
+    // Progress reporting shared by all update paths
+    int lastProgressPercent;
+    uint32_t progressBytes;
+    unsigned long progressStart;
+    
+    // ArduinoOTA upload state, set from its callbacks
+    bool arduinoOtaStarted;
+    bool arduinoOtaFailed;
+    wifi_ps_type_t savedPsMode;  // Power save mode before the upload window
+    
+    using StreamHandler = std::function<bool(const uint8_t* data, size_t len)>;
+    
     bool performHTTPUpdate(const String& filename);
+    bool performDeltaUpdate(const String& patchPath);
+    bool performCompressedUpdate(const String& imagePath);
+    bool performFullUpdate(const String& imagePath);
+    bool streamDownload(const String& path, const char* label, const StreamHandler& onData);
+    bool beginStreamedUpdate(uint32_t size);
+    bool writeStreamedUpdate(const uint8_t* data, size_t len);
+    // expectedSha256 is the digest embedded in a patch or compressed image
+    // (nullptr for a plain .bin); the signed manifest's hash is checked too
+    bool finishStreamedUpdate(bool ok, const uint8_t expectedSha256[32]);
+    bool verifyRunningImage(uint32_t size, const uint8_t expectedSha256[32]);
+    static String deltaPatchPath(const String& filename);
+    static bool isReleaseVersion(const String& version);  // "X.Y.Z", not "dev" or "nightly-..."
     void saveOTATrigger(const String& filename);
+    void queueUpdate(const String& filename);  // Keeps the trust state set by the caller
     bool isNewerVersion(const String& latestVersion, const String& currentVersion);
+    bool fetchManifest();
+    bool manifestCheckDue();
+    bool verifyManifestSignature(const char* text, const OtaManifest& manifest);
+    void beginTrialBoot();
+    bool isRolledBack(const String& targetVersion);  // Until the manifest moves on or 'otaver' sets it again
+    void waitForArduinoOTA(unsigned long windowMs);
+    void startProgress();
+    void reportProgress(uint32_t done, uint32_t total);
+    void reportThroughput();
+    void setLowPowerWait(bool enable);
     
 public:
     OTAManager(ConfigManager& cfg, DisplayManager* disp = nullptr);
     
     void setup();
-    void requestUpdate(const String& filename);
+    void requestUpdate(const String& filename);  // Explicit request: no manifest hash applies
     void clearOTATrigger();  // Public method to clear pending OTA trigger
     bool isUpdateRequested() const;
     bool checkPendingOTA();  // Check if OTA was triggered while asleep
-    bool checkForUpdates();  // Automatically check if newer version is available
+    bool checkForUpdates();  // Check the release manifest (or pinned version) for newer firmware
     void handleUpdate();
     void loop();
+    
+    // Rollback protection for freshly installed firmware
+    void checkBootHealth();       // Call early in setup(); rolls back after too many failed boots
+    void noteBrokerReached();     // Call once connected to the broker; counts this boot as a trial
+    void markBootHealthy();       // Call once a wake cycle has published successfully
+    String takeRollbackReason();  // Reason for a past rollback (cleared once read), or ""
 };
 
 #endif // OTA_MANAGER_H
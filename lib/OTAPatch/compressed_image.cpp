@@ -0,0 +1,75 @@
+/*
+ * Compressed Firmware Image Decoder Implementation
+ */
+
+#include "compressed_image.h"
+#include <string.h>
+
+bool CompressedImageHeader::parse(const uint8_t* raw, size_t len) {
+    if (len < CompressedImageConfig::HEADER_SIZE || memcmp(raw, "BMHS", 4) != 0) {
+        return false;
+    }
+    version = raw[4];
+    windowBits = raw[5];
+    lookaheadBits = raw[6];
+    imageSize = (uint32_t)raw[8] | ((uint32_t)raw[9] << 8) |
+                ((uint32_t)raw[10] << 16) | ((uint32_t)raw[11] << 24);
+    memcpy(imageSha256, raw + 12, 32);
+    return version == CompressedImageConfig::FORMAT_VERSION;
+}
+
+CompressedImageDecoder::CompressedImageDecoder(HeaderHandler onHeader, ImageWriter writer)
+    : handleHeader(onHeader), writeImage(writer),
+      headerLen(0), headerParsed(false), failed(false), written(0) {
+    memset(&hdr, 0, sizeof(hdr));
+}
+
+bool CompressedImageDecoder::feed(const uint8_t* data, size_t len) {
+    if (failed) {
+        return false;
+    }
+
+    if (!headerParsed) {
+        size_t take = CompressedImageConfig::HEADER_SIZE - headerLen;
+        if (take > len) take = len;
+        memcpy(headerBuf + headerLen, data, take);
+        headerLen += take;
+        data += take;
+        len -= take;
+
+        if (headerLen < CompressedImageConfig::HEADER_SIZE) {
+            return true;
+        }
+
+        bool ok = hdr.parse(headerBuf, headerLen) &&
+            decoder.begin(hdr.windowBits, hdr.lookaheadBits,
+                [this](const uint8_t* out, size_t outLen) {
+                    if (written + outLen > hdr.imageSize || !writeImage(out, outLen)) {
+                        return false;
+                    }
+                    written += outLen;
+                    return true;
+                }) &&
+            handleHeader(hdr);
+        if (!ok) {
+            failed = true;
+            return false;
+        }
+        headerParsed = true;
+    }
+
+    if (len > 0 && !decoder.feed(data, len)) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool CompressedImageDecoder::finish() {
+    if (failed || !headerParsed || !decoder.flush()) {
+        failed = true;
+        return false;
+    }
+    decoder.end();
+    return written == hdr.imageSize;
+}
@@ -0,0 +1,78 @@
+/*
+ * Compressed Firmware Image Decoder
+ *
+ * Streams a heatshrink-compressed firmware image (".bin.hs") back into the
+ * original .bin, a small chunk at a time, so it can go straight into the
+ * update partition without buffering the image.
+ *
+ * Image layout (little-endian):
+ *   Header (44 bytes, uncompressed)
+ *     char[4]  magic "BMHS"
+ *     uint8    format version (1)
+ *     uint8    heatshrink window bits
+ *     uint8    heatshrink lookahead bits
+ *     uint8    reserved (0)
+ *     uint32   decompressed image size
+ *     uint8[32] SHA-256 of the decompressed image
+ *   Body: heatshrink-compressed image
+ *
+ * Generate with tools/compress_firmware.py.
+ */
+
+#ifndef COMPRESSED_IMAGE_H
+#define COMPRESSED_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "heatshrink_decoder.h"
+
+namespace CompressedImageConfig {
+    constexpr uint8_t FORMAT_VERSION = 1;
+    constexpr size_t HEADER_SIZE = 44;
+}
+
+struct CompressedImageHeader {
+    uint8_t version;
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    uint32_t imageSize;
+    uint8_t imageSha256[32];
+
+    // Parse a raw header. Returns false if the magic or version don't match.
+    bool parse(const uint8_t* raw, size_t len);
+};
+
+class CompressedImageDecoder {
+public:
+    // Called once the header is parsed; return false to abort (e.g. Update.begin failed)
+    using HeaderHandler = std::function<bool(const CompressedImageHeader& header)>;
+    // Receives the decompressed image in order
+    using ImageWriter = std::function<bool(const uint8_t* data, size_t len)>;
+
+    CompressedImageDecoder(HeaderHandler onHeader, ImageWriter writer);
+
+    // Feed raw bytes of the .bin.hs file as they arrive
+    bool feed(const uint8_t* data, size_t len);
+
+    // Call after the last byte; true if exactly imageSize bytes were produced
+    bool finish();
+
+    bool headerReady() const { return headerParsed; }
+    const CompressedImageHeader& header() const { return hdr; }
+    uint32_t bytesWritten() const { return written; }
+
+private:
+    HeaderHandler handleHeader;
+    ImageWriter writeImage;
+    HeatshrinkDecoder decoder;
+    CompressedImageHeader hdr;
+
+    uint8_t headerBuf[CompressedImageConfig::HEADER_SIZE];
+    size_t headerLen;
+    bool headerParsed;
+    bool failed;
+    uint32_t written;
+};
+
+#endif // COMPRESSED_IMAGE_H
@@ -0,0 +1,227 @@
+/*
+ * Delta Patch Applier Implementation
+ */
+
+#include "delta_patch.h"
+#include <string.h>
+
+static uint32_t readLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool DeltaPatchHeader::parse(const uint8_t* raw, size_t len) {
+    if (len < DeltaPatchConfig::HEADER_SIZE || memcmp(raw, "BMDP", 4) != 0) {
+        return false;
+    }
+    version = raw[4];
+    windowBits = raw[5];
+    lookaheadBits = raw[6];
+    sourceSize = readLE32(raw + 8);
+    targetSize = readLE32(raw + 12);
+    memcpy(sourceSha256, raw + 16, 32);
+    memcpy(targetSha256, raw + 48, 32);
+    return version == DeltaPatchConfig::FORMAT_VERSION;
+}
+
+DeltaPatchApplier::DeltaPatchApplier(SourceReader reader, TargetWriter writer)
+    : readSource(reader), writeTarget(writer), lastError(DeltaPatchError::NONE),
+      headerLen(0), headerParsed(false), state(State::DIFF_LEN),
+      varint(0), varintShift(0), diffRemaining(0), extraRemaining(0),
+      sourcePos(0), written(0) {
+    memset(&hdr, 0, sizeof(hdr));
+}
+
+const char* DeltaPatchApplier::errorToString(DeltaPatchError error) {
+    switch (error) {
+        case DeltaPatchError::NONE:            return "OK";
+        case DeltaPatchError::BAD_HEADER:      return "Bad patch header";
+        case DeltaPatchError::NO_MEMORY:       return "Out of memory";
+        case DeltaPatchError::SOURCE_READ:     return "Source read failed";
+        case DeltaPatchError::SOURCE_RANGE:    return "Source out of range";
+        case DeltaPatchError::TARGET_WRITE:    return "Target write failed";
+        case DeltaPatchError::TARGET_OVERFLOW: return "Target overflow";
+        case DeltaPatchError::TRUNCATED:       return "Patch truncated";
+        default:                               return "Unknown";
+    }
+}
+
+bool DeltaPatchApplier::fail(DeltaPatchError error) {
+    if (lastError == DeltaPatchError::NONE) {
+        lastError = error;
+    }
+    return false;
+}
+
+bool DeltaPatchApplier::feed(const uint8_t* data, size_t len) {
+    if (lastError != DeltaPatchError::NONE) {
+        return false;
+    }
+
+    if (!headerParsed) {
+        size_t take = DeltaPatchConfig::HEADER_SIZE - headerLen;
+        if (take > len) take = len;
+        memcpy(headerBuf + headerLen, data, take);
+        headerLen += take;
+        data += take;
+        len -= take;
+
+        if (headerLen < DeltaPatchConfig::HEADER_SIZE) {
+            return true;
+        }
+        if (!hdr.parse(headerBuf, headerLen)) {
+            return fail(DeltaPatchError::BAD_HEADER);
+        }
+        bool ok = decoder.begin(hdr.windowBits, hdr.lookaheadBits,
+            [this](const uint8_t* out, size_t outLen) { return onDecoded(out, outLen); });
+        if (!ok) {
+            return fail(HeatshrinkDecoder::validParameters(hdr.windowBits, hdr.lookaheadBits)
+                        ? DeltaPatchError::NO_MEMORY : DeltaPatchError::BAD_HEADER);
+        }
+        headerParsed = true;
+    }
+
+    if (len == 0) {
+        return true;
+    }
+    if (!decoder.feed(data, len)) {
+        return fail(DeltaPatchError::TARGET_WRITE);
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::finish() {
+    if (lastError != DeltaPatchError::NONE) {
+        return false;
+    }
+    if (!headerParsed) {
+        return fail(DeltaPatchError::TRUNCATED);
+    }
+    if (!decoder.flush()) {
+        return fail(DeltaPatchError::TARGET_WRITE);
+    }
+    decoder.end();
+    if (written != hdr.targetSize) {
+        return fail(DeltaPatchError::TRUNCATED);
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::readVarint(uint8_t byte, bool& done) {
+    if (varintShift >= 64) {
+        return fail(DeltaPatchError::BAD_HEADER);
+    }
+    varint |= (uint64_t)(byte & 0x7F) << varintShift;
+    varintShift += 7;
+    done = (byte & 0x80) == 0;
+    return true;
+}
+
+bool DeltaPatchApplier::writeOut(const uint8_t* data, size_t len) {
+    if (written + len > hdr.targetSize) {
+        return fail(DeltaPatchError::TARGET_OVERFLOW);
+    }
+    if (!writeTarget(data, len)) {
+        return fail(DeltaPatchError::TARGET_WRITE);
+    }
+    written += len;
+    return true;
+}
+
+bool DeltaPatchApplier::applyDiff(const uint8_t* data, size_t len) {
+    uint8_t chunk[DeltaPatchConfig::SOURCE_CHUNK];
+
+    while (len > 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+
+        // Like bsdiff, bytes outside the source image read as zero
+        memset(chunk, 0, n);
+        int64_t start = sourcePos < 0 ? 0 : sourcePos;
+        int64_t stop = sourcePos + (int64_t)n;
+        if (stop > (int64_t)hdr.sourceSize) stop = hdr.sourceSize;
+        if (stop > start) {
+            if (!readSource((uint32_t)start, chunk + (start - sourcePos), (size_t)(stop - start))) {
+                return fail(DeltaPatchError::SOURCE_READ);
+            }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = (uint8_t)(chunk[i] + data[i]);
+        }
+        if (!writeOut(chunk, n)) {
+            return false;
+        }
+
+        sourcePos += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::onDecoded(const uint8_t* data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        bool done = false;
+        switch (state) {
+            case State::DIFF_LEN:
+                if (!readVarint(data[i++], done)) return false;
+                if (done) {
+                    diffRemaining = (uint32_t)varint;
+                    varint = 0;
+                    varintShift = 0;
+                    state = State::EXTRA_LEN;
+                }
+                break;
+
+            case State::EXTRA_LEN:
+                if (!readVarint(data[i++], done)) return false;
+                if (done) {
+                    extraRemaining = (uint32_t)varint;
+                    varint = 0;
+                    varintShift = 0;
+                    state = State::SEEK;
+                }
+                break;
+
+            case State::SEEK:
+                // The seek is read up front but kept in varint until the
+                // diff and extra bytes of this record have been applied
+                if (!readVarint(data[i++], done)) return false;
+                if (done) {
+                    varintShift = 0;
+                    state = diffRemaining > 0 ? State::DIFF : State::EXTRA;
+                }
+                break;
+
+            case State::DIFF: {
+                size_t n = len - i;
+                if (n > diffRemaining) n = diffRemaining;
+                if (!applyDiff(data + i, n)) return false;
+                i += n;
+                diffRemaining -= n;
+                if (diffRemaining == 0) {
+                    state = State::EXTRA;
+                }
+                break;
+            }
+
+            case State::EXTRA: {
+                size_t n = len - i;
+                if (n > extraRemaining) n = extraRemaining;
+                if (n > 0 && !writeOut(data + i, n)) return false;
+                i += n;
+                extraRemaining -= n;
+                break;
+            }
+        }
+
+        if (state == State::EXTRA && extraRemaining == 0) {
+            // Record complete: apply the zigzag-encoded seek
+            int64_t seek = (int64_t)(varint >> 1) ^ -(int64_t)(varint & 1);
+            sourcePos += seek;
+            varint = 0;
+            state = State::DIFF_LEN;
+        }
+    }
+    return true;
+}
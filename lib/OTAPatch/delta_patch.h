@@ -0,0 +1,116 @@
+/*
+ * Delta Patch Applier
+ *
+ * Applies a binary diff between two firmware images while it streams in.
+ * The patch is a bsdiff-style sequence of (diff, extra, seek) records,
+ * heatshrink-compressed, so the full patch never has to be held in RAM.
+ *
+ * Patch layout (little-endian):
+ *   Header (80 bytes, uncompressed)
+ *     char[4]  magic "BMDP"
+ *     uint8    format version (1)
+ *     uint8    heatshrink window bits
+ *     uint8    heatshrink lookahead bits
+ *     uint8    reserved (0)
+ *     uint32   source image size
+ *     uint32   target image size
+ *     uint8[32] SHA-256 of the source image
+ *     uint8[32] SHA-256 of the target image
+ *   Body (heatshrink-compressed), repeated until targetSize bytes written:
+ *     varint   diff length   - bytes added to the source at the read cursor
+ *     varint   extra length  - literal bytes copied straight to the output
+ *     zigzag   seek          - signed move of the source read cursor
+ *     uint8[diff length]
+ *     uint8[extra length]
+ *
+ * Generate patches with tools/make_ota_patch.py.
+ */
+
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "heatshrink_decoder.h"
+
+namespace DeltaPatchConfig {
+    constexpr uint8_t FORMAT_VERSION = 1;
+    constexpr size_t HEADER_SIZE = 80;
+    constexpr size_t SOURCE_CHUNK = 256;  // Bytes of the running image read at a time
+}
+
+struct DeltaPatchHeader {
+    uint8_t version;
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    uint32_t sourceSize;
+    uint32_t targetSize;
+    uint8_t sourceSha256[32];
+    uint8_t targetSha256[32];
+
+    // Parse a raw header. Returns false if the magic or version don't match.
+    bool parse(const uint8_t* raw, size_t len);
+};
+
+enum class DeltaPatchError : uint8_t {
+    NONE,
+    BAD_HEADER,
+    NO_MEMORY,
+    SOURCE_READ,
+    SOURCE_RANGE,
+    TARGET_WRITE,
+    TARGET_OVERFLOW,
+    TRUNCATED
+};
+
+class DeltaPatchApplier {
+public:
+    // Read len bytes of the running image at offset into buf
+    using SourceReader = std::function<bool(uint32_t offset, uint8_t* buf, size_t len)>;
+    // Write the next chunk of the new image
+    using TargetWriter = std::function<bool(const uint8_t* data, size_t len)>;
+
+    DeltaPatchApplier(SourceReader reader, TargetWriter writer);
+
+    // Feed raw patch bytes (header included) as they arrive
+    bool feed(const uint8_t* data, size_t len);
+
+    // Call after the last byte; true if the whole target was produced
+    bool finish();
+
+    bool headerReady() const { return headerParsed; }
+    const DeltaPatchHeader& header() const { return hdr; }
+    uint32_t bytesWritten() const { return written; }
+    DeltaPatchError error() const { return lastError; }
+    static const char* errorToString(DeltaPatchError error);
+
+private:
+    enum class State : uint8_t { DIFF_LEN, EXTRA_LEN, SEEK, DIFF, EXTRA };
+
+    SourceReader readSource;
+    TargetWriter writeTarget;
+    HeatshrinkDecoder decoder;
+    DeltaPatchHeader hdr;
+    DeltaPatchError lastError;
+
+    uint8_t headerBuf[DeltaPatchConfig::HEADER_SIZE];
+    size_t headerLen;
+    bool headerParsed;
+
+    State state;
+    uint64_t varint;
+    uint8_t varintShift;
+    uint32_t diffRemaining;
+    uint32_t extraRemaining;
+    int64_t sourcePos;
+    uint32_t written;
+
+    bool fail(DeltaPatchError error);
+    bool onDecoded(const uint8_t* data, size_t len);
+    bool readVarint(uint8_t byte, bool& done);
+    bool applyDiff(const uint8_t* data, size_t len);
+    bool writeOut(const uint8_t* data, size_t len);
+};
+
+#endif // DELTA_PATCH_H
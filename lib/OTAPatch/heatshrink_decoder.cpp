@@ -0,0 +1,133 @@
+/*
+ * Heatshrink Decoder Implementation
+ */
+
+#include "heatshrink_decoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+HeatshrinkDecoder::HeatshrinkDecoder()
+    : window(nullptr), windowMask(0), windowBits(0), lookaheadBits(0), head(0),
+      state(State::TAG), bitBuffer(0), bitCount(0), backrefIndex(0),
+      outLen(0), outTotal(0) {}
+
+HeatshrinkDecoder::~HeatshrinkDecoder() {
+    end();
+}
+
+bool HeatshrinkDecoder::validParameters(uint8_t wBits, uint8_t lBits) {
+    return wBits >= HeatshrinkConfig::MIN_WINDOW_BITS && wBits <= HeatshrinkConfig::MAX_WINDOW_BITS &&
+           lBits >= HeatshrinkConfig::MIN_LOOKAHEAD_BITS && lBits < wBits;
+}
+
+bool HeatshrinkDecoder::begin(uint8_t wBits, uint8_t lBits, Sink outputSink) {
+    if (!validParameters(wBits, lBits)) {
+        return false;
+    }
+
+    end();
+    window = (uint8_t*)malloc((size_t)1 << wBits);
+    if (!window) {
+        return false;
+    }
+
+    windowBits = wBits;
+    lookaheadBits = lBits;
+    windowMask = (uint16_t)((1u << wBits) - 1);
+    sink = outputSink;
+    reset();
+    return true;
+}
+
+void HeatshrinkDecoder::reset() {
+    if (window) {
+        memset(window, 0, (size_t)windowMask + 1);
+    }
+    head = 0;
+    state = State::TAG;
+    bitBuffer = 0;
+    bitCount = 0;
+    backrefIndex = 0;
+    outLen = 0;
+    outTotal = 0;
+}
+
+void HeatshrinkDecoder::end() {
+    free(window);
+    window = nullptr;
+}
+
+bool HeatshrinkDecoder::takeBits(uint8_t count, uint16_t& value) {
+    if (bitCount < count) {
+        return false;
+    }
+    bitCount -= count;
+    value = (uint16_t)((bitBuffer >> bitCount) & ((1u << count) - 1));
+    return true;
+}
+
+bool HeatshrinkDecoder::emit(uint8_t byte) {
+    window[head & windowMask] = byte;
+    head++;
+
+    outBuffer[outLen++] = byte;
+    outTotal++;
+    if (outLen == sizeof(outBuffer)) {
+        return flush();
+    }
+    return true;
+}
+
+bool HeatshrinkDecoder::flush() {
+    if (outLen == 0) {
+        return true;
+    }
+    bool ok = sink ? sink(outBuffer, outLen) : false;
+    outLen = 0;
+    return ok;
+}
+
+bool HeatshrinkDecoder::feed(const uint8_t* data, size_t len) {
+    if (!window) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (true) {
+        // Top up the bit buffer; at most 16 bits are ever consumed at once
+        while (bitCount <= 24 && pos < len) {
+            bitBuffer = (bitBuffer << 8) | data[pos++];
+            bitCount += 8;
+        }
+
+        uint16_t bits;
+        switch (state) {
+            case State::TAG:
+                if (!takeBits(1, bits)) return true;
+                state = bits ? State::LITERAL : State::INDEX;
+                break;
+
+            case State::LITERAL:
+                if (!takeBits(8, bits)) return true;
+                if (!emit((uint8_t)bits)) return false;
+                state = State::TAG;
+                break;
+
+            case State::INDEX:
+                if (!takeBits(windowBits, bits)) return true;
+                backrefIndex = bits + 1;
+                state = State::COUNT;
+                break;
+
+            case State::COUNT: {
+                if (!takeBits(lookaheadBits, bits)) return true;
+                uint16_t count = bits + 1;
+                for (uint16_t i = 0; i < count; i++) {
+                    if (!emit(window[(uint16_t)(head - backrefIndex) & windowMask])) return false;
+                }
+                state = State::TAG;
+                break;
+            }
+        }
+    }
+}
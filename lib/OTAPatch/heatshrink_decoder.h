@@ -0,0 +1,72 @@
+/*
+ * Heatshrink Decoder
+ *
+ * Streaming LZSS decoder compatible with the heatshrink format
+ * (https://github.com/atomicobject/heatshrink). Uses a fixed
+ * 2^windowBits byte window, so RAM use is known at build time.
+ *
+ * Plain C++ with no Arduino dependencies so it can be unit tested
+ * on the host as well as on the ESP32.
+ */
+
+#ifndef HEATSHRINK_DECODER_H
+#define HEATSHRINK_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+namespace HeatshrinkConfig {
+    constexpr uint8_t MIN_WINDOW_BITS = 4;
+    constexpr uint8_t MAX_WINDOW_BITS = 12;  // 4 KB window upper bound
+    constexpr uint8_t MIN_LOOKAHEAD_BITS = 3;
+    constexpr size_t OUTPUT_CHUNK = 256;     // Bytes buffered before calling the sink
+}
+
+class HeatshrinkDecoder {
+public:
+    // Receives decoded bytes. Return false to abort decoding.
+    using Sink = std::function<bool(const uint8_t* data, size_t len)>;
+
+    HeatshrinkDecoder();
+    ~HeatshrinkDecoder();
+
+    // Allocate the window and reset state. Returns false on invalid parameters
+    // or if the window could not be allocated.
+    bool begin(uint8_t windowBits, uint8_t lookaheadBits, Sink sink);
+    static bool validParameters(uint8_t windowBits, uint8_t lookaheadBits);
+    void reset();
+    void end();
+
+    // Decode a chunk of compressed input. Returns false if the sink aborted.
+    bool feed(const uint8_t* data, size_t len);
+
+    // Flush buffered output to the sink
+    bool flush();
+
+    size_t totalOut() const { return outTotal; }
+
+private:
+    enum class State : uint8_t { TAG, LITERAL, INDEX, COUNT };
+
+    Sink sink;
+    uint8_t* window;
+    uint16_t windowMask;
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    uint16_t head;
+
+    State state;
+    uint32_t bitBuffer;
+    uint8_t bitCount;
+    uint16_t backrefIndex;
+
+    uint8_t outBuffer[HeatshrinkConfig::OUTPUT_CHUNK];
+    size_t outLen;
+    size_t outTotal;
+
+    bool emit(uint8_t byte);
+    bool takeBits(uint8_t count, uint16_t& value);
+};
+
+#endif // HEATSHRINK_DECODER_H
@@ -0,0 +1,122 @@
+/*
+ * OTA Release Manifest Implementation
+ */
+
+#include "ota_manifest.h"
+#include <string.h>
+
+static void copyValue(char* dest, size_t destLen, const char* value, size_t valueLen) {
+    size_t n = valueLen < destLen - 1 ? valueLen : destLen - 1;
+    memcpy(dest, value, n);
+    dest[n] = '\0';
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parseSha256(uint8_t* out, const char* hex, size_t len) {
+    if (len != 64) {
+        return false;
+    }
+    for (size_t i = 0; i < 32; i++) {
+        int hi = hexNibble(hex[2 * i]);
+        int lo = hexNibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+// Matches "key" or "key.<chemistry>"; sets specific=true for the latter
+static bool keyMatches(const char* key, size_t keyLen, const char* name,
+                       const char* chemistry, bool& specific) {
+    size_t nameLen = strlen(name);
+    if (keyLen == nameLen && memcmp(key, name, nameLen) == 0) {
+        specific = false;
+        return true;
+    }
+    size_t chemLen = chemistry ? strlen(chemistry) : 0;
+    if (chemLen > 0 && keyLen == nameLen + 1 + chemLen &&
+        memcmp(key, name, nameLen) == 0 && key[nameLen] == '.' &&
+        memcmp(key + nameLen + 1, chemistry, chemLen) == 0) {
+        specific = true;
+        return true;
+    }
+    return false;
+}
+
+bool OtaManifest::parse(const char* text, size_t len, const char* chemistry) {
+    memset(this, 0, sizeof(*this));
+    if (len > OtaManifestConfig::MAX_SIZE) {
+        return false;
+    }
+
+    bool imageSpecific = false;
+    bool shaSpecific = false;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t lineStart = pos;
+        size_t lineEnd = pos;
+        while (lineEnd < len && text[lineEnd] != '\n') lineEnd++;
+        pos = lineEnd + 1;
+
+        size_t end = lineEnd;
+        if (end > lineStart && text[end - 1] == '\r') end--;
+
+        const char* line = text + lineStart;
+        const char* eq = (const char*)memchr(line, '=', end - lineStart);
+        if (!eq || line[0] == '#') {
+            continue;
+        }
+
+        size_t keyLen = eq - line;
+        const char* value = eq + 1;
+        size_t valueLen = text + end - value;
+        bool specific = false;
+
+        if (keyLen == 3 && memcmp(line, "sig", 3) == 0) {
+            copyValue(signature, sizeof(signature), value, valueLen);
+            signedLength = lineStart;
+            break;  // Anything after the signature is ignored
+        } else if (keyLen == 7 && memcmp(line, "version", 7) == 0) {
+            copyValue(version, sizeof(version), value, valueLen);
+        } else if (keyLen == 10 && memcmp(line, "patch.from", 10) == 0) {
+            copyValue(patchFrom, sizeof(patchFrom), value, valueLen);
+        } else if (keyMatches(line, keyLen, "image", chemistry, specific)) {
+            if (specific || !imageSpecific) {
+                copyValue(image, sizeof(image), value, valueLen);
+                imageSpecific = specific;
+            }
+        } else if (keyMatches(line, keyLen, "sha256", chemistry, specific)) {
+            if (specific || !shaSpecific) {
+                hasSha256 = parseSha256(sha256, value, valueLen);
+                shaSpecific = specific;
+            }
+        }
+    }
+
+    return version[0] != '\0' && image[0] != '\0' && signature[0] != '\0';
+}
+
+bool OtaManifest::hasPatchFrom(const char* currentVersion) const {
+    size_t currentLen = strlen(currentVersion);
+    const char* entry = patchFrom;
+
+    while (*entry) {
+        const char* comma = strchr(entry, ',');
+        size_t entryLen = comma ? (size_t)(comma - entry) : strlen(entry);
+        if (entryLen == currentLen && memcmp(entry, currentVersion, currentLen) == 0) {
+            return true;
+        }
+        if (!comma) break;
+        entry = comma + 1;
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+/*
+ * OTA Release Manifest
+ *
+ * Parses the small signed manifest published with every release, so a
+ * device can find out about new firmware with one (usually 304) request.
+ *
+ * Format: one key=value per line, signature last:
+ *   version=1.0.3
+ *   image=v1.0.3/firmware-prod.bin
+ *   image.lifepo4=v1.0.3/firmware-lifepo4.bin   (optional per-chemistry override)
+ *   sha256=<hex of image>                        (sha256.<chemistry> likewise)
+ *   patch.from=1.0.1,1.0.2                       (versions with a delta patch)
+ *   sig=<base64 ECDSA P-256 / SHA-256 signature>
+ *
+ * The signature covers every byte before the "sig=" line. Verification is
+ * left to the caller (mbedtls on the device).
+ */
+
+#ifndef OTA_MANIFEST_H
+#define OTA_MANIFEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace OtaManifestConfig {
+    constexpr size_t MAX_SIZE = 1024;         // Larger manifests are rejected
+    constexpr size_t VERSION_LEN = 24;
+    constexpr size_t PATH_LEN = 96;
+    constexpr size_t PATCH_LIST_LEN = 96;
+    constexpr size_t SIGNATURE_LEN = 100;     // base64 of a DER ECDSA P-256 signature
+}
+
+struct OtaManifest {
+    char version[OtaManifestConfig::VERSION_LEN];
+    char image[OtaManifestConfig::PATH_LEN];
+    uint8_t sha256[32];
+    bool hasSha256;
+    char patchFrom[OtaManifestConfig::PATCH_LIST_LEN];
+    char signature[OtaManifestConfig::SIGNATURE_LEN];
+    size_t signedLength;  // Bytes covered by the signature
+
+    // Parse manifest text, picking the image/sha256 entries for the given
+    // chemistry ("leadacid", "lifepo4") over the generic ones.
+    // Returns false if version, image or signature are missing.
+    bool parse(const char* text, size_t len, const char* chemistry);
+
+    // True if a delta patch from the given version is published
+    bool hasPatchFrom(const char* currentVersion) const;
+};
+
+#endif // OTA_MANIFEST_H
@@ -0,0 +1,69 @@
+#include "frame_sender.h"
+
+namespace SensorUplink {
+
+SendResult FrameSender::send(const uint8_t* frame, size_t len, uint8_t knownChannel) {
+    SendResult result = {false, 0, 0};
+    
+    if (knownChannel >= 1 && knownChannel <= SensorUplinkConfig::MAX_CHANNEL && link.setChannel(knownChannel)) {
+        uint32_t delayMs = SensorUplinkConfig::RETRY_DELAY_MS;
+        for (uint8_t i = 0; i < SensorUplinkConfig::ATTEMPTS_ON_KNOWN_CHANNEL; i++) {
+            if (i > 0) {
+                link.wait(delayMs);
+                delayMs *= 2;
+            }
+            result.attempts++;
+            if (link.send(frame, len)) {
+                result.delivered = true;
+                result.channel = knownChannel;
+                return result;
+            }
+        }
+    }
+    
+    // The gateway may have moved with its access point: try every channel once
+    for (uint8_t channel = 1; channel <= SensorUplinkConfig::MAX_CHANNEL; channel++) {
+        if (channel == knownChannel || !link.setChannel(channel)) {
+            continue;
+        }
+        for (uint8_t i = 0; i < SensorUplinkConfig::ATTEMPTS_PER_SWEEP_CHANNEL; i++) {
+            result.attempts++;
+            if (link.send(frame, len)) {
+                result.delivered = true;
+                result.channel = channel;
+                return result;
+            }
+        }
+    }
+    return result;
+}
+
+bool LoopbackLink::setChannel(uint8_t channel) {
+    if (channel < 1 || channel > SensorUplinkConfig::MAX_CHANNEL) {
+        return false;
+    }
+    this->channel = channel;
+    return true;
+}
+
+bool LoopbackLink::send(const uint8_t* frame, size_t len) {
+    framesSent++;
+    if (channel != gatewayChannel) {
+        return false;  // Nobody listening here, so no acknowledgement
+    }
+    if (dropCount > 0) {
+        dropCount--;
+        return false;
+    }
+    framesDelivered++;
+    if (receiver) {
+        receiver(frame, len);
+    }
+    if (ackLossCount > 0) {
+        ackLossCount--;
+        return false;  // The sender will repeat a frame the gateway already has
+    }
+    return true;
+}
+
+} // namespace SensorUplink
@@ -0,0 +1,88 @@
+/*
+ * Sensor Frame Sender
+ *
+ * Delivers one reading frame to the gateway over a RadioLink, with the
+ * retry policy of the ESP-NOW uplink: a few attempts with growing delays
+ * on the channel that worked last time, then one sweep over all channels
+ * (the gateway follows its access point, so its channel can change).
+ *
+ * LoopbackLink is an in-process RadioLink for tests: it hands delivered
+ * frames to a receiver callback and can lose frames or their
+ * acknowledgements, or sit on another channel, so retries and channel
+ * discovery run on the host.
+ */
+
+#ifndef FRAME_SENDER_H
+#define FRAME_SENDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+namespace SensorUplinkConfig {
+    constexpr uint8_t MAX_CHANNEL = 13;
+    constexpr uint8_t ATTEMPTS_ON_KNOWN_CHANNEL = 3;
+    constexpr uint8_t ATTEMPTS_PER_SWEEP_CHANNEL = 1;
+    constexpr uint32_t RETRY_DELAY_MS = 4;    // Doubles with each retry on the known channel
+}
+
+namespace SensorUplink {
+
+class RadioLink {
+public:
+    virtual ~RadioLink() {}
+    virtual bool setChannel(uint8_t channel) = 0;
+    // Sends one frame to the gateway; true when the gateway acknowledged it
+    virtual bool send(const uint8_t* frame, size_t len) = 0;
+    virtual void wait(uint32_t ms) = 0;
+};
+
+struct SendResult {
+    bool delivered;
+    uint8_t channel;         // Channel the gateway acknowledged on (0 = none)
+    uint8_t attempts;
+};
+
+class FrameSender {
+public:
+    explicit FrameSender(RadioLink& link) : link(link) {}
+    
+    // knownChannel = channel that worked last time (0 = unknown)
+    SendResult send(const uint8_t* frame, size_t len, uint8_t knownChannel);
+    
+private:
+    RadioLink& link;
+};
+
+class LoopbackLink : public RadioLink {
+public:
+    using Receiver = std::function<void(const uint8_t* frame, size_t len)>;
+    
+    explicit LoopbackLink(uint8_t gatewayChannel = 1)
+        : gatewayChannel(gatewayChannel), channel(0), dropCount(0), ackLossCount(0),
+          framesSent(0), framesDelivered(0), waitedMs(0) {}
+    
+    void setReceiver(Receiver receiver) { this->receiver = receiver; }
+    void setGatewayChannel(uint8_t channel) { gatewayChannel = channel; }
+    void dropNext(uint32_t count) { dropCount = count; }  // Lose the next frames that reach the gateway
+    void loseAcks(uint32_t count) { ackLossCount = count; }  // Deliver the next frames, but report no ack
+    
+    bool setChannel(uint8_t channel) override;
+    bool send(const uint8_t* frame, size_t len) override;
+    void wait(uint32_t ms) override { waitedMs += ms; }
+    
+    uint8_t gatewayChannel;
+    uint8_t channel;
+    uint32_t dropCount;
+    uint32_t ackLossCount;
+    uint32_t framesSent;
+    uint32_t framesDelivered;
+    uint32_t waitedMs;       // Simulated time spent in retry delays
+    
+private:
+    Receiver receiver;
+};
+
+} // namespace SensorUplink
+
+#endif // FRAME_SENDER_H
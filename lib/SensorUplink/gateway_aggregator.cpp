@@ -0,0 +1,153 @@
+#include "gateway_aggregator.h"
+#include <string.h>
+
+namespace SensorUplink {
+
+void GatewayAggregator::clear() {
+    memset(table, 0, sizeof(table));
+    memset(&stats, 0, sizeof(stats));
+    childCount = 0;
+    pendingCount = 0;
+}
+
+GatewayAggregator::Child* GatewayAggregator::find(const uint8_t mac[6], bool add, uint32_t nowMs) {
+    Child* freeSlot = nullptr;
+    Child* idlest = nullptr;
+    for (Child& child : table) {
+        if (child.used && memcmp(child.mac, mac, sizeof(child.mac)) == 0) {
+            return &child;
+        }
+        if (!child.used && freeSlot == nullptr) {
+            freeSlot = &child;
+        }
+        if (child.used && !child.pending &&
+            (idlest == nullptr || nowMs - child.lastSeenMs > nowMs - idlest->lastSeenMs)) {
+            idlest = &child;
+        }
+    }
+    if (!add) {
+        return nullptr;
+    }
+    if (freeSlot == nullptr) {
+        // Table full: a unit that was moved or retired gives up its slot
+        if (idlest == nullptr || nowMs - idlest->lastSeenMs < SensorUplinkConfig::CHILD_IDLE_MS) {
+            return nullptr;
+        }
+        freeSlot = idlest;
+        childCount--;
+        stats.evicted++;
+    }
+    memset(freeSlot, 0, sizeof(*freeSlot));
+    memcpy(freeSlot->mac, mac, sizeof(freeSlot->mac));
+    freeSlot->used = true;
+    childCount++;
+    return freeSlot;
+}
+
+bool GatewayAggregator::receive(const uint8_t mac[6], const uint8_t* frame, size_t len, uint32_t nowMs) {
+    stats.frames++;
+    
+    SensorReading reading;
+    if (!decodeFrame(frame, len, reading)) {
+        stats.invalid++;
+        return false;
+    }
+    
+    bool known = find(mac, false, nowMs) != nullptr;
+    Child* child = find(mac, true, nowMs);
+    if (child == nullptr) {
+        stats.tableFull++;
+        return false;
+    }
+    child->lastSeenMs = nowMs;
+    
+    if (known && !sequenceNewer(reading.sequence, child->lastSequence)) {
+        // A restarted unit counts from 1 again; a resend of its first frame
+        // carries the same sequence number and is still a repeat
+        if (!reading.coldBoot || reading.sequence == child->lastSequence) {
+            stats.repeats++;
+            return false;
+        }
+        stats.restarts++;
+    }
+    
+    if (child->pending) {
+        stats.superseded++;
+    } else {
+        pendingCount++;
+    }
+    child->lastSequence = reading.sequence;
+    child->latest = reading;
+    child->receivedMs = child->pending ? child->receivedMs : nowMs;  // Keep its place in the queue
+    child->pending = true;
+    if (child->intervalSec != reading.nextReadingSec) {
+        child->announced = false;  // expire_after depends on the interval
+    }
+    stats.accepted++;
+    return true;
+}
+
+bool GatewayAggregator::batchReady(uint32_t nowMs) const {
+    if (pendingCount >= SensorUplinkConfig::BATCH_MAX) {
+        return true;
+    }
+    for (const Child& child : table) {
+        if (child.pending && nowMs - child.receivedMs >= SensorUplinkConfig::BATCH_WINDOW_MS) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t GatewayAggregator::takeBatch(ChildUpdate* out, size_t max) {
+    size_t count = 0;
+    while (count < max && pendingCount > 0) {
+        Child* oldest = nullptr;
+        for (Child& child : table) {
+            if (child.pending && (oldest == nullptr || (int32_t)(child.receivedMs - oldest->receivedMs) < 0)) {
+                oldest = &child;
+            }
+        }
+        ChildUpdate& update = out[count++];
+        update.slot = static_cast<uint8_t>(oldest - table);
+        memcpy(update.mac, oldest->mac, sizeof(update.mac));
+        update.reading = oldest->latest;
+        update.receivedMs = oldest->receivedMs;
+        update.announce = !oldest->announced;
+        
+        oldest->pending = false;
+        oldest->announced = true;
+        oldest->intervalSec = oldest->latest.nextReadingSec;
+        pendingCount--;
+    }
+    return count;
+}
+
+void GatewayAggregator::requeue(const ChildUpdate* updates, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const ChildUpdate& update = updates[i];
+        Child& child = table[update.slot];
+        if (!child.used || memcmp(child.mac, update.mac, sizeof(child.mac)) != 0) {
+            continue;
+        }
+        if (update.announce) {
+            child.announced = false;
+        }
+        if (child.pending) {
+            stats.superseded++;
+            continue;
+        }
+        child.pending = true;
+        child.latest = update.reading;
+        child.receivedMs = update.receivedMs;
+        pendingCount++;
+    }
+}
+
+void GatewayAggregator::announceAll() {
+    for (Child& child : table) {
+        child.announced = false;
+    }
+}
+
+} // namespace SensorUplink
@@ -0,0 +1,105 @@
+/*
+ * Gateway Aggregator
+ *
+ * Collects the reading frames of many sensor units on the gateway and
+ * hands them out in batches for publishing. Pure C++ with no Arduino
+ * dependency, so it also runs in the native test build.
+ *
+ *   - Repeats are dropped by sequence number: a unit resends a frame whose
+ *     acknowledgement was lost, and late copies must not overwrite newer
+ *     state. A unit that lost its RTC memory starts over at a low sequence
+ *     number with the cold boot flag set, which is accepted as a restart.
+ *   - Only the latest reading of a unit is kept until it is published;
+ *     state topics are retained "latest value" topics anyway.
+ *   - A batch is ready once BATCH_MAX units have news, or the oldest
+ *     waiting reading is BATCH_WINDOW_MS old.
+ *   - With the table full, a new unit takes the slot of the unit that has
+ *     been silent longest, once that is CHILD_IDLE_MS or more.
+ */
+
+#ifndef GATEWAY_AGGREGATOR_H
+#define GATEWAY_AGGREGATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_frame.h"
+
+namespace SensorUplinkConfig {
+    constexpr size_t MAX_CHILDREN = 32;          // Sensor units one gateway tracks
+    constexpr size_t BATCH_MAX = 8;              // Units per MQTT batch
+    constexpr uint32_t BATCH_WINDOW_MS = 2000;   // Longest a reading waits for its batch
+    constexpr uint32_t CHILD_IDLE_MS = 24UL * 3600 * 1000;  // Silent this long, a unit may lose its slot
+}
+
+namespace SensorUplink {
+
+struct ChildUpdate {
+    uint8_t slot;              // Table slot, stable while the gateway runs
+    uint8_t mac[6];
+    SensorReading reading;
+    uint32_t receivedMs;
+    bool announce;             // Discovery for this unit is (re)due
+};
+
+struct AggregatorStats {
+    uint32_t frames;           // Everything passed to receive()
+    uint32_t accepted;
+    uint32_t repeats;          // Same or older sequence number
+    uint32_t invalid;          // Bad length, version or CRC
+    uint32_t tableFull;        // From a unit beyond MAX_CHILDREN
+    uint32_t evicted;          // Idle units whose slot went to a new one
+    uint32_t superseded;       // Replaced by a newer reading before publishing
+    uint32_t restarts;         // Units that came back after a cold boot
+};
+
+class GatewayAggregator {
+public:
+    GatewayAggregator() { clear(); }
+    
+    void clear();
+    
+    // One received frame; false if it was dropped
+    bool receive(const uint8_t mac[6], const uint8_t* frame, size_t len, uint32_t nowMs);
+    
+    // A full batch is waiting, or the oldest reading has waited long enough
+    bool batchReady(uint32_t nowMs) const;
+    
+    // Moves up to max waiting updates into out, oldest first
+    size_t takeBatch(ChildUpdate* out, size_t max);
+    
+    // Puts updates back after a failed publish; dropped where a newer
+    // reading arrived in the meantime
+    void requeue(const ChildUpdate* updates, size_t count);
+    
+    // Announce every unit again with its next update (e.g. the broker lost
+    // its session and possibly the retained discovery configs)
+    void announceAll();
+    
+    size_t pending() const { return pendingCount; }
+    size_t children() const { return childCount; }
+    const AggregatorStats& getStats() const { return stats; }
+    
+private:
+    struct Child {
+        uint8_t mac[6];
+        bool used;
+        bool pending;
+        bool announced;        // Discovery published with the current interval
+        uint16_t lastSequence;
+        uint16_t intervalSec;  // Report interval discovery was announced with
+        SensorReading latest;
+        uint32_t receivedMs;
+        uint32_t lastSeenMs;   // Last frame from the unit, repeats included
+    };
+    
+    Child table[SensorUplinkConfig::MAX_CHILDREN];
+    size_t childCount;
+    size_t pendingCount;
+    AggregatorStats stats;
+    
+    Child* find(const uint8_t mac[6], bool add, uint32_t nowMs);
+};
+
+} // namespace SensorUplink
+
+#endif // GATEWAY_AGGREGATOR_H
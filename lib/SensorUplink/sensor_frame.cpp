@@ -0,0 +1,64 @@
+#include "sensor_frame.h"
+
+namespace SensorUplink {
+
+uint16_t crc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+size_t encodeFrame(const SensorReading& reading, uint8_t* buf, size_t cap) {
+    if (cap < SensorUplinkConfig::FRAME_SIZE) {
+        return 0;
+    }
+    float percentage = reading.percentage < 0 ? 0 : reading.percentage > 100 ? 100 : reading.percentage;
+    
+    buf[0] = SensorUplinkConfig::FRAME_VERSION;
+    buf[1] = (reading.lifepo4 ? 0x01 : 0x00) | (reading.coldBoot ? 0x02 : 0x00);
+    buf[2] = reading.sequence & 0xFF;
+    buf[3] = reading.sequence >> 8;
+    buf[4] = reading.millivolts & 0xFF;
+    buf[5] = reading.millivolts >> 8;
+    buf[6] = static_cast<uint8_t>(percentage * 2 + 0.5f);
+    buf[7] = reading.status;
+    for (int i = 0; i < 4; i++) {
+        buf[8 + i] = (reading.bootCount >> (8 * i)) & 0xFF;
+    }
+    buf[12] = reading.nextReadingSec & 0xFF;
+    buf[13] = reading.nextReadingSec >> 8;
+    
+    uint16_t crc = crc16(buf, 14);
+    buf[14] = crc & 0xFF;
+    buf[15] = crc >> 8;
+    return SensorUplinkConfig::FRAME_SIZE;
+}
+
+bool decodeFrame(const uint8_t* buf, size_t len, SensorReading& out) {
+    if (len != SensorUplinkConfig::FRAME_SIZE || buf[0] != SensorUplinkConfig::FRAME_VERSION) {
+        return false;
+    }
+    if (crc16(buf, 14) != (buf[14] | (buf[15] << 8))) {
+        return false;
+    }
+    
+    out.lifepo4 = buf[1] & 0x01;
+    out.coldBoot = buf[1] & 0x02;
+    out.sequence = buf[2] | (buf[3] << 8);
+    out.millivolts = buf[4] | (buf[5] << 8);
+    out.percentage = buf[6] / 2.0f;
+    out.status = buf[7];
+    out.bootCount = 0;
+    for (int i = 0; i < 4; i++) {
+        out.bootCount |= static_cast<uint32_t>(buf[8 + i]) << (8 * i);
+    }
+    out.nextReadingSec = buf[12] | (buf[13] << 8);
+    return true;
+}
+
+} // namespace SensorUplink
@@ -0,0 +1,64 @@
+/*
+ * Sensor Reading Frame
+ *
+ * Compact binary form of one battery reading, sent by sensor units over a
+ * low-power radio link (ESP-NOW) instead of MQTT. Pure C++ with no Arduino
+ * dependency, so it also runs in the native test build.
+ *
+ * Layout (16 bytes, little-endian):
+ *   [0]      version (SensorUplinkConfig::FRAME_VERSION)
+ *   [1]      flags: bit 0 = LiFePO4, bit 1 = first frame after a cold boot
+ *   [2..3]   sequence number, +1 per reading, wraps
+ *   [4..5]   voltage in mV
+ *   [6]      state of charge in 0.5 % steps (0-200)
+ *   [7]      status (BatteryStatus order: FULL, GOOD, LOW, CRITICAL, DEAD)
+ *   [8..11]  boot count
+ *   [12..13] seconds until the next reading (0 = unknown)
+ *   [14..15] CRC-16/CCITT-FALSE over bytes 0-13
+ *
+ * The radio layer encrypts and authenticates frames (ESP-NOW CCMP with a
+ * per-peer key); the CRC only catches frames garbled outside of it, e.g. on
+ * the loopback link or an unencrypted test setup.
+ */
+
+#ifndef SENSOR_FRAME_H
+#define SENSOR_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace SensorUplinkConfig {
+    constexpr uint8_t FRAME_VERSION = 1;
+    constexpr size_t FRAME_SIZE = 16;
+}
+
+namespace SensorUplink {
+
+struct SensorReading {
+    uint16_t sequence;
+    uint16_t millivolts;
+    float percentage;        // 0-100, sent with 0.5 % resolution
+    uint8_t status;
+    bool lifepo4;
+    bool coldBoot;
+    uint32_t bootCount;
+    uint16_t nextReadingSec;
+};
+
+// Writes one frame; returns FRAME_SIZE, or 0 if cap is too small
+size_t encodeFrame(const SensorReading& reading, uint8_t* buf, size_t cap);
+
+// False for a wrong length, unknown version or bad CRC
+bool decodeFrame(const uint8_t* buf, size_t len, SensorReading& out);
+
+uint16_t crc16(const uint8_t* data, size_t len);
+
+// True when a sequence number is newer than the last one seen from a unit
+// (serial number arithmetic, so wrap-around is handled)
+inline bool sequenceNewer(uint16_t sequence, uint16_t last) {
+    return static_cast<int16_t>(sequence - last) > 0;
+}
+
+} // namespace SensorUplink
+
+#endif // SENSOR_FRAME_H
@@ -0,0 +1,188 @@
+#include "series_codec.h"
+#include <string.h>
+
+namespace SeriesCodec {
+
+namespace {
+    const uint8_t FLAG_TIME = 0x01;
+    const uint8_t FLAG_PERCENT = 0x02;
+    const uint8_t FLAG_STATUS = 0x04;
+    const uint8_t FLAG_RESERVED = 0x08;
+    const uint8_t VOLTAGE_SHIFT = 4;
+    const uint32_t VOLTAGE_VARINT = 15;  // Nibble value: the change follows as a varint
+    const uint8_t FULL_SAMPLE = (VOLTAGE_VARINT << VOLTAGE_SHIFT) | FLAG_TIME | FLAG_PERCENT | FLAG_STATUS;
+    const uint8_t STATUS_MAX = 0x7F;
+}
+
+size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+size_t getVarint(const uint8_t* in, size_t len, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        if (i == 4 && in[i] > 0x0F) {
+            return 0;  // More than 32 bits
+        }
+        value |= static_cast<uint32_t>(in[i] & 0x7F) << (7 * i);
+        if ((in[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void Encoder::reset() {
+    memset(&state, 0, sizeof(state));
+}
+
+size_t Encoder::encode(const Sample& sample, uint8_t* out) {
+    size_t n = 1;
+    uint8_t ctrl;
+
+    if (!state.started) {
+        ctrl = FULL_SAMPLE;
+        n += putVarint(out + n, sample.time);
+        n += putVarint(out + n, sample.millivolts);
+        n += putVarint(out + n, sample.percentage);
+        out[n++] = sample.status & STATUS_MAX;
+        state.delta = 0;
+    } else {
+        ctrl = 0;
+        int32_t delta = static_cast<int32_t>(sample.time - state.time);
+        int32_t dod = delta - state.delta;
+        if (dod != 0) {
+            ctrl |= FLAG_TIME;
+            n += putVarint(out + n, zigzag(dod));
+        }
+
+        uint32_t voltage = zigzag(static_cast<int32_t>(sample.millivolts) - state.millivolts);
+        if (voltage < VOLTAGE_VARINT) {
+            ctrl |= voltage << VOLTAGE_SHIFT;
+        } else {
+            ctrl |= VOLTAGE_VARINT << VOLTAGE_SHIFT;
+            n += putVarint(out + n, voltage);
+        }
+
+        if (sample.percentage != state.percentage) {
+            ctrl |= FLAG_PERCENT;
+            n += putVarint(out + n, zigzag(static_cast<int32_t>(sample.percentage) - state.percentage));
+        }
+        if (sample.status != state.status) {
+            ctrl |= FLAG_STATUS;
+            out[n++] = sample.status & STATUS_MAX;
+        }
+        state.delta = delta;
+    }
+
+    out[0] = ctrl;
+    state.started = true;
+    state.time = sample.time;
+    state.millivolts = sample.millivolts;
+    state.percentage = sample.percentage;
+    state.status = sample.status & STATUS_MAX;
+    return n;
+}
+
+Decoder::Decoder(const uint8_t* data, size_t len) : data(data), len(len), pos(0), bad(false) {
+    memset(&state, 0, sizeof(state));
+}
+
+bool Decoder::next(Sample& out) {
+    if (bad || pos >= len || data[pos] == SeriesCodecConfig::END) {
+        return false;
+    }
+
+    uint8_t ctrl = data[pos];
+    size_t p = pos + 1;
+    uint32_t value;
+    auto varint = [&]() {
+        size_t used = getVarint(data + p, len - p, value);
+        p += used;
+        return used > 0;
+    };
+
+    auto fail = [this]() {
+        bad = true;
+        return false;
+    };
+
+    SeriesState next = state;
+    if (ctrl & FLAG_RESERVED || (!state.started && ctrl != FULL_SAMPLE)) {
+        return fail();
+    }
+
+    if (!state.started) {
+        if (!varint()) {
+            return fail();
+        }
+        next.time = value;
+        if (!varint() || value > 0xFFFF) {
+            return fail();
+        }
+        next.millivolts = value;
+        if (!varint() || value > 0xFF) {
+            return fail();
+        }
+        next.percentage = value;
+        next.delta = 0;
+    } else {
+        int32_t dod = 0;
+        if (ctrl & FLAG_TIME) {
+            if (!varint()) {
+                return fail();
+            }
+            dod = unzigzag(value);
+        }
+        next.delta = state.delta + dod;
+        next.time = state.time + static_cast<uint32_t>(next.delta);
+
+        uint32_t voltage = ctrl >> VOLTAGE_SHIFT;
+        if (voltage == VOLTAGE_VARINT) {
+            if (!varint()) {
+                return fail();
+            }
+            voltage = value;
+        }
+        int32_t millivolts = static_cast<int32_t>(state.millivolts) + unzigzag(voltage);
+        if (millivolts < 0 || millivolts > 0xFFFF) {
+            return fail();
+        }
+        next.millivolts = millivolts;
+
+        if (ctrl & FLAG_PERCENT) {
+            if (!varint()) {
+                return fail();
+            }
+            int32_t percentage = static_cast<int32_t>(state.percentage) + unzigzag(value);
+            if (percentage < 0 || percentage > 0xFF) {
+                return fail();
+            }
+            next.percentage = percentage;
+        }
+    }
+
+    if (ctrl & FLAG_STATUS) {
+        if (p >= len || data[p] > STATUS_MAX) {
+            return fail();
+        }
+        next.status = data[p++];
+    }
+
+    next.started = true;
+    state = next;
+    pos = p;
+    out.time = state.time;
+    out.millivolts = state.millivolts;
+    out.percentage = state.percentage;
+    out.status = state.status;
+    return true;
+}
+
+} // namespace SeriesCodec
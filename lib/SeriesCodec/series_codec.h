@@ -0,0 +1,109 @@
+/*
+ * Series Codec
+ *
+ * Streaming compression for battery reading series, after Facebook's
+ * Gorilla time-series encoding but byte-aligned. Readings change slowly
+ * and arrive at a near-regular interval, so a typical one costs one or
+ * two bytes instead of the 9-16 of a plain record. Pure C++ with no
+ * Arduino dependency, so it also runs in the native test build.
+ *
+ * Each sample is a control byte followed by the fields it flags:
+ *   bits 0-2  TIME: delta-of-delta of the timestamp follows (zigzag varint)
+ *             PERCENT: change of the percentage follows (zigzag varint)
+ *             STATUS: new status follows (one byte, 0-127)
+ *   bit 3     always 0, so an erased 0xFF byte never starts a sample
+ *   bits 4-7  voltage change in mV, zigzag encoded, when below 15;
+ *             15 = the zigzag varint follows
+ * Fields that did not change are left out. The first sample after
+ * reset() is written in full (control byte 0xF7, then time, millivolts
+ * and percentage as plain varints and the status byte).
+ *
+ * Voltage is carried as integer millivolts, the ADC's resolution, so
+ * plain deltas replace Gorilla's float XOR. Readings whose tail was lost
+ * to a reset (erased 0xFF bytes) always decode as malformed, never as a
+ * wrong reading.
+ */
+
+#ifndef SERIES_CODEC_H
+#define SERIES_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace SeriesCodecConfig {
+    constexpr size_t MAX_SAMPLE_BYTES = 17;  // Control byte, three 5-byte varints, status
+    constexpr uint8_t END = 0xFF;            // Erased flash; ends a stream
+}
+
+namespace SeriesCodec {
+
+struct Sample {
+    uint32_t time;           // Unix seconds
+    uint16_t millivolts;
+    uint8_t percentage;
+    uint8_t status;          // BatteryStatus, 0-127
+};
+
+// What the next sample is encoded against; all zero = nothing written yet
+struct SeriesState {
+    bool started;
+    uint32_t time;
+    int32_t delta;           // Between the last two timestamps
+    uint16_t millivolts;
+    uint8_t percentage;
+    uint8_t status;
+};
+
+class Encoder {
+public:
+    Encoder() { reset(); }
+
+    void reset();            // The next sample is written in full
+    // Continue a stream that was decoded up to its end
+    void resume(const SeriesState& decoded) { state = decoded; }
+
+    // Writes sample to out (MAX_SAMPLE_BYTES free) and returns its length
+    size_t encode(const Sample& sample, uint8_t* out);
+
+    const SeriesState& getState() const { return state; }
+
+private:
+    SeriesState state;
+};
+
+class Decoder {
+public:
+    Decoder(const uint8_t* data, size_t len);
+
+    // False at the end of the stream (no data left or an END byte), or
+    // on a malformed sample (see malformed())
+    bool next(Sample& out);
+
+    bool malformed() const { return bad; }
+    size_t position() const { return pos; }  // Bytes of whole samples read
+    const SeriesState& getState() const { return state; }
+
+private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool bad;
+    SeriesState state;
+};
+
+// Building blocks, also used for framing around encoded streams
+size_t putVarint(uint8_t* out, uint32_t value);
+// Returns bytes read, 0 if incomplete or longer than 5 bytes
+size_t getVarint(const uint8_t* in, size_t len, uint32_t& value);
+
+inline uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+} // namespace SeriesCodec
+
+#endif // SERIES_CODEC_H
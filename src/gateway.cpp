@@ -0,0 +1,213 @@
+/*
+ * ESP32 Battery Monitor Gateway
+ *
+ * Mains-powered build of the firmware (pio run -e gateway) that stays
+ * connected to WiFi and MQTT. Sensor units with the ESP-NOW uplink send
+ * their readings here; the gateway drops repeats, collects them in batches
+ * and publishes them over its one TLS session, with Home Assistant
+ * discovery on behalf of each unit. It reports its own battery as well.
+ *
+ * The gateway listens on its access point's channel; units find it with
+ * their channel sweep. Configure it over serial like a sensor unit
+ * (wifi_ssid, mqtt_server, espnow_key, espnow_peers).
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <PubSubClient.h>
+#include "battery_monitor.h"
+#include "config_manager.h"
+#include "network_manager.h"
+#include "espnow_receiver.h"
+#include "gateway_aggregator.h"
+#include "ota_manager.h"
+#include "command_handler.h"
+
+#include "wifi_credentials.h"
+#include "mqtt_credentials.h"
+
+BatteryMonitor monitor;
+WiFiClientSecure wifiClient;
+SessionClient mqttTransport(wifiClient);
+PubSubClient mqttClient(mqttTransport);
+ConfigManager config;
+NetworkManager network(wifiClient, mqttTransport, mqttClient, config);
+CommandHandler commandHandler(config);
+OTAManager otaManager(config);
+EspNowReceiver receiver;
+SensorUplink::GatewayAggregator aggregator;
+
+RTC_DATA_ATTR int bootCount = 0;  // Survives software resets
+String gatewayId;
+bool receiverStarted = false;
+bool wasConnected = false;
+unsigned long lastOwnReading = 0;
+unsigned long lastStats = 0;
+
+// Discovery fingerprints per aggregator slot (RAM: republished once after a restart)
+uint32_t childFingerprint[SensorUplinkConfig::MAX_CHILDREN] = {};
+
+void startReceiver()
+{
+  uint8_t key[16];
+  uint8_t peers[Config::ESPNOW_MAX_ENCRYPTED_PEERS][6];
+  bool encrypted = config.getEspNowKey(key);
+  int peerCount = encrypted ? config.getEspNowPeers(peers, Config::ESPNOW_MAX_ENCRYPTED_PEERS) : 0;
+  receiverStarted = receiver.begin(encrypted ? key : nullptr, peers, peerCount);
+}
+
+void publishBatch()
+{
+  SensorUplink::ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+  size_t count = aggregator.takeBatch(batch, SensorUplinkConfig::BATCH_MAX);
+  time_t now;
+  time(&now);
+
+  network.beginBatch();
+  bool ok = true;
+  for (size_t i = 0; i < count; i++)
+  {
+    const SensorUplink::ChildUpdate &update = batch[i];
+    char id[24];
+    snprintf(id, sizeof(id), "battery-%02x%02x%02x%02x%02x%02x",
+             update.mac[0], update.mac[1], update.mac[2], update.mac[3], update.mac[4], update.mac[5]);
+    DeviceIdentity unit = {id, update.reading.lifepo4 ? "LiFePO4" : "Lead-Acid", gatewayId.c_str(),
+                           update.reading.nextReadingSec};
+
+    if (update.announce)
+    {
+      network.publishHomeAssistantDiscovery(unit, childFingerprint[update.slot]);
+    }
+
+    BatteryReading reading;
+    reading.voltage = update.reading.millivolts / 1000.0f;
+    reading.percentage = update.reading.percentage;
+    reading.status = static_cast<BatteryStatus>(update.reading.status);
+    reading.timestamp = update.receivedMs;
+    time_t nextReading = update.reading.nextReadingSec > 0 ? now + update.reading.nextReadingSec : 0;
+    ok &= network.publishReading(unit, reading, update.reading.bootCount, nextReading);
+  }
+  ok &= network.endBatch();
+
+  if (!ok)
+  {
+    // Published again with the next batch, unless newer readings arrive first
+    aggregator.requeue(batch, count);
+    Serial.printf("❌ Batch of %u units not published, queued again\n", (unsigned)count);
+  }
+  else
+  {
+    Serial.printf("✓ Published batch of %u units (%u waiting)\n", (unsigned)count, (unsigned)aggregator.pending());
+  }
+}
+
+void printStats()
+{
+  const SensorUplink::AggregatorStats &stats = aggregator.getStats();
+  Serial.println("\n─────────────────────────────────");
+  Serial.printf("Gateway: %u units | %lu frames, %lu accepted, %lu repeats, %lu invalid\n",
+                (unsigned)aggregator.children(), (unsigned long)stats.frames, (unsigned long)stats.accepted,
+                (unsigned long)stats.repeats, (unsigned long)stats.invalid);
+  Serial.printf("         %lu superseded, %lu restarts, %lu over the unit limit, %lu idle units replaced\n",
+                (unsigned long)stats.superseded, (unsigned long)stats.restarts,
+                (unsigned long)stats.tableFull, (unsigned long)stats.evicted);
+  Serial.printf("         %lu lost in the queue, %lu from units not in espnow_peers\n",
+                (unsigned long)receiver.dropped(), (unsigned long)receiver.rejected());
+  Serial.println("─────────────────────────────────");
+}
+
+void setup()
+{
+  Serial.begin(Config::SERIAL_BAUD_RATE);
+  delay(500);
+  bootCount++;
+
+  Serial.println("\n╔═════════════════════════════════════╗");
+  Serial.println("║  ESP32 Battery Monitor (Gateway)    ║");
+  Serial.println("╚═════════════════════════════════════╝");
+
+  otaManager.checkBootHealth();
+
+  config.begin(WIFI_SSID, WIFI_PASSWORD,
+               MQTT_SERVER, MQTT_PORT,
+               MQTT_USER, MQTT_PASSWORD,
+               MQTT_CLIENT_ID);
+
+  if (config.batteryType.equalsIgnoreCase("lifepo4")) {
+    BatteryMonitor::setChemistry(BatteryChemistry::LIFEPO4);
+  } else {
+    BatteryMonitor::setChemistry(BatteryChemistry::LEAD_ACID);
+  }
+  monitor.begin();
+
+  network.setOTACallback([](const String &filename)
+                         { otaManager.requestUpdate(filename); });
+  network.setResetCallback([]()
+                           {
+    config.clear();
+    Serial.println("NVS will be cleared. Rebooting in 2 seconds...");
+    delay(2000);
+    ESP.restart(); });
+
+  // Always connected; ESP-NOW reception needs the radio awake
+  network.setAvailabilityMode(true, Config::READING_INTERVAL_MS / 1000);
+  network.setListenMode(false);
+}
+
+void loop()
+{
+  bool connected = network.maintainConnection();
+  if (connected && !wasConnected)
+  {
+    otaManager.noteBrokerReached();
+    gatewayId = WiFi.getHostname();
+    if (!receiverStarted)
+    {
+      otaManager.setup();
+      startReceiver();
+    }
+    // Without the session the broker may have lost retained configs too
+    if (!network.sessionPresent())
+    {
+      aggregator.announceAll();
+    }
+  }
+  wasConnected = connected;
+
+  EspNowReceiver::Frame frame;
+  while (receiver.take(frame))
+  {
+    aggregator.receive(frame.mac, frame.data, frame.len, millis());
+  }
+
+  if (connected && aggregator.batchReady(millis()))
+  {
+    publishBatch();
+  }
+
+  if (connected && (lastOwnReading == 0 || millis() - lastOwnReading >= Config::READING_INTERVAL_MS))
+  {
+    lastOwnReading = millis();
+    BatteryReading reading = monitor.readBattery();
+    time_t now;
+    time(&now);
+    if (network.publishReading(reading, bootCount, now + Config::READING_INTERVAL_MS / 1000))
+    {
+      otaManager.markBootHealthy();
+    }
+  }
+
+  if (millis() - lastStats >= Config::GATEWAY_STATS_INTERVAL_MS)
+  {
+    lastStats = millis();
+    printStats();
+  }
+
+  commandHandler.checkCommands();
+  if (otaManager.isUpdateRequested())
+  {
+    otaManager.handleUpdate();
+  }
+  delay(10);
+}
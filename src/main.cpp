@@ -27,9 +27,14 @@
 #include "esp_sleep.h"
 #include "config_manager.h"
 #include "network_manager.h"
+#include "radio_uplink.h"
+#include "ble_beacon_uplink.h"
 #include "ota_manager.h"
 #include "command_handler.h"
 #include "display_manager.h"
+#include "voltage_history.h"
+#include "partition_flash.h"
+#include "reading_log.h"
 
 // Include credentials (create these files!)
 // These are now used as DEFAULT VALUES only - actual credentials stored in NVS
@@ -39,16 +44,23 @@
 // RTC memory to preserve data across deep sleep
 RTC_DATA_ATTR int bootCount = 0;
 RTC_DATA_ATTR float lastVoltage = 0.0;
+RTC_DATA_ATTR VoltageHistory voltageHistory;  // Last readings for the history screen
 
 // Global objects
 BatteryMonitor monitor;
 WiFiClientSecure wifiClient;
-PubSubClient mqttClient(wifiClient);
+SessionClient mqttTransport(wifiClient);  // Reports the CONNACK session-present flag
+PubSubClient mqttClient(mqttTransport);
 ConfigManager config; // Manages credentials in NVS (persists across OTA updates)
-NetworkManager network(wifiClient, mqttClient, config);
+NetworkManager network(wifiClient, mqttTransport, mqttClient, config);
+EspNowLink espNowLink;
+RadioUplink espNowUplink(espNowLink, "ESP-NOW");  // Used when config.uplinkMode is "espnow"
+BleBeaconUplink bleUplink(config.mqttClientID);   // Used when config.uplinkMode is "ble"
 CommandHandler commandHandler(config);
 DisplayManager display;
 OTAManager otaManager(config, &display);
+PartitionFlash readingFlash;
+FlashLog::ReadingLog readingLog(readingFlash);  // Every reading, for history requests over MQTT
 
 void printWakeupReason()
 {
@@ -105,7 +117,8 @@ void enterDeepSleep()
   // Show sleep screen on display
   if (display.isReady()) {
     display.showSleepScreen(wakeupTime, monitor.readBattery());
-    delay(2000); // Show sleep screen for 2 seconds
+    // The panel keeps showing the last frame; only wait for it to be sent
+    display.waitIdle(DisplayConfig::FINAL_FRAME_TIMEOUT_MS);
   }
   
   Serial.flush(); // Wait for serial transmission to complete
@@ -117,6 +130,28 @@ void enterDeepSleep()
   esp_deep_sleep_start();
 }
 
+void setupEspNowUplink()
+{
+  uint8_t gatewayMac[6];
+  uint8_t key[16];
+  if (!config.getEspNowGateway(gatewayMac))
+  {
+    Serial.println("✗ ESP-NOW uplink needs espnow_gateway, using MQTT");
+    return;
+  }
+  bool encrypted = config.getEspNowKey(key);
+  if (!encrypted)
+  {
+    Serial.println("ESP-NOW key not set, frames are sent unencrypted");
+  }
+  if (espNowLink.begin(gatewayMac, encrypted ? key : nullptr))
+  {
+    network.setUplink(&espNowUplink);
+    Serial.print("✓ Readings go over ESP-NOW to ");
+    Serial.println(config.espnowGateway);
+  }
+}
+
 void setup()
 {
   // Initialize serial communication
@@ -136,6 +171,9 @@ void setup()
   // Print wakeup reason
   printWakeupReason();
 
+  // Roll back freshly installed firmware that keeps failing to publish
+  otaManager.checkBootHealth();
+
   if (bootCount > 1)
   {
     Serial.print("Last voltage: ");
@@ -145,11 +183,10 @@ void setup()
 
   Serial.println();
 
-  // Initialize display early
+  // Initialize display early (rendering runs in its own task)
   display.begin();
   if (display.isReady()) {
     display.showBootScreen(bootCount);
-    delay(1000); // Show boot screen for 1 second
   }
 
   // Initialize configuration manager (loads from NVS or uses defaults on first run)
@@ -190,33 +227,45 @@ void setup()
     {
       Serial.println("Failed to connect to WiFi for OTA. Will retry next boot.");
     }
-  }if (display.isReady()) {
-      display.showOTAScreen("Checking...");
-    }
-    
-    
-  // Automatically check for available updates on every wake
-  else if (Config::AUTO_CHECK_OTA)
+  }
+  // Automatic update checks run on the regular uplink in loop()
+
+  // ESP-NOW sensor units send their reading to a gateway instead of joining
+  // WiFi; BLE beacons just broadcast it
+  if (config.useEspNow())
   {
-    // Connect to WiFi to check for updates
-    if (network.connectWiFi())
+    setupEspNowUplink();
+  }
+  else if (config.useBleBeacon())
+  {
+    if (BleBeaconUplink::available())
     {
-      // Check if a newer version is available
-      if (otaManager.checkForUpdates())
-      {
-        // New version found and OTA requested
-        otaManager.setup();
-        otaManager.handleUpdate();
-        // If we reach here, OTA timed out or failed
-        // Continue with normal operation
-      }
-      network.disconnect();
+      network.setUplink(&bleUplink);
+      Serial.println("✓ Readings are broadcast as BLE beacons");
     }
     else
     {
-      Serial.println("Failed to connect to WiFi for update check.");
+      Serial.println("✗ BLE beacon not in this build (esp32dev_ble), using MQTT");
+    }
+  }
+
+  // Reading log in its own flash partition
+  if (readingFlash.begin(Config::READING_LOG_PARTITION) && readingLog.mount())
+  {
+    network.setReadingLog(&readingLog);
+    if (bootCount == 1)
+    {
+      FlashLog::LogStats stats = readingLog.stats();
+      Serial.printf("✓ Reading log: %lu readings in %lu of %lu sectors, erased %lu-%lu times\n",
+                    (unsigned long)stats.records, (unsigned long)stats.usedSectors,
+                    (unsigned long)stats.sectors, (unsigned long)stats.minErases,
+                    (unsigned long)stats.maxErases);
     }
   }
+  else
+  {
+    Serial.println("✗ No reading log partition (flash partitions.csv over USB)");
+  }
 
   // Initialize battery monitor
   monitor.begin();
@@ -237,6 +286,142 @@ void setup()
     Serial.println("NVS will be cleared. Rebooting in 2 seconds...");
     delay(2000);
     ESP.restart(); });
+
+  commandHandler.setTlsBenchmarkCallback([](int rounds)
+                                         { network.benchmarkHandshake(rounds); });
+}
+
+// Initialize OTA once WiFi is up (only once per wake cycle)
+void setupOTAOnce()
+{
+  static bool otaInitialized = false;
+  if (!otaInitialized)
+  {
+    otaManager.setup();
+    otaInitialized = true;
+  }
+}
+
+// Publish a reading over the connected MQTT session and act on new firmware
+void publishAndCheckOTA(const BatteryReading &reading, unsigned long intervalSec)
+{
+  // Calculate next reading time for MQTT publishing
+  time_t now;
+  time(&now);
+  time_t nextReading = now + intervalSec;
+
+  // Reaching the broker makes this a trial boot of new firmware
+  otaManager.noteBrokerReached();
+
+  if (network.publishReading(reading, bootCount, nextReading))
+  {
+    // A full wake cycle with a successful publish confirms new firmware
+    otaManager.markBootHealthy();
+
+    String rollbackReason = otaManager.takeRollbackReason();
+    if (rollbackReason.length() > 0)
+    {
+      network.publishOTAStatus(("rollback: " + rollbackReason).c_str());
+    }
+  }
+
+  // Conditional manifest check (usually a 304), once per wake or hour
+  if (Config::AUTO_CHECK_OTA && otaManager.checkForUpdates())
+  {
+    if (display.isReady()) {
+      display.showOTAScreen("Starting...");
+    }
+    otaManager.handleUpdate();
+  }
+}
+
+// Keep the reading in the flash log; readings before the first NTP sync
+// have no usable time and are not logged
+void logReading(const BatteryReading &reading)
+{
+  time_t now = time(nullptr);
+  if (!readingLog.mounted() || now < (time_t)Config::CLOCK_VALID_AFTER)
+  {
+    return;
+  }
+
+  FlashLog::LogRecord record;
+  record.time = (uint32_t)now;
+  float millivolts = reading.voltage * 1000.0f + 0.5f;
+  record.millivolts = millivolts < 0 ? 0 : millivolts > 65535 ? 65535 : (uint16_t)millivolts;
+  record.percentage = (uint8_t)(reading.percentage + 0.5f);
+  record.status = (uint8_t)reading.status;
+  if (!readingLog.append(record))
+  {
+    Serial.println("❌ Failed to write reading to the flash log");
+  }
+}
+
+bool deepSleepActive()
+{
+  return config.deepSleepEnabled && Config::ENABLE_DEEP_SLEEP;
+}
+
+// Send a reading over the radio uplink; there is no MQTT session for
+// commands or update checks in this mode
+void publishOverUplink(const BatteryReading &reading, unsigned long intervalSec)
+{
+  time_t now;
+  time(&now);
+
+  if (network.publishReading(reading, bootCount, now + intervalSec))
+  {
+    otaManager.markBootHealthy();
+  }
+}
+
+// Always-on operation: WiFi and MQTT stay up between readings and are only
+// re-established after a loss, with exponential backoff
+void runPersistentCycle(const BatteryReading &reading)
+{
+  unsigned long cycleStart = millis();
+
+  network.setAvailabilityMode(true, Config::READING_INTERVAL_MS / 1000);
+  network.setListenMode(false);
+
+  Serial.println("\n─────────────────────────────────");
+  if (network.hasUplink())
+  {
+    publishOverUplink(reading, Config::READING_INTERVAL_MS / 1000);
+  }
+  else if (network.maintainConnection())
+  {
+    if (display.isReady()) {
+      display.update(reading, true, WiFi.RSSI());
+    }
+    setupOTAOnce();
+    publishAndCheckOTA(reading, Config::READING_INTERVAL_MS / 1000);
+  }
+  else
+  {
+    Serial.println("Offline, reading not published");
+  }
+  Serial.println("─────────────────────────────────");
+
+  // Serve MQTT commands, serial commands and OTA until the next reading
+  network.setListenMode(true);
+  while (millis() - cycleStart < Config::READING_INTERVAL_MS && !deepSleepActive())
+  {
+    if (!network.hasUplink())
+    {
+      network.maintainConnection();
+    }
+    commandHandler.checkCommands();
+
+    if (otaManager.isUpdateRequested())
+    {
+      if (display.isReady()) {
+        display.showOTAScreen("Starting...");
+      }
+      otaManager.handleUpdate();
+    }
+    delay(50);
+  }
 }
 
 void loop()
@@ -246,18 +431,32 @@ void loop()
 
   // Store voltage in RTC memory
   lastVoltage = reading.voltage;
+  voltageHistory.setPlotRange(BatteryMonitor::getMinVoltage(), BatteryMonitor::getMaxVoltage());
+  voltageHistory.add(reading.voltage);
+  logReading(reading);
 
   // Display reading
   monitor.printReading(reading);
 
+  // With deep sleep off, keep the connection instead of reconnecting per reading
+  if (!deepSleepActive())
+  {
+    runPersistentCycle(reading);
+    return;
+  }
+
   // Update display with battery info (WiFi not connected yet)
   if (display.isReady()) {
     display.update(reading, false, 0);
   }
 
-  // Connect to WiFi and MQTT, then publish
+  // Connect to WiFi and MQTT, then publish (ESP-NOW and BLE uplinks skip both)
   Serial.println("\n─────────────────────────────────");
-  if (network.connectWiFi())
+  if (network.hasUplink())
+  {
+    publishOverUplink(reading, Config::DEEP_SLEEP_INTERVAL_US / 1000000);
+  }
+  else if (network.connectWiFi())
   {
     // Get WiFi RSSI
     int8_t rssi = WiFi.RSSI();
@@ -266,35 +465,26 @@ void loop()
     if (display.isReady()) {
       display.update(reading, true, rssi);
     }
-    // Initialize OTA early (only once per wake cycle)
-    static bool otaInitialized = false;
-    if (!otaInitialized)
-    {
-      otaManager.setup();
-      otaInitialized = true;
-    }
+    setupOTAOnce();
 
+    network.setAvailabilityMode(false, Config::DEEP_SLEEP_INTERVAL_US / 1000000);
     if (network.connectMQTT())
     {
-      // Calculate next reading time for MQTT publishing
-      time_t now;
-      time(&now);
-      time_t nextReading = now + (Config::DEEP_SLEEP_INTERVAL_US / 1000000);
-      
-      network.publishReading(reading, bootCount, nextReading);
+      publishAndCheckOTA(reading, Config::DEEP_SLEEP_INTERVAL_US / 1000000);
+
+      // Show the voltage trend while we listen for commands
+      if (display.isReady()) {
+        display.showHistory(voltageHistory);
+      }
 
       // Process MQTT messages for a few seconds to check for OTA trigger
       Serial.println("Checking for MQTT commands...");
+      network.setListenMode(true);
       unsigned long checkStart = millis();
       while (millis() - checkStart < 3000)
       {
         network.loop();
         
-        // Update display periodically
-        if (display.isReady() && millis() % 500 < 100) {
-          display.update(reading, true, WiFi.RSSI());
-        }
-        
         delay(100);
 
         // If OTA is requested, handle it
@@ -332,7 +522,7 @@ void loop()
     Serial.println("Device will remain active to handle OTA update");
     delay(Config::READING_INTERVAL_MS);
   }
-  else if (config.deepSleepEnabled && Config::ENABLE_DEEP_SLEEP)
+  else if (deepSleepActive())
   {
     // On first boot, wait longer to allow serial commands
     if (bootCount == 1)
@@ -363,25 +553,21 @@ void loop()
     }
     else
     {
-      // Not first boot - enter deep sleep immediately
-      delay(2000);
+      // Not first boot - enter deep sleep immediately (the radio uplink
+      // has nothing left in flight)
+      if (!network.hasUplink())
+      {
+        delay(2000);
+      }
       enterDeepSleep();
     }
   }
   
   // If we reach here, deep sleep is disabled or was disabled during first boot wait
-  if (!config.deepSleepEnabled)
+  if (!deepSleepActive())
   {
-    // Stay awake and listen for commands
-    Serial.println("Deep sleep disabled, staying awake...");
+    // The next loop() runs in persistent connection mode
+    Serial.println("Deep sleep disabled, staying awake with a persistent connection...");
     Serial.println("Type 'sleep' to re-enable deep sleep");
-    
-    // Keep listening for commands with periodic updates
-    unsigned long loopStart = millis();
-    while (millis() - loopStart < Config::READING_INTERVAL_MS)
-    {
-      commandHandler.checkCommands();
-      delay(200);
-    }
   }
 }
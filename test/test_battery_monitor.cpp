@@ -6,6 +6,7 @@
  * - Battery status determination
  * - Voltage calculations
  * - Boundary conditions
+ * - Voltage history ring buffer
  * 
  * Note: These tests run on ESP32 hardware. Code compiles successfully.
  * To run tests, connect ESP32 and execute: pio test -e esp32dev
@@ -14,6 +15,7 @@
 #include <Arduino.h>
 #include <unity.h>
 #include "battery_monitor.h"
+#include "voltage_history.h"
 
 // Test helper to verify library is loaded correctly
 void test_library_loaded() {
@@ -213,6 +215,102 @@ void test_battery_status_zero_voltage() {
   TEST_ASSERT_EQUAL_STRING("DEAD", status.c_str());
 }
 
+// ============================================================================
+// TEST: Voltage History
+// ============================================================================
+
+void test_history_quantize_round_trip() {
+  TEST_ASSERT_EQUAL_UINT8(125, VoltageHistory::quantize(12.5));
+  TEST_ASSERT_FLOAT_WITHIN(0.011, 12.47, VoltageHistory::dequantize(VoltageHistory::quantize(12.47)));
+  TEST_ASSERT_EQUAL_UINT8(0, VoltageHistory::quantize(5.0));
+  TEST_ASSERT_EQUAL_UINT8(255, VoltageHistory::quantize(20.0));
+}
+
+void test_history_evicts_oldest() {
+  VoltageHistory history = {};
+  for (int i = 0; i < HistoryConfig::SAMPLES + 10; i++) {
+    history.add(11.0 + i * 0.02);
+  }
+  TEST_ASSERT_EQUAL_UINT8(HistoryConfig::SAMPLES, history.count);
+  // The 10 oldest readings are gone
+  TEST_ASSERT_FLOAT_WITHIN(0.011, 11.2, history.minVoltage());
+  TEST_ASSERT_FLOAT_WITHIN(0.011, 11.0 + (HistoryConfig::SAMPLES + 9) * 0.02, history.maxVoltage());
+  TEST_ASSERT_FLOAT_WITHIN(0.011, 11.2, VoltageHistory::dequantize(history.sampleAt(0)));
+}
+
+void test_history_average() {
+  VoltageHistory history = {};
+  history.add(12.0);
+  history.add(12.4);
+  history.add(12.8);
+  TEST_ASSERT_FLOAT_WITHIN(0.011, 12.4, history.averageVoltage());
+}
+
+void test_history_column_heights() {
+  VoltageHistory history = {};
+  history.setPlotRange(10.5, 12.7);
+  history.add(10.0);   // Below range
+  history.add(11.6);   // Middle
+  history.add(13.5);   // Above range (charging)
+  TEST_ASSERT_EQUAL_UINT8(0, history.heightAt(0));
+  TEST_ASSERT_EQUAL_UINT8(HistoryConfig::PLOT_HEIGHT / 2, history.heightAt(1));
+  TEST_ASSERT_EQUAL_UINT8(HistoryConfig::PLOT_HEIGHT, history.heightAt(2));
+  
+  // Changing the range recomputes stored heights
+  history.setPlotRange(11.6, 13.6);
+  TEST_ASSERT_EQUAL_UINT8(0, history.heightAt(1));
+}
+
+// The incremental plot must match one drawn from scratch
+static void assertPlotMatchesRedraw(const HistoryPlot& plot, const VoltageHistory& history) {
+  HistoryPlot fresh = {};
+  TEST_ASSERT_EQUAL(HistoryPlot::REDRAWN, fresh.update(history));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(&fresh.pages[0][0], &plot.pages[0][0], sizeof(plot.pages));
+}
+
+void test_history_plot_appends_then_scrolls() {
+  VoltageHistory history = {};
+  HistoryPlot plot = {};  // As in RTC memory after power-on
+  history.setPlotRange(10.5, 12.7);
+
+  history.add(11.6);
+  TEST_ASSERT_EQUAL(HistoryPlot::REDRAWN, plot.update(history));
+  TEST_ASSERT_EQUAL(HistoryPlot::UNCHANGED, plot.update(history));
+
+  // One sample per wake while filling up: one new column each
+  for (int i = 1; i < HistoryConfig::SAMPLES; i++) {
+    history.add(10.5 + (i % 23) * 0.1);
+    TEST_ASSERT_EQUAL(HistoryPlot::APPENDED, plot.update(history));
+  }
+  assertPlotMatchesRedraw(plot, history);
+
+  // Full: each further sample scrolls by one column
+  for (int i = 0; i < 10; i++) {
+    history.add(12.7 - i * 0.2);
+    TEST_ASSERT_EQUAL(HistoryPlot::SCROLLED, plot.update(history));
+  }
+  assertPlotMatchesRedraw(plot, history);
+}
+
+void test_history_plot_redraws_after_gap_or_new_range() {
+  VoltageHistory history = {};
+  HistoryPlot plot = {};
+  history.setPlotRange(10.5, 12.7);
+  history.add(12.0);
+  plot.update(history);
+
+  // A wake that did not show the screen: two samples behind
+  history.add(12.1);
+  history.add(12.2);
+  TEST_ASSERT_EQUAL(HistoryPlot::REDRAWN, plot.update(history));
+  assertPlotMatchesRedraw(plot, history);
+
+  // New chemistry, new range
+  history.setPlotRange(10.0, 14.6);
+  TEST_ASSERT_EQUAL(HistoryPlot::REDRAWN, plot.update(history));
+  assertPlotMatchesRedraw(plot, history);
+}
+
 // ============================================================================
 // Main Setup and Runner
 // ============================================================================
@@ -268,6 +366,14 @@ void setup() {
   RUN_TEST(test_battery_status_negative_voltage);
   RUN_TEST(test_battery_status_zero_voltage);
   
+  // Voltage History Tests
+  RUN_TEST(test_history_quantize_round_trip);
+  RUN_TEST(test_history_evicts_oldest);
+  RUN_TEST(test_history_average);
+  RUN_TEST(test_history_column_heights);
+  RUN_TEST(test_history_plot_appends_then_scrolls);
+  RUN_TEST(test_history_plot_redraws_after_gap_or_new_range);
+  
   UNITY_END();
 }
 
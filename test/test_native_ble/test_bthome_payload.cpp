@@ -0,0 +1,152 @@
+/*
+ * Unit Tests for the BTHome Beacon Payload
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "bthome_payload.h"
+
+using namespace BleBeacon;
+
+void setUp() {}
+void tearDown() {}
+
+static BeaconReading sampleReading() {
+  BeaconReading reading = {};
+  reading.packetId = 0x2A;
+  reading.percentage = 87;
+  reading.millivolts = 12650;
+  reading.batteryLow = false;
+  return reading;
+}
+
+// ============================================================================
+// TEST: Encoding
+// ============================================================================
+
+void test_service_data_layout() {
+  uint8_t data[BleBeaconConfig::SERVICE_DATA_MAX];
+  size_t len = encodeServiceData(sampleReading(), data, sizeof(data));
+
+  const uint8_t expected[] = {
+    0x44,               // BTHome v2, irregular updates, not encrypted
+    0x00, 0x2A,         // packet id
+    0x01, 87,           // battery %
+    0x0C, 0x6A, 0x31,   // 12650 mV
+    0x15, 0x00          // battery low: no
+  };
+  TEST_ASSERT_EQUAL(sizeof(expected), len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, data, len);
+}
+
+void test_advertisement_fits_and_carries_name() {
+  uint8_t adv[BleBeaconConfig::ADV_MAX];
+  size_t len = encodeAdvertisement(sampleReading(), "esp32-garage", adv, sizeof(adv));
+
+  TEST_ASSERT_LESS_OR_EQUAL(BleBeaconConfig::ADV_MAX, len);
+  const uint8_t header[] = {0x02, 0x01, 0x06, 0x0D, 0x16, 0xD2, 0xFC};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(header, adv, sizeof(header));
+  TEST_ASSERT_EQUAL_UINT8(1 + strlen("esp32-garage"), adv[17]);
+  TEST_ASSERT_EQUAL_HEX8(0x09, adv[18]);
+  TEST_ASSERT_EQUAL(0, memcmp(adv + 19, "esp32-garage", 12));
+}
+
+void test_long_name_is_left_out() {
+  uint8_t adv[BleBeaconConfig::ADV_MAX];
+  size_t len = encodeAdvertisement(sampleReading(), "a-very-long-battery-monitor-name", adv, sizeof(adv));
+  TEST_ASSERT_EQUAL(17, len);
+}
+
+void test_values_are_clamped() {
+  BeaconReading reading = sampleReading();
+  reading.percentage = 150;
+  uint8_t data[BleBeaconConfig::SERVICE_DATA_MAX];
+  encodeServiceData(reading, data, sizeof(data));
+  TEST_ASSERT_EQUAL_UINT8(100, data[4]);
+}
+
+void test_encode_rejects_small_buffer() {
+  uint8_t data[BleBeaconConfig::SERVICE_DATA_MAX];
+  TEST_ASSERT_EQUAL(0, encodeServiceData(sampleReading(), data, 9));
+  uint8_t adv[16];
+  TEST_ASSERT_EQUAL(0, encodeAdvertisement(sampleReading(), nullptr, adv, sizeof(adv)));
+}
+
+// ============================================================================
+// TEST: Decoding
+// ============================================================================
+
+void test_roundtrip_through_advertisement() {
+  BeaconReading reading = sampleReading();
+  reading.batteryLow = true;
+  uint8_t adv[BleBeaconConfig::ADV_MAX];
+  size_t len = encodeAdvertisement(reading, "esp32-garage", adv, sizeof(adv));
+
+  const uint8_t* data;
+  size_t dataLen;
+  TEST_ASSERT_TRUE(findServiceData(adv, len, data, dataLen));
+  BeaconReading decoded;
+  TEST_ASSERT_TRUE(decodeServiceData(data, dataLen, decoded));
+  TEST_ASSERT_EQUAL_UINT8(0x2A, decoded.packetId);
+  TEST_ASSERT_EQUAL_UINT8(87, decoded.percentage);
+  TEST_ASSERT_EQUAL_UINT16(12650, decoded.millivolts);
+  TEST_ASSERT_TRUE(decoded.batteryLow);
+}
+
+void test_decode_skips_other_known_objects() {
+  // Another BTHome device: packet id, battery, temperature, voltage
+  const uint8_t data[] = {0x40, 0x00, 0x01, 0x01, 0x50, 0x02, 0xCA, 0x09, 0x0C, 0xB8, 0x0B};
+  BeaconReading decoded;
+  TEST_ASSERT_TRUE(decodeServiceData(data, sizeof(data), decoded));
+  TEST_ASSERT_EQUAL_UINT8(80, decoded.percentage);
+  TEST_ASSERT_EQUAL_UINT16(3000, decoded.millivolts);
+  TEST_ASSERT_FALSE(decoded.batteryLow);
+}
+
+void test_decode_rejects_version_encryption_and_unknown_objects() {
+  BeaconReading decoded;
+  const uint8_t v1[] = {0x24, 0x01, 0x50, 0x0C, 0xB8, 0x0B};
+  TEST_ASSERT_FALSE(decodeServiceData(v1, sizeof(v1), decoded));
+
+  const uint8_t encrypted[] = {0x41, 0x01, 0x50, 0x0C, 0xB8, 0x0B};
+  TEST_ASSERT_FALSE(decodeServiceData(encrypted, sizeof(encrypted), decoded));
+
+  const uint8_t unknown[] = {0x40, 0x01, 0x50, 0x7E, 0x00, 0x0C, 0xB8, 0x0B};
+  TEST_ASSERT_FALSE(decodeServiceData(unknown, sizeof(unknown), decoded));
+
+  const uint8_t truncated[] = {0x40, 0x01, 0x50, 0x0C, 0xB8};
+  TEST_ASSERT_FALSE(decodeServiceData(truncated, sizeof(truncated), decoded));
+
+  const uint8_t noVoltage[] = {0x40, 0x01, 0x50};
+  TEST_ASSERT_FALSE(decodeServiceData(noVoltage, sizeof(noVoltage), decoded));
+}
+
+void test_find_ignores_other_services_and_bad_lengths() {
+  const uint8_t other[] = {0x02, 0x01, 0x06, 0x05, 0x16, 0x0F, 0x18, 0x55, 0x00};
+  const uint8_t* data;
+  size_t dataLen;
+  TEST_ASSERT_FALSE(findServiceData(other, sizeof(other), data, dataLen));
+
+  const uint8_t overrun[] = {0x02, 0x01, 0x06, 0x10, 0x16, 0xD2, 0xFC};
+  TEST_ASSERT_FALSE(findServiceData(overrun, sizeof(overrun), data, dataLen));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_service_data_layout);
+  RUN_TEST(test_advertisement_fits_and_carries_name);
+  RUN_TEST(test_long_name_is_left_out);
+  RUN_TEST(test_values_are_clamped);
+  RUN_TEST(test_encode_rejects_small_buffer);
+
+  RUN_TEST(test_roundtrip_through_advertisement);
+  RUN_TEST(test_decode_skips_other_known_objects);
+  RUN_TEST(test_decode_rejects_version_encryption_and_unknown_objects);
+  RUN_TEST(test_find_ignores_other_services_and_bad_lengths);
+
+  return UNITY_END();
+}
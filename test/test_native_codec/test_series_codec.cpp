@@ -0,0 +1,355 @@
+/*
+ * Unit Tests and Benchmark for the Series Codec
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ *
+ * The benchmark encodes and decodes reading traces and prints the
+ * compression ratio against a BatteryReading (four 4-byte fields) and the
+ * 9-byte records of the first reading log, plus encode/decode throughput.
+ * The built-in traces are generated with the timing and noise of the
+ * device's two modes. A recorded trace can be added with
+ *   CODEC_TRACE=readings.csv pio test -e native -f test_native_codec
+ * where each line is "time,millivolts,percentage,status", as in the
+ * history command's JSON readings.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "series_codec.h"
+
+using namespace SeriesCodec;
+using SeriesCodecConfig::MAX_SAMPLE_BYTES;
+
+void setUp() {}
+void tearDown() {}
+
+static Sample sampleOf(uint32_t time, uint16_t millivolts, uint8_t percentage, uint8_t status) {
+  Sample sample;
+  sample.time = time;
+  sample.millivolts = millivolts;
+  sample.percentage = percentage;
+  sample.status = status;
+  return sample;
+}
+
+static std::vector<uint8_t> encodeAll(const std::vector<Sample>& samples) {
+  std::vector<uint8_t> out;
+  Encoder encoder;
+  uint8_t buf[MAX_SAMPLE_BYTES];
+  for (const Sample& sample : samples) {
+    size_t n = encoder.encode(sample, buf);
+    TEST_ASSERT_TRUE(n > 0 && n <= MAX_SAMPLE_BYTES);
+    out.insert(out.end(), buf, buf + n);
+  }
+  return out;
+}
+
+static void assertSameSample(const Sample& want, const Sample& got) {
+  TEST_ASSERT_EQUAL_UINT32(want.time, got.time);
+  TEST_ASSERT_EQUAL_UINT16(want.millivolts, got.millivolts);
+  TEST_ASSERT_EQUAL_UINT8(want.percentage, got.percentage);
+  TEST_ASSERT_EQUAL_UINT8(want.status, got.status);
+}
+
+static void assertRoundTrip(const std::vector<Sample>& samples) {
+  std::vector<uint8_t> data = encodeAll(samples);
+  Decoder decoder(data.data(), data.size());
+  Sample sample;
+  size_t i = 0;
+  while (decoder.next(sample)) {
+    TEST_ASSERT_TRUE(i < samples.size());
+    assertSameSample(samples[i++], sample);
+  }
+  TEST_ASSERT_FALSE(decoder.malformed());
+  TEST_ASSERT_EQUAL(samples.size(), i);
+  TEST_ASSERT_EQUAL(data.size(), decoder.position());
+}
+
+// Small deterministic generator, so traces are the same on every run
+static uint32_t rngState = 1;
+static uint32_t rng() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState >> 8;
+}
+static int32_t noise(int32_t amplitude) {
+  return static_cast<int32_t>(rng() % (2 * amplitude + 1)) - amplitude;
+}
+
+// Lead-acid percentage and BatteryStatus as the firmware computes them
+static Sample leadAcidSample(uint32_t time, int32_t millivolts) {
+  float volts = millivolts / 1000.0f;
+  float percent = (volts - 10.5f) / (12.7f - 10.5f) * 100.0f;
+  percent = percent < 0 ? 0 : percent > 100 ? 100 : percent;
+  uint8_t status = volts >= 12.7f ? 0 : volts >= 12.4f ? 1 : volts >= 12.0f ? 2 : volts >= 11.8f ? 3 : 4;
+  return sampleOf(time, millivolts, static_cast<uint8_t>(percent + 0.5f), status);
+}
+
+// ============================================================================
+// TEST: Building blocks
+// ============================================================================
+
+void test_varint_and_zigzag() {
+  const uint32_t values[] = {0, 1, 127, 128, 16383, 16384, 0x0FFFFFFF, 0xFFFFFFFF};
+  uint8_t buf[5];
+  for (uint32_t value : values) {
+    size_t n = putVarint(buf, value);
+    uint32_t decoded;
+    TEST_ASSERT_EQUAL(n, getVarint(buf, n, decoded));
+    TEST_ASSERT_EQUAL_UINT32(value, decoded);
+    TEST_ASSERT_EQUAL(0, getVarint(buf, n - 1, decoded));  // Cut short
+  }
+
+  const uint8_t overlong[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x1F};
+  uint32_t decoded;
+  TEST_ASSERT_EQUAL(0, getVarint(overlong, sizeof(overlong), decoded));
+
+  TEST_ASSERT_EQUAL_UINT32(0, zigzag(0));
+  TEST_ASSERT_EQUAL_UINT32(1, zigzag(-1));
+  TEST_ASSERT_EQUAL_UINT32(2, zigzag(1));
+  TEST_ASSERT_EQUAL_INT32(-2147483647 - 1, unzigzag(zigzag(-2147483647 - 1)));
+  TEST_ASSERT_EQUAL_INT32(2147483647, unzigzag(zigzag(2147483647)));
+}
+
+// ============================================================================
+// TEST: Encoding
+// ============================================================================
+
+void test_steady_reading_is_one_byte() {
+  Encoder encoder;
+  uint8_t buf[MAX_SAMPLE_BYTES];
+
+  size_t first = encoder.encode(sampleOf(1718000000, 12650, 90, 1), buf);
+  TEST_ASSERT_EQUAL_HEX8(0xF7, buf[0]);
+  TEST_ASSERT_EQUAL(1 + 5 + 2 + 1 + 1, first);
+
+  // Regular interval from here on, voltage within 7 mV, same percentage and status
+  TEST_ASSERT_EQUAL(3, encoder.encode(sampleOf(1718000600, 12648, 90, 1), buf));  // First interval, 2-byte varint
+  TEST_ASSERT_EQUAL(1, encoder.encode(sampleOf(1718001200, 12650, 90, 1), buf));
+  TEST_ASSERT_EQUAL_HEX8(0x40, buf[0]);  // zigzag(+2) inline, no fields
+  TEST_ASSERT_EQUAL(1, encoder.encode(sampleOf(1718001800, 12643, 90, 1), buf));
+  TEST_ASSERT_EQUAL(2, encoder.encode(sampleOf(1718002403, 12643, 90, 1), buf));  // 3 s late
+}
+
+void test_round_trip_extremes() {
+  std::vector<Sample> samples = {
+      sampleOf(1, 0, 0, 0),
+      sampleOf(0xFFFFFFFE, 65535, 255, 127),  // Everything jumps at once
+      sampleOf(1000, 0, 0, 0),                // Clock set back
+      sampleOf(1000, 0, 0, 0),                // Same time twice
+      sampleOf(4000000000u, 40000, 7, 3),
+      sampleOf(4000000600u, 40001, 7, 3),
+  };
+  assertRoundTrip(samples);
+}
+
+void test_round_trip_random() {
+  rngState = 7;
+  std::vector<Sample> samples;
+  uint32_t time = 1700000000;
+  for (int i = 0; i < 5000; i++) {
+    time += rng() % 100000;
+    samples.push_back(sampleOf(time, rng() % 65536, rng() % 256, rng() % 128));
+  }
+  assertRoundTrip(samples);
+}
+
+void test_resume_continues_stream() {
+  std::vector<Sample> samples;
+  for (uint32_t i = 0; i < 20; i++) {
+    samples.push_back(sampleOf(1718000000 + i * 600, 12600 + i, 80, 1));
+  }
+  std::vector<uint8_t> data = encodeAll(std::vector<Sample>(samples.begin(), samples.begin() + 12));
+
+  // Decode what is there, then append the rest from the decoded state
+  Decoder decoder(data.data(), data.size());
+  Sample sample;
+  while (decoder.next(sample)) {
+  }
+  Encoder encoder;
+  encoder.resume(decoder.getState());
+  uint8_t buf[MAX_SAMPLE_BYTES];
+  for (size_t i = 12; i < samples.size(); i++) {
+    size_t n = encoder.encode(samples[i], buf);
+    data.insert(data.end(), buf, buf + n);
+  }
+
+  Decoder all(data.data(), data.size());
+  size_t i = 0;
+  while (all.next(sample)) {
+    assertSameSample(samples[i++], sample);
+  }
+  TEST_ASSERT_EQUAL(samples.size(), i);
+}
+
+// ============================================================================
+// TEST: Streams in flash
+// ============================================================================
+
+void test_stream_ends_at_erased_flash() {
+  std::vector<Sample> samples = {sampleOf(1718000000, 12650, 90, 1), sampleOf(1718000600, 12640, 89, 1)};
+  std::vector<uint8_t> data = encodeAll(samples);
+  size_t used = data.size();
+  data.resize(64, 0xFF);
+
+  Decoder decoder(data.data(), data.size());
+  Sample sample;
+  TEST_ASSERT_TRUE(decoder.next(sample));
+  TEST_ASSERT_TRUE(decoder.next(sample));
+  TEST_ASSERT_FALSE(decoder.next(sample));
+  TEST_ASSERT_FALSE(decoder.malformed());
+  TEST_ASSERT_EQUAL(used, decoder.position());
+
+  const uint8_t reserved[] = {0xF7, 0x01, 0x01, 0x01, 0x00, 0x08};
+  Decoder bad(reserved, sizeof(reserved));
+  TEST_ASSERT_TRUE(bad.next(sample));
+  TEST_ASSERT_FALSE(bad.next(sample));
+  TEST_ASSERT_TRUE(bad.malformed());
+}
+
+void test_sample_cut_short_is_never_misread() {
+  // Every prefix of a stream, as left in flash by a reset mid-write
+  rngState = 11;
+  std::vector<Sample> samples;
+  uint32_t time = 1718000000;
+  for (int i = 0; i < 200; i++) {
+    time += 600 + noise(i % 3 == 0 ? 40000 : 2);
+    samples.push_back(sampleOf(time, 12000 + noise(i % 7 == 0 ? 3000 : 5), 50 + noise(20), rng() % 5));
+  }
+  std::vector<uint8_t> data = encodeAll(samples);
+
+  for (size_t cut = 0; cut < data.size(); cut++) {
+    std::vector<uint8_t> flash(data.begin(), data.begin() + cut);
+    flash.resize(data.size() + MAX_SAMPLE_BYTES, 0xFF);
+    Decoder decoder(flash.data(), flash.size());
+    Sample sample;
+    size_t i = 0;
+    while (decoder.next(sample)) {
+      TEST_ASSERT_TRUE(i < samples.size());
+      assertSameSample(samples[i++], sample);
+    }
+    TEST_ASSERT_TRUE(decoder.position() <= cut);
+  }
+}
+
+// ============================================================================
+// BENCHMARK: Compression ratio and throughput
+// ============================================================================
+
+// Deep sleep: one reading every 4 hours, wake time jitter of a few
+// seconds, slow discharge with ADC noise
+static std::vector<Sample> sleepingTrace() {
+  rngState = 1;
+  std::vector<Sample> trace;
+  uint32_t time = 1718000000;
+  for (int i = 0; i < 20000; i++) {
+    time += 4 * 3600 + noise(3);
+    int32_t millivolts = 12750 - i / 20 % 700 + noise(4);
+    trace.push_back(leadAcidSample(time, millivolts));
+  }
+  return trace;
+}
+
+// Always on: a reading a minute, solar charging by day and a load at night
+static std::vector<Sample> persistentTrace() {
+  rngState = 2;
+  std::vector<Sample> trace;
+  uint32_t time = 1718000000;
+  for (int i = 0; i < 20000; i++) {
+    time += 60 + (rng() % 50 == 0 ? noise(2) : 0);
+    int minute = i % 1440;
+    int32_t solar = minute > 420 && minute < 1140 ? (360 - abs(minute - 780)) * 4 : 0;
+    int32_t millivolts = 12300 + solar - minute / 6 + noise(6);
+    trace.push_back(leadAcidSample(time, millivolts));
+  }
+  return trace;
+}
+
+static std::vector<Sample> loadTrace(const char* path) {
+  std::vector<Sample> trace;
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    return trace;
+  }
+  unsigned long time;
+  unsigned millivolts, percentage, status;
+  while (fscanf(file, "%lu,%u,%u,%u", &time, &millivolts, &percentage, &status) == 4) {
+    trace.push_back(sampleOf(time, millivolts, percentage, status));
+  }
+  fclose(file);
+  return trace;
+}
+
+static void benchmark(const char* name, const std::vector<Sample>& trace) {
+  using Clock = std::chrono::steady_clock;
+  const int rounds = 20;
+  std::vector<uint8_t> data;
+
+  auto start = Clock::now();
+  for (int r = 0; r < rounds; r++) {
+    data = encodeAll(trace);
+  }
+  double encodeNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds / trace.size();
+
+  size_t decoded = 0;
+  uint32_t check = 0;
+  start = Clock::now();
+  for (int r = 0; r < rounds; r++) {
+    Decoder decoder(data.data(), data.size());
+    Sample sample;
+    while (decoder.next(sample)) {
+      check += sample.millivolts;
+      decoded++;
+    }
+  }
+  double decodeNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds / trace.size();
+  TEST_ASSERT_EQUAL(trace.size() * rounds, decoded);
+  TEST_ASSERT_TRUE(check > 0);
+
+  double bytesPerSample = static_cast<double>(data.size()) / trace.size();
+  printf("%-12s %6zu readings  %.2f bytes/reading  %4.1fx vs BatteryReading  %4.1fx vs 9-byte record  "
+         "encode %.0f ns  decode %.0f ns per reading\n",
+         name, trace.size(), bytesPerSample, 16.0 / bytesPerSample, 9.0 / bytesPerSample, encodeNs, decodeNs);
+
+  assertRoundTrip(trace);
+}
+
+void test_benchmark_traces() {
+  std::vector<Sample> sleeping = sleepingTrace();
+  std::vector<Sample> persistent = persistentTrace();
+  benchmark("deep sleep", sleeping);
+  benchmark("persistent", persistent);
+
+  // Both modes fit at least four readings in the space of one old record
+  TEST_ASSERT_LESS_OR_EQUAL(9 * sleeping.size() / 4, encodeAll(sleeping).size());
+  TEST_ASSERT_LESS_OR_EQUAL(9 * persistent.size() / 4, encodeAll(persistent).size());
+
+  const char* path = getenv("CODEC_TRACE");
+  if (path != nullptr) {
+    std::vector<Sample> recorded = loadTrace(path);
+    TEST_ASSERT_TRUE_MESSAGE(!recorded.empty(), "CODEC_TRACE could not be read");
+    benchmark("recorded", recorded);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_varint_and_zigzag);
+
+  RUN_TEST(test_steady_reading_is_one_byte);
+  RUN_TEST(test_round_trip_extremes);
+  RUN_TEST(test_round_trip_random);
+  RUN_TEST(test_resume_continues_stream);
+
+  RUN_TEST(test_stream_ends_at_erased_flash);
+  RUN_TEST(test_sample_cut_short_is_never_misread);
+
+  RUN_TEST(test_benchmark_traces);
+
+  return UNITY_END();
+}
@@ -0,0 +1,414 @@
+/*
+ * Unit and Load Tests for the Gateway Aggregator
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ *
+ * The load test runs MAX_CHILDREN sensor units against one gateway over
+ * LoopbackLink in virtual time, with lost frames, lost acknowledgements
+ * (resent frames), cold reboots, sequence wrap-around and failed MQTT
+ * batches, and checks that every unit's state is published in order and
+ * without repeats.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "sensor_frame.h"
+#include "frame_sender.h"
+#include "gateway_aggregator.h"
+
+using namespace SensorUplink;
+
+void setUp() {}
+void tearDown() {}
+
+static const uint8_t MAC_A[6] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x01};
+static const uint8_t MAC_B[6] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x02};
+
+static size_t frameFor(uint16_t sequence, uint16_t millivolts, uint8_t* frame, bool coldBoot = false,
+                       uint16_t intervalSec = 3600) {
+  SensorReading reading = {};
+  reading.sequence = sequence;
+  reading.millivolts = millivolts;
+  reading.percentage = 80.0f;
+  reading.status = 1;
+  reading.coldBoot = coldBoot;
+  reading.bootCount = sequence;
+  reading.nextReadingSec = intervalSec;
+  return encodeFrame(reading, frame, SensorUplinkConfig::FRAME_SIZE);
+}
+
+// ============================================================================
+// TEST: Deduplication and batching
+// ============================================================================
+
+void test_repeat_is_dropped() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+
+  size_t len = frameFor(10, 12600, frame);
+  TEST_ASSERT_TRUE(gateway.receive(MAC_A, frame, len, 0));
+  TEST_ASSERT_FALSE(gateway.receive(MAC_A, frame, len, 5));   // Resent after a lost ack
+  len = frameFor(9, 12500, frame);
+  TEST_ASSERT_FALSE(gateway.receive(MAC_A, frame, len, 10));  // Late copy of an older reading
+
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+  TEST_ASSERT_EQUAL(1, gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX));
+  TEST_ASSERT_EQUAL_UINT16(10, batch[0].reading.sequence);
+  TEST_ASSERT_EQUAL_UINT16(12600, batch[0].reading.millivolts);
+  TEST_ASSERT_EQUAL_UINT32(2, gateway.getStats().repeats);
+}
+
+void test_cold_boot_restart_is_accepted() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+
+  size_t len = frameFor(500, 12600, frame);
+  gateway.receive(MAC_A, frame, len, 0);
+  gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX);
+
+  // Power loss: RTC memory is gone and the unit counts from 1 again
+  len = frameFor(1, 12400, frame, true);
+  TEST_ASSERT_TRUE(gateway.receive(MAC_A, frame, len, 10));
+  TEST_ASSERT_FALSE(gateway.receive(MAC_A, frame, len, 15));  // Resend of the same first frame
+  len = frameFor(2, 12450, frame);
+  TEST_ASSERT_TRUE(gateway.receive(MAC_A, frame, len, 20));
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().restarts);
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().repeats);
+}
+
+void test_newer_reading_supersedes_pending() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+
+  gateway.receive(MAC_A, frame, frameFor(1, 12000, frame), 0);
+  gateway.receive(MAC_B, frame, frameFor(1, 13000, frame), 10);
+  gateway.receive(MAC_A, frame, frameFor(2, 12100, frame), 20);
+  TEST_ASSERT_EQUAL(2, gateway.pending());
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().superseded);
+
+  // A keeps its place in the queue, with its newest reading
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+  TEST_ASSERT_EQUAL(2, gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(MAC_A, batch[0].mac, 6);
+  TEST_ASSERT_EQUAL_UINT16(12100, batch[0].reading.millivolts);
+  TEST_ASSERT_EQUAL_UINT32(0, batch[0].receivedMs);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(MAC_B, batch[1].mac, 6);
+}
+
+void test_batch_ready_by_size_and_window() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x01, 0x00};
+
+  gateway.receive(mac, frame, frameFor(1, 12000, frame), 100);
+  TEST_ASSERT_FALSE(gateway.batchReady(100));
+  TEST_ASSERT_FALSE(gateway.batchReady(100 + SensorUplinkConfig::BATCH_WINDOW_MS - 1));
+  TEST_ASSERT_TRUE(gateway.batchReady(100 + SensorUplinkConfig::BATCH_WINDOW_MS));
+
+  for (size_t i = 1; i < SensorUplinkConfig::BATCH_MAX; i++) {
+    mac[5] = i;
+    gateway.receive(mac, frame, frameFor(1, 12000, frame), 200);
+  }
+  TEST_ASSERT_TRUE(gateway.batchReady(200));
+}
+
+void test_requeue_after_failed_publish() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+
+  gateway.receive(MAC_A, frame, frameFor(1, 12000, frame), 0);
+  gateway.receive(MAC_B, frame, frameFor(1, 13000, frame), 0);
+  size_t count = gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX);
+  TEST_ASSERT_EQUAL(0, gateway.pending());
+
+  // B reports again while the batch is out; its old reading is not restored
+  gateway.receive(MAC_B, frame, frameFor(2, 13100, frame), 50);
+  gateway.requeue(batch, count);
+  TEST_ASSERT_EQUAL(2, gateway.pending());
+
+  count = gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX);
+  TEST_ASSERT_EQUAL(2, count);
+  TEST_ASSERT_TRUE(batch[0].announce);  // Discovery was in the failed batch too
+  TEST_ASSERT_EQUAL_UINT16(13100, batch[1].reading.millivolts);
+}
+
+void test_announce_once_per_interval() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+
+  gateway.receive(MAC_A, frame, frameFor(1, 12000, frame), 0);
+  gateway.takeBatch(batch, 1);
+  TEST_ASSERT_TRUE(batch[0].announce);
+
+  gateway.receive(MAC_A, frame, frameFor(2, 12000, frame), 10);
+  gateway.takeBatch(batch, 1);
+  TEST_ASSERT_FALSE(batch[0].announce);
+
+  // expire_after follows the unit's interval
+  gateway.receive(MAC_A, frame, frameFor(3, 12000, frame, false, 600), 20);
+  gateway.takeBatch(batch, 1);
+  TEST_ASSERT_TRUE(batch[0].announce);
+
+  gateway.announceAll();
+  gateway.receive(MAC_A, frame, frameFor(4, 12000, frame, false, 600), 30);
+  gateway.takeBatch(batch, 1);
+  TEST_ASSERT_TRUE(batch[0].announce);
+}
+
+void test_table_full_and_invalid_frames() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x02, 0x00};
+
+  for (size_t i = 0; i <= SensorUplinkConfig::MAX_CHILDREN; i++) {
+    mac[5] = i;
+    gateway.receive(mac, frame, frameFor(1, 12000, frame), 0);
+  }
+  TEST_ASSERT_EQUAL(SensorUplinkConfig::MAX_CHILDREN, gateway.children());
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().tableFull);
+
+  frameFor(2, 12000, frame);
+  frame[4] ^= 0x01;
+  TEST_ASSERT_FALSE(gateway.receive(MAC_A, frame, SensorUplinkConfig::FRAME_SIZE, 0));
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().invalid);
+}
+
+void test_idle_unit_gives_up_its_slot() {
+  GatewayAggregator gateway;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x03, 0x00};
+  ChildUpdate batch[SensorUplinkConfig::MAX_CHILDREN];
+
+  // Unit 0 goes quiet after its first reading; the others keep reporting
+  for (size_t i = 0; i < SensorUplinkConfig::MAX_CHILDREN; i++) {
+    mac[5] = i;
+    gateway.receive(mac, frame, frameFor(1, 12000, frame), 0);
+  }
+  gateway.takeBatch(batch, SensorUplinkConfig::MAX_CHILDREN);
+  uint32_t later = SensorUplinkConfig::CHILD_IDLE_MS - 1000;
+  for (size_t i = 1; i < SensorUplinkConfig::MAX_CHILDREN; i++) {
+    mac[5] = i;
+    gateway.receive(mac, frame, frameFor(2, 12000, frame), later);
+  }
+  gateway.takeBatch(batch, SensorUplinkConfig::MAX_CHILDREN);
+
+  // Not idle long enough yet
+  mac[5] = 0xF0;
+  TEST_ASSERT_FALSE(gateway.receive(mac, frame, frameFor(1, 12000, frame), SensorUplinkConfig::CHILD_IDLE_MS - 1));
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().tableFull);
+
+  // Past CHILD_IDLE_MS the new unit takes unit 0's slot and is announced
+  TEST_ASSERT_TRUE(gateway.receive(mac, frame, frameFor(1, 12000, frame), SensorUplinkConfig::CHILD_IDLE_MS));
+  TEST_ASSERT_EQUAL_UINT32(1, gateway.getStats().evicted);
+  TEST_ASSERT_EQUAL(SensorUplinkConfig::MAX_CHILDREN, gateway.children());
+  TEST_ASSERT_EQUAL(1, gateway.takeBatch(batch, 1));
+  TEST_ASSERT_EQUAL_UINT8(0, batch[0].slot);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac, batch[0].mac, 6);
+  TEST_ASSERT_TRUE(batch[0].announce);
+
+  // The others are still recent: a further new unit finds no slot
+  mac[5] = 0xF1;
+  TEST_ASSERT_FALSE(gateway.receive(mac, frame, frameFor(1, 12000, frame), SensorUplinkConfig::CHILD_IDLE_MS));
+  TEST_ASSERT_EQUAL_UINT32(2, gateway.getStats().tableFull);
+}
+
+// ============================================================================
+// TEST: Many sensor units against one gateway
+// ============================================================================
+
+// Deterministic xorshift, so failures reproduce
+static uint32_t rngState = 0x2545F491;
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+struct SimUnit {
+  uint8_t mac[6];
+  LoopbackLink link;
+  uint16_t sequence;
+  uint32_t bootCount;
+  bool frameSent;               // RTC state of RadioUplink
+  uint8_t channel;
+  uint32_t nextReportMs;
+  uint32_t periodMs;
+  uint16_t lastAccepted;        // Newest sequence the gateway took from this unit
+  uint16_t lastAcceptedMv;
+  bool anyAccepted;
+  uint16_t lastPublished;
+  bool anyPublished;
+  bool restartPending;          // Rebooted; the next publish may go back in sequence
+  uint32_t published;
+};
+
+void test_multi_node_load() {
+  const size_t UNITS = SensorUplinkConfig::MAX_CHILDREN;
+  const uint32_t TICK_MS = 50;
+  const uint32_t RUN_MS = 30 * 60 * 1000;  // 30 virtual minutes
+  const uint32_t GATEWAY_CHANNEL = 6;
+
+  GatewayAggregator gateway;
+  std::vector<SimUnit> units(UNITS);
+  uint32_t nowMs = 0;
+  uint32_t sentReadings = 0, deliveredReadings = 0, batches = 0, failedBatches = 0;
+  uint32_t maxLatencyMs = 0;
+  size_t maxBatch = 0;
+
+  for (size_t i = 0; i < UNITS; i++) {
+    SimUnit& unit = units[i];
+    const uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x10, 0x00, (uint8_t)i};
+    memcpy(unit.mac, mac, 6);
+    unit.link.setGatewayChannel(GATEWAY_CHANNEL);
+    unit.sequence = (i % 4 == 0) ? 0xFFF0 : 0;  // Some wrap during the run
+    unit.periodMs = 5000 + (nextRandom() % 10000);
+    unit.nextReportMs = nextRandom() % unit.periodMs;
+    SimUnit* self = &unit;
+    unit.link.setReceiver([&gateway, &nowMs, self](const uint8_t* frame, size_t len) {
+      if (gateway.receive(self->mac, frame, len, nowMs)) {
+        SensorReading reading;
+        decodeFrame(frame, len, reading);
+        self->lastAccepted = reading.sequence;
+        self->lastAcceptedMv = reading.millivolts;
+        self->anyAccepted = true;
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (nowMs = 0; nowMs < RUN_MS; nowMs += TICK_MS) {
+    for (SimUnit& unit : units) {
+      if (nowMs < unit.nextReportMs) {
+        continue;
+      }
+      unit.nextReportMs = nowMs + unit.periodMs;
+
+      // About one wake in 200 is a cold boot with RTC memory lost
+      if (nextRandom() % 200 == 0) {
+        unit.sequence = 0;
+        unit.frameSent = false;
+        unit.channel = 0;
+        unit.restartPending = true;
+      }
+
+      SensorReading reading = {};
+      reading.sequence = ++unit.sequence;
+      reading.millivolts = 11500 + nextRandom() % 1500;
+      reading.percentage = 50.0f;
+      reading.status = 1;
+      reading.coldBoot = !unit.frameSent;
+      reading.bootCount = ++unit.bootCount;
+      reading.nextReadingSec = unit.periodMs / 1000;
+      uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+      size_t len = encodeFrame(reading, frame, sizeof(frame));
+
+      uint32_t roll = nextRandom() % 100;
+      if (roll < 10) {
+        unit.link.dropNext(1 + nextRandom() % 2);
+      } else if (roll < 20) {
+        unit.link.loseAcks(1 + nextRandom() % 2);  // Gateway gets the frame more than once
+      }
+
+      FrameSender sender(unit.link);
+      SendResult result = sender.send(frame, len, unit.channel);
+      sentReadings++;
+      if (result.delivered) {
+        unit.channel = result.channel;
+        unit.frameSent = true;
+        deliveredReadings++;
+      }
+    }
+
+    if (gateway.batchReady(nowMs)) {
+      ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+      size_t count = gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX);
+      if (count > maxBatch) {
+        maxBatch = count;
+      }
+      // One batch in 50 fails, as on a dropped MQTT connection
+      if (nextRandom() % 50 == 0) {
+        gateway.requeue(batch, count);
+        failedBatches++;
+        continue;
+      }
+      batches++;
+      for (size_t i = 0; i < count; i++) {
+        SimUnit& unit = units[batch[i].mac[5]];
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(unit.mac, batch[i].mac, 6);
+        uint16_t sequence = batch[i].reading.sequence;
+        if (unit.anyPublished && !unit.restartPending) {
+          TEST_ASSERT_TRUE_MESSAGE(sequenceNewer(sequence, unit.lastPublished), "reading published out of order");
+        }
+        unit.lastPublished = sequence;
+        unit.anyPublished = true;
+        unit.restartPending = false;
+        unit.published++;
+        uint32_t latency = nowMs - batch[i].receivedMs;
+        if (latency > maxLatencyMs) {
+          maxLatencyMs = latency;
+        }
+      }
+    }
+  }
+
+  // Drain what is left and check every unit ended on its newest reading
+  ChildUpdate batch[SensorUplinkConfig::BATCH_MAX];
+  size_t count;
+  while ((count = gateway.takeBatch(batch, SensorUplinkConfig::BATCH_MAX)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      SimUnit& unit = units[batch[i].mac[5]];
+      unit.lastPublished = batch[i].reading.sequence;
+      TEST_ASSERT_EQUAL_UINT16(unit.lastAcceptedMv, batch[i].reading.millivolts);
+      unit.published++;
+    }
+  }
+  double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  const AggregatorStats& stats = gateway.getStats();
+  for (const SimUnit& unit : units) {
+    TEST_ASSERT_TRUE(unit.anyAccepted);
+    TEST_ASSERT_EQUAL_UINT16(unit.lastAccepted, unit.lastPublished);
+  }
+  TEST_ASSERT_EQUAL(UNITS, gateway.children());
+  TEST_ASSERT_EQUAL_UINT32(stats.frames, stats.accepted + stats.repeats + stats.invalid + stats.tableFull);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.invalid);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.tableFull);
+  TEST_ASSERT_GREATER_THAN(0, stats.repeats);
+  TEST_ASSERT_GREATER_THAN(0, stats.restarts);
+  TEST_ASSERT_LESS_OR_EQUAL(SensorUplinkConfig::BATCH_MAX, maxBatch);
+  TEST_ASSERT_LESS_OR_EQUAL(SensorUplinkConfig::BATCH_WINDOW_MS + TICK_MS, maxLatencyMs);
+  TEST_ASSERT_GREATER_THAN(sentReadings * 9 / 10, deliveredReadings);
+
+  char summary[200];
+  snprintf(summary, sizeof(summary),
+           "%u units, %u readings, %u frames (%u repeats, %u restarts), %u batches (%u failed), "
+           "max latency %u ms, %.1f ms host time",
+           (unsigned)UNITS, (unsigned)sentReadings, (unsigned)stats.frames, (unsigned)stats.repeats,
+           (unsigned)stats.restarts, (unsigned)batches, (unsigned)failedBatches, (unsigned)maxLatencyMs, elapsedMs);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_repeat_is_dropped);
+  RUN_TEST(test_cold_boot_restart_is_accepted);
+  RUN_TEST(test_newer_reading_supersedes_pending);
+  RUN_TEST(test_batch_ready_by_size_and_window);
+  RUN_TEST(test_requeue_after_failed_publish);
+  RUN_TEST(test_announce_once_per_interval);
+  RUN_TEST(test_table_full_and_invalid_frames);
+  RUN_TEST(test_idle_unit_gives_up_its_slot);
+
+  RUN_TEST(test_multi_node_load);
+
+  return UNITY_END();
+}
@@ -0,0 +1,413 @@
+/*
+ * Unit Tests for the Reading Log and History Query
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ *
+ * The log runs on FileFlash, a file-backed flash emulator with NOR write
+ * rules, so remounting, wrap-around, wear and power cuts part-way through
+ * a write are all exercised against real bytes. Readings are stored
+ * compressed, so how many fit in a sector depends on the data.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "flash_region.h"
+#include "reading_log.h"
+#include "history_query.h"
+
+using namespace FlashLog;
+using FlashLogConfig::SECTOR_SIZE;
+
+static const char* FLASH_FILE = "test_reading_log.bin";
+static const char* SCRATCH_FILE = "test_reading_log_scratch.bin";
+static const uint32_t T0 = 1718000000;  // June 2024
+static const uint32_t INTERVAL = 600;
+
+static FileFlash flash;
+
+void setUp() {
+  remove(FLASH_FILE);
+  TEST_ASSERT_TRUE(flash.open(FLASH_FILE, 8 * SECTOR_SIZE));
+}
+
+void tearDown() {
+  flash.close();
+  remove(FLASH_FILE);
+}
+
+static LogRecord recordAt(uint32_t i) {
+  LogRecord record;
+  record.time = T0 + i * INTERVAL;
+  record.millivolts = 12000 + i % 800;
+  record.percentage = 50 + i % 50;
+  record.status = i % 5;
+  return record;
+}
+
+static void appendRange(ReadingLog& log, uint32_t first, uint32_t count) {
+  for (uint32_t i = first; i < first + count; i++) {
+    TEST_ASSERT_TRUE(log.append(recordAt(i)));
+  }
+}
+
+static size_t countAll(ReadingLog& log) {
+  return log.query(0, 0xFFFFFFFE, [](const LogRecord&) { return true; });
+}
+
+// Checks that the log holds recordAt(first) .. recordAt(first + count - 1)
+static void assertHolds(ReadingLog& log, uint32_t first, uint32_t count) {
+  uint32_t expected = first;
+  size_t n = log.query(0, 0xFFFFFFFE, [&expected](const LogRecord& record) {
+    LogRecord want = recordAt(expected++);
+    TEST_ASSERT_EQUAL_UINT32(want.time, record.time);
+    TEST_ASSERT_EQUAL_UINT16(want.millivolts, record.millivolts);
+    TEST_ASSERT_EQUAL_UINT8(want.percentage, record.percentage);
+    TEST_ASSERT_EQUAL_UINT8(want.status, record.status);
+    return true;
+  });
+  TEST_ASSERT_EQUAL(count, n);
+}
+
+// Readings that fit in the first sector (the stream length varies with the data)
+static uint32_t recordsInFirstSector() {
+  FileFlash scratch;
+  TEST_ASSERT_TRUE(scratch.open(SCRATCH_FILE, 2 * SECTOR_SIZE));
+  ReadingLog log(scratch);
+  TEST_ASSERT_TRUE(log.mount());
+  uint32_t i = 0;
+  while (log.stats().usedSectors < 2) {
+    TEST_ASSERT_TRUE(log.append(recordAt(i++)));
+  }
+  scratch.close();
+  remove(SCRATCH_FILE);
+  return i - 1;
+}
+
+static std::string responseFor(ReadingLog& log, uint32_t from, uint32_t to, bool packed = false) {
+  std::string text;
+  HistoryRequest request = {from, to, packed};
+  size_t length = writeHistoryResponse(log, request, [&text](const uint8_t* part, size_t len) {
+    text.append(reinterpret_cast<const char*>(part), len);
+  });
+  TEST_ASSERT_EQUAL(text.size(), length);
+  return text;
+}
+
+// ============================================================================
+// TEST: Flash emulator
+// ============================================================================
+
+void test_file_flash_only_clears_bits() {
+  uint8_t value = 0x0F;
+  TEST_ASSERT_TRUE(flash.write(100, &value, 1));
+  value = 0xF3;
+  TEST_ASSERT_TRUE(flash.write(100, &value, 1));
+  TEST_ASSERT_TRUE(flash.read(100, &value, 1));
+  TEST_ASSERT_EQUAL_HEX8(0x03, value);
+
+  TEST_ASSERT_TRUE(flash.eraseSector(0));
+  TEST_ASSERT_TRUE(flash.read(100, &value, 1));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, value);
+  TEST_ASSERT_EQUAL_UINT32(1, flash.erasesOf(0));
+  TEST_ASSERT_FALSE(flash.eraseSector(100));  // Not sector aligned
+}
+
+// ============================================================================
+// TEST: Appending and queries
+// ============================================================================
+
+void test_empty_log() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  size_t n = log.query(0, 0xFFFFFFFE, [](const LogRecord&) { return true; });
+  TEST_ASSERT_EQUAL(0, n);
+  TEST_ASSERT_EQUAL_UINT32(0, log.stats().records);
+  TEST_ASSERT_EQUAL_UINT32(8, log.stats().sectors);
+}
+
+void test_query_returns_range_in_order() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  appendRange(log, 0, 3000);  // Several sectors
+
+  uint32_t expected = 100;
+  size_t n = log.query(recordAt(100).time, recordAt(199).time, [&expected](const LogRecord& record) {
+    LogRecord want = recordAt(expected++);
+    TEST_ASSERT_EQUAL_UINT32(want.time, record.time);
+    TEST_ASSERT_EQUAL_UINT16(want.millivolts, record.millivolts);
+    TEST_ASSERT_EQUAL_UINT8(want.percentage, record.percentage);
+    TEST_ASSERT_EQUAL_UINT8(want.status, record.status);
+    return true;
+  });
+  TEST_ASSERT_EQUAL(100, n);
+  assertHolds(log, 0, 3000);
+
+  // Between two readings, and before the first one
+  TEST_ASSERT_EQUAL(0, log.query(recordAt(5).time + 1, recordAt(6).time - 1, [](const LogRecord&) { return true; }));
+  TEST_ASSERT_EQUAL(1, log.query(0, T0, [](const LogRecord&) { return true; }));
+}
+
+void test_log_survives_remount() {
+  const uint32_t count = 2000;
+  {
+    ReadingLog log(flash);
+    TEST_ASSERT_TRUE(log.mount());
+    appendRange(log, 0, count);
+  }
+  flash.close();
+  TEST_ASSERT_TRUE(flash.open(FLASH_FILE, 8 * SECTOR_SIZE));
+
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  LogStats stats = log.stats();
+  TEST_ASSERT_EQUAL_UINT32(count, stats.records);
+  TEST_ASSERT_EQUAL_UINT32(T0, stats.oldest);
+  TEST_ASSERT_EQUAL_UINT32(recordAt(count - 1).time, stats.newest);
+
+  // Appending continues the head sector's stream where it ended
+  appendRange(log, count, 5);
+  assertHolds(log, 0, count + 5);
+}
+
+void test_query_reads_only_matching_sectors() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  appendRange(log, 0, 7000);
+  TEST_ASSERT_TRUE(log.stats().usedSectors >= 5);
+
+  // Ten readings: the sector holding them, at most its neighbour too
+  flash.reads = 0;
+  uint32_t first = 4000;
+  size_t n = log.query(recordAt(first).time, recordAt(first + 9).time, [](const LogRecord&) { return true; });
+  TEST_ASSERT_EQUAL(10, n);
+  TEST_ASSERT_LESS_OR_EQUAL(2, flash.reads);
+}
+
+// ============================================================================
+// TEST: Wrap-around and wear
+// ============================================================================
+
+void test_wrap_drops_oldest_sector() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  uint32_t total = 0;
+  while (log.stats().maxErases < 2) {  // Laps once, reusing sector 0
+    TEST_ASSERT_TRUE(log.append(recordAt(total++)));
+  }
+  appendRange(log, total, 100);
+  total += 100;
+
+  LogStats stats = log.stats();
+  TEST_ASSERT_EQUAL_UINT32(8, stats.usedSectors);
+  TEST_ASSERT_TRUE(stats.oldest > T0);
+  TEST_ASSERT_EQUAL_UINT32(recordAt(total - 1).time, stats.newest);
+  uint32_t dropped = (stats.oldest - T0) / INTERVAL;
+  TEST_ASSERT_EQUAL_UINT32(total - dropped, stats.records);
+  assertHolds(log, dropped, total - dropped);
+
+  // The head is found again after a remount
+  ReadingLog again(flash);
+  TEST_ASSERT_TRUE(again.mount());
+  TEST_ASSERT_TRUE(again.append(recordAt(total)));
+  TEST_ASSERT_EQUAL_UINT32(recordAt(total).time, again.stats().newest);
+  TEST_ASSERT_EQUAL_UINT32(stats.oldest, again.stats().oldest);
+  assertHolds(again, dropped, total - dropped + 1);
+}
+
+void test_erases_are_spread_evenly() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  appendRange(log, 0, 30000);  // Three laps and a bit
+
+  uint32_t low = 0xFFFFFFFF, high = 0;
+  for (uint32_t s = 0; s < 8; s++) {
+    low = flash.erasesOf(s) < low ? flash.erasesOf(s) : low;
+    high = flash.erasesOf(s) > high ? flash.erasesOf(s) : high;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(1, high - low);
+  TEST_ASSERT_TRUE(high >= 3);
+
+  // The erase counts kept in the sector headers agree
+  LogStats stats = log.stats();
+  TEST_ASSERT_EQUAL_UINT32(low, stats.minErases);
+  TEST_ASSERT_EQUAL_UINT32(high, stats.maxErases);
+}
+
+// ============================================================================
+// TEST: Power cuts
+// ============================================================================
+
+void test_record_cut_short_is_skipped() {
+  // recordAt() readings take three bytes: control, percentage and status
+  for (int32_t cut = 1; cut <= 2; cut++) {
+    setUp();
+    ReadingLog log(flash);
+    TEST_ASSERT_TRUE(log.mount());
+    appendRange(log, 0, 10);
+
+    flash.cutPowerAfter(cut);
+    TEST_ASSERT_FALSE(log.append(recordAt(10)));
+    flash.cutPowerAfter(-1);
+
+    ReadingLog rebooted(flash);
+    TEST_ASSERT_TRUE(rebooted.mount());
+    assertHolds(rebooted, 0, 10);
+
+    // The damaged stream is closed and appending continues in a new sector
+    appendRange(rebooted, 11, 3);
+    TEST_ASSERT_EQUAL(13, countAll(rebooted));
+    TEST_ASSERT_EQUAL_UINT32(13, rebooted.stats().records);
+    TEST_ASSERT_EQUAL_UINT32(2, rebooted.stats().usedSectors);
+    tearDown();
+  }
+  setUp();
+}
+
+void test_cut_while_opening_sector() {
+  const uint32_t fill = recordsInFirstSector();
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  appendRange(log, 0, fill);
+  TEST_ASSERT_EQUAL_UINT32(1, log.stats().usedSectors);
+
+  flash.cutPowerAfter(6);  // Sector 1 erased, header half written
+  TEST_ASSERT_FALSE(log.append(recordAt(fill)));
+  flash.cutPowerAfter(-1);
+
+  ReadingLog rebooted(flash);
+  TEST_ASSERT_TRUE(rebooted.mount());
+  TEST_ASSERT_EQUAL_UINT32(fill, rebooted.stats().records);
+  appendRange(rebooted, fill + 1, 2);
+  TEST_ASSERT_EQUAL(fill + 2, countAll(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(2, rebooted.stats().usedSectors);
+}
+
+// ============================================================================
+// TEST: History request and response
+// ============================================================================
+
+void test_parse_history_request() {
+  const uint32_t now = T0 + 86400;
+  HistoryRequest request;
+
+  TEST_ASSERT_TRUE(parseHistoryRequest("1718000000 1718003600", 21, now, request));
+  TEST_ASSERT_EQUAL_UINT32(T0, request.from);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 3600, request.to);
+
+  TEST_ASSERT_TRUE(parseHistoryRequest(" 1718000000\n", 12, now, request));
+  TEST_ASSERT_EQUAL_UINT32(now, request.to);
+
+  TEST_ASSERT_TRUE(parseHistoryRequest("-3600", 5, now, request));
+  TEST_ASSERT_EQUAL_UINT32(now - 3600, request.from);
+  TEST_ASSERT_EQUAL_UINT32(now, request.to);
+
+  TEST_ASSERT_FALSE(parseHistoryRequest("", 0, now, request));
+  TEST_ASSERT_FALSE(parseHistoryRequest("yesterday", 9, now, request));
+  TEST_ASSERT_FALSE(parseHistoryRequest("200 100", 7, now, request));     // from after to
+  TEST_ASSERT_FALSE(parseHistoryRequest("100 200 300", 11, now, request));
+  TEST_ASSERT_FALSE(parseHistoryRequest("99999999999", 11, now, request));
+  TEST_ASSERT_FALSE(request.packed);
+
+  TEST_ASSERT_TRUE(parseHistoryRequest("-3600 packed", 12, now, request));
+  TEST_ASSERT_TRUE(request.packed);
+  TEST_ASSERT_TRUE(parseHistoryRequest("1718000000 1718003600 packed\n", 29, now, request));
+  TEST_ASSERT_TRUE(request.packed);
+  TEST_ASSERT_EQUAL_UINT32(T0 + 3600, request.to);
+  TEST_ASSERT_FALSE(parseHistoryRequest("1718000000 packedx", 18, now, request));
+}
+
+void test_response_format() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  appendRange(log, 0, 3);
+
+  std::string text = responseFor(log, T0, T0 + 600);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"from\":1718000000,\"to\":1718000600,"
+      "\"readings\":[[1718000000,12000,50,0],[1718000600,12001,51,1]],\"count\":2}",
+      text.c_str());
+
+  text = responseFor(log, 0, 100);
+  TEST_ASSERT_EQUAL_STRING("{\"from\":0,\"to\":100,\"readings\":[],\"count\":0}", text.c_str());
+}
+
+void test_response_is_paged() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  const uint32_t total = FlashLogConfig::HISTORY_MAX_READINGS + 20;
+  appendRange(log, 0, total);
+
+  std::string text = responseFor(log, 0, 0xFFFFFFFE);
+  char tail[64];
+  snprintf(tail, sizeof(tail), "],\"count\":%u,\"next\":%lu}", (unsigned)FlashLogConfig::HISTORY_MAX_READINGS,
+           (unsigned long)recordAt(FlashLogConfig::HISTORY_MAX_READINGS).time);
+  TEST_ASSERT_TRUE(text.size() > strlen(tail));
+  TEST_ASSERT_EQUAL_STRING(tail, text.c_str() + text.size() - strlen(tail));
+
+  // The follow-up request returns the rest
+  text = responseFor(log, recordAt(FlashLogConfig::HISTORY_MAX_READINGS).time, 0xFFFFFFFE);
+  TEST_ASSERT_TRUE(text.find("\"count\":20}") != std::string::npos);
+}
+
+void test_packed_response() {
+  ReadingLog log(flash);
+  TEST_ASSERT_TRUE(log.mount());
+  const uint32_t total = FlashLogConfig::HISTORY_MAX_PACKED + 20;
+  appendRange(log, 0, total);
+
+  std::string packed = responseFor(log, 0, 0xFFFFFFFE, true);
+  std::string json = responseFor(log, 0, recordAt(FlashLogConfig::HISTORY_MAX_READINGS - 1).time);
+  // A fraction of the JSON size per reading
+  TEST_ASSERT_LESS_OR_EQUAL(json.size() / FlashLogConfig::HISTORY_MAX_READINGS * 2 / 10,
+                            packed.size() / FlashLogConfig::HISTORY_MAX_PACKED);
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(packed.data());
+  TEST_ASSERT_EQUAL_HEX8(FlashLogConfig::HISTORY_PACKED_VERSION, data[0]);
+  SeriesCodec::Decoder decoder(data + 1, packed.size() - 1);
+  LogRecord record;
+  uint32_t i = 0;
+  while (decoder.next(record)) {
+    TEST_ASSERT_EQUAL_UINT32(recordAt(i).time, record.time);
+    TEST_ASSERT_EQUAL_UINT16(recordAt(i).millivolts, record.millivolts);
+    i++;
+  }
+  TEST_ASSERT_FALSE(decoder.malformed());
+  TEST_ASSERT_EQUAL_UINT32(FlashLogConfig::HISTORY_MAX_PACKED, i);
+
+  // Trailer: END, count, next
+  size_t p = 1 + decoder.position();
+  TEST_ASSERT_EQUAL_HEX8(SeriesCodecConfig::END, data[p++]);
+  uint32_t count, next;
+  p += SeriesCodec::getVarint(data + p, packed.size() - p, count);
+  p += SeriesCodec::getVarint(data + p, packed.size() - p, next);
+  TEST_ASSERT_EQUAL_UINT32(FlashLogConfig::HISTORY_MAX_PACKED, count);
+  TEST_ASSERT_EQUAL_UINT32(recordAt(FlashLogConfig::HISTORY_MAX_PACKED).time, next);
+  TEST_ASSERT_EQUAL(packed.size(), p);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_file_flash_only_clears_bits);
+
+  RUN_TEST(test_empty_log);
+  RUN_TEST(test_query_returns_range_in_order);
+  RUN_TEST(test_log_survives_remount);
+  RUN_TEST(test_query_reads_only_matching_sectors);
+
+  RUN_TEST(test_wrap_drops_oldest_sector);
+  RUN_TEST(test_erases_are_spread_evenly);
+
+  RUN_TEST(test_record_cut_short_is_skipped);
+  RUN_TEST(test_cut_while_opening_sector);
+
+  RUN_TEST(test_parse_history_request);
+  RUN_TEST(test_response_format);
+  RUN_TEST(test_response_is_paged);
+  RUN_TEST(test_packed_response);
+
+  return UNITY_END();
+}
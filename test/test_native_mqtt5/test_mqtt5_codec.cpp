@@ -0,0 +1,448 @@
+/*
+ * Unit Tests for the MQTT 5 Packet Codec
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ *
+ * The broker round-trip test talks to a local Mosquitto (2.x, MQTT 5 enabled)
+ * on 127.0.0.1:1883, or the host:port in MQTT5_TEST_BROKER. It is skipped
+ * when no broker answers:
+ *   mosquitto -p 1883 &
+ *   pio test -e native
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "mqtt5_codec.h"
+
+using namespace Mqtt5;
+
+void setUp() {}
+void tearDown() {}
+
+static Mqtt5::ConnectOptions defaultOptions(const char* clientId) {
+  Mqtt5::ConnectOptions options = {};
+  options.clientId = clientId;
+  options.keepAliveSec = 15;
+  return options;
+}
+
+// ============================================================================
+// TEST: Encoding
+// ============================================================================
+
+void test_connect_with_session_expiry() {
+  Mqtt5::ConnectOptions options = defaultOptions("dev");
+  options.sessionExpirySec = 7260;
+
+  uint8_t buf[64];
+  size_t len = encodeConnect(buf, sizeof(buf), options);
+
+  const uint8_t expected[] = {
+    0x10, 21,                                  // CONNECT, remaining length
+    0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05,      // Protocol name and version
+    0x00,                                      // Flags: clean start off
+    0x00, 0x0F,                                // Keep alive 15 s
+    0x05, 0x11, 0x00, 0x00, 0x1C, 0x5C,        // Session Expiry Interval 7260
+    0x00, 0x03, 'd', 'e', 'v'                  // Client ID
+  };
+  TEST_ASSERT_EQUAL(sizeof(expected), len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_connect_with_credentials_and_will() {
+  Mqtt5::ConnectOptions options = defaultOptions("dev");
+  options.username = "u";
+  options.password = "p";
+  options.willTopic = "w";
+  options.willPayload = "offline";
+  options.willQos = 1;
+  options.willRetain = true;
+  options.cleanStart = true;
+
+  uint8_t buf[64];
+  size_t len = encodeConnect(buf, sizeof(buf), options);
+  TEST_ASSERT_GREATER_THAN(0, len);
+  TEST_ASSERT_EQUAL_HEX8(0x80 | 0x40 | 0x20 | 0x08 | 0x04 | 0x02, buf[9]);
+}
+
+void test_publish_alias_sends_topic_once() {
+  const uint8_t payload[] = {'1', '2', '.', '6'};
+  uint8_t first[64];
+  uint8_t second[64];
+
+  size_t firstLen = encodePublish(first, sizeof(first), "host_voltage/state", 1, payload, 4, true);
+  size_t secondLen = encodePublish(second, sizeof(second), "", 1, payload, 4, true);
+
+  // Topic (2 + 18) dropped on the second publish
+  TEST_ASSERT_EQUAL(firstLen - 18, secondLen);
+  TEST_ASSERT_EQUAL_HEX8(0x31, second[0]);              // PUBLISH, retain
+  const uint8_t body[] = {0x00, 0x00, 0x03, 0x23, 0x00, 0x01, '1', '2', '.', '6'};
+  TEST_ASSERT_EQUAL(sizeof(body), second[1]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(body, second + 2, sizeof(body));
+}
+
+void test_subscribe_encoding() {
+  uint8_t buf[64];
+  size_t len = encodeSubscribe(buf, sizeof(buf), 7, "a/ota", 1);
+  const uint8_t expected[] = {0x82, 11, 0x00, 0x07, 0x00, 0x00, 0x05, 'a', '/', 'o', 't', 'a', 0x01};
+  TEST_ASSERT_EQUAL(sizeof(expected), len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_encode_rejects_small_buffer() {
+  uint8_t buf[16];
+  uint8_t payload[32] = {0};
+  TEST_ASSERT_EQUAL(0, encodePublish(buf, sizeof(buf), "topic", 0, payload, sizeof(payload), false));
+}
+
+void test_large_remaining_length() {
+  static uint8_t buf[400];
+  static uint8_t payload[300];
+  size_t len = encodePublish(buf, sizeof(buf), "t", 0, payload, sizeof(payload), false);
+
+  uint8_t type, flags;
+  uint32_t remaining;
+  int header = decodeFixedHeader(buf, len, type, flags, remaining);
+  TEST_ASSERT_EQUAL(3, header);                         // Two-byte remaining length
+  TEST_ASSERT_EQUAL(PUBLISH, type);
+  TEST_ASSERT_EQUAL(len - 3, remaining);
+}
+
+void test_streamed_publish_header_matches_publish() {
+  static uint8_t whole[2100];
+  static uint8_t payload[2000];
+  for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)i;
+  size_t wholeLen = encodePublish(whole, sizeof(whole), "homeassistant/device/host/config", 0, payload, sizeof(payload), true);
+
+  // Header alone, with the payload counted but not written
+  uint8_t header[64];
+  size_t headerLen = encodePublishHeader(header, sizeof(header), "homeassistant/device/host/config", sizeof(payload), true);
+  TEST_ASSERT_EQUAL(wholeLen - sizeof(payload), headerLen);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(whole, header, headerLen);
+}
+
+// ============================================================================
+// TEST: Decoding
+// ============================================================================
+
+void test_connack_properties() {
+  const uint8_t body[] = {
+    0x01, 0x00,                         // Session present, success
+    19,                                 // Property length
+    0x22, 0x00, 0x0A,                   // Topic Alias Maximum 10
+    0x1F, 0x00, 0x02, 'o', 'k',         // Reason string
+    0x26, 0x00, 0x01, 'a', 0x00, 0x01, 'b',  // User property (skipped)
+    0x24, 0x01,                         // Maximum QoS 1
+    0x25, 0x00                          // Retain not available
+  };
+  Connack connack;
+  TEST_ASSERT_TRUE(decodeConnack(body, sizeof(body), connack));
+  TEST_ASSERT_TRUE(connack.sessionPresent);
+  TEST_ASSERT_EQUAL(0, connack.reason);
+  TEST_ASSERT_EQUAL(10, connack.topicAliasMax);
+  TEST_ASSERT_EQUAL_STRING("ok", connack.reasonString);
+  TEST_ASSERT_EQUAL(1, connack.maxQos);
+  TEST_ASSERT_FALSE(connack.retainAvailable);
+}
+
+void test_connack_error_without_properties() {
+  const uint8_t body[] = {0x00, 0x87};
+  Connack connack;
+  TEST_ASSERT_TRUE(decodeConnack(body, sizeof(body), connack));
+  TEST_ASSERT_FALSE(connack.sessionPresent);
+  TEST_ASSERT_EQUAL_HEX8(NOT_AUTHORIZED, connack.reason);
+  TEST_ASSERT_EQUAL_STRING("Not authorized", reasonName(connack.reason));
+}
+
+void test_connack_truncated_property() {
+  const uint8_t body[] = {0x00, 0x00, 0x03, 0x22, 0x00};
+  Connack connack;
+  TEST_ASSERT_FALSE(decodeConnack(body, sizeof(body), connack));
+}
+
+void test_suback_reason_codes() {
+  const uint8_t body[] = {0x00, 0x05, 0x00, 0x01, 0x87};
+  Suback suback;
+  TEST_ASSERT_TRUE(decodeSuback(body, sizeof(body), suback));
+  TEST_ASSERT_EQUAL(5, suback.packetId);
+  TEST_ASSERT_EQUAL(2, suback.count);
+  TEST_ASSERT_EQUAL_HEX8(GRANTED_QOS_1, suback.reasons[0]);
+  TEST_ASSERT_EQUAL_HEX8(NOT_AUTHORIZED, suback.reasons[1]);
+}
+
+void test_disconnect_reason_string() {
+  const uint8_t body[] = {0x8E, 0x05, 0x1F, 0x00, 0x02, 'h', 'i'};
+  Disconnect disconnect;
+  TEST_ASSERT_TRUE(decodeDisconnect(body, sizeof(body), disconnect));
+  TEST_ASSERT_EQUAL_HEX8(SESSION_TAKEN_OVER, disconnect.reason);
+  TEST_ASSERT_EQUAL_STRING("hi", disconnect.reasonString);
+}
+
+void test_publish_decode_qos1() {
+  const uint8_t body[] = {0x00, 0x03, 'o', 't', 'a', 0x12, 0x34, 0x00, 'v', '1'};
+  Publish publish;
+  TEST_ASSERT_TRUE(decodePublish(0x02, body, sizeof(body), publish));
+  TEST_ASSERT_EQUAL(1, publish.qos);
+  TEST_ASSERT_EQUAL_HEX16(0x1234, publish.packetId);
+  TEST_ASSERT_EQUAL(3, publish.topicLen);
+  TEST_ASSERT_EQUAL_MEMORY("ota", publish.topic, 3);
+  TEST_ASSERT_EQUAL(2, publish.payloadLen);
+  TEST_ASSERT_EQUAL_MEMORY("v1", publish.payload, 2);
+}
+
+void test_fixed_header_incomplete_and_malformed() {
+  uint8_t type, flags;
+  uint32_t remaining;
+  const uint8_t incomplete[] = {0x30, 0x80};
+  TEST_ASSERT_EQUAL(0, decodeFixedHeader(incomplete, sizeof(incomplete), type, flags, remaining));
+  const uint8_t malformed[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  TEST_ASSERT_EQUAL(-1, decodeFixedHeader(malformed, sizeof(malformed), type, flags, remaining));
+}
+
+// ============================================================================
+// TEST: Topic Aliases
+// ============================================================================
+
+void test_topic_aliases_reuse_and_limit() {
+  TopicAliases aliases;
+  aliases.reset(2);
+  bool isNew;
+
+  TEST_ASSERT_EQUAL(1, aliases.lookup("a", isNew));
+  TEST_ASSERT_TRUE(isNew);
+  TEST_ASSERT_EQUAL(2, aliases.lookup("b", isNew));
+  TEST_ASSERT_EQUAL(1, aliases.lookup("a", isNew));
+  TEST_ASSERT_FALSE(isNew);
+  TEST_ASSERT_EQUAL(0, aliases.lookup("c", isNew));   // Broker allows only two
+  TEST_ASSERT_FALSE(isNew);
+
+  aliases.reset(0);                                    // Broker without aliases
+  TEST_ASSERT_EQUAL(0, aliases.lookup("a", isNew));
+}
+
+// ============================================================================
+// TEST: Keep Alive
+// ============================================================================
+
+// Loop every 10 ms for two keep-alive periods; the broker answers each
+// PINGREQ after 40 ms. The connection must survive without a timeout.
+void test_keep_alive_survives_answered_pings() {
+  KeepAlive keepAlive;
+  keepAlive.reset(15, 0);
+
+  unsigned long answerAt = 0;
+  int pings = 0;
+  for (unsigned long now = 10; now <= 2 * 15000 + 100; now += 10) {
+    if (answerAt != 0 && now >= answerAt) {
+      keepAlive.received(now);   // PINGRESP read before the check
+      keepAlive.pingAnswered();
+      answerAt = 0;
+    }
+    KeepAlive::Action action = keepAlive.poll(now);
+    TEST_ASSERT_NOT_EQUAL(KeepAlive::TIMED_OUT, action);
+    if (action == KeepAlive::SEND_PING) {
+      keepAlive.pingSent(now);
+      answerAt = now + 40;
+      pings++;
+    }
+  }
+  TEST_ASSERT_EQUAL(2, pings);
+}
+
+void test_keep_alive_waits_a_period_for_pingresp() {
+  KeepAlive keepAlive;
+  keepAlive.reset(15, 0);
+
+  TEST_ASSERT_EQUAL(KeepAlive::NONE, keepAlive.poll(14999));
+  TEST_ASSERT_EQUAL(KeepAlive::SEND_PING, keepAlive.poll(15000));
+  keepAlive.pingSent(15000);
+
+  // Nothing received since connect, but the PINGREQ has just gone out
+  TEST_ASSERT_EQUAL(KeepAlive::NONE, keepAlive.poll(15010));
+  TEST_ASSERT_EQUAL(KeepAlive::NONE, keepAlive.poll(29999));
+  TEST_ASSERT_EQUAL(KeepAlive::TIMED_OUT, keepAlive.poll(30000));
+}
+
+void test_keep_alive_pings_when_only_inbound_idle() {
+  KeepAlive keepAlive;
+  keepAlive.reset(15, 0);
+
+  keepAlive.sent(10000);   // Publishing, but the broker has sent nothing
+  TEST_ASSERT_EQUAL(KeepAlive::SEND_PING, keepAlive.poll(15000));
+
+  keepAlive.reset(0, 0);   // Keep-alive disabled
+  TEST_ASSERT_EQUAL(KeepAlive::NONE, keepAlive.poll(1000000));
+}
+
+// ============================================================================
+// TEST: Local Broker Round Trip
+// ============================================================================
+
+static int openBroker() {
+  const char* target = getenv("MQTT5_TEST_BROKER");
+  char host[64] = "127.0.0.1";
+  char port[8] = "1883";
+  if (target != nullptr) {
+    const char* colon = strchr(target, ':');
+    size_t hostLen = colon ? (size_t)(colon - target) : strlen(target);
+    if (hostLen >= sizeof(host)) hostLen = sizeof(host) - 1;
+    memcpy(host, target, hostLen);
+    host[hostLen] = '\0';
+    if (colon) strncpy(port, colon + 1, sizeof(port) - 1);
+  }
+
+  struct addrinfo hints = {};
+  struct addrinfo* result = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &result) != 0) return -1;
+
+  int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  struct timeval timeout = {2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+static bool sendPacket(int fd, const uint8_t* buf, size_t len) {
+  return len > 0 && send(fd, buf, len, 0) == (ssize_t)len;
+}
+
+// Reads one packet; body goes to buf, returns its length or -1
+static int readPacket(int fd, uint8_t* buf, size_t cap, uint8_t& type, uint8_t& flags) {
+  uint8_t header[5];
+  size_t have = 0;
+  uint32_t remaining = 0;
+  int headerLen = 0;
+  while (headerLen == 0 && have < sizeof(header)) {
+    if (recv(fd, header + have, 1, 0) != 1) return -1;
+    have++;
+    headerLen = decodeFixedHeader(header, have, type, flags, remaining);
+    if (headerLen < 0) return -1;
+  }
+  if (remaining > cap) return -1;
+  size_t got = 0;
+  while (got < remaining) {
+    ssize_t n = recv(fd, buf + got, remaining - got, 0);
+    if (n <= 0) return -1;
+    got += n;
+  }
+  return (int)remaining;
+}
+
+static bool connectSession(int fd, const char* clientId, bool cleanStart, Connack& connack) {
+  Mqtt5::ConnectOptions options = defaultOptions(clientId);
+  options.cleanStart = cleanStart;
+  options.sessionExpirySec = 60;
+  options.maxPacketSize = 1024;
+
+  uint8_t buf[256];
+  if (!sendPacket(fd, buf, encodeConnect(buf, sizeof(buf), options))) return false;
+  uint8_t type, flags;
+  int len = readPacket(fd, buf, sizeof(buf), type, flags);
+  return len >= 0 && type == CONNACK && decodeConnack(buf, len, connack);
+}
+
+void test_local_broker_roundtrip() {
+  int fd = openBroker();
+  if (fd < 0) {
+    TEST_IGNORE_MESSAGE("No MQTT 5 broker on 127.0.0.1:1883 (set MQTT5_TEST_BROKER)");
+  }
+
+  char clientId[32];
+  char topic[64];
+  snprintf(clientId, sizeof(clientId), "bm-test-%d", (int)getpid());
+  snprintf(topic, sizeof(topic), "batterymonitor/test/%d", (int)getpid());
+
+  Connack connack;
+  TEST_ASSERT_TRUE(connectSession(fd, clientId, true, connack));
+  TEST_ASSERT_EQUAL_HEX8(SUCCESS, connack.reason);
+  TEST_ASSERT_FALSE(connack.sessionPresent);
+
+  uint8_t buf[1024];
+  uint8_t type, flags;
+  TEST_ASSERT_TRUE(sendPacket(fd, buf, encodeSubscribe(buf, sizeof(buf), 1, topic, 1)));
+  int len = readPacket(fd, buf, sizeof(buf), type, flags);
+  Suback suback;
+  TEST_ASSERT_EQUAL(SUBACK, type);
+  TEST_ASSERT_TRUE(decodeSuback(buf, len, suback));
+  TEST_ASSERT_EQUAL_HEX8(GRANTED_QOS_1, suback.reasons[0]);
+
+  // Publish twice through an alias; the broker must resolve the second one
+  TopicAliases aliases;
+  aliases.reset(connack.topicAliasMax);
+  for (int i = 0; i < 2; i++) {
+    bool isNew;
+    uint16_t alias = aliases.lookup(topic, isNew);
+    const char* sendTopic = (alias == 0 || isNew) ? topic : "";
+    const uint8_t payload[] = {(uint8_t)('0' + i)};
+    TEST_ASSERT_TRUE(sendPacket(fd, buf, encodePublish(buf, sizeof(buf), sendTopic, alias, payload, 1, false)));
+
+    len = readPacket(fd, buf, sizeof(buf), type, flags);
+    Publish publish;
+    TEST_ASSERT_EQUAL(PUBLISH, type);
+    TEST_ASSERT_TRUE(decodePublish(flags, buf, len, publish));
+    TEST_ASSERT_EQUAL(strlen(topic), publish.topicLen);
+    TEST_ASSERT_EQUAL_MEMORY(topic, publish.topic, publish.topicLen);
+    TEST_ASSERT_EQUAL_UINT8('0' + i, publish.payload[0]);
+    if (publish.qos == 1) {
+      uint8_t ack[8];
+      sendPacket(fd, ack, encodePuback(ack, sizeof(ack), publish.packetId));
+    }
+  }
+
+  // A normal DISCONNECT keeps the session for its expiry interval
+  TEST_ASSERT_TRUE(sendPacket(fd, buf, encodeDisconnect(buf, sizeof(buf))));
+  close(fd);
+
+  fd = openBroker();
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_TRUE(connectSession(fd, clientId, false, connack));
+  TEST_ASSERT_EQUAL_HEX8(SUCCESS, connack.reason);
+  TEST_ASSERT_TRUE(connack.sessionPresent);
+
+  // The test session expires on the broker 60 s after this
+  sendPacket(fd, buf, encodeDisconnect(buf, sizeof(buf)));
+  close(fd);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_connect_with_session_expiry);
+  RUN_TEST(test_connect_with_credentials_and_will);
+  RUN_TEST(test_publish_alias_sends_topic_once);
+  RUN_TEST(test_subscribe_encoding);
+  RUN_TEST(test_encode_rejects_small_buffer);
+  RUN_TEST(test_large_remaining_length);
+  RUN_TEST(test_streamed_publish_header_matches_publish);
+
+  RUN_TEST(test_connack_properties);
+  RUN_TEST(test_connack_error_without_properties);
+  RUN_TEST(test_connack_truncated_property);
+  RUN_TEST(test_suback_reason_codes);
+  RUN_TEST(test_disconnect_reason_string);
+  RUN_TEST(test_publish_decode_qos1);
+  RUN_TEST(test_fixed_header_incomplete_and_malformed);
+
+  RUN_TEST(test_topic_aliases_reuse_and_limit);
+
+  RUN_TEST(test_keep_alive_survives_answered_pings);
+  RUN_TEST(test_keep_alive_waits_a_period_for_pingresp);
+  RUN_TEST(test_keep_alive_pings_when_only_inbound_idle);
+
+  RUN_TEST(test_local_broker_roundtrip);
+
+  return UNITY_END();
+}
@@ -0,0 +1,242 @@
+/*
+ * Unit Tests for the Sensor Uplink (reading frames and frame sender)
+ *
+ * Runs on the host, no hardware required:
+ *   pio test -e native
+ *
+ * The ESP-NOW radio is replaced by LoopbackLink, so frame encoding, the
+ * retry policy and the gateway channel sweep run in-process.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "sensor_frame.h"
+#include "frame_sender.h"
+
+using namespace SensorUplink;
+
+void setUp() {}
+void tearDown() {}
+
+static SensorReading sampleReading() {
+  SensorReading reading = {};
+  reading.sequence = 4711;
+  reading.millivolts = 12650;
+  reading.percentage = 93.5f;
+  reading.status = 1;
+  reading.lifepo4 = true;
+  reading.coldBoot = false;
+  reading.bootCount = 70001;
+  reading.nextReadingSec = 3600;
+  return reading;
+}
+
+// ============================================================================
+// TEST: Frame encoding
+// ============================================================================
+
+void test_frame_roundtrip() {
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  TEST_ASSERT_EQUAL(SensorUplinkConfig::FRAME_SIZE, encodeFrame(sampleReading(), frame, sizeof(frame)));
+
+  SensorReading decoded;
+  TEST_ASSERT_TRUE(decodeFrame(frame, sizeof(frame), decoded));
+  TEST_ASSERT_EQUAL_UINT16(4711, decoded.sequence);
+  TEST_ASSERT_EQUAL_UINT16(12650, decoded.millivolts);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 93.5f, decoded.percentage);
+  TEST_ASSERT_EQUAL_UINT8(1, decoded.status);
+  TEST_ASSERT_TRUE(decoded.lifepo4);
+  TEST_ASSERT_FALSE(decoded.coldBoot);
+  TEST_ASSERT_EQUAL_UINT32(70001, decoded.bootCount);
+  TEST_ASSERT_EQUAL_UINT16(3600, decoded.nextReadingSec);
+}
+
+void test_frame_layout_is_little_endian() {
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  encodeFrame(sampleReading(), frame, sizeof(frame));
+
+  TEST_ASSERT_EQUAL_HEX8(SensorUplinkConfig::FRAME_VERSION, frame[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, frame[1]);                // LiFePO4, not a cold boot
+  TEST_ASSERT_EQUAL_HEX8(4711 & 0xFF, frame[2]);
+  TEST_ASSERT_EQUAL_HEX8(4711 >> 8, frame[3]);
+  TEST_ASSERT_EQUAL_HEX8(12650 & 0xFF, frame[4]);
+  TEST_ASSERT_EQUAL_UINT8(187, frame[6]);                // 93.5 % in 0.5 % steps
+}
+
+void test_percentage_is_clamped() {
+  SensorReading reading = sampleReading();
+  reading.percentage = 140.0f;
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  encodeFrame(reading, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT8(200, frame[6]);
+
+  reading.percentage = -5.0f;
+  encodeFrame(reading, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT8(0, frame[6]);
+}
+
+void test_encode_rejects_small_buffer() {
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE - 1];
+  TEST_ASSERT_EQUAL(0, encodeFrame(sampleReading(), frame, sizeof(frame)));
+}
+
+void test_crc_check_value() {
+  // CRC-16/CCITT-FALSE check value
+  const char* check = "123456789";
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(reinterpret_cast<const uint8_t*>(check), 9));
+}
+
+void test_decode_rejects_corrupt_frames() {
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  encodeFrame(sampleReading(), frame, sizeof(frame));
+  SensorReading decoded;
+
+  TEST_ASSERT_FALSE(decodeFrame(frame, sizeof(frame) - 1, decoded));
+
+  for (size_t i = 0; i < sizeof(frame); i++) {
+    uint8_t flipped[SensorUplinkConfig::FRAME_SIZE];
+    memcpy(flipped, frame, sizeof(frame));
+    flipped[i] ^= 0x10;
+    TEST_ASSERT_FALSE_MESSAGE(decodeFrame(flipped, sizeof(flipped), decoded), "single bit flip accepted");
+  }
+}
+
+void test_decode_rejects_unknown_version() {
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  encodeFrame(sampleReading(), frame, sizeof(frame));
+  frame[0] = SensorUplinkConfig::FRAME_VERSION + 1;
+  uint16_t crc = crc16(frame, 14);
+  frame[14] = crc & 0xFF;
+  frame[15] = crc >> 8;
+
+  SensorReading decoded;
+  TEST_ASSERT_FALSE(decodeFrame(frame, sizeof(frame), decoded));
+}
+
+void test_sequence_wraps() {
+  TEST_ASSERT_TRUE(sequenceNewer(2, 1));
+  TEST_ASSERT_FALSE(sequenceNewer(1, 1));
+  TEST_ASSERT_FALSE(sequenceNewer(1, 2));
+  TEST_ASSERT_TRUE(sequenceNewer(0, 0xFFFF));
+  TEST_ASSERT_TRUE(sequenceNewer(5, 0xFFF0));
+  TEST_ASSERT_FALSE(sequenceNewer(0xFFF0, 5));
+}
+
+// ============================================================================
+// TEST: Frame sender over the loopback link
+// ============================================================================
+
+struct Gateway {
+  std::vector<SensorReading> received;
+  void attach(LoopbackLink& link) {
+    link.setReceiver([this](const uint8_t* frame, size_t len) {
+      SensorReading reading;
+      if (decodeFrame(frame, len, reading)) {
+        received.push_back(reading);
+      }
+    });
+  }
+};
+
+void test_send_on_known_channel() {
+  LoopbackLink link(6);
+  Gateway gateway;
+  gateway.attach(link);
+
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  size_t len = encodeFrame(sampleReading(), frame, sizeof(frame));
+  FrameSender sender(link);
+  SendResult result = sender.send(frame, len, 6);
+
+  TEST_ASSERT_TRUE(result.delivered);
+  TEST_ASSERT_EQUAL_UINT8(6, result.channel);
+  TEST_ASSERT_EQUAL_UINT8(1, result.attempts);
+  TEST_ASSERT_EQUAL_UINT32(0, link.waitedMs);
+  TEST_ASSERT_EQUAL(1, gateway.received.size());
+  TEST_ASSERT_EQUAL_UINT16(4711, gateway.received[0].sequence);
+}
+
+void test_retries_with_backoff_after_losses() {
+  LoopbackLink link(6);
+  Gateway gateway;
+  gateway.attach(link);
+  link.dropNext(SensorUplinkConfig::ATTEMPTS_ON_KNOWN_CHANNEL - 1);
+
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  size_t len = encodeFrame(sampleReading(), frame, sizeof(frame));
+  FrameSender sender(link);
+  SendResult result = sender.send(frame, len, 6);
+
+  TEST_ASSERT_TRUE(result.delivered);
+  TEST_ASSERT_EQUAL_UINT8(6, result.channel);
+  TEST_ASSERT_EQUAL_UINT8(SensorUplinkConfig::ATTEMPTS_ON_KNOWN_CHANNEL, result.attempts);
+  // Delays double: 4 + 8 ms for three attempts
+  TEST_ASSERT_EQUAL_UINT32(SensorUplinkConfig::RETRY_DELAY_MS * 3, link.waitedMs);
+  TEST_ASSERT_EQUAL(1, gateway.received.size());
+}
+
+void test_sweep_finds_moved_gateway() {
+  LoopbackLink link(11);
+  Gateway gateway;
+  gateway.attach(link);
+
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  size_t len = encodeFrame(sampleReading(), frame, sizeof(frame));
+  FrameSender sender(link);
+  SendResult result = sender.send(frame, len, 6);
+
+  TEST_ASSERT_TRUE(result.delivered);
+  TEST_ASSERT_EQUAL_UINT8(11, result.channel);
+  // Known channel attempts, then channels 1-5 and 7-10 once each
+  TEST_ASSERT_EQUAL_UINT8(SensorUplinkConfig::ATTEMPTS_ON_KNOWN_CHANNEL + 10, result.attempts);
+  TEST_ASSERT_EQUAL(1, gateway.received.size());
+}
+
+void test_unknown_channel_sweeps_from_one() {
+  LoopbackLink link(3);
+  FrameSender sender(link);
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  size_t len = encodeFrame(sampleReading(), frame, sizeof(frame));
+
+  SendResult result = sender.send(frame, len, 0);
+  TEST_ASSERT_TRUE(result.delivered);
+  TEST_ASSERT_EQUAL_UINT8(3, result.channel);
+  TEST_ASSERT_EQUAL_UINT8(3, result.attempts);
+  TEST_ASSERT_EQUAL_UINT32(0, link.waitedMs);
+}
+
+void test_gives_up_without_gateway() {
+  LoopbackLink link(14);  // Outside the swept channels: nobody answers
+  FrameSender sender(link);
+  uint8_t frame[SensorUplinkConfig::FRAME_SIZE];
+  size_t len = encodeFrame(sampleReading(), frame, sizeof(frame));
+
+  SendResult result = sender.send(frame, len, 6);
+  TEST_ASSERT_FALSE(result.delivered);
+  TEST_ASSERT_EQUAL_UINT8(0, result.channel);
+  TEST_ASSERT_EQUAL_UINT8(SensorUplinkConfig::ATTEMPTS_ON_KNOWN_CHANNEL + SensorUplinkConfig::MAX_CHANNEL - 1,
+                          result.attempts);
+  TEST_ASSERT_EQUAL_UINT32(0, link.framesDelivered);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_frame_roundtrip);
+  RUN_TEST(test_frame_layout_is_little_endian);
+  RUN_TEST(test_percentage_is_clamped);
+  RUN_TEST(test_encode_rejects_small_buffer);
+  RUN_TEST(test_crc_check_value);
+  RUN_TEST(test_decode_rejects_corrupt_frames);
+  RUN_TEST(test_decode_rejects_unknown_version);
+  RUN_TEST(test_sequence_wraps);
+
+  RUN_TEST(test_send_on_known_channel);
+  RUN_TEST(test_retries_with_backoff_after_losses);
+  RUN_TEST(test_sweep_finds_moved_gateway);
+  RUN_TEST(test_unknown_channel_sweeps_from_one);
+  RUN_TEST(test_gives_up_without_gateway);
+
+  return UNITY_END();
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""
+Compress a firmware image for streamed OTA updates.
+
+The output is the "BMHS" format decoded on the device by
+lib/OTAPatch/compressed_image.cpp: a 44 byte header followed by the
+heatshrink-compressed image. The device tries <name>.bin.hs before
+falling back to <name>.bin.
+
+Usage:
+    compress_firmware.py firmware.bin [firmware.bin.hs] [--window 10] [--lookahead 5]
+
+Requires: pip install heatshrink2
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+import heatshrink2
+
+FORMAT_VERSION = 1
+
+
+def compress_image(image, window, lookahead):
+    header = b"BMHS" + struct.pack("<BBBBI", FORMAT_VERSION, window, lookahead, 0, len(image))
+    header += hashlib.sha256(image).digest()
+    return header + heatshrink2.compress(image, window_sz2=window, lookahead_sz2=lookahead)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image")
+    parser.add_argument("out", nargs="?")
+    parser.add_argument("--window", type=int, default=10, help="heatshrink window bits (max 12)")
+    parser.add_argument("--lookahead", type=int, default=5, help="heatshrink lookahead bits")
+    args = parser.parse_args()
+
+    out = args.out or args.image + ".hs"
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    compressed = compress_image(image, args.window, args.lookahead)
+    with open(out, "wb") as f:
+        f.write(compressed)
+
+    print(f"{out}: {len(compressed)} bytes ({100.0 * len(compressed) / len(image):.1f}% of {len(image)} byte image)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
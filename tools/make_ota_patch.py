@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Build a delta OTA patch between two firmware images.
+
+The output is the streaming "BMDP" format applied on the device by
+lib/OTAPatch/delta_patch.cpp: an 80 byte header followed by bsdiff
+control/diff/extra records, interleaved and heatshrink-compressed.
+
+Usage:
+    make_ota_patch.py OLD.bin NEW.bin OUT.patch [--window 10] [--lookahead 5]
+
+Requires: pip install bsdiff4 heatshrink2
+"""
+
+import argparse
+import bz2
+import hashlib
+import struct
+import sys
+
+import bsdiff4
+import heatshrink2
+
+FORMAT_VERSION = 1
+
+
+def offtin(buf):
+    """Decode bsdiff's sign-magnitude 64-bit integer."""
+    value = struct.unpack("<Q", buf)[0]
+    if value & (1 << 63):
+        return -(value & ~(1 << 63))
+    return value
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63)
+
+
+def bsdiff_records(old, new):
+    """Yield (diff bytes, extra bytes, seek) records from a BSDIFF40 patch."""
+    patch = bsdiff4.diff(old, new)
+    if patch[:8] != b"BSDIFF40":
+        raise ValueError("unexpected bsdiff4 output")
+
+    ctrl_len = offtin(patch[8:16])
+    diff_len = offtin(patch[16:24])
+    ctrl = bz2.decompress(patch[32:32 + ctrl_len])
+    diff = bz2.decompress(patch[32 + ctrl_len:32 + ctrl_len + diff_len])
+    extra = bz2.decompress(patch[32 + ctrl_len + diff_len:])
+
+    diff_pos = extra_pos = 0
+    for i in range(0, len(ctrl), 24):
+        x = offtin(ctrl[i:i + 8])
+        y = offtin(ctrl[i + 8:i + 16])
+        z = offtin(ctrl[i + 16:i + 24])
+        yield diff[diff_pos:diff_pos + x], extra[extra_pos:extra_pos + y], z
+        diff_pos += x
+        extra_pos += y
+
+
+def make_patch(old, new, window, lookahead):
+    body = bytearray()
+    for diff, extra, seek in bsdiff_records(old, new):
+        body += varint(len(diff))
+        body += varint(len(extra))
+        body += varint(zigzag(seek) & 0xFFFFFFFFFFFFFFFF)
+        body += diff
+        body += extra
+
+    header = b"BMDP" + struct.pack("<BBBBII", FORMAT_VERSION, window, lookahead, 0, len(old), len(new))
+    header += hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    return header + heatshrink2.compress(bytes(body), window_sz2=window, lookahead_sz2=lookahead)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("out")
+    parser.add_argument("--window", type=int, default=10, help="heatshrink window bits (max 12)")
+    parser.add_argument("--lookahead", type=int, default=5, help="heatshrink lookahead bits")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    patch = make_patch(old, new, args.window, args.lookahead)
+    with open(args.out, "wb") as f:
+        f.write(patch)
+
+    print(f"{args.out}: {len(patch)} bytes ({100.0 * len(patch) / len(new):.1f}% of {len(new)} byte image)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())